@@ -0,0 +1,222 @@
+#pragma once
+
+#include "allocation_tracker.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace deribit {
+namespace bench {
+
+// Minimal benchmark runner shared by the benchmark executables.
+//
+// Each benchmark body performs one operation per call. The runner executes
+// it in batches, times every batch, and reports mean ns/op plus percentiles
+// over the per-batch means. When the tree is built with
+// DERIBIT_TRACK_ALLOCATIONS, allocations and bytes per operation are
+// reported as well; otherwise those fields are null. Results are written as
+// one JSON document so that runs can be diffed over time.
+struct Result {
+    std::string name;
+    std::map<std::string, std::string> params;
+    uint64_t operations = 0;
+    double ns_per_op = 0;
+    double p50_ns = 0;
+    double p99_ns = 0;
+    double max_ns = 0;
+    double allocations_per_op = -1;
+    double bytes_per_op = -1;
+    std::map<std::string, double> extra;
+};
+
+struct Options {
+    std::string filter;
+    std::string output = "benchmark_results.json";
+    double min_time_s = 0.5;
+    uint32_t batch_size = 100;
+};
+
+class Runner {
+public:
+    explicit Runner(const Options& options) : options_(options) {}
+
+    // True if the filter names this group or a benchmark inside it.
+    bool selected(const std::string& group) const {
+        return options_.filter.empty() ||
+               group.find(options_.filter) != std::string::npos ||
+               options_.filter.find(group) != std::string::npos;
+    }
+
+    // `teardown_batch` runs after every batch outside the timed region,
+    // e.g. to drain work the body queued.
+    Result& run(const std::string& name,
+                const std::map<std::string, std::string>& params,
+                const std::function<void()>& body,
+                const std::function<void()>& teardown_batch = {}) {
+        Result result;
+        result.name = name;
+        result.params = params;
+
+        for (uint32_t i = 0; i < options_.batch_size; ++i) {
+            body();
+        }
+        if (teardown_batch) {
+            teardown_batch();
+        }
+
+        std::vector<double> batch_ns;
+        double total_ns = 0;
+        AllocationCounts allocations_before = AllocationTracker::thread_counts();
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::duration<double>(options_.min_time_s);
+
+        while (std::chrono::steady_clock::now() < deadline || batch_ns.size() < 10) {
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < options_.batch_size; ++i) {
+                body();
+            }
+            auto end = std::chrono::steady_clock::now();
+
+            double elapsed = std::chrono::duration<double, std::nano>(end - start).count();
+            total_ns += elapsed;
+            batch_ns.push_back(elapsed / options_.batch_size);
+            result.operations += options_.batch_size;
+
+            if (teardown_batch) {
+                teardown_batch();
+            }
+        }
+        AllocationCounts allocations_after = AllocationTracker::thread_counts();
+
+        std::sort(batch_ns.begin(), batch_ns.end());
+        result.ns_per_op = total_ns / result.operations;
+        result.p50_ns = percentile(batch_ns, 50);
+        result.p99_ns = percentile(batch_ns, 99);
+        result.max_ns = batch_ns.back();
+
+        // Teardown work is excluded from timing but not from allocation
+        // counts, so only report allocations for benchmarks without it.
+        if (AllocationTracker::enabled() && !teardown_batch) {
+            result.allocations_per_op =
+                static_cast<double>(allocations_after.allocations - allocations_before.allocations) / result.operations;
+            result.bytes_per_op =
+                static_cast<double>(allocations_after.bytes - allocations_before.bytes) / result.operations;
+        }
+
+        std::cerr << std::left << std::setw(48) << describe(result)
+                  << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << result.ns_per_op << " ns/op"
+                  << std::setw(12) << result.p99_ns << " p99";
+        if (result.allocations_per_op >= 0) {
+            std::cerr << std::setw(10) << result.allocations_per_op << " allocs/op";
+        }
+        std::cerr << std::defaultfloat << std::endl;
+
+        results_.push_back(result);
+        return results_.back();
+    }
+
+    bool write_json(const std::string& suite) const {
+        std::ofstream out(options_.output, std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Unable to write " << options_.output << std::endl;
+            return false;
+        }
+
+        char host[256] = {};
+        ::gethostname(host, sizeof(host) - 1);
+
+        out << std::setprecision(10);
+        out << "{\n  \"context\": {\"suite\": \"" << suite << "\", \"host\": \"" << host
+            << "\", \"timestamp\": " << std::time(nullptr)
+            << ", \"allocation_tracking\": " << (AllocationTracker::enabled() ? "true" : "false")
+            << ", \"batch_size\": " << options_.batch_size << "},\n  \"benchmarks\": [";
+
+        for (size_t i = 0; i < results_.size(); ++i) {
+            const Result& r = results_[i];
+            out << (i ? ",\n" : "\n") << "    {\"name\": \"" << r.name << "\", \"params\": {";
+            bool first = true;
+            for (const auto& [key, value] : r.params) {
+                out << (first ? "" : ", ") << "\"" << key << "\": \"" << value << "\"";
+                first = false;
+            }
+            out << "}, \"operations\": " << r.operations
+                << ", \"ns_per_op\": " << r.ns_per_op
+                << ", \"p50_ns\": " << r.p50_ns
+                << ", \"p99_ns\": " << r.p99_ns
+                << ", \"max_ns\": " << r.max_ns
+                << ", \"allocations_per_op\": ";
+            write_optional(out, r.allocations_per_op);
+            out << ", \"bytes_per_op\": ";
+            write_optional(out, r.bytes_per_op);
+            for (const auto& [key, value] : r.extra) {
+                out << ", \"" << key << "\": " << value;
+            }
+            out << "}";
+        }
+        out << "\n  ]\n}\n";
+
+        std::cerr << "Results written to " << options_.output << std::endl;
+        return out.good();
+    }
+
+private:
+    static double percentile(const std::vector<double>& sorted, double p) {
+        size_t index = static_cast<size_t>(p / 100.0 * (sorted.size() - 1));
+        return sorted[index];
+    }
+
+    static std::string describe(const Result& result) {
+        std::string text = result.name;
+        for (const auto& [key, value] : result.params) {
+            text += " " + key + "=" + value;
+        }
+        return text;
+    }
+
+    static void write_optional(std::ostream& out, double value) {
+        if (value < 0) {
+            out << "null";
+        } else {
+            out << value;
+        }
+    }
+
+    Options options_;
+    std::vector<Result> results_;
+};
+
+inline Options parse_options(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (arg == "--out" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            options.min_time_s = std::stod(argv[++i]);
+        } else if (arg == "--batch" && i + 1 < argc) {
+            options.batch_size = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--filter <substring>] [--out <file.json>] [--min-time <seconds>] [--batch <ops>]"
+                      << std::endl;
+            std::exit(arg == "--help" ? 0 : 1);
+        }
+    }
+    return options;
+}
+
+} // namespace bench
+} // namespace deribit
@@ -0,0 +1,22 @@
+#pragma once
+
+// Upstream messages captured from the Deribit testnet feed, used as
+// benchmark inputs. Numbers and ids are left as recorded.
+
+namespace deribit {
+namespace payloads {
+
+constexpr const char* BOOK_CHANGE =
+    R"({"jsonrpc":"2.0","method":"subscription","params":{"channel":"book.BTC-PERPETUAL.100ms","data":{"type":"change","timestamp":1712745617583,"prev_change_id":67783523918,"instrument_name":"BTC-PERPETUAL","change_id":67783523996,"bids":[["change",69421.5,43210.0],["new",69419.0,1500.0],["delete",69405.5,0.0]],"asks":[["change",69422.0,120.0],["delete",69430.5,0.0],["new",69441.0,25000.0]]}}})";
+
+constexpr const char* BOOK_SNAPSHOT =
+    R"({"jsonrpc":"2.0","method":"subscription","params":{"channel":"book.ETH-PERPETUAL.100ms","data":{"type":"snapshot","timestamp":1712745617001,"instrument_name":"ETH-PERPETUAL","change_id":41235688120,"bids":[["new",3521.35,41250.0],["new",3521.3,1000.0],["new",3521.2,5000.0],["new",3521.1,12000.0],["new",3521.0,80000.0],["new",3520.9,2500.0],["new",3520.8,7500.0],["new",3520.75,30000.0],["new",3520.6,1000.0],["new",3520.5,64000.0]],"asks":[["new",3521.4,9875.0],["new",3521.45,2000.0],["new",3521.5,15000.0],["new",3521.6,4000.0],["new",3521.7,33000.0],["new",3521.8,1000.0],["new",3521.9,22500.0],["new",3522.0,50000.0],["new",3522.1,3000.0],["new",3522.25,11000.0]]}}})";
+
+constexpr const char* TICKER =
+    R"({"jsonrpc":"2.0","method":"subscription","params":{"channel":"ticker.BTC-PERPETUAL.100ms","data":{"timestamp":1712745617605,"stats":{"volume_usd":1102372340.0,"volume":15874.35,"price_change":-1.2031,"low":68900.0,"high":71200.5},"state":"open","settlement_price":69810.32,"open_interest":1057896230,"min_price":68380.5,"max_price":70463.5,"mark_price":69421.93,"last_price":69422.0,"instrument_name":"BTC-PERPETUAL","index_price":69409.77,"funding_8h":0.00005611,"estimated_delivery_price":69409.77,"current_funding":0.0,"best_bid_price":69421.5,"best_bid_amount":43210.0,"best_ask_price":69422.0,"best_ask_amount":120.0}}})";
+
+constexpr const char* SUBSCRIBE_RESPONSE =
+    R"({"jsonrpc":"2.0","id":42,"result":["book.BTC-PERPETUAL.100ms"],"usIn":1712745616998123,"usOut":1712745616998201,"usDiff":78,"testnet":true})";
+
+} // namespace payloads
+} // namespace deribit
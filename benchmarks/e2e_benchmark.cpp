@@ -0,0 +1,416 @@
+#include "config.hpp"
+#include "load_client.hpp"
+#include "logger.hpp"
+#include "mock_deribit.hpp"
+#include "uring_transport.hpp"
+#include "websocket_server.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+// End-to-end capacity benchmark: mock Deribit feed -> WebsocketServer ->
+// simulated clients, all in one process on the loopback interface.
+//
+// The feed rate starts at --start-rate and is multiplied by --step-factor
+// after every step that meets the SLO. A step passes when the clients' p99
+// latency (feed send time to client receipt) stays within --slo-p99-us,
+// at least --min-delivery of the expected fan-out messages arrived within
+// the step, and no session saw a sequence break or disconnect. The last
+// passing step is the maximum sustainable throughput.
+//
+// Each step also reports the send-side syscalls the server made per feed
+// update and per delivered message (see SessionWriteStats), to compare the
+// write paths: with and without --io-uring, and --write-batch 1 against
+// batched session writes.
+
+namespace {
+
+using deribit::load::LatencyHistogram;
+using deribit::load::Totals;
+
+struct Options {
+    uint32_t clients = 1000;
+    uint32_t client_threads = 2;
+    double connect_rate = 2000;
+    std::vector<std::string> instruments{"BTC-PERPETUAL", "ETH-PERPETUAL", "SOL_USDC-PERPETUAL", "XRP_USDC-PERPETUAL"};
+    uint32_t symbols_per_session = 1;
+    double slow_fraction = 0;
+    uint32_t slow_delay_ms = 50;
+    uint32_t burst = 1;
+    double start_rate = 100;
+    double max_rate = 1000000;
+    double step_factor = 2;
+    double warmup_s = 1;
+    double step_s = 5;
+    uint64_t slo_p99_us = 10000;
+    double min_delivery = 0.99;
+    uint16_t server_port = 18080;
+    bool io_uring = false;
+    uint32_t write_batch_max = 64;
+    uint32_t write_batch_delay_us = 0;
+    std::string output = "e2e_results.json";
+};
+
+struct Step {
+    double target_rate = 0;
+    double feed_rate = 0;
+    double delivered_rate = 0;
+    double delivery_ratio = 0;
+    uint64_t sequence_breaks = 0;
+    uint64_t disconnects = 0;
+    double syscalls_per_update = 0;
+    double syscalls_per_message = 0;
+    LatencyHistogram::Snapshot latency;
+    bool passed = false;
+    std::string failure;
+};
+
+std::vector<std::string> split(const std::string& text) {
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        if (end > start) {
+            items.push_back(text.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return items;
+}
+
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --clients <n>           client sessions (default: 1000)\n"
+              << "  --client-threads <n>    io threads driving the clients (default: 2)\n"
+              << "  --connect-rate <n>      new sessions per second (default: 2000)\n"
+              << "  --instruments <a,b,..>  instruments published by the feed\n"
+              << "  --per-session <n>       instruments each session subscribes to (default: 1)\n"
+              << "  --slow-fraction <0..1>  share of slow-reading sessions (default: 0)\n"
+              << "  --slow-delay <ms>       pause between reads for slow sessions (default: 50)\n"
+              << "  --burst <n>             feed updates published back to back (default: 1)\n"
+              << "  --start-rate <n>        first feed rate in messages/s (default: 100)\n"
+              << "  --max-rate <n>          stop ramping above this feed rate (default: 1000000)\n"
+              << "  --step-factor <x>       rate multiplier between steps (default: 2)\n"
+              << "  --warmup <s>            settle time after each rate change (default: 1)\n"
+              << "  --step <s>              measurement time per step (default: 5)\n"
+              << "  --slo-p99-us <n>        p99 latency objective (default: 10000)\n"
+              << "  --min-delivery <0..1>   required share of expected deliveries (default: 0.99)\n"
+              << "  --server-port <port>    port for the server under test (default: 18080)\n"
+              << "  --io-uring              send session writes through io_uring\n"
+              << "  --write-batch <n>       most messages per session write (default: 64)\n"
+              << "  --write-batch-delay <us> wait for a batch to fill (default: 0)\n"
+              << "  --out <file.json>       results file (default: e2e_results.json)\n";
+}
+
+Options parse_options(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--clients" && has_value) {
+            options.clients = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--client-threads" && has_value) {
+            options.client_threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--connect-rate" && has_value) {
+            options.connect_rate = std::stod(argv[++i]);
+        } else if (arg == "--instruments" && has_value) {
+            options.instruments = split(argv[++i]);
+        } else if (arg == "--per-session" && has_value) {
+            options.symbols_per_session = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--slow-fraction" && has_value) {
+            options.slow_fraction = std::stod(argv[++i]);
+        } else if (arg == "--slow-delay" && has_value) {
+            options.slow_delay_ms = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--burst" && has_value) {
+            options.burst = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--start-rate" && has_value) {
+            options.start_rate = std::stod(argv[++i]);
+        } else if (arg == "--max-rate" && has_value) {
+            options.max_rate = std::stod(argv[++i]);
+        } else if (arg == "--step-factor" && has_value) {
+            options.step_factor = std::stod(argv[++i]);
+        } else if (arg == "--warmup" && has_value) {
+            options.warmup_s = std::stod(argv[++i]);
+        } else if (arg == "--step" && has_value) {
+            options.step_s = std::stod(argv[++i]);
+        } else if (arg == "--slo-p99-us" && has_value) {
+            options.slo_p99_us = std::stoull(argv[++i]);
+        } else if (arg == "--min-delivery" && has_value) {
+            options.min_delivery = std::stod(argv[++i]);
+        } else if (arg == "--server-port" && has_value) {
+            options.server_port = static_cast<uint16_t>(std::stoul(argv[++i]));
+        } else if (arg == "--io-uring") {
+            options.io_uring = true;
+        } else if (arg == "--write-batch" && has_value) {
+            options.write_batch_max = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--write-batch-delay" && has_value) {
+            options.write_batch_delay_us = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--out" && has_value) {
+            options.output = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            std::exit(arg == "--help" ? 0 : 1);
+        }
+    }
+    if (options.instruments.empty() || options.step_factor <= 1 || options.start_rate <= 0) {
+        std::cerr << "Need at least one instrument, --step-factor > 1 and --start-rate > 0" << std::endl;
+        std::exit(1);
+    }
+    options.symbols_per_session = std::min<uint32_t>(
+        std::max(options.symbols_per_session, 1u), static_cast<uint32_t>(options.instruments.size()));
+    return options;
+}
+
+template <typename Predicate>
+bool wait_for(Predicate predicate, std::chrono::seconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+void sleep_seconds(double seconds) {
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+}
+
+Step measure_step(const Options& options, double rate, deribit::mock::MockDeribit& feed,
+                  deribit::load::ClientPool& pool, const std::map<std::string, uint64_t>& subscribers) {
+    Step step;
+    step.target_rate = rate;
+    feed.set_publish_rate(rate);
+    sleep_seconds(options.warmup_s);
+
+    deribit::SessionWriteStats& writes = deribit::session_write_stats();
+    Totals before = pool.totals();
+    auto published_before = feed.published_by_instrument();
+    uint64_t syscalls_before = writes.syscalls.load();
+    auto start = std::chrono::steady_clock::now();
+    sleep_seconds(options.step_s);
+    Totals after = pool.totals();
+    auto published_after = feed.published_by_instrument();
+    uint64_t syscalls = writes.syscalls.load() - syscalls_before;
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t published = 0;
+    uint64_t expected = 0;
+    for (const auto& [instrument, count] : published_after) {
+        uint64_t delta = count - published_before[instrument];
+        published += delta;
+        auto it = subscribers.find(instrument);
+        expected += delta * (it == subscribers.end() ? 0 : it->second);
+    }
+
+    // Slow readers fall behind by design, so delivery and latency are
+    // judged on the normal readers only.
+    step.latency = after.fast_latency.since(before.fast_latency);
+    uint64_t delivered = step.latency.count;
+
+    step.feed_rate = published / elapsed_s;
+    step.delivered_rate = delivered / elapsed_s;
+    step.delivery_ratio = expected ? static_cast<double>(delivered) / expected : 0;
+    step.syscalls_per_update = published ? static_cast<double>(syscalls) / published : 0;
+    step.syscalls_per_message = delivered ? static_cast<double>(syscalls) / delivered : 0;
+    step.sequence_breaks = (after.sequence_gaps - before.sequence_gaps) +
+                           (after.sequence_regressions - before.sequence_regressions);
+    step.disconnects = after.disconnects - before.disconnects;
+
+    if (step.feed_rate < 0.95 * rate) {
+        step.failure = "feed could not reach the target rate";
+    } else if (step.disconnects) {
+        step.failure = "client disconnects";
+    } else if (step.sequence_breaks) {
+        step.failure = "sequence breaks";
+    } else if (step.delivery_ratio < options.min_delivery) {
+        step.failure = "delivery backlog";
+    } else if (step.latency.percentile(99) > options.slo_p99_us) {
+        step.failure = "p99 above SLO";
+    } else {
+        step.passed = true;
+    }
+    return step;
+}
+
+void print_step(const Step& step) {
+    std::cout << std::fixed << std::setprecision(0)
+              << std::setw(10) << step.target_rate
+              << std::setw(12) << step.feed_rate
+              << std::setw(14) << step.delivered_rate
+              << std::setprecision(3) << std::setw(10) << step.delivery_ratio
+              << std::setw(10) << step.latency.percentile(50)
+              << std::setw(10) << step.latency.percentile(99)
+              << std::setw(10) << step.latency.percentile(99.9)
+              << std::setw(10) << step.latency.max
+              << std::setprecision(2) << std::setw(10) << step.syscalls_per_update
+              << std::setprecision(3) << std::setw(10) << step.syscalls_per_message
+              << "  " << (step.passed ? "ok" : step.failure)
+              << std::defaultfloat << std::endl;
+}
+
+bool write_json(const Options& options, const std::vector<Step>& steps, const Step* best) {
+    std::ofstream out(options.output, std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Unable to write " << options.output << std::endl;
+        return false;
+    }
+
+    char host[256] = {};
+    ::gethostname(host, sizeof(host) - 1);
+
+    out << "{\n  \"context\": {\"suite\": \"e2e\", \"host\": \"" << host
+        << "\", \"timestamp\": " << std::time(nullptr)
+        << ", \"clients\": " << options.clients
+        << ", \"instruments\": " << options.instruments.size()
+        << ", \"symbols_per_session\": " << options.symbols_per_session
+        << ", \"slow_fraction\": " << options.slow_fraction
+        << ", \"io_uring\": " << (options.io_uring ? "true" : "false")
+        << ", \"burst\": " << options.burst
+        << ", \"write_batch_max\": " << options.write_batch_max
+        << ", \"write_batch_delay_us\": " << options.write_batch_delay_us
+        << ", \"slo_p99_us\": " << options.slo_p99_us << "},\n";
+    out << "  \"max_sustainable_feed_rate\": " << (best ? best->feed_rate : 0)
+        << ",\n  \"max_sustainable_delivered_rate\": " << (best ? best->delivered_rate : 0)
+        << ",\n  \"steps\": [";
+    for (size_t i = 0; i < steps.size(); ++i) {
+        const Step& step = steps[i];
+        out << (i ? ",\n" : "\n")
+            << "    {\"target_rate\": " << step.target_rate
+            << ", \"feed_rate\": " << step.feed_rate
+            << ", \"delivered_rate\": " << step.delivered_rate
+            << ", \"delivery_ratio\": " << step.delivery_ratio
+            << ", \"sequence_breaks\": " << step.sequence_breaks
+            << ", \"disconnects\": " << step.disconnects
+            << ", \"p50_us\": " << step.latency.percentile(50)
+            << ", \"p99_us\": " << step.latency.percentile(99)
+            << ", \"p999_us\": " << step.latency.percentile(99.9)
+            << ", \"max_us\": " << step.latency.max
+            << ", \"syscalls_per_update\": " << step.syscalls_per_update
+            << ", \"syscalls_per_message\": " << step.syscalls_per_message
+            << ", \"passed\": " << (step.passed ? "true" : "false")
+            << ", \"failure\": \"" << step.failure << "\"}";
+    }
+    out << "\n  ]\n}\n";
+
+    std::cerr << "Results written to " << options.output << std::endl;
+    return out.good();
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options = parse_options(argc, argv);
+
+    deribit::Logger::instance().set_level(deribit::LogLevel::WARNING);
+    deribit::Logger::instance().set_log_file("e2e_benchmark.log");
+
+    try {
+        deribit::mock::MockDeribit feed;
+        feed.set_burst(options.burst);
+        feed.start();
+
+        deribit::Config config("", "", options.server_port, "BTC", options.instruments.front(), options.instruments);
+        config.endpoints.websocket_url = feed.websocket_url();
+        config.server.io_uring = options.io_uring;
+        config.server.write_batch_max = options.write_batch_max;
+        config.server.write_batch_delay_us = options.write_batch_delay_us;
+        deribit::WebsocketServer server(config);
+        server.run(options.server_port);
+
+        deribit::load::ClientOptions client_options;
+        client_options.host = "127.0.0.1";
+        client_options.port = std::to_string(options.server_port);
+        client_options.slow_delay_ms = options.slow_delay_ms;
+        deribit::load::ClientPool pool(client_options, options.client_threads);
+
+        // Instruments are dealt out round-robin so every one has subscribers
+        // and the expected fan-out per instrument is known exactly.
+        std::map<std::string, uint64_t> subscribers;
+        uint32_t slow_every = options.slow_fraction > 0 ? static_cast<uint32_t>(1 / options.slow_fraction) : 0;
+        for (uint32_t i = 0; i < options.clients; ++i) {
+            std::vector<std::string> symbols;
+            for (uint32_t k = 0; k < options.symbols_per_session; ++k) {
+                const std::string& instrument =
+                    options.instruments[(i * options.symbols_per_session + k) % options.instruments.size()];
+                symbols.push_back(instrument);
+            }
+            bool slow = slow_every && i % slow_every == slow_every - 1;
+            if (!slow) {
+                for (const auto& symbol : symbols) {
+                    ++subscribers[symbol];
+                }
+            }
+            pool.add_session(std::move(symbols), slow);
+        }
+
+        std::cout << "Connecting " << options.clients << " clients to the server on port "
+                  << options.server_port << std::endl;
+        auto interval = std::chrono::duration<double>(1.0 / std::max(options.connect_rate, 1.0));
+        while (pool.start_next()) {
+            std::this_thread::sleep_for(interval);
+        }
+        if (!wait_for([&] { return pool.totals().connected >= options.clients; }, std::chrono::seconds(30))) {
+            std::cerr << "Only " << pool.totals().connected << " of " << options.clients
+                      << " clients connected" << std::endl;
+            return 1;
+        }
+        if (!wait_for([&] { return feed.subscriptions() >= subscribers.size(); }, std::chrono::seconds(10))) {
+            std::cerr << "Server did not subscribe to every instrument upstream" << std::endl;
+            return 1;
+        }
+
+        std::cout << "\n" << std::setw(10) << "target/s" << std::setw(12) << "feed/s"
+                  << std::setw(14) << "delivered/s" << std::setw(10) << "ratio"
+                  << std::setw(10) << "p50 us" << std::setw(10) << "p99 us"
+                  << std::setw(10) << "p99.9 us" << std::setw(10) << "max us"
+                  << std::setw(10) << "sys/upd" << std::setw(10) << "sys/msg" << std::endl;
+
+        std::vector<Step> steps;
+        for (double rate = options.start_rate; rate <= options.max_rate; rate *= options.step_factor) {
+            steps.push_back(measure_step(options, rate, feed, pool, subscribers));
+            print_step(steps.back());
+            if (!steps.back().passed) {
+                break;
+            }
+        }
+        feed.set_publish_rate(0);
+        sleep_seconds(options.warmup_s);
+
+        const Step* best = nullptr;
+        for (const auto& step : steps) {
+            if (step.passed) {
+                best = &step;
+            }
+        }
+        if (best) {
+            std::cout << std::fixed << std::setprecision(0)
+                      << "\nMax sustainable: " << best->feed_rate << " upstream msgs/s, "
+                      << best->delivered_rate << " client msgs/s (p99 " << best->latency.percentile(99)
+                      << " us)" << std::defaultfloat << std::endl;
+        } else {
+            std::cout << "\nNo step met the SLO" << std::endl;
+        }
+
+        pool.stop();
+        server.stop();
+        feed.stop();
+        return write_json(options, steps, best) ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "End-to-end benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,523 @@
+#include "bench_harness.hpp"
+#include "deribit_payloads.hpp"
+#include "book_decoder.hpp"
+#include "config.hpp"
+#include "json_writer.hpp"
+#include "logger.hpp"
+#include "ondemand_json.hpp"
+#include "order_book.hpp"
+#include "order_manager.hpp"
+#include "performance_metrics.hpp"
+#include "shm_metrics.hpp"
+#include "timer_wheel.hpp"
+#include "websocket_server.hpp"
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <cpprest/json.h>
+#include <json/json.h>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <unistd.h>
+
+namespace deribit {
+
+// Reaches into WebsocketServer to drive its message handlers without a
+// network connection.
+class WebsocketServerBenchmark {
+public:
+    explicit WebsocketServerBenchmark(Config& config) : server_(config) {}
+
+    void add_sessions(size_t count, const std::vector<std::string>& symbols) {
+        std::lock_guard<InstrumentedMutex> lock(server_.sessions_mutex_);
+        for (size_t i = 0; i < count; ++i) {
+            auto session = std::make_shared<WebSocketSession>(
+                SessionSocket(boost::asio::make_strand(session_ioc_)),
+                [](std::shared_ptr<WebSocketSession>, const std::string&) {});
+            server_.sessions_.push_back(session);
+            server_.subscriptions_[session] = std::set<std::string, std::less<>>(symbols.begin(), symbols.end());
+        }
+    }
+
+    void clear_sessions() {
+        drain();
+        std::lock_guard<InstrumentedMutex> lock(server_.sessions_mutex_);
+        server_.sessions_.clear();
+        server_.subscriptions_.clear();
+    }
+
+    void on_deribit_message(const std::string& payload) {
+        server_.on_deribit_message(payload, 0);
+    }
+
+    void broadcast(const std::string& symbol, const std::string& data) {
+        server_.broadcast_to_subscribers(symbol, data, 0);
+    }
+
+    // Runs the sends posted by broadcast(); the sessions were never
+    // started, so each one is dropped without a write.
+    void drain() {
+        session_ioc_.restart();
+        session_ioc_.poll();
+    }
+
+private:
+    boost::asio::io_context session_ioc_;
+    WebsocketServer server_;
+};
+
+} // namespace deribit
+
+namespace {
+
+using deribit::bench::Runner;
+
+std::vector<std::string> make_symbols(size_t count) {
+    std::vector<std::string> symbols;
+    symbols.push_back("BTC-PERPETUAL");
+    for (size_t i = 1; i < count; ++i) {
+        symbols.push_back("BTC-" + std::to_string(20240000 + i) + "-70000-C");
+    }
+    return symbols;
+}
+
+void benchmark_upstream_routing(Runner& runner, deribit::Config& config) {
+    deribit::WebsocketServerBenchmark server(config);
+    const std::pair<const char*, const char*> inputs[] = {
+        {"book_change", deribit::payloads::BOOK_CHANGE},
+        {"book_snapshot", deribit::payloads::BOOK_SNAPSHOT},
+        {"ticker", deribit::payloads::TICKER},
+        {"rpc_response", deribit::payloads::SUBSCRIBE_RESPONSE},
+    };
+
+    for (const auto& [kind, payload] : inputs) {
+        std::string message = payload;
+        runner.run("upstream.route", {{"payload", kind}, {"bytes", std::to_string(message.size())}},
+                   [&] { server.on_deribit_message(message); });
+    }
+}
+
+// Each decoder extracts what a consumer of the payload needs: the channel,
+// the timestamp, and every book level or the top-of-book fields. The
+// libraries are compared on equal work rather than on laziness alone.
+double decode_jsoncpp(const std::string& payload) {
+    Json::Value root;
+    Json::Reader reader;
+    if (!reader.parse(payload, root)) {
+        return -1;
+    }
+    const Json::Value& data = root["params"]["data"];
+    double sum = root["params"]["channel"].asString().size() + data["timestamp"].asDouble();
+    if (data.isMember("bids")) {
+        for (const char* side : {"bids", "asks"}) {
+            for (const auto& level : data[side]) {
+                sum += level[1].asDouble() + level[2].asDouble();
+            }
+        }
+    } else {
+        sum += data["best_bid_price"].asDouble() + data["best_ask_price"].asDouble() + data["mark_price"].asDouble();
+    }
+    return sum;
+}
+
+double decode_cpprest(const std::string& payload) {
+    auto root = web::json::value::parse(utility::conversions::to_string_t(payload));
+    const auto& params = root.at(U("params"));
+    const auto& data = params.at(U("data"));
+    double sum = params.at(U("channel")).as_string().size() + data.at(U("timestamp")).as_double();
+    if (data.has_field(U("bids"))) {
+        for (const char* side : {"bids", "asks"}) {
+            for (const auto& level : data.at(U(side)).as_array()) {
+                sum += level.at(1).as_double() + level.at(2).as_double();
+            }
+        }
+    } else {
+        sum += data.at(U("best_bid_price")).as_double() + data.at(U("best_ask_price")).as_double() +
+               data.at(U("mark_price")).as_double();
+    }
+    return sum;
+}
+
+double decode_ondemand(deribit::json::Parser& parser, const std::string& payload) {
+    using deribit::json::Decimal;
+    auto document = parser.parse(payload);
+    if (document.error() != deribit::json::Error::None) {
+        return -1;
+    }
+    auto params = document.root()["params"];
+    std::string_view channel;
+    uint64_t timestamp = 0;
+    params["channel"].get(channel);
+    auto data = params["data"];
+    data["timestamp"].get(timestamp);
+    int64_t units = 0;
+    if (auto bids = data["bids"]) {
+        for (const auto& side : {bids, data["asks"]}) {
+            for (const auto& level : side.elements()) {
+                Decimal price, amount;
+                level.at(1).get(price);
+                level.at(2).get(amount);
+                units += price.units + amount.units;
+            }
+        }
+    } else {
+        for (const char* key : {"best_bid_price", "best_ask_price", "mark_price"}) {
+            Decimal value;
+            data[key].get(value);
+            units += value.units;
+        }
+    }
+    return channel.size() + static_cast<double>(timestamp) + static_cast<double>(units) / Decimal::SCALE;
+}
+
+void benchmark_parse(Runner& runner) {
+    using deribit::json::Backend;
+    const std::pair<const char*, const char*> inputs[] = {
+        {"book_change", deribit::payloads::BOOK_CHANGE},
+        {"book_snapshot", deribit::payloads::BOOK_SNAPSHOT},
+        {"ticker", deribit::payloads::TICKER},
+    };
+    volatile double sink = 0;
+
+    for (const auto& [kind, payload] : inputs) {
+        std::string message = payload;
+        std::string bytes = std::to_string(message.size());
+        runner.run("parse.decode", {{"payload", kind}, {"bytes", bytes}, {"library", "jsoncpp"}},
+                   [&] { sink = decode_jsoncpp(message); });
+        runner.run("parse.decode", {{"payload", kind}, {"bytes", bytes}, {"library", "cpprest"}},
+                   [&] { sink = decode_cpprest(message); });
+        for (Backend backend : {Backend::Scalar, Backend::Sse2, Backend::Avx2}) {
+            if (!deribit::json::backend_supported(backend)) {
+                continue;
+            }
+            deribit::json::Parser parser(backend);
+            const char* name = deribit::json::backend_name(backend);
+            runner.run("parse.decode", {{"payload", kind}, {"bytes", bytes}, {"library", "ondemand"}, {"backend", name}},
+                       [&] { sink = decode_ondemand(parser, message); });
+            runner.run("parse.index", {{"payload", kind}, {"bytes", bytes}, {"backend", name}},
+                       [&] { sink = static_cast<double>(parser.parse(message).error()); });
+        }
+    }
+    (void)sink;
+}
+
+void benchmark_book_decoder(Runner& runner) {
+    const std::pair<const char*, const char*> inputs[] = {
+        {"book_change", deribit::payloads::BOOK_CHANGE},
+        {"book_snapshot", deribit::payloads::BOOK_SNAPSHOT},
+        {"ticker", deribit::payloads::TICKER},
+    };
+    deribit::BookDeltaTable table({"BTC-PERPETUAL", "ETH-PERPETUAL"});
+    deribit::BookDeltaTable::Entry* entry = nullptr;
+    volatile int sink = 0;
+
+    for (const auto& [kind, payload] : inputs) {
+        std::string message = payload;
+        runner.run("book.decode", {{"payload", kind}, {"bytes", std::to_string(message.size())}},
+                   [&] { sink = static_cast<int>(deribit::decode_book_notification(message, table, entry)); });
+    }
+    (void)sink;
+}
+
+// BookStore::apply with the decoded sample deltas. The change runs against
+// a BTC book about 40 levels deep per side and alternates with its
+// inverse, so every call inserts, updates and deletes levels as a live
+// feed does instead of settling into plain updates.
+void benchmark_book_apply(Runner& runner) {
+    using deribit::BookAction;
+    using deribit::BookDelta;
+    auto change = std::make_unique<BookDelta>();
+    auto snapshot = std::make_unique<BookDelta>();
+    std::string_view change_instrument;
+    std::string_view snapshot_instrument;
+    if (deribit::decode_book_notification(deribit::payloads::BOOK_CHANGE, *change, change_instrument) !=
+            deribit::BookDecodeStatus::Ok ||
+        deribit::decode_book_notification(deribit::payloads::BOOK_SNAPSHOT, *snapshot, snapshot_instrument) !=
+            deribit::BookDecodeStatus::Ok) {
+        std::fprintf(stderr, "book.apply: sample payloads did not decode\n");
+        return;
+    }
+
+    auto undo = std::make_unique<BookDelta>(*change);
+    auto invert = [](deribit::BookLevel& level) {
+        if (level.action == BookAction::New) {
+            level.action = BookAction::Delete;
+        } else if (level.action == BookAction::Delete) {
+            level.action = BookAction::New;
+            level.amount = deribit::json::Decimal{deribit::json::Decimal::SCALE};
+        }
+    };
+    for (uint32_t i = 0; i < undo->bid_count; ++i) {
+        invert(undo->bids[i]);
+    }
+    for (uint32_t i = 0; i < undo->ask_count; ++i) {
+        invert(undo->asks[i]);
+    }
+
+    // Half-dollar levels around the change's prices, minus the ones it
+    // adds.
+    auto seed = std::make_unique<BookDelta>();
+    seed->snapshot = true;
+    seed->change_id = change->prev_change_id;
+    auto fill = [](const auto& levels, uint32_t count, int64_t best, int64_t step, auto& out, uint32_t& out_count) {
+        for (int i = 0; i < 40; ++i) {
+            deribit::json::Decimal price{best + step * i};
+            bool added = false;
+            for (uint32_t j = 0; j < count; ++j) {
+                added |= levels[j].action == BookAction::New && levels[j].price == price;
+            }
+            if (!added) {
+                out[out_count++] = {price, deribit::json::Decimal{deribit::json::Decimal::SCALE}, BookAction::New};
+            }
+        }
+    };
+    const int64_t half = deribit::json::Decimal::SCALE / 2;
+    fill(change->bids, change->bid_count, change->bids[0].price.units, -half, seed->bids, seed->bid_count);
+    fill(change->asks, change->ask_count, change->asks[0].price.units, half, seed->asks, seed->ask_count);
+
+    deribit::BookStore store;
+    deribit::OrderBook& btc = store.find_or_add(change_instrument);
+    deribit::OrderBook& eth = store.find_or_add(snapshot_instrument);
+    store.apply(btc, *seed);
+    bool forward = true;
+    volatile int sink = 0;
+
+    runner.run("book.apply",
+               {{"payload", "book_change"}, {"levels", std::to_string(change->bid_count + change->ask_count)}}, [&] {
+                   BookDelta& delta = forward ? *change : *undo;
+                   forward = !forward;
+                   delta.prev_change_id = btc.change_id;
+                   delta.change_id = btc.change_id + 1;
+                   sink = static_cast<int>(store.apply(btc, delta));
+               });
+    runner.run("book.apply",
+               {{"payload", "book_snapshot"}, {"levels", std::to_string(snapshot->bid_count + snapshot->ask_count)}},
+               [&] { sink = static_cast<int>(store.apply(eth, *snapshot)); });
+    (void)sink;
+}
+
+void benchmark_broadcast(Runner& runner, deribit::Config& config) {
+    const std::string data = deribit::payloads::BOOK_CHANGE;
+    for (size_t sessions : {1, 100, 1000}) {
+        for (size_t symbols : {1, 50}) {
+            deribit::WebsocketServerBenchmark server(config);
+            server.add_sessions(sessions, make_symbols(symbols));
+            runner.run("fanout.broadcast",
+                       {{"sessions", std::to_string(sessions)}, {"symbols", std::to_string(symbols)}},
+                       [&] { server.broadcast("BTC-PERPETUAL", data); },
+                       [&] { server.drain(); });
+            server.clear_sessions();
+        }
+    }
+}
+
+void benchmark_logger(Runner& runner) {
+    auto& logger = deribit::Logger::instance();
+    std::ostringstream sink;
+    std::streambuf* console = std::cout.rdbuf(sink.rdbuf());
+
+    logger.set_level(deribit::LogLevel::INFO);
+    runner.run("logger.call", {{"level", "filtered"}},
+               [] { LOG_DEBUG("Handling orderbook update for %s", "BTC-PERPETUAL"); });
+
+    std::string log_file = "/tmp/hot_path_benchmark." + std::to_string(::getpid()) + ".log";
+    logger.set_log_file(log_file);
+    runner.run("logger.call", {{"level", "emitted"}},
+               [] { LOG_INFO("Message propagation time for %s: %lld microseconds", "BTC-PERPETUAL", 42LL); },
+               [&] { sink.str(""); });
+
+    logger.set_log_file("/dev/null");
+    std::remove(log_file.c_str());
+    std::cout.rdbuf(console);
+    logger.set_level(deribit::LogLevel::CRITICAL);
+}
+
+void benchmark_metrics(Runner& runner) {
+    auto& shm = deribit::ShmMetrics::instance();
+    std::string segment = "/deribit_bench_" + std::to_string(::getpid());
+    bool shm_open = shm.open(segment);
+
+    runner.run("metrics.timing", {{"api", "START/END_TIMING"}},
+               [] {
+                   START_TIMING("bench_operation");
+                   END_TIMING("bench_operation");
+               },
+               [] { deribit::PerformanceMetrics::instance().reset_stats("bench_operation"); });
+
+    if (shm_open) {
+        int counter = shm.counter("bench.counter");
+        int histogram = shm.histogram("bench.histogram");
+        uint64_t value = 0;
+        runner.run("metrics.shm", {{"api", "counter"}}, [&] { shm.add(counter); });
+        runner.run("metrics.shm", {{"api", "histogram"}}, [&] { shm.record(histogram, ++value & 0xffff); });
+        shm.close();
+    }
+}
+
+// Outbound message construction: a Json::Value tree plus FastWriter, as the
+// server used to build them, against json::Writer into a reused buffer.
+void benchmark_serialize(Runner& runner) {
+    const std::string channel = "book.BTC-PERPETUAL.100ms";
+    deribit::OrderParams params{"BTC-PERPETUAL", 10, 69421.5, "limit"};
+    uint64_t id = 1000;
+    std::string buffer;
+
+    runner.run("serialize.message", {{"message", "subscribe"}, {"library", "jsoncpp"}}, [&] {
+        Json::Value request;
+        request["jsonrpc"] = "2.0";
+        request["id"] = 42;
+        request["method"] = "public/subscribe";
+        request["params"]["channels"] = Json::arrayValue;
+        request["params"]["channels"].append(channel);
+        buffer = Json::FastWriter().write(request);
+    });
+    runner.run("serialize.message", {{"message", "subscribe"}, {"library", "writer"}}, [&] {
+        buffer.clear();
+        deribit::json::Writer(buffer)
+            .begin_object()
+            .member("jsonrpc", "2.0")
+            .member("id", 42)
+            .member("method", "public/subscribe")
+            .key("params").begin_object()
+            .key("channels").begin_array().value(channel).end_array()
+            .end_object()
+            .end_object();
+    });
+    runner.run("serialize.message", {{"message", "order"}, {"library", "jsoncpp"}}, [&] {
+        Json::Value request;
+        request["jsonrpc"] = "2.0";
+        request["id"] = Json::UInt64(++id);
+        request["method"] = "private/buy";
+        request["params"]["instrument_name"] = params.instrument_name;
+        request["params"]["amount"] = params.amount;
+        request["params"]["type"] = params.type;
+        request["params"]["price"] = params.price;
+        buffer = Json::FastWriter().write(request);
+    });
+    runner.run("serialize.message", {{"message", "order"}, {"library", "writer"}}, [&] {
+        buffer.clear();
+        deribit::json::Writer(buffer)
+            .begin_object()
+            .member("jsonrpc", "2.0")
+            .member("id", ++id)
+            .member("method", "private/buy")
+            .key("params").begin_object()
+            .member("instrument_name", params.instrument_name)
+            .member("amount", params.amount)
+            .member("type", params.type)
+            .member("price", params.price)
+            .end_object()
+            .end_object();
+    });
+}
+
+// Arming and cancelling timers with 100k others pending, as idle checks
+// and request deadlines do: the wheel against one steady_timer per timer
+// in the io_context's timer heap. Nothing is run; the io_context is only
+// polled between batches to drain cancelled waits.
+void benchmark_timers(Runner& runner) {
+    constexpr size_t PENDING = 100000;
+    const std::map<std::string, std::string> wheel_params{{"impl", "wheel"}, {"pending", std::to_string(PENDING)}};
+    const std::map<std::string, std::string> asio_params{{"impl", "steady_timer"}, {"pending", std::to_string(PENDING)}};
+    const auto far = std::chrono::minutes(10);
+    std::mt19937 rng(5);
+
+    {
+        boost::asio::io_context ioc;
+        deribit::TimerWheel wheel(ioc, std::chrono::microseconds(1000), PENDING + 1024);
+        std::vector<deribit::TimerWheel::TimerId> ids(PENDING);
+        for (auto& id : ids) {
+            id = wheel.schedule(far + std::chrono::milliseconds(rng() % 60000), [] {});
+        }
+        runner.run("timers.arm_cancel", wheel_params,
+                   [&] { wheel.cancel(wheel.schedule(std::chrono::seconds(5), [] {})); });
+        size_t next = 0;
+        runner.run("timers.rearm", wheel_params, [&] {
+            auto& id = ids[next++ % PENDING];
+            wheel.cancel(id);
+            id = wheel.schedule(far, [] {});
+        });
+    }
+
+    {
+        boost::asio::io_context ioc;
+        std::vector<std::unique_ptr<boost::asio::steady_timer>> timers;
+        timers.reserve(PENDING);
+        for (size_t i = 0; i < PENDING; ++i) {
+            timers.push_back(std::make_unique<boost::asio::steady_timer>(
+                ioc, far + std::chrono::milliseconds(rng() % 60000)));
+            timers.back()->async_wait([](boost::system::error_code) {});
+        }
+        auto drain = [&] {
+            ioc.restart();
+            ioc.poll();
+        };
+        runner.run("timers.arm_cancel", asio_params, [&] {
+            auto timer = std::make_unique<boost::asio::steady_timer>(ioc, std::chrono::seconds(5));
+            timer->async_wait([](boost::system::error_code) {});
+            timer->cancel();
+        }, drain);
+        size_t next = 0;
+        runner.run("timers.rearm", asio_params, [&] {
+            auto& timer = *timers[next++ % PENDING];
+            timer.expires_after(far);
+            timer.async_wait([](boost::system::error_code) {});
+        }, drain);
+        for (auto& timer : timers) {
+            timer->cancel();
+        }
+        drain();
+    }
+}
+
+void benchmark_order_serialization(Runner& runner) {
+    deribit::OrderParams params{"BTC-PERPETUAL", 10, 69421.5, "limit"};
+    std::string path;
+    runner.run("order.serialize", {{"side", "buy"}}, [&] { path = deribit::OrderManager::buy_order_path(params); });
+    runner.run("order.serialize", {{"side", "sell"}}, [&] { path = deribit::OrderManager::sell_order_path(params); });
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    auto options = deribit::bench::parse_options(argc, argv);
+    Runner runner(options);
+
+    // Failed writes to the unconnected benchmark sessions log at ERROR.
+    deribit::Logger::instance().set_level(deribit::LogLevel::CRITICAL);
+    deribit::Config config("", "", 0, "BTC", "BTC-PERPETUAL", {"BTC-PERPETUAL"});
+    config.monitoring.loop_lag_enabled = false;
+
+    if (runner.selected("parse")) {
+        benchmark_parse(runner);
+    }
+    if (runner.selected("serialize")) {
+        benchmark_serialize(runner);
+    }
+    if (runner.selected("book")) {
+        benchmark_book_decoder(runner);
+        benchmark_book_apply(runner);
+    }
+    if (runner.selected("upstream")) {
+        benchmark_upstream_routing(runner, config);
+    }
+    if (runner.selected("fanout")) {
+        benchmark_broadcast(runner, config);
+    }
+    if (runner.selected("logger")) {
+        benchmark_logger(runner);
+    }
+    if (runner.selected("metrics")) {
+        benchmark_metrics(runner);
+    }
+    if (runner.selected("timers")) {
+        benchmark_timers(runner);
+    }
+    if (runner.selected("order")) {
+        benchmark_order_serialization(runner);
+    }
+
+    return runner.write_json("hot_path") ? 0 : 1;
+}
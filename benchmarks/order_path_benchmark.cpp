@@ -0,0 +1,435 @@
+#include "authentication.hpp"
+#include "config.hpp"
+#include "json_writer.hpp"
+#include "logger.hpp"
+#include "mock_deribit.hpp"
+#include "ondemand_json.hpp"
+#include "order_manager.hpp"
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+// Order-path latency benchmark: order transports against the mock exchange
+// on the loopback interface, so neither credentials nor the internet are
+// involved.
+//
+// For every combination of transport, server latency and concurrency, that
+// many threads place orders back to back for --duration seconds. The mock
+// holds each order for exactly the configured server latency, so a round
+// trip minus that latency is what our side of the path costs: building the
+// request, the transport, parsing the reply and handing it back to the
+// caller. Comparing server latency 0 with a realistic value shows whether
+// that overhead grows while orders are in flight, e.g. when a connection
+// pool runs dry.
+//
+// Transports:
+//   rest       OrderManager, exactly as the trading system uses it.
+//   websocket  JSON-RPC private/buy and private/sell over one websocket,
+//              with replies matched to callers by request id. OrderManager
+//              has no websocket path yet; this is the reference for one.
+
+namespace {
+
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+
+struct Options {
+    std::vector<std::string> transports{"rest", "websocket"};
+    std::vector<uint32_t> concurrency{1, 4, 16};
+    std::vector<uint32_t> server_latency_us{0, 1000};
+    double duration_s = 3;
+    double warmup_s = 0.5;
+    std::string instrument = "BTC-PERPETUAL";
+    std::string output = "order_path_results.json";
+};
+
+struct Run {
+    std::string transport;
+    uint32_t server_latency_us = 0;
+    uint32_t concurrency = 0;
+    double orders_per_second = 0;
+    uint64_t errors = 0;
+    // Client-side overhead per order in nanoseconds, sorted.
+    std::vector<uint64_t> overhead_ns;
+
+    double percentile_us(double p) const {
+        if (overhead_ns.empty()) {
+            return 0;
+        }
+        size_t index = std::min(overhead_ns.size() - 1, static_cast<size_t>(p / 100.0 * overhead_ns.size()));
+        return overhead_ns[index] / 1000.0;
+    }
+};
+
+// Places one order and returns its order_id, or an empty string on failure.
+class OrderTransport {
+public:
+    virtual ~OrderTransport() = default;
+    virtual std::string place(bool buy, const deribit::OrderParams& params) = 0;
+};
+
+class RestTransport : public OrderTransport {
+public:
+    explicit RestTransport(deribit::Config& config) : orders_(config) {}
+
+    std::string place(bool buy, const deribit::OrderParams& params) override {
+        return buy ? orders_.place_buy_order(params) : orders_.place_sell_order(params);
+    }
+
+private:
+    deribit::OrderManager orders_;
+};
+
+// Callers write under a mutex and block on a future; a reader thread
+// completes the futures as replies arrive, in whatever order they come.
+class WebSocketTransport : public OrderTransport {
+public:
+    WebSocketTransport(const std::string& host, const std::string& port, const std::string& path)
+        : ws_(ioc_)
+        , next_id_(1)
+    {
+        tcp::resolver resolver(ioc_);
+        asio::connect(ws_.next_layer(), resolver.resolve(host, port));
+        ws_.next_layer().set_option(tcp::no_delay(true));
+        ws_.handshake(host + ":" + port, path);
+        ws_.text(true);
+        reader_ = std::thread([this] { read_loop(); });
+    }
+
+    ~WebSocketTransport() override {
+        beast::error_code ec;
+        ws_.next_layer().shutdown(tcp::socket::shutdown_both, ec);
+        reader_.join();
+    }
+
+    std::string place(bool buy, const deribit::OrderParams& params) override {
+        uint64_t id = next_id_.fetch_add(1, std::memory_order_relaxed);
+        std::future<std::string> reply;
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            reply = pending_[id].get_future();
+        }
+        try {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            request_.clear();
+            deribit::json::Writer writer(request_);
+            writer.begin_object()
+                .member("jsonrpc", "2.0")
+                .member("id", id)
+                .member("method", buy ? "private/buy" : "private/sell")
+                .key("params").begin_object()
+                .member("instrument_name", params.instrument_name)
+                .member("amount", params.amount)
+                .member("type", params.type);
+            if (params.type == "limit") {
+                writer.member("price", params.price);
+            }
+            writer.end_object().end_object();
+            ws_.write(asio::buffer(request_));
+        } catch (const std::exception&) {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            pending_.erase(id);
+            return "";
+        }
+        return reply.get();
+    }
+
+private:
+    void read_loop() {
+        deribit::json::Parser parser;
+        try {
+            for (;;) {
+                beast::flat_buffer buffer;
+                ws_.read(buffer);
+                auto data = buffer.data();
+                auto document = parser.parse(std::string_view(static_cast<const char*>(data.data()), data.size()));
+                auto reply = document.root();
+                uint64_t id;
+                if (!reply["id"].get(id)) {
+                    continue;
+                }
+                std::promise<std::string> waiter;
+                {
+                    std::lock_guard<std::mutex> lock(pending_mutex_);
+                    auto it = pending_.find(id);
+                    if (it == pending_.end()) {
+                        continue;
+                    }
+                    waiter = std::move(it->second);
+                    pending_.erase(it);
+                }
+                waiter.set_value(reply["result"]["order"]["order_id"].get_or(""));
+            }
+        } catch (const std::exception&) {
+        }
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        for (auto& [id, waiter] : pending_) {
+            waiter.set_value("");
+        }
+        pending_.clear();
+    }
+
+    asio::io_context ioc_;
+    websocket::stream<tcp::socket> ws_;
+    std::thread reader_;
+    std::atomic<uint64_t> next_id_;
+    // Guards the stream's writes and the request buffer.
+    std::mutex write_mutex_;
+    std::string request_;
+    std::mutex pending_mutex_;
+    std::map<uint64_t, std::promise<std::string>> pending_;
+};
+
+std::vector<std::string> split(const std::string& text) {
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        if (end > start) {
+            items.push_back(text.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return items;
+}
+
+std::vector<uint32_t> split_numbers(const std::string& text) {
+    std::vector<uint32_t> numbers;
+    for (const auto& item : split(text)) {
+        numbers.push_back(static_cast<uint32_t>(std::stoul(item)));
+    }
+    return numbers;
+}
+
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --transports <a,b>          rest and/or websocket (default: rest,websocket)\n"
+              << "  --concurrency <n,..>        order threads per run (default: 1,4,16)\n"
+              << "  --server-latency-us <n,..>  time the mock holds each order (default: 0,1000)\n"
+              << "  --duration <s>              measurement time per run (default: 3)\n"
+              << "  --warmup <s>                unmeasured orders before each run (default: 0.5)\n"
+              << "  --instrument <name>         instrument to order (default: BTC-PERPETUAL)\n"
+              << "  --out <file.json>           results file (default: order_path_results.json)\n";
+}
+
+Options parse_options(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--transports" && has_value) {
+            options.transports = split(argv[++i]);
+        } else if (arg == "--concurrency" && has_value) {
+            options.concurrency = split_numbers(argv[++i]);
+        } else if (arg == "--server-latency-us" && has_value) {
+            options.server_latency_us = split_numbers(argv[++i]);
+        } else if (arg == "--duration" && has_value) {
+            options.duration_s = std::stod(argv[++i]);
+        } else if (arg == "--warmup" && has_value) {
+            options.warmup_s = std::stod(argv[++i]);
+        } else if (arg == "--instrument" && has_value) {
+            options.instrument = argv[++i];
+        } else if (arg == "--out" && has_value) {
+            options.output = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            std::exit(arg == "--help" ? 0 : 1);
+        }
+    }
+    for (const auto& transport : options.transports) {
+        if (transport != "rest" && transport != "websocket") {
+            std::cerr << "Unknown transport: " << transport << std::endl;
+            std::exit(1);
+        }
+    }
+    if (options.transports.empty() || options.concurrency.empty() || options.server_latency_us.empty()) {
+        std::cerr << "Need at least one transport, concurrency level and server latency" << std::endl;
+        std::exit(1);
+    }
+    return options;
+}
+
+Run measure(const Options& options, OrderTransport& transport, const std::string& name,
+            uint32_t server_latency_us, uint32_t concurrency) {
+    Run run;
+    run.transport = name;
+    run.server_latency_us = server_latency_us;
+    run.concurrency = concurrency;
+
+    std::atomic<bool> measuring{false};
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> errors{0};
+    std::vector<std::vector<uint64_t>> samples(concurrency);
+    const auto server_latency = std::chrono::nanoseconds(std::chrono::microseconds(server_latency_us));
+
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < concurrency; ++t) {
+        threads.emplace_back([&, t] {
+            deribit::OrderParams params{options.instrument, 10, 50000.0 + t, "limit"};
+            bool buy = t % 2 == 0;
+            while (!done.load(std::memory_order_relaxed)) {
+                auto start = clock_type::now();
+                std::string order_id = transport.place(buy, params);
+                auto elapsed = clock_type::now() - start;
+                buy = !buy;
+                if (!measuring.load(std::memory_order_relaxed)) {
+                    continue;
+                }
+                if (order_id.empty()) {
+                    errors.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                samples[t].push_back(static_cast<uint64_t>(std::max(elapsed - server_latency, clock_type::duration::zero()).count()));
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.warmup_s));
+    measuring = true;
+    auto start = clock_type::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.duration_s));
+    measuring = false;
+    double elapsed_s = std::chrono::duration<double>(clock_type::now() - start).count();
+    done = true;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (auto& thread_samples : samples) {
+        run.overhead_ns.insert(run.overhead_ns.end(), thread_samples.begin(), thread_samples.end());
+    }
+    std::sort(run.overhead_ns.begin(), run.overhead_ns.end());
+    run.orders_per_second = run.overhead_ns.size() / elapsed_s;
+    run.errors = errors;
+    return run;
+}
+
+void print_run(const Run& run) {
+    std::cout << std::left << std::setw(11) << run.transport << std::right
+              << std::setw(10) << run.server_latency_us
+              << std::setw(8) << run.concurrency
+              << std::fixed << std::setprecision(0) << std::setw(11) << run.orders_per_second
+              << std::setprecision(1)
+              << std::setw(10) << run.percentile_us(50)
+              << std::setw(10) << run.percentile_us(90)
+              << std::setw(10) << run.percentile_us(99)
+              << std::setw(10) << run.percentile_us(99.9)
+              << std::setw(10) << (run.overhead_ns.empty() ? 0.0 : run.overhead_ns.back() / 1000.0)
+              << std::setw(8) << run.errors
+              << std::defaultfloat << std::endl;
+}
+
+bool write_json(const Options& options, const std::vector<Run>& runs) {
+    std::ofstream out(options.output, std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Unable to write " << options.output << std::endl;
+        return false;
+    }
+
+    char host[256] = {};
+    ::gethostname(host, sizeof(host) - 1);
+
+    out << "{\n  \"context\": {\"suite\": \"order_path\", \"host\": \"" << host
+        << "\", \"timestamp\": " << std::time(nullptr)
+        << ", \"duration_s\": " << options.duration_s
+        << ", \"instrument\": \"" << options.instrument << "\"},\n";
+    out << "  \"runs\": [";
+    for (size_t i = 0; i < runs.size(); ++i) {
+        const Run& run = runs[i];
+        out << (i ? ",\n" : "\n")
+            << "    {\"transport\": \"" << run.transport
+            << "\", \"server_latency_us\": " << run.server_latency_us
+            << ", \"concurrency\": " << run.concurrency
+            << ", \"orders\": " << run.overhead_ns.size()
+            << ", \"orders_per_second\": " << run.orders_per_second
+            << ", \"errors\": " << run.errors
+            << ", \"overhead_p50_us\": " << run.percentile_us(50)
+            << ", \"overhead_p90_us\": " << run.percentile_us(90)
+            << ", \"overhead_p99_us\": " << run.percentile_us(99)
+            << ", \"overhead_p999_us\": " << run.percentile_us(99.9)
+            << ", \"overhead_max_us\": " << (run.overhead_ns.empty() ? 0.0 : run.overhead_ns.back() / 1000.0)
+            << "}";
+    }
+    out << "\n  ]\n}\n";
+
+    std::cerr << "Results written to " << options.output << std::endl;
+    return out.good();
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options = parse_options(argc, argv);
+
+    deribit::Logger::instance().set_level(deribit::LogLevel::WARNING);
+    deribit::Logger::instance().set_log_file("order_path_benchmark.log");
+
+    try {
+        deribit::mock::MockDeribit exchange;
+        exchange.start();
+
+        deribit::Config config("benchmark", "benchmark", 0, "BTC", options.instrument, {options.instrument});
+        config.endpoints.rest_url = exchange.rest_url();
+        config.endpoints.websocket_url = exchange.websocket_url();
+
+        std::cout << std::left << std::setw(11) << "transport" << std::right
+                  << std::setw(10) << "server us" << std::setw(8) << "threads"
+                  << std::setw(11) << "orders/s" << std::setw(10) << "p50 us"
+                  << std::setw(10) << "p90 us" << std::setw(10) << "p99 us"
+                  << std::setw(10) << "p99.9 us" << std::setw(10) << "max us"
+                  << std::setw(8) << "errors" << std::endl;
+
+        std::vector<Run> runs;
+        for (const auto& name : options.transports) {
+            std::unique_ptr<OrderTransport> transport;
+            if (name == "rest") {
+                deribit::Authentication auth(config);
+                if (!auth.authenticate()) {
+                    std::cerr << "Authentication against the mock exchange failed" << std::endl;
+                    return 1;
+                }
+                transport = std::make_unique<RestTransport>(config);
+            } else {
+                transport = std::make_unique<WebSocketTransport>(
+                    "127.0.0.1", std::to_string(exchange.port()), "/ws/api/v2");
+            }
+
+            for (uint32_t latency_us : options.server_latency_us) {
+                exchange.set_order_latency(std::chrono::microseconds(latency_us));
+                for (uint32_t concurrency : options.concurrency) {
+                    runs.push_back(measure(options, *transport, name, latency_us, std::max(concurrency, 1u)));
+                    print_run(runs.back());
+                }
+            }
+        }
+
+        exchange.stop();
+        return write_json(options, runs) ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Order-path benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace deribit {
+
+// Heap allocation accounting for hot paths.
+//
+// Built with -DDERIBIT_TRACK_ALLOCATIONS=ON, the global operator new/delete
+// are replaced with versions that bump thread-local counters before calling
+// malloc/free. Without the option nothing is replaced and the guard macros
+// below compile to nothing.
+//
+//   ALLOCATION_GUARD("on_deribit_message");
+//       counts allocations made by this thread until the end of the scope
+//       and exports them as alloc.<region>.{calls,allocations,bytes}
+//
+//   ASSERT_NO_ALLOCATIONS("broadcast_to_subscribers");
+//       aborts with a message if the scope allocates at all
+struct AllocationCounts {
+    uint64_t allocations = 0;
+    uint64_t deallocations = 0;
+    uint64_t bytes = 0;
+};
+
+class AllocationTracker {
+public:
+    static constexpr bool enabled() {
+#ifdef DERIBIT_TRACK_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Counts for the calling thread since it started.
+    static AllocationCounts thread_counts();
+};
+
+class AllocationRegion {
+public:
+    explicit AllocationRegion(const std::string& name);
+
+    const std::string& name() const { return name_; }
+    void record(const AllocationCounts& delta) const;
+
+private:
+    std::string name_;
+    int calls_metric_;
+    int allocations_metric_;
+    int bytes_metric_;
+};
+
+class AllocationGuard {
+public:
+    enum class Mode {
+        Count,
+        Assert
+    };
+
+    AllocationGuard(const AllocationRegion& region, Mode mode);
+    ~AllocationGuard();
+
+    AllocationGuard(const AllocationGuard&) = delete;
+    AllocationGuard& operator=(const AllocationGuard&) = delete;
+
+    // Allocations made by this thread since the guard was created.
+    AllocationCounts delta() const;
+
+private:
+    const AllocationRegion& region_;
+    Mode mode_;
+    AllocationCounts start_;
+};
+
+#ifdef DERIBIT_TRACK_ALLOCATIONS
+#define ALLOCATION_GUARD(region) \
+    static const deribit::AllocationRegion deribit_allocation_region(region); \
+    deribit::AllocationGuard deribit_allocation_guard(deribit_allocation_region, deribit::AllocationGuard::Mode::Count)
+#define ASSERT_NO_ALLOCATIONS(region) \
+    static const deribit::AllocationRegion deribit_allocation_region(region); \
+    deribit::AllocationGuard deribit_allocation_guard(deribit_allocation_region, deribit::AllocationGuard::Mode::Assert)
+#else
+#define ALLOCATION_GUARD(region) ((void)0)
+#define ASSERT_NO_ALLOCATIONS(region) ((void)0)
+#endif
+
+} // namespace deribit
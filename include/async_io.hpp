@@ -0,0 +1,102 @@
+#pragma once
+
+#include "memory_pool.hpp"
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/system/error_code.hpp>
+#include <chrono>
+#include <type_traits>
+#include <utility>
+
+namespace deribit {
+
+// Types for the coroutine-based network code.
+//
+// Sessions run on a strand of the server's io_context and the upstream
+// client on its own io_context. The executor types are spelled out rather
+// than left as asio::any_io_executor: the type-erased executor is copied,
+// and heap-allocated, for every operation.
+//
+// Inside a coroutine, operations are awaited with await_with():
+//
+//   boost::system::error_code ec;
+//   co_await ws.async_read(buffer, await_with<SessionExecutor>(read_memory_, ec));
+//
+// which stores the error in `ec` instead of throwing, and allocates the
+// operation's state from a HandlerMemory owned by the loop.
+
+using SessionExecutor = boost::asio::strand<boost::asio::io_context::executor_type>;
+using SessionSocket = boost::asio::basic_stream_socket<boost::asio::ip::tcp, SessionExecutor>;
+using SessionTimer = boost::asio::basic_waitable_timer<
+    std::chrono::steady_clock, boost::asio::wait_traits<std::chrono::steady_clock>, SessionExecutor>;
+
+using UpstreamExecutor = boost::asio::io_context::executor_type;
+using UpstreamSocket = boost::asio::basic_stream_socket<boost::asio::ip::tcp, UpstreamExecutor>;
+using UpstreamTimer = boost::asio::basic_waitable_timer<
+    std::chrono::steady_clock, boost::asio::wait_traits<std::chrono::steady_clock>, UpstreamExecutor>;
+
+// Completion token; see await_with().
+template <typename Executor>
+struct AwaitWith {
+    HandlerMemory* memory;
+    boost::system::error_code* ec;
+};
+
+template <typename Executor>
+AwaitWith<Executor> await_with(HandlerMemory& memory, boost::system::error_code& ec) {
+    return {&memory, &ec};
+}
+
+} // namespace deribit
+
+namespace boost {
+namespace asio {
+
+template <typename Handler, typename Allocator, typename Executor>
+struct associated_executor<deribit::AllocatingHandler<Handler, Allocator>, Executor> {
+    using type = typename associated_executor<Handler, Executor>::type;
+
+    static type get(const deribit::AllocatingHandler<Handler, Allocator>& handler,
+                    const Executor& executor = Executor()) noexcept {
+        return associated_executor<Handler, Executor>::get(handler.handler(), executor);
+    }
+};
+
+// Awaits like redirect_error(use_awaitable_t<Executor>(), ec), with the
+// handler wrapped so that the operation allocates from the HandlerMemory.
+template <typename Executor, typename Signature>
+struct async_result<deribit::AwaitWith<Executor>, Signature> {
+    using token_type = redirect_error_t<use_awaitable_t<Executor>>;
+    using return_type = typename async_result<token_type, Signature>::return_type;
+
+    template <typename Initiation>
+    struct init_wrapper {
+        template <typename Handler, typename... Args>
+        void operator()(Handler&& handler, Args&&... args) {
+            using Wrapped = deribit::AllocatingHandler<std::decay_t<Handler>, deribit::HandlerAllocator<char>>;
+            std::move(initiation)(Wrapped(std::forward<Handler>(handler), deribit::HandlerAllocator<char>(*memory)),
+                                  std::forward<Args>(args)...);
+        }
+
+        deribit::HandlerMemory* memory;
+        Initiation initiation;
+    };
+
+    template <typename Initiation, typename RawToken, typename... Args>
+    static return_type initiate(Initiation&& initiation, RawToken&& token, Args&&... args) {
+        token_type inner = redirect_error(use_awaitable_t<Executor>(), *token.ec);
+        return async_initiate<token_type, Signature>(
+            init_wrapper<std::decay_t<Initiation>>{token.memory, std::forward<Initiation>(initiation)},
+            inner, std::forward<Args>(args)...);
+    }
+};
+
+} // namespace asio
+} // namespace boost
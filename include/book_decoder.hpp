@@ -0,0 +1,101 @@
+#pragma once
+
+#include "ondemand_json.hpp"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace deribit {
+
+class OrderBook;
+
+// Dedicated decoder for Deribit book notifications:
+//
+//   {"method":"subscription","params":{"channel":"book.<instrument>...",
+//    "data":{"type":..., "timestamp":..., "change_id":..., "prev_change_id":...,
+//            "bids":[[action, price, amount], ...], "asks":[...]}}}
+//
+// The payload is scanned once by hand-written code for exactly this shape
+// (keys in any order, unknown keys skipped) and written straight into a
+// preallocated BookDelta for the instrument. There is no DOM and no
+// allocation per message. Every read is bounds-checked and nesting is
+// limited, so arbitrary input is rejected rather than trusted.
+
+enum class BookAction : uint8_t {
+    New,
+    Change,
+    Delete,
+};
+
+struct BookLevel {
+    json::Decimal price;
+    json::Decimal amount;
+    BookAction action = BookAction::New;
+};
+
+struct BookDelta {
+    // Per side. Deeper snapshots are rejected with TooManyLevels.
+    static constexpr size_t MAX_LEVELS = 1024;
+
+    bool snapshot = false;
+    uint64_t timestamp_ms = 0;
+    uint64_t change_id = 0;
+    // 0 for snapshots.
+    uint64_t prev_change_id = 0;
+    uint32_t bid_count = 0;
+    uint32_t ask_count = 0;
+    std::array<BookLevel, MAX_LEVELS> bids;
+    std::array<BookLevel, MAX_LEVELS> asks;
+};
+
+enum class BookDecodeStatus {
+    Ok,
+    // Valid JSON-RPC but not a book notification; use the generic path.
+    NotBook,
+    Malformed,
+    TooManyLevels,
+};
+
+const char* book_decode_status_name(BookDecodeStatus status);
+
+// Preallocated deltas, one per instrument, plus the last change_id applied
+// for each so callers can check the sequence. Lookups do not allocate;
+// instruments that were not preallocated are added on first sight.
+class BookDeltaTable {
+public:
+    struct Entry {
+        explicit Entry(std::string_view name) : instrument(name) {}
+
+        std::string instrument;
+        uint64_t last_change_id = 0;
+        BookDelta delta;
+        // The instrument's book in the server's BookStore, once looked up.
+        OrderBook* book = nullptr;
+    };
+
+    explicit BookDeltaTable(const std::vector<std::string>& instruments = {});
+
+    Entry* find(std::string_view instrument);
+    Entry& find_or_add(std::string_view instrument);
+    size_t size() const { return entries_.size(); }
+
+private:
+    // Sorted by instrument.
+    std::vector<std::unique_ptr<Entry>> entries_;
+};
+
+// Decodes a book notification into the table entry for its channel's
+// instrument. On Ok, `entry` points at that entry; otherwise its delta may
+// be partly overwritten and must not be used.
+BookDecodeStatus decode_book_notification(std::string_view payload, BookDeltaTable& table,
+                                          BookDeltaTable::Entry*& entry);
+
+// Same, into a caller-provided delta. `instrument` receives the channel's
+// instrument as a view into the payload.
+BookDecodeStatus decode_book_notification(std::string_view payload, BookDelta& delta,
+                                          std::string_view& instrument);
+
+} // namespace deribit
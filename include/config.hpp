@@ -1,9 +1,30 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <map>
 #include <string>
 #include <vector>
 namespace deribit {
 
+// Placement and scheduling for one kind of thread, applied by
+// apply_thread_role() when the thread starts.
+struct ThreadRole {
+    // Linux truncates thread names to 15 characters. Roles with several
+    // threads append "-<index>".
+    std::string name;
+    // CPUs to run on; empty means every CPU the process started with.
+    // Threads of a role with several threads are pinned one CPU each,
+    // round robin over the list.
+    std::vector<int> cpus;
+    // "other", "batch", "idle", "fifo" or "rr".
+    std::string policy = "other";
+    // 1-99 for fifo and rr; ignored by the other policies.
+    int priority = 0;
+    // Thread count for roles with several threads; 0 picks the default.
+    uint32_t threads = 0;
+};
+
 struct Config {
     static constexpr const char* BASE_URL = "https://test.deribit.com/api/v2";
     static constexpr const char* WS_URL = "wss://test.deribit.com/ws/api/v2";
@@ -14,16 +35,139 @@ struct Config {
 
     struct Server {
         int websocket_port;
+        // Send session writes through io_uring, batched per flush (see
+        // uring_transport.hpp). Falls back to plain writes if the kernel
+        // does not support it.
+        bool io_uring = false;
+        // Sends submitted per io_uring_enter().
+        uint32_t io_uring_entries = 256;
+        // Sessions that can use the ring at once; later ones write directly.
+        uint32_t io_uring_sessions = 4096;
+        // Most queued messages a session sends with one write.
+        uint32_t write_batch_max = 64;
+        // How long a queued message may wait for more to batch with it.
+        uint32_t write_batch_delay_us = 0;
+        // Bytes a session may have queued before the client is treated as
+        // too slow and disconnected; 0 never disconnects.
+        uint32_t session_max_queued_bytes = 8 * 1024 * 1024;
     } server;
 
+    struct Endpoints {
+        std::string rest_url = BASE_URL;
+        std::string websocket_url = WS_URL;
+    } endpoints;
+
     struct Trading {
         std::string default_currency;
         std::string default_instrument;
+        // Instruments, or shell-style patterns such as "BTC-*-C" matched
+        // against the trading.default_currency instrument catalog.
         std::vector<std::string> supported_instruments;
+        // Subscribe upstream to supported_instruments at startup, so their
+        // books are warm before the first client asks for one.
+        bool presubscribe = true;
+        // How long startup waits for those books' first snapshots.
+        uint32_t presubscribe_wait_ms = 5000;
     } trading;
 
+    struct Metrics {
+        bool shared_memory_enabled = false;
+        std::string shared_memory_name = "/deribit_metrics";
+    } metrics;
+
+    struct Tracing {
+        bool enabled = false;
+        uint32_t sample_every = 1000;
+        size_t buffer_events = 65536;
+        std::string output_file = "logs/trace.json";
+    } tracing;
+
+    struct Logging {
+        // "debug", "info", "warning", "error" or "critical".
+        std::string level = "info";
+    } logging;
+
+    struct Monitoring {
+        bool loop_lag_enabled = true;
+        uint32_t loop_probe_interval_us = 10000;
+        uint32_t loop_lag_warning_us = 1000;
+        uint32_t loop_lag_critical_us = 10000;
+        bool perf_counters_enabled = false;
+        uint32_t perf_sample_every = 100;
+        bool lock_profiling_enabled = false;
+    } monitoring;
+
+    // The timer wheel shared by the server, the upstream client and the
+    // order manager (see timer_wheel.hpp).
+    struct Timers {
+        uint32_t tick_us = 1000;
+        // Sessions that send nothing, not even a pong, for this long are
+        // closed; a ping goes out halfway. 0 leaves it to Beast's own idle
+        // timeout.
+        uint32_t session_idle_timeout_ms = 300000;
+        // Upstream subscribe requests unanswered for this long are re-sent.
+        uint32_t upstream_request_timeout_ms = 5000;
+        // REST order requests are abandoned after this long; 0 waits as
+        // long as the HTTP client does.
+        uint32_t order_timeout_ms = 10000;
+    } timers;
+
+    // Warm restart: books, upstream channels and the instrument catalog are
+    // saved every interval and loaded back on start (see checkpoint.hpp).
+    struct Checkpoint {
+        bool enabled = false;
+        std::string path = "state/checkpoint.bin";
+        uint32_t interval_ms = 1000;
+        // Books in an older checkpoint are not restored; its channels and
+        // catalog still are.
+        uint32_t max_age_s = 300;
+    } checkpoint;
+
+    // Headless mode, chosen with --daemon: no console menu; commands come
+    // over a Unix domain socket (see control_server.hpp) and SIGINT or
+    // SIGTERM shut down gracefully.
+    struct Daemon {
+        std::string control_socket = "deribit-control.sock";
+        // Threads running control commands.
+        uint32_t control_workers = 2;
+        // Shutdown gives running commands and queued client writes this
+        // long to finish.
+        uint32_t shutdown_drain_ms = 5000;
+    } daemon;
+
+    struct Memory {
+        // Back the message arena and the session pool with huge pages.
+        bool huge_pages = false;
+        // Chunk size of the per-message arena.
+        size_t message_arena_bytes = 64 * 1024;
+        // Sessions per slab of the session pool.
+        uint32_t sessions_per_slab = 64;
+    } memory;
+
+    // Roles: "main" (console and REST orders), "upstream" (the Deribit
+    // reader, which also decodes, applies books and fans out) and "io"
+    // (the client-facing io_context threads).
+    struct Threading {
+        std::map<std::string, ThreadRole> roles;
+
+        // The configured role, or an unpinned default named after it.
+        ThreadRole role(const std::string& role_name) const {
+            auto it = roles.find(role_name);
+            if (it != roles.end()) {
+                return it->second;
+            }
+            ThreadRole defaults;
+            defaults.name = "deribit-" + role_name;
+            return defaults;
+        }
+    } threading;
+
     Config(const std::string& id, const std::string& secret, int port, const std::string& currency, const std::string& instrument, const std::vector<std::string>& instruments)
         : client_id(id), client_secret(secret), server{port}, trading{currency, instrument, instruments} {}
 };
 
+// Reads config.json. Throws if the file cannot be read or parsed; missing
+// settings keep their defaults.
+Config load_config(const std::string& config_path);
+
 } // namespace deribit
\ No newline at end of file
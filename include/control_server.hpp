@@ -0,0 +1,100 @@
+#pragma once
+
+#include "json_writer.hpp"
+#include "ondemand_json.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+namespace deribit {
+
+// Control socket for daemon mode.
+//
+// Clients connect to a Unix domain socket and send one JSON request per
+// line. Every request gets one JSON reply line that echoes its "id":
+//
+//   -> {"id":1,"command":"cancel","order_id":"ETH-123"}
+//   <- {"id":1,"ok":true,"result":{"cancelled":"ETH-123"}}
+//   <- {"id":2,"ok":false,"error":"unknown command: cancle"}
+//
+// The socket is served by one thread of its own. Commands run on a small
+// worker pool, because most of them wait for a REST round trip; a client
+// may pipeline requests, and replies then come back in completion order.
+// A client that shuts down its sending side after the last request, as a
+// script piping into socat does, still gets every reply before the
+// connection closes.
+class ControlServer {
+public:
+    // Writes one JSON value to `result` and returns true, or sets `error`
+    // and returns false. Runs on a worker thread.
+    using Handler = std::function<bool(const json::Value& request, json::Writer& result, std::string& error)>;
+
+    ControlServer(std::string path, uint32_t workers);
+    ~ControlServer();
+
+    // Before start().
+    void add(const std::string& command, Handler handler);
+
+    // Binds the socket, replacing one left behind by an earlier run, and
+    // starts serving. False if it cannot bind.
+    bool start();
+
+    // Stops taking connections and requests, gives running commands until
+    // `deadline` to reply and the replies until then to be written, and
+    // closes every connection. Returns false if a command was still
+    // running; it is left to finish, which the order timeout bounds.
+    bool stop(std::chrono::steady_clock::time_point deadline);
+
+private:
+    struct Connection;
+
+    static constexpr size_t MAX_REQUEST_BYTES = 64 * 1024;
+
+    void accept();
+    boost::asio::awaitable<void> serve(std::shared_ptr<Connection> connection);
+    std::string execute(const std::string& line);
+    // All on the io thread.
+    void reply(const std::shared_ptr<Connection>& connection, std::string message);
+    void write_next(const std::shared_ptr<Connection>& connection);
+    // Closes a connection the client has stopped sending on, once it has
+    // nothing left to answer or write.
+    void close_when_answered(const std::shared_ptr<Connection>& connection);
+    void close(const std::shared_ptr<Connection>& connection);
+
+    std::string path_;
+    std::map<std::string, Handler> handlers_;
+    boost::asio::io_context ioc_;
+    boost::asio::local::stream_protocol::acceptor acceptor_;
+    boost::asio::thread_pool workers_;
+    std::thread thread_;
+    std::atomic<bool> accepting_;
+
+    // Only touched on the io thread.
+    std::set<std::shared_ptr<Connection>> connections_;
+    bool closing_ = false;
+    boost::asio::steady_timer close_deadline_;
+
+    // Requests handed to the workers and not yet replied to.
+    std::mutex in_flight_mutex_;
+    std::condition_variable in_flight_done_;
+    size_t in_flight_ = 0;
+
+    int commands_metric_;
+    int command_latency_metric_;
+};
+
+} // namespace deribit
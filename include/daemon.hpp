@@ -0,0 +1,48 @@
+#pragma once
+
+#include "config.hpp"
+#include "control_server.hpp"
+#include "order_manager.hpp"
+#include "websocket_server.hpp"
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <chrono>
+
+namespace deribit {
+
+// Headless mode, enabled with --daemon, in place of the console menu.
+// Socket, worker and drain settings come from config.daemon.
+//
+// Serves these commands on the control socket:
+//
+//   place      {"side":"buy"|"sell", "amount", "price", "instrument"?, "type"?}
+//   cancel     {"order_id"}
+//   status     server, session and upstream state
+//   stats      counters and latency histograms (needs shared-memory metrics)
+//   subscribe  {"instrument"}: subscribe upstream ahead of any client
+//
+// and shuts down on SIGINT or SIGTERM: running commands and queued client
+// writes get config.daemon.shutdown_drain_ms between them to finish.
+class Daemon {
+public:
+    // Catches the signals from here on, so one that arrives during
+    // startup still shuts down gracefully once run() is called.
+    Daemon(Config& config, WebsocketServer& server, OrderManager& orders);
+
+    // Serves until a signal arrives, then drains the control socket and
+    // the server. The caller stops the server. Returns the exit code.
+    int run();
+
+private:
+    void add_commands();
+
+    Config& config_;
+    WebsocketServer& server_;
+    OrderManager& orders_;
+    ControlServer control_;
+    boost::asio::io_context signals_ioc_;
+    boost::asio::signal_set signals_;
+    std::chrono::steady_clock::time_point started_;
+};
+
+} // namespace deribit
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+namespace deribit {
+
+// Contention profiling for named locks.
+//
+// InstrumentedMutex is a drop-in replacement for std::mutex (it satisfies
+// Lockable, so std::lock_guard / std::unique_lock work unchanged). Every
+// instance carries a name; instances with the same name share one set of
+// statistics, e.g. all per-session write locks report as "session.write".
+//
+// Profiling is switched at runtime with LockProfiler::set_enabled(). When it
+// is off, lock() and unlock() add one relaxed atomic load to std::mutex.
+// When it is on, an uncontended lock() costs a try_lock, a clock read and
+// two atomic adds (the acquisition count and its shared-memory counter);
+// unlock() reads the clock again, updates the hold totals and records the
+// hold time in the shared-memory histogram, which takes that slot's write
+// lock. Contended acquisitions also pay for timing the wait and recording
+// it the same way. All locks with one name share these counters and
+// histogram slots, so busy names such as "session.write" contend on them
+// across threads. Wait and hold times are exported as lock.<name>.wait /
+// lock.<name>.hold histograms, and print_ranking() lists locks ordered by
+// total time spent waiting.
+struct LockStats;
+
+class LockProfiler {
+public:
+    static void set_enabled(bool enabled);
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    static LockStats* stats_for(const std::string& name);
+    static void print_ranking(std::ostream& out);
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+class InstrumentedMutex {
+public:
+    explicit InstrumentedMutex(const std::string& name);
+
+    InstrumentedMutex(const InstrumentedMutex&) = delete;
+    InstrumentedMutex& operator=(const InstrumentedMutex&) = delete;
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+private:
+    std::mutex mutex_;
+    LockStats* stats_;
+    // Only touched by the thread holding mutex_; 0 when the current
+    // acquisition is not being profiled.
+    uint64_t acquired_ns_;
+};
+
+} // namespace deribit
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "ondemand_json.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace deribit {
+namespace json {
+
+// Streaming JSON writer for outbound messages.
+//
+// Output is appended to a caller-owned string. Callers keep one buffer per
+// writer site and clear() it before each message, so once the buffer has
+// grown to the largest message there are no allocations: no tree is built
+// and numbers are formatted with std::to_chars on the stack.
+//
+//   buffer.clear();
+//   json::Writer(buffer)
+//       .begin_object()
+//       .member("jsonrpc", "2.0")
+//       .member("id", id)
+//       .key("params").begin_object() ... .end_object()
+//       .end_object();
+//
+// Commas are inserted automatically. The writer does not check that
+// begin/end calls balance or that keys are only used inside objects;
+// nesting deeper than MAX_DEPTH is not supported.
+class Writer {
+public:
+    static constexpr int MAX_DEPTH = 63;
+
+    explicit Writer(std::string& out) : out_(out) {}
+
+    Writer& begin_object() { open('{'); return *this; }
+    Writer& end_object() { close('}'); return *this; }
+    Writer& begin_array() { open('['); return *this; }
+    Writer& end_array() { close(']'); return *this; }
+
+    Writer& key(std::string_view name);
+
+    Writer& value(std::string_view text);
+    Writer& value(const char* text) { return value(std::string_view(text)); }
+    Writer& value(const std::string& text) { return value(std::string_view(text)); }
+    Writer& value(bool flag);
+    Writer& value(int number) { return write_signed(number); }
+    Writer& value(long number) { return write_signed(number); }
+    Writer& value(long long number) { return write_signed(number); }
+    Writer& value(unsigned number) { return write_unsigned(number); }
+    Writer& value(unsigned long number) { return write_unsigned(number); }
+    Writer& value(unsigned long long number) { return write_unsigned(number); }
+    // Shortest text that reads back as the same double.
+    Writer& value(double number);
+    // Exact, without trailing zeros.
+    Writer& value(const Decimal& number);
+    Writer& null();
+    // Already-serialized JSON, copied verbatim.
+    Writer& raw(std::string_view json);
+
+    template <typename T>
+    Writer& member(std::string_view name, const T& v) {
+        key(name);
+        return value(v);
+    }
+
+private:
+    void separate() {
+        if (after_key_) {
+            after_key_ = false;
+        } else if (depth_ > 0 && (has_items_ >> depth_ & 1)) {
+            out_ += ',';
+        }
+        has_items_ |= 1ULL << depth_;
+    }
+
+    void open(char bracket) {
+        separate();
+        out_ += bracket;
+        ++depth_;
+        has_items_ &= ~(1ULL << depth_);
+    }
+
+    void close(char bracket) {
+        out_ += bracket;
+        --depth_;
+    }
+
+    Writer& write_signed(long long number);
+    Writer& write_unsigned(unsigned long long number);
+
+    std::string& out_;
+    int depth_ = 0;
+    // Bit d is set once the container at depth d has an item.
+    uint64_t has_items_ = 0;
+    bool after_key_ = false;
+};
+
+} // namespace json
+} // namespace deribit
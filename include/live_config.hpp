@@ -0,0 +1,77 @@
+#pragma once
+
+#include "config.hpp"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace deribit {
+
+// The current config as an immutable snapshot.
+//
+// Readers take the snapshot with one acquire load and no lock, so hot paths
+// can look settings up on every use. A reload publishes a whole new
+// snapshot, so a reader sees either every old value or every new one,
+// never a mix. Snapshots are kept until the LiveConfig is destroyed rather
+// than reclaimed: reloads are rare and a Config is small, and it spares
+// readers any reference counting.
+class LiveConfig {
+public:
+    explicit LiveConfig(const Config& initial);
+
+    const Config& get() const { return *current_.load(std::memory_order_acquire); }
+
+    // Returns the snapshot it replaced.
+    const Config& publish(const Config& next);
+
+private:
+    std::atomic<const Config*> current_;
+    std::mutex publish_mutex_;
+    std::vector<std::unique_ptr<const Config>> snapshots_;
+};
+
+// Reloads config.json when it changes on disk.
+//
+// The directory is watched with inotify, so a file replaced by rename, as
+// most editors and deployment tools do, is picked up as well as one
+// written in place. A file that fails to parse is logged and ignored.
+//
+// Settings that can change in place are applied by reload() itself (the
+// log level, lock profiling) and by the `apply` callback (everything owned
+// by a component). The rest only take effect after a restart; changes to
+// them are published like any other, but logged as such.
+class ConfigWatcher {
+public:
+    // Runs on the watcher thread after the new snapshot is published.
+    using Apply = std::function<void(const Config& previous, const Config& next)>;
+
+    ConfigWatcher(std::string path, LiveConfig& live, Apply apply);
+    ~ConfigWatcher();
+
+    bool start();
+    void stop();
+
+    // Loads and applies the file now. False if it could not be loaded.
+    bool reload();
+
+    // Names of the changed settings that need a restart.
+    static std::vector<std::string> restart_required(const Config& previous, const Config& next);
+
+private:
+    void run();
+
+    std::string path_;
+    std::string file_name_;
+    LiveConfig& live_;
+    Apply apply_;
+    int inotify_fd_ = -1;
+    // Written by stop() to wake the watcher thread.
+    int wake_fd_ = -1;
+    std::thread thread_;
+};
+
+} // namespace deribit
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "instrumented_mutex.hpp"
+#include <atomic>
 #include <string>
 #include <fstream>
 #include <iostream>
@@ -23,36 +25,75 @@ class Logger {
 public:
     static Logger& instance();
 
+    // May be called while other threads log, e.g. on a config reload.
     void set_level(LogLevel level);
+    // "debug", "info", "warning", "error" or "critical".
+    static bool parse_level(const std::string& name, LogLevel& level);
     void set_log_file(const std::string& filename);
 
     template<typename... Args>
-    void debug(const std::string& format, Args... args);
+    void debug(const char* format, Args... args);
 
     template<typename... Args>
-    void info(const std::string& format, Args... args);
+    void info(const char* format, Args... args);
 
     template<typename... Args>
-    void warning(const std::string& format, Args... args);
+    void warning(const char* format, Args... args);
 
     template<typename... Args>
-    void error(const std::string& format, Args... args);
+    void error(const char* format, Args... args);
 
     template<typename... Args>
-    void critical(const std::string& format, Args... args);
+    void critical(const char* format, Args... args);
 
 private:
     Logger();
     ~Logger();
 
     template<typename... Args>
-    void log(LogLevel level, const std::string& format, Args... args);
+    void log(LogLevel level, const char* format, Args... args);
 
-    LogLevel level_;
+    void write(LogLevel level, const char* message);
+
+    std::atomic<LogLevel> level_;
     std::ofstream file_;
-    std::mutex mutex_;
+    InstrumentedMutex mutex_;
 };
 
+template<typename... Args>
+void Logger::debug(const char* format, Args... args) {
+    log(LogLevel::DEBUG, format, args...);
+}
+
+template<typename... Args>
+void Logger::info(const char* format, Args... args) {
+    log(LogLevel::INFO, format, args...);
+}
+
+template<typename... Args>
+void Logger::warning(const char* format, Args... args) {
+    log(LogLevel::WARNING, format, args...);
+}
+
+template<typename... Args>
+void Logger::error(const char* format, Args... args) {
+    log(LogLevel::ERROR, format, args...);
+}
+
+template<typename... Args>
+void Logger::critical(const char* format, Args... args) {
+    log(LogLevel::CRITICAL, format, args...);
+}
+
+template<typename... Args>
+void Logger::log(LogLevel level, const char* format, Args... args) {
+    if (level < level_.load(std::memory_order_relaxed)) return;
+
+    char buffer[1024];
+    snprintf(buffer, sizeof(buffer), format, args...);
+    write(level, buffer);
+}
+
 #define LOG_DEBUG(...) deribit::Logger::instance().debug(__VA_ARGS__)
 #define LOG_INFO(...) deribit::Logger::instance().info(__VA_ARGS__)
 #define LOG_WARNING(...) deribit::Logger::instance().warning(__VA_ARGS__)
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace deribit {
+
+// Measures how far an io_context is falling behind.
+//
+// A probe timer posts a timestamped no-op handler every `probe_interval`;
+// the delay until that handler runs is the loop lag, i.e. how long a freshly
+// queued completion waits behind the work already queued. Threads that drive
+// the io_context through run() also report the number of handlers executed
+// and the busy time of each loop iteration (one poll() batch).
+//
+// Exported through ShmMetrics as loop.<name>.lag, loop.<name>.iteration,
+// loop.<name>.handlers and loop.<name>.lag_alerts.
+class LoopMonitor {
+public:
+    LoopMonitor(boost::asio::io_context& ioc,
+                const std::string& name,
+                std::chrono::microseconds probe_interval,
+                std::chrono::microseconds warning_threshold,
+                std::chrono::microseconds critical_threshold);
+
+    void start();
+    void stop();
+
+    // Drop-in replacement for ioc.run() that records handler counts and
+    // per-iteration busy time.
+    void run();
+
+private:
+    void schedule_probe();
+    void on_probe(std::chrono::steady_clock::time_point posted);
+
+    boost::asio::io_context& ioc_;
+    boost::asio::steady_timer timer_;
+    std::string name_;
+    std::chrono::microseconds probe_interval_;
+    std::chrono::microseconds warning_threshold_;
+    std::chrono::microseconds critical_threshold_;
+    std::atomic<bool> running_;
+    std::atomic<int64_t> last_alert_ns_;
+
+    int lag_metric_;
+    int iteration_metric_;
+    int handlers_metric_;
+    int alerts_metric_;
+};
+
+} // namespace deribit
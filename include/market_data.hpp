@@ -1,8 +1,11 @@
 #pragma once
 
 #include "config.hpp"
+#include "ondemand_json.hpp"
+#include "instrumented_mutex.hpp"
 #include <cpprest/http_client.h>
 #include <string>
+#include <vector>
 
 namespace deribit {
 
@@ -10,14 +13,24 @@ class MarketData {
 public:
     explicit MarketData(Config& config);
     
-    web::json::value get_orderbook(const std::string& instrument_name, int depth);
-    web::json::value get_ticker(const std::string& instrument_name);
-    web::json::value get_instruments(const std::string& currency, const std::string& kind);
-    web::json::value get_options_instruments(const std::string& currency);
+    json::Message get_orderbook(const std::string& instrument_name, int depth);
+    json::Message get_ticker(const std::string& instrument_name);
+    json::Message get_instruments(const std::string& currency, const std::string& kind);
+    json::Message get_options_instruments(const std::string& currency);
+
+    // Fetches every instrument of `currency`, of all kinds, into the
+    // catalog. Returns false and keeps the previous catalog on failure.
+    bool load_instrument_catalog(const std::string& currency);
+    // Names in the catalog; empty until it has been loaded.
+    std::vector<std::string> instrument_names() const;
+    // Seeds the catalog, e.g. from a checkpoint, until it is loaded.
+    void set_instrument_catalog(std::vector<std::string> names);
 
 private:
     Config& config_;
     web::http::client::http_client client_;
+    mutable InstrumentedMutex catalog_mutex_;
+    std::vector<std::string> catalog_;
 };
 
 } // namespace deribit
\ No newline at end of file
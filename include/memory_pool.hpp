@@ -0,0 +1,301 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace deribit {
+
+// Allocation for the steady-state message path.
+//
+// Everything here takes its memory in large, prefaulted blocks up front or
+// on first use, then recycles it, so a server that has warmed up stops
+// calling malloc and stops taking page faults:
+//
+//   Arena          bump allocation for data that dies together, e.g. the
+//                  scratch state of one upstream message; reset() releases
+//                  it all at once and keeps the memory.
+//   FixedPool      fixed-size blocks shared between threads, e.g. sessions
+//                  and posted handlers.
+//   StringPool     payload strings shared by many write queues; each one
+//                  goes back to the pool with its capacity when the last
+//                  queue lets go of it.
+//   HandlerMemory  one recycled block per outstanding Asio operation, for
+//                  a session's read and write loops.
+//
+// Blocks come from anonymous mappings, optionally on huge pages (explicit
+// hugetlbfs pages if reserved, else transparent huge pages).
+
+// Maps at least `bytes` of prefaulted memory and sets `bytes` to the size
+// actually mapped, which is what unmap_pages() needs. Returns nullptr on
+// failure.
+void* map_pages(size_t& bytes, bool huge_pages);
+void unmap_pages(void* memory, size_t bytes);
+
+// For the pools' free lists, which are held for a pointer swap at a time.
+class SpinLock {
+public:
+    void lock() {
+        while (flag_.test_and_set(std::memory_order_acquire)) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+    }
+    void unlock() { flag_.clear(std::memory_order_release); }
+
+private:
+    std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
+};
+
+class Arena {
+public:
+    explicit Arena(size_t chunk_bytes = 64 * 1024, bool huge_pages = false);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    // Frees everything allocated since the last reset. The chunks are kept,
+    // so the next message reuses the same memory.
+    void reset();
+
+    size_t chunk_count() const { return chunks_.size(); }
+
+private:
+    struct Chunk {
+        char* memory;
+        size_t size;
+    };
+
+    bool next_chunk(size_t bytes, size_t alignment);
+
+    size_t chunk_bytes_;
+    bool huge_pages_;
+    std::vector<Chunk> chunks_;
+    size_t current_;
+    char* cursor_;
+    char* limit_;
+};
+
+// Standard allocator over an Arena; deallocate() is a no-op.
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(Arena& arena) : arena_(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena_) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena_ == other.arena_; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena_ != other.arena_; }
+
+private:
+    template <typename U>
+    friend class ArenaAllocator;
+    Arena* arena_;
+};
+
+// Thread-safe pool of fixed-size blocks, carved from slabs that are only
+// returned when the pool is destroyed.
+class FixedPool {
+public:
+    explicit FixedPool(size_t block_size, size_t blocks_per_slab = 256, bool huge_pages = false);
+    ~FixedPool();
+
+    FixedPool(const FixedPool&) = delete;
+    FixedPool& operator=(const FixedPool&) = delete;
+
+    size_t block_size() const { return block_size_; }
+
+    // Never returns nullptr; throws std::bad_alloc if a slab cannot be
+    // mapped.
+    void* allocate();
+    void deallocate(void* block);
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    void add_slab();
+
+    size_t block_size_;
+    size_t blocks_per_slab_;
+    bool huge_pages_;
+    SpinLock lock_;
+    FreeBlock* free_;
+    std::vector<std::pair<void*, size_t>> slabs_;
+};
+
+// Standard allocator over a FixedPool. Requests that do not fit one block
+// (arrays, oversized or overaligned types) go to operator new, so it is
+// safe to rebind to any type.
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    explicit PoolAllocator(FixedPool& pool) : pool_(&pool) {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) : pool_(other.pool_) {}
+
+    T* allocate(size_t n) {
+        if (fits(n)) {
+            return static_cast<T*>(pool_->allocate());
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) {
+        if (fits(n)) {
+            pool_->deallocate(p);
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>& other) const { return pool_ == other.pool_; }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>& other) const { return pool_ != other.pool_; }
+
+private:
+    template <typename U>
+    friend class PoolAllocator;
+
+    bool fits(size_t n) const {
+        return n == 1 && sizeof(T) <= pool_->block_size() && alignof(T) <= alignof(std::max_align_t);
+    }
+
+    FixedPool* pool_;
+};
+
+// Recycles payload strings together with their capacity. share() copies
+// bytes into a pooled string and returns it as a shared, immutable
+// payload; the string returns to the pool when the last owner drops it,
+// on whichever thread that happens. The shared_ptr control blocks are
+// pooled as well, so a warmed-up pool does not allocate.
+//
+// Payloads may outlive the StringPool object; the storage is released
+// with the last of them.
+class StringPool {
+public:
+    explicit StringPool(size_t max_cached = 4096, bool huge_pages = false);
+
+    std::shared_ptr<const std::string> share(std::string_view data);
+
+    // Owned jointly by the pool and the payloads it handed out.
+    struct State;
+
+private:
+    std::shared_ptr<State> state_;
+};
+
+// Memory for one Asio operation at a time. A session keeps one per loop
+// (read, write); since each loop has at most one operation in flight, the
+// same block is reused for every operation. Requests that are too large,
+// or arrive while the block is taken, fall back to the heap.
+class HandlerMemory {
+public:
+    static constexpr size_t SIZE = 1024;
+
+    HandlerMemory() = default;
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    void* allocate(size_t bytes) {
+        if (!in_use_ && bytes <= SIZE) {
+            in_use_ = true;
+            return &storage_;
+        }
+        return ::operator new(bytes);
+    }
+
+    void deallocate(void* p) {
+        if (p == &storage_) {
+            in_use_ = false;
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+private:
+    typename std::aligned_storage<SIZE, alignof(std::max_align_t)>::type storage_;
+    bool in_use_ = false;
+};
+
+template <typename T>
+class HandlerAllocator {
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory& memory) : memory_(&memory) {}
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) : memory_(other.memory_) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(memory_->allocate(n * sizeof(T))); }
+    void deallocate(T* p, size_t) { memory_->deallocate(p); }
+
+    template <typename U>
+    bool operator==(const HandlerAllocator<U>& other) const { return memory_ == other.memory_; }
+    template <typename U>
+    bool operator!=(const HandlerAllocator<U>& other) const { return memory_ != other.memory_; }
+
+private:
+    template <typename U>
+    friend class HandlerAllocator;
+    HandlerMemory* memory_;
+};
+
+// Wraps a completion handler so that Asio and Beast allocate the
+// operation's state with `Allocator` (found through the handler's
+// allocator_type / get_allocator()).
+template <typename Handler, typename Allocator>
+class AllocatingHandler {
+public:
+    using allocator_type = Allocator;
+
+    AllocatingHandler(Handler handler, Allocator allocator)
+        : handler_(std::move(handler)), allocator_(allocator) {}
+
+    allocator_type get_allocator() const noexcept { return allocator_; }
+    const Handler& handler() const noexcept { return handler_; }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        handler_(std::forward<Args>(args)...);
+    }
+
+private:
+    Handler handler_;
+    Allocator allocator_;
+};
+
+template <typename Handler>
+AllocatingHandler<std::decay_t<Handler>, HandlerAllocator<char>> bind_handler_memory(HandlerMemory& memory,
+                                                                                     Handler&& handler) {
+    return {std::forward<Handler>(handler), HandlerAllocator<char>(memory)};
+}
+
+template <typename Handler>
+AllocatingHandler<std::decay_t<Handler>, PoolAllocator<char>> bind_handler_pool(FixedPool& pool, Handler&& handler) {
+    return {std::forward<Handler>(handler), PoolAllocator<char>(pool)};
+}
+
+} // namespace deribit
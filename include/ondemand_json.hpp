@@ -0,0 +1,273 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace deribit {
+namespace json {
+
+// On-demand JSON reader for the upstream hot path.
+//
+// Parsing happens in two steps. Parser::parse() indexes the structural
+// characters of the input ({ } [ ] : , and unescaped quotes outside of
+// strings) in 64-byte blocks, using SIMD where the CPU supports it.
+// Navigation then walks that index on demand: only the fields that are
+// asked for are looked at, strings come back as views into the input, and
+// numbers are converted straight from the text to integers or fixed-point.
+//
+// Nothing is copied or allocated per message once the parser's index has
+// grown to the largest input seen. The input and the parser must outlive
+// every Document and Value taken from them, and a new parse() invalidates
+// the previous Document.
+//
+// Validation is limited to what navigation touches: malformed input is
+// never read out of bounds, but an error in a field nobody reads goes
+// unnoticed.
+
+enum class Error {
+    None,
+    Empty,
+    UnclosedString,
+    TooLarge,
+};
+
+const char* error_message(Error error);
+
+// Structural indexing backends. Scalar works everywhere; the others are
+// only offered where the CPU supports them.
+enum class Backend {
+    Scalar,
+    Sse2,
+    Avx2,
+};
+
+const char* backend_name(Backend backend);
+bool backend_supported(Backend backend);
+Backend best_backend();
+
+// Fixed-point number with 8 fractional digits: exact for every price and
+// amount Deribit sends, so book levels can be compared and keyed without
+// binary rounding.
+struct Decimal {
+    static constexpr int DIGITS = 8;
+    static constexpr int64_t SCALE = 100000000;
+
+    int64_t units = 0;
+
+    double to_double() const { return static_cast<double>(units) / SCALE; }
+
+    bool operator==(const Decimal& other) const { return units == other.units; }
+    bool operator!=(const Decimal& other) const { return units != other.units; }
+    bool operator<(const Decimal& other) const { return units < other.units; }
+    bool operator>(const Decimal& other) const { return units > other.units; }
+};
+
+// Parses a JSON number into a Decimal, rounding half away from zero past
+// the eighth fractional digit. Fails on malformed numbers and values that
+// do not fit.
+bool parse_decimal(std::string_view text, Decimal& out);
+
+enum class Type {
+    Invalid,
+    Object,
+    Array,
+    String,
+    Number,
+    Bool,
+    Null,
+};
+
+class Document;
+class Field;
+class ObjectRange;
+class ArrayRange;
+
+// A position in a parsed document. Lookups that fail return an invalid
+// Value rather than throwing, so chains like root["params"]["channel"] can
+// be checked once at the end.
+class Value {
+public:
+    Value() = default;
+
+    bool valid() const { return doc_ != nullptr; }
+    explicit operator bool() const { return valid(); }
+    Type type() const;
+
+    // Object member by key, compared against the raw (still escaped) key.
+    Value operator[](std::string_view key) const;
+    // Array element by position.
+    Value at(size_t index) const;
+
+    ObjectRange fields() const;
+    ArrayRange elements() const;
+
+    // Accessors leave `out` untouched and return false on a type mismatch or
+    // when the number does not fit. String views are returned raw, without
+    // unescaping; std::string receives the unescaped text.
+    bool get(std::string_view& out) const;
+    bool get(std::string& out) const;
+    bool get(uint64_t& out) const;
+    bool get(int64_t& out) const;
+    bool get(uint32_t& out) const;
+    bool get(int32_t& out) const;
+    bool get(double& out) const;
+    bool get(Decimal& out) const;
+    bool get(bool& out) const;
+
+    // The value as T, or `fallback` if it is missing or has another type:
+    //   port = root["server"]["websocket_port"].get_or(8080);
+    template <typename T>
+    T get_or(T fallback) const {
+        T out{};
+        return get(out) ? out : fallback;
+    }
+    std::string get_or(const char* fallback) const { return get_or(std::string(fallback)); }
+
+    // Source text of a scalar, e.g. for logging.
+    std::string_view raw() const;
+
+private:
+    friend class Document;
+    friend class ObjectRange;
+    friend class ArrayRange;
+
+    Value(const Document* doc, uint32_t token, uint32_t pos) : doc_(doc), token_(token), pos_(pos) {}
+
+    // Index of the first structural token after this value.
+    uint32_t skip() const;
+
+    const Document* doc_ = nullptr;
+    // For containers and strings, the token of the opening character; for
+    // other scalars, the token that terminates them.
+    uint32_t token_ = 0;
+    // Offset of the value's first character in the input.
+    uint32_t pos_ = 0;
+};
+
+class Field {
+public:
+    std::string_view key;
+    Value value;
+};
+
+class ObjectRange {
+public:
+    class iterator {
+    public:
+        const Field& operator*() const { return field_; }
+        const Field* operator->() const { return &field_; }
+        iterator& operator++();
+        bool operator!=(const iterator& other) const { return field_.value.doc_ != other.field_.value.doc_ ||
+                                                              field_.value.pos_ != other.field_.value.pos_; }
+
+    private:
+        friend class ObjectRange;
+        friend class Value;
+        void load(const Document* doc, uint32_t token);
+        Field field_;
+    };
+
+    iterator begin() const { return begin_; }
+    iterator end() const { return iterator(); }
+
+private:
+    friend class Value;
+    iterator begin_;
+};
+
+class ArrayRange {
+public:
+    class iterator {
+    public:
+        const Value& operator*() const { return value_; }
+        const Value* operator->() const { return &value_; }
+        iterator& operator++();
+        bool operator!=(const iterator& other) const { return value_.doc_ != other.value_.doc_ ||
+                                                              value_.pos_ != other.value_.pos_; }
+
+    private:
+        friend class ArrayRange;
+        friend class Value;
+        void load(const Document* doc, uint32_t token, uint32_t pos);
+        Value value_;
+    };
+
+    iterator begin() const { return begin_; }
+    iterator end() const { return iterator(); }
+
+private:
+    friend class Value;
+    iterator begin_;
+};
+
+class Document {
+public:
+    Document() = default;
+
+    Error error() const { return error_; }
+    Value root() const;
+
+private:
+    friend class Parser;
+    friend class Value;
+    friend class ObjectRange;
+    friend class ArrayRange;
+
+    // Offset of the first non-whitespace character at or after `pos`.
+    uint32_t skip_whitespace(uint32_t pos) const;
+    char at(uint32_t token) const { return input_[index_[token]]; }
+
+    const char* input_ = nullptr;
+    uint32_t size_ = 0;
+    const uint32_t* index_ = nullptr;
+    uint32_t tokens_ = 0;
+    Error error_ = Error::Empty;
+};
+
+class Parser {
+public:
+    explicit Parser(Backend backend = best_backend());
+
+    Parser(const Parser&) = delete;
+    Parser& operator=(const Parser&) = delete;
+
+    Backend backend() const { return backend_; }
+
+    Document parse(std::string_view input);
+
+private:
+    Backend backend_;
+    std::unique_ptr<uint32_t[]> index_;
+    size_t capacity_;
+};
+
+// A parsed document that owns its text and parser, for results that
+// outlive the call that produced them: REST responses and the config file.
+// Allocates once per message, so it is not meant for the streaming path;
+// use a long-lived Parser there.
+class Message {
+public:
+    // Empty; error() is Error::Empty.
+    Message();
+    explicit Message(std::string text);
+    ~Message();
+
+    Message(Message&&) noexcept;
+    Message& operator=(Message&&) noexcept;
+
+    Error error() const;
+    bool ok() const { return error() == Error::None; }
+    Value root() const;
+    // The text as received, e.g. for printing.
+    const std::string& text() const;
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+} // namespace json
+} // namespace deribit
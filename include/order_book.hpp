@@ -0,0 +1,102 @@
+#pragma once
+
+#include "book_decoder.hpp"
+#include "instrumented_mutex.hpp"
+#include "ondemand_json.hpp"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace deribit {
+
+struct PriceLevel {
+    json::Decimal price;
+    json::Decimal amount;
+};
+
+// Price levels of one instrument, rebuilt from its decoded book
+// notifications. Bids are kept best (highest) first and asks best (lowest)
+// first, in sorted vectors: books are shallow and most changes land near
+// the top, so this beats a node-based map on both update and copy.
+class OrderBook {
+public:
+    // A snapshot replaces the book; a change is applied level by level.
+    void apply(const BookDelta& delta);
+    void clear();
+
+    // A change whose prev_change_id is not the book's change_id misses
+    // updates in between.
+    bool follows(const BookDelta& delta) const {
+        return delta.snapshot || delta.prev_change_id == change_id;
+    }
+
+    const std::vector<PriceLevel>& bids() const { return bids_; }
+    const std::vector<PriceLevel>& asks() const { return asks_; }
+    std::vector<PriceLevel>& bids() { return bids_; }
+    std::vector<PriceLevel>& asks() { return asks_; }
+
+    uint64_t change_id = 0;
+    uint64_t timestamp_ms = 0;
+    // False until the first snapshot, and again after a change that could
+    // not be applied on top of the book; invalid books are not served.
+    bool valid = false;
+    // Loaded from a checkpoint and not yet checked against a live update.
+    bool restored = false;
+
+private:
+    std::vector<PriceLevel> bids_;
+    std::vector<PriceLevel> asks_;
+};
+
+// The books of every instrument received from upstream. The upstream
+// thread applies each decoded delta; the io threads read a book when a
+// client subscribes and the checkpoint writer copies them all. One lock
+// covers the store, so applying a delta costs an uncontended lock.
+class BookStore {
+public:
+    // What applying a delta did to a book restored from a checkpoint.
+    enum class Update {
+        Applied,
+        // The first live update followed on from the checkpoint.
+        CheckpointConfirmed,
+        // A snapshot arrived first and replaced the checkpoint.
+        CheckpointReplaced,
+        // The first live update did not follow on; the book is dropped
+        // until the next snapshot.
+        CheckpointDiscarded,
+        // A live change did not follow on from the one before: the book
+        // has missed updates and is dropped until the next snapshot.
+        Gap,
+    };
+
+    BookStore();
+
+    // Books never move once added, so callers may keep the reference.
+    OrderBook& find_or_add(std::string_view instrument);
+    Update apply(OrderBook& book, const BookDelta& delta);
+
+    // Appends `instrument`'s book as a Deribit snapshot notification on
+    // `channel`. False, with nothing written, if there is no valid book.
+    bool write_snapshot(std::string_view instrument, std::string_view channel, std::string& out) const;
+
+    void restore(const std::string& instrument, OrderBook book);
+    // Drops restored books that no live update has confirmed.
+    size_t discard_restored();
+    // Valid books.
+    size_t size() const;
+    // How many of `instruments` have a valid book built from live updates
+    // rather than one restored and not yet confirmed.
+    size_t count_live(const std::vector<std::string>& instruments) const;
+
+    // Calls `visit(instrument, book)` for each valid book, under the lock.
+    void for_each(const std::function<void(const std::string&, const OrderBook&)>& visit) const;
+
+private:
+    mutable InstrumentedMutex mutex_;
+    std::map<std::string, OrderBook, std::less<>> books_;
+};
+
+} // namespace deribit
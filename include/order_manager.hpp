@@ -1,6 +1,9 @@
 #pragma once
 
 #include "config.hpp"
+#include "live_config.hpp"
+#include "ondemand_json.hpp"
+#include "timer_wheel.hpp"
 #include <string>
 #include <cpprest/http_client.h>
 
@@ -15,17 +18,32 @@ struct OrderParams {
 
 class OrderManager {
 public:
-    explicit OrderManager(Config& config);
+    // With `timers`, each request is abandoned after
+    // config.timers.order_timeout_ms.
+    explicit OrderManager(Config& config, TimerWheel* timers = nullptr);
+    // Takes order_timeout_ms from the live snapshot from then on.
+    void use_live_config(const LiveConfig* live) { live_ = live; }
     
     std::string place_buy_order(const OrderParams& params);
     std::string place_sell_order(const OrderParams& params);
     bool cancel_order(const std::string& order_id);
     bool modify_order(const std::string& order_id, double new_amount, double new_price);
-    web::json::value get_positions(const std::string& currency, const std::string& kind);
+    json::Message get_positions(const std::string& currency, const std::string& kind);
+    // Opens the REST connection ahead of the first order with a
+    // public/test request, so that order does not pay for the TCP and TLS
+    // handshakes.
+    bool warm_up();
+
+    static std::string buy_order_path(const OrderParams& params);
+    static std::string sell_order_path(const OrderParams& params);
 
 private:
     Config& config_;
+    const LiveConfig* live_ = nullptr;
     web::http::client::http_client client_;
+    TimerWheel* timers_;
+
+    web::http::http_response send(const web::http::http_request& request);
     
     web::http::http_request create_authenticated_request(
         web::http::method method,
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+namespace deribit {
+
+// Per-stage CPU counter sampling via perf_event_open(2).
+//
+// Each thread that profiles a stage lazily opens two counter groups for
+// itself: a hardware group (cycles, instructions, cache misses, branch
+// misses) and a software group (task clock, context switches, page faults).
+// When the PMU is not accessible, e.g. inside most VMs or with a strict
+// perf_event_paranoid, only the software group is used and IPC/miss rates
+// are reported as unavailable.
+//
+// Sampling is decided once per message on the thread that handles it:
+// begin_message() marks the message as sampled (one in `sample_every`), and
+// every PerfStageScope on that thread then reads the counters at entry and
+// exit. Unsampled messages cost one thread-local flag check per stage.
+enum PerfCounterId {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_TASK_CLOCK_NS,
+    PERF_CONTEXT_SWITCHES,
+    PERF_PAGE_FAULTS,
+    PERF_COUNTER_COUNT
+};
+
+struct PerfSample {
+    uint64_t values[PERF_COUNTER_COUNT] = {};
+    uint64_t wall_ns = 0;
+    bool hardware = false;
+};
+
+class PerfCounterGroup {
+public:
+    PerfCounterGroup();
+    ~PerfCounterGroup();
+
+    PerfCounterGroup(const PerfCounterGroup&) = delete;
+    PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+    bool hardware_available() const { return hardware_fds_[0] >= 0; }
+    bool software_available() const { return software_fds_[0] >= 0; }
+    void read(PerfSample& sample) const;
+
+private:
+    int hardware_fds_[4];
+    int software_fds_[3];
+};
+
+class PerfStageProfiler {
+public:
+    static PerfStageProfiler& instance();
+
+    void configure(bool enabled, uint32_t sample_every);
+    bool enabled() const { return enabled_; }
+
+    // Called at the start of each message; returns whether it is sampled.
+    bool begin_message();
+    void end_message();
+
+    void record(const char* stage, const PerfSample& start, const PerfSample& end);
+    void print_report(std::ostream& out);
+
+private:
+    PerfStageProfiler() = default;
+
+    struct StageTotals {
+        uint64_t samples = 0;
+        uint64_t hardware_samples = 0;
+        uint64_t wall_ns = 0;
+        uint64_t values[PERF_COUNTER_COUNT] = {};
+        int samples_metric = -1;
+        int latency_metric = -1;
+        int value_metrics[PERF_COUNTER_COUNT] = {};
+    };
+
+    bool enabled_ = false;
+    uint32_t sample_every_ = 100;
+    std::mutex mutex_;
+    // Transparent, so looking up a sampled stage does not allocate.
+    std::map<std::string, StageTotals, std::less<>> stages_;
+};
+
+class PerfStageScope {
+public:
+    explicit PerfStageScope(const char* stage);
+    ~PerfStageScope();
+
+    PerfStageScope(const PerfStageScope&) = delete;
+    PerfStageScope& operator=(const PerfStageScope&) = delete;
+
+private:
+    const char* stage_;
+    const PerfCounterGroup* group_;
+    PerfSample start_;
+};
+
+} // namespace deribit
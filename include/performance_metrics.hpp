@@ -1,6 +1,8 @@
 #pragma once
 
+#include "instrumented_mutex.hpp"
 #include <chrono>
+#include <limits>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -30,16 +32,17 @@ public:
     void print_all_stats();
 
 private:
-    PerformanceMetrics() = default;
+    PerformanceMetrics() : mutex_("performance_metrics") {}
     ~PerformanceMetrics() = default;
     
     struct OperationTiming {
         std::chrono::high_resolution_clock::time_point start_time;
         std::vector<double> measurements_ms;
+        int shm_histogram = -1;
     };
     
     std::unordered_map<std::string, OperationTiming> operations_;
-    std::mutex mutex_;
+    InstrumentedMutex mutex_;
 };
 
 #define START_TIMING(id) deribit::PerformanceMetrics::instance().start_measurement(id)
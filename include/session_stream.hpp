@@ -0,0 +1,239 @@
+#pragma once
+
+#include "async_io.hpp"
+#include "memory_pool.hpp"
+#include "uring_transport.hpp"
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/beast/core/bind_handler.hpp>
+#include <boost/beast/core/role.hpp>
+#include <boost/beast/websocket/teardown.hpp>
+#include <boost/system/error_code.hpp>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace deribit {
+
+// The stream beneath a session's websocket. Reads go to the socket; writes
+// go through the io_uring transport when there is one and the socket got a
+// slot, else straight to the socket.
+//
+// Between cork() and flush() writes are not sent but collected, in order,
+// and each completes at once. flush() then sends all of them with one
+// scatter-gather write. The websocket stream still frames every message
+// and may add control frames of its own (pongs, the close frame) while the
+// stream is corked; those are collected with the rest, so nothing can
+// interleave with a batch on the socket.
+//
+// Collected buffers of up to COPY_LIMIT bytes are copied, and adjacent
+// copies share one iovec; that covers frame headers, control frames and
+// small messages. Larger buffers are referenced, so a corked message's
+// payload must stay alive until flush() is done.
+class SessionStream {
+public:
+    using executor_type = SessionExecutor;
+    using next_layer_type = SessionSocket;
+
+    static constexpr size_t COPY_LIMIT = 512;
+
+    explicit SessionStream(SessionSocket socket, UringTransport* transport = nullptr);
+    ~SessionStream();
+
+    SessionStream(const SessionStream&) = delete;
+    SessionStream& operator=(const SessionStream&) = delete;
+
+    executor_type get_executor() noexcept { return socket_.get_executor(); }
+    next_layer_type& next_layer() noexcept { return socket_; }
+    const next_layer_type& next_layer() const noexcept { return socket_; }
+
+    template <typename MutableBufferSequence, typename ReadHandler>
+    auto async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler) {
+        return socket_.async_read_some(buffers, std::forward<ReadHandler>(handler));
+    }
+
+    template <typename ConstBufferSequence, typename WriteHandler>
+    auto async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler) {
+        return boost::asio::async_initiate<WriteHandler, void(boost::system::error_code, std::size_t)>(
+            [this](auto&& handler, const ConstBufferSequence& buffers) {
+                if (corked_) {
+                    collect(std::forward<decltype(handler)>(handler), buffers);
+                } else {
+                    start_write(std::forward<decltype(handler)>(handler), buffers);
+                }
+            },
+            handler, buffers);
+    }
+
+    // Only on the session's strand, with no write outstanding.
+    void cork() { corked_ = true; }
+
+    // Sends what was collected since cork(), including writes made while
+    // the flush is under way, then uncorks. If the socket fails, `ec` is
+    // set and the rest is dropped.
+    boost::asio::awaitable<void, SessionExecutor> flush(HandlerMemory& memory, boost::system::error_code& ec);
+
+private:
+    // What a retried send writes; copied out of the operation before it is
+    // freed.
+    struct BufferList {
+        std::array<boost::asio::const_buffer, UringTransport::Operation::MAX_BUFFERS> buffers;
+        size_t count = 0;
+
+        const boost::asio::const_buffer* begin() const { return buffers.data(); }
+        const boost::asio::const_buffer* end() const { return buffers.data() + count; }
+    };
+
+    template <typename Handler>
+    class WriteOperation final : public UringTransport::Operation {
+    public:
+        WriteOperation(SessionStream& stream, Handler handler)
+            : stream_(stream), handler_(std::move(handler)) {}
+
+        void complete(int result) override {
+            SessionStream& stream = stream_;
+            Handler handler(std::move(handler_));
+            BufferList retry;
+            if (result == -EAGAIN) {
+                for (size_t i = 0; i < message_.msg_iovlen; ++i) {
+                    retry.buffers[i] = boost::asio::const_buffer(iov_[i].iov_base, iov_[i].iov_len);
+                }
+                retry.count = message_.msg_iovlen;
+            }
+            // Freed before the upcall, so the next write can reuse the
+            // memory.
+            auto allocator = allocator_for<WriteOperation>(handler);
+            this->~WriteOperation();
+            allocator.deallocate(this, 1);
+
+            if (result == -EAGAIN) {
+                session_write_stats().ring_retries.fetch_add(1, std::memory_order_relaxed);
+                // The socket is only touched on the session's strand.
+                boost::asio::dispatch(
+                    stream.get_executor(),
+                    [&stream, retry, handler = std::move(handler)]() mutable {
+                        stream.socket_.async_write_some(retry, std::move(handler));
+                    });
+                return;
+            }
+
+            boost::system::error_code ec;
+            std::size_t bytes = 0;
+            if (result < 0) {
+                ec.assign(-result, boost::system::system_category());
+            } else {
+                bytes = static_cast<std::size_t>(result);
+            }
+            auto executor = boost::asio::get_associated_executor(handler, stream.get_executor());
+            boost::asio::dispatch(executor, boost::beast::bind_front_handler(std::move(handler), ec, bytes));
+        }
+
+    private:
+        SessionStream& stream_;
+        Handler handler_;
+    };
+
+    // Writes collected while corked. A segment with `data` set references
+    // the caller's buffer; otherwise it is `size` bytes of `bytes` at
+    // `offset`.
+    struct Collected {
+        struct Segment {
+            const void* data;
+            size_t offset;
+            size_t size;
+        };
+        std::string bytes;
+        std::vector<Segment> segments;
+    };
+
+    // Writes straight to the transport or the socket, ignoring the cork;
+    // what flush() sends through.
+    struct Unbuffered {
+        using executor_type = SessionExecutor;
+        SessionStream& stream;
+
+        executor_type get_executor() noexcept { return stream.get_executor(); }
+
+        template <typename ConstBufferSequence, typename WriteHandler>
+        auto async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler) {
+            return boost::asio::async_initiate<WriteHandler, void(boost::system::error_code, std::size_t)>(
+                [this](auto&& handler, const ConstBufferSequence& buffers) {
+                    stream.start_write(std::forward<decltype(handler)>(handler), buffers);
+                },
+                handler, buffers);
+        }
+    };
+
+    template <typename Op, typename Handler>
+    static auto allocator_for(const Handler& handler) {
+        auto allocator = boost::asio::get_associated_allocator(handler);
+        return typename std::allocator_traits<decltype(allocator)>::template rebind_alloc<Op>(allocator);
+    }
+
+    template <typename Handler, typename ConstBufferSequence>
+    void collect(Handler&& handler, const ConstBufferSequence& buffers) {
+        std::size_t bytes = 0;
+        for (auto it = boost::asio::buffer_sequence_begin(buffers); it != boost::asio::buffer_sequence_end(buffers);
+             ++it) {
+            boost::asio::const_buffer buffer(*it);
+            add_segment(buffer.data(), buffer.size());
+            bytes += buffer.size();
+        }
+        auto executor = boost::asio::get_associated_executor(handler, get_executor());
+        boost::asio::post(executor, boost::beast::bind_front_handler(std::forward<Handler>(handler),
+                                                                     boost::system::error_code(), bytes));
+    }
+
+    void add_segment(const void* data, size_t size);
+
+    template <typename Handler, typename ConstBufferSequence>
+    void start_write(Handler&& handler, const ConstBufferSequence& buffers) {
+        SessionWriteStats& stats = session_write_stats();
+        stats.writes.fetch_add(1, std::memory_order_relaxed);
+        if (slot_ < 0) {
+            stats.syscalls.fetch_add(1, std::memory_order_relaxed);
+            socket_.async_write_some(buffers, std::forward<Handler>(handler));
+            return;
+        }
+
+        using Op = WriteOperation<std::decay_t<Handler>>;
+        auto allocator = allocator_for<Op>(handler);
+        Op* op = allocator.allocate(1);
+        new (op) Op(*this, std::forward<Handler>(handler));
+        op->set_buffers(buffers);
+        transport_->submit(op, slot_, socket_.get_executor().get_inner_executor());
+    }
+
+    SessionSocket socket_;
+    UringTransport* transport_;
+    // Fixed-file slot of the socket, or -1 for direct writes. While it is
+    // registered the ring holds a reference to the socket, so the
+    // connection is only released once the session is destroyed.
+    int slot_ = -1;
+
+    bool corked_ = false;
+    // Writes collect in collected_[collecting_] while the other set is
+    // being flushed.
+    std::array<Collected, 2> collected_;
+    int collecting_ = 0;
+    std::vector<boost::asio::const_buffer> flush_buffers_;
+};
+
+void teardown(boost::beast::role_type role, SessionStream& stream, boost::system::error_code& ec);
+
+template <typename TeardownHandler>
+void async_teardown(boost::beast::role_type role, SessionStream& stream, TeardownHandler&& handler) {
+    using boost::beast::websocket::async_teardown;
+    async_teardown(role, stream.next_layer(), std::forward<TeardownHandler>(handler));
+}
+
+} // namespace deribit
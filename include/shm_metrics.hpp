@@ -0,0 +1,155 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace deribit {
+
+// Shared-memory metrics segment, layout version 1.
+//
+// The trading process creates a POSIX shared-memory object (shm_open) and
+// writes counters and latency histograms into it with plain atomic stores.
+// External tools map the same object read-only; reading never makes a
+// syscall or takes a lock in the trading process.
+//
+//   SegmentHeader                      64 bytes
+//   CounterSlot[MAX_COUNTERS]          64 bytes each
+//   HistogramSlot[MAX_HISTOGRAMS]      64-byte aligned
+//
+// Counters are monotonic and updated with relaxed atomic adds, so a reader
+// can load them at any time.
+//
+// Histograms are guarded by a per-slot seqlock: a writer moves `sequence`
+// from even to odd before touching the slot and back to even afterwards.
+// A reader copies the slot and retries if it saw an odd value or if the
+// value changed during the copy; a slot that stays odd (its writer died
+// mid-update) is reported as stale after a short timeout. Bucket i counts samples in
+// [2^i, 2^(i+1)) nanoseconds; bucket 0 also counts zero-length samples.
+//
+// Slots are published by writing the name and then incrementing
+// counter_count / histogram_count with release ordering, so readers only
+// scan [0, count). `magic` is written last when the segment is initialised;
+// a reader must ignore the segment until it matches SEGMENT_MAGIC.
+namespace shm {
+
+constexpr uint32_t SEGMENT_MAGIC = 0x544d5244; // "DRMT"
+constexpr uint32_t LAYOUT_VERSION = 1;
+constexpr size_t MAX_COUNTERS = 128;
+constexpr size_t MAX_HISTOGRAMS = 64;
+constexpr size_t NAME_LENGTH = 48;
+constexpr size_t HISTOGRAM_BUCKETS = 64;
+constexpr const char* DEFAULT_SEGMENT_NAME = "/deribit_metrics";
+
+struct alignas(64) SegmentHeader {
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    uint64_t segment_size;
+    int64_t writer_pid;
+    uint64_t start_time_ns; // CLOCK_REALTIME when the segment was created
+    std::atomic<uint32_t> counter_count;
+    std::atomic<uint32_t> histogram_count;
+};
+
+struct alignas(64) CounterSlot {
+    char name[NAME_LENGTH];
+    std::atomic<uint64_t> value;
+};
+
+struct alignas(64) HistogramSlot {
+    std::atomic<uint32_t> sequence;
+    char name[NAME_LENGTH];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum_ns;
+    std::atomic<uint64_t> min_ns;
+    std::atomic<uint64_t> max_ns;
+    std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];
+};
+
+struct Segment {
+    SegmentHeader header;
+    CounterSlot counters[MAX_COUNTERS];
+    HistogramSlot histograms[MAX_HISTOGRAMS];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared-memory atomics must be lock-free");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory atomics must be lock-free");
+
+struct CounterSnapshot {
+    std::string name;
+    uint64_t value = 0;
+};
+
+struct HistogramSnapshot {
+    std::string name;
+    uint64_t count = 0;
+    uint64_t sum_ns = 0;
+    uint64_t min_ns = 0;
+    uint64_t max_ns = 0;
+    uint64_t buckets[HISTOGRAM_BUCKETS] = {};
+    // The slot was left mid-update, so the values may be off by the one
+    // sample that was being recorded.
+    bool stale = false;
+
+    // Upper bound of the bucket containing the given percentile (0-100).
+    uint64_t percentile_ns(double percentile) const;
+};
+
+size_t bucket_for(uint64_t nanoseconds);
+
+} // namespace shm
+
+class ShmMetrics {
+public:
+    static ShmMetrics& instance();
+
+    bool open(const std::string& name);
+    void close();
+    bool is_open() const { return segment_.load(std::memory_order_acquire) != nullptr; }
+
+    // Registration takes a lock and should be done once per name; the ids
+    // stay valid whether or not the segment is open.
+    int counter(const std::string& name);
+    int histogram(const std::string& name);
+
+    void add(int counter_id, uint64_t delta = 1);
+    void record(int histogram_id, uint64_t nanoseconds);
+
+private:
+    ShmMetrics() = default;
+    ~ShmMetrics();
+
+    void publish_counter(int id);
+    void publish_histogram(int id);
+
+    std::atomic<shm::Segment*> segment_{nullptr};
+    std::string name_;
+    std::mutex registry_mutex_;
+    std::vector<std::string> counter_names_;
+    std::vector<std::string> histogram_names_;
+    std::unordered_map<std::string, int> counter_ids_;
+    std::unordered_map<std::string, int> histogram_ids_;
+};
+
+class ShmMetricsReader {
+public:
+    ShmMetricsReader() = default;
+    ~ShmMetricsReader();
+
+    bool open(const std::string& name);
+    void close();
+
+    const shm::SegmentHeader* header() const;
+    std::vector<shm::CounterSnapshot> read_counters() const;
+    std::vector<shm::HistogramSnapshot> read_histograms() const;
+
+private:
+    const shm::Segment* segment_ = nullptr;
+    size_t mapped_size_ = 0;
+};
+
+} // namespace deribit
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace deribit {
+
+// Runs the startup phases of the trading system concurrently.
+//
+// Each phase is a blocking function that returns true on success. A phase
+// starts on its own thread as soon as every phase it depends on has
+// succeeded, so independent network round trips (authentication, the
+// upstream handshake, REST connection warm-up, the instrument catalog)
+// overlap instead of running one after another. A phase whose dependency
+// failed is skipped.
+//
+// run() returns once every phase has finished and logs when each one
+// started and how long it took; the durations are also exported as
+// startup.<phase> histograms through ShmMetrics.
+class StartupSequence {
+public:
+    enum class Status { Pending, Succeeded, Failed, Skipped };
+
+    struct Phase {
+        std::string name;
+        std::function<bool()> body;
+        std::vector<std::string> after;
+        // run() fails if a required phase does not succeed; an optional
+        // one is only logged.
+        bool required;
+        Status status = Status::Pending;
+        std::chrono::nanoseconds started{0};
+        std::chrono::nanoseconds duration{0};
+        std::string error;
+    };
+
+    // Phases named in `after` must have been added already.
+    void add(const std::string& name,
+             std::function<bool()> body,
+             std::vector<std::string> after = {},
+             bool required = true);
+
+    // False if a required phase failed or was skipped.
+    bool run();
+
+    const std::vector<Phase>& phases() const { return phases_; }
+    std::chrono::nanoseconds elapsed() const { return elapsed_; }
+
+    static const char* status_name(Status status);
+
+private:
+    std::vector<Phase> phases_;
+    std::chrono::nanoseconds elapsed_{0};
+};
+
+} // namespace deribit
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "config.hpp"
+#include <cstddef>
+#include <pthread.h>
+
+namespace deribit {
+
+// Applies a thread role to the calling thread: its name, CPU affinity and
+// scheduling policy. Call it first thing in the thread's body.
+//
+// Each attribute is applied on its own. One that cannot be set is logged
+// and left as it was, e.g. a CPU that does not exist or a real-time policy
+// without CAP_SYS_NICE. Returns false if anything was skipped.
+bool apply_thread_role(const ThreadRole& role);
+
+// For roles with several threads: thread `index` is named "<name>-<index>"
+// and pinned to one CPU from the role's list.
+bool apply_thread_role(const ThreadRole& role, size_t index);
+
+// The same for a thread that is already running, e.g. when a config
+// reload changes its role.
+bool apply_thread_role(pthread_t thread, const ThreadRole& role);
+bool apply_thread_role(pthread_t thread, const ThreadRole& role, size_t index);
+
+// The role names that have threads of their own, for validating config.
+bool thread_role_known(const std::string& role_name);
+
+} // namespace deribit
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "instrumented_mutex.hpp"
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace deribit {
+
+// Hierarchical timing wheel for the many coarse timers of the server:
+// session idle checks, upstream request deadlines, REST order deadlines.
+//
+// One steady_timer on the io_context ticks the wheel every `tick`; each
+// scheduled timer is a node on an intrusive list in one of
+// LEVELS * SLOTS buckets, so schedule() and cancel() are O(1) under one
+// lock, with no heap operation and no allocation once the node pool has
+// grown to the number of timers pending at once. Level 0 buckets hold the
+// next SLOTS ticks; each higher level covers SLOTS times the span of the
+// one below and is cascaded down as the wheel turns. Delays beyond the top
+// level are clamped to it.
+//
+// A timer fires on the first tick at or after its deadline, i.e. up to one
+// tick late, plus loop lag. Callbacks run on an io_context thread outside
+// any strand, with no lock held; they may schedule or cancel timers, and
+// code that owns strand state posts to its strand. A callback is stored in
+// the node itself and must fit CALLBACK_BYTES, e.g. a weak_ptr and a few
+// words.
+class TimerWheel {
+public:
+    using clock = std::chrono::steady_clock;
+    // Generation in the high half, node index in the low half; 0 is never
+    // issued, so it can stand for "no timer".
+    using TimerId = uint64_t;
+
+    static constexpr size_t LEVELS = 4;
+    static constexpr size_t SLOT_BITS = 8;
+    static constexpr size_t SLOTS = size_t(1) << SLOT_BITS;
+    static constexpr size_t CALLBACK_BYTES = 48;
+
+    TimerWheel(boost::asio::io_context& ioc, std::chrono::microseconds tick, size_t initial_capacity = 1024);
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Starts and stops the tick. Timers pending at stop() stay scheduled
+    // and are released, unfired, with the wheel.
+    void start();
+    void stop();
+
+    // Runs `callback` once, `delay` from now. Thread-safe.
+    template <typename Callback>
+    TimerId schedule(std::chrono::nanoseconds delay, Callback&& callback) {
+        using Stored = std::decay_t<Callback>;
+        static_assert(sizeof(Stored) <= CALLBACK_BYTES, "timer callback does not fit TimerWheel::CALLBACK_BYTES");
+        static_assert(alignof(Stored) <= alignof(std::max_align_t), "timer callback is over-aligned");
+
+        std::lock_guard<InstrumentedMutex> lock(mutex_);
+        uint32_t index = acquire_node();
+        Node& n = node(index);
+        new (n.callback) Stored(std::forward<Callback>(callback));
+        n.invoke = [](void* storage) { (*static_cast<Stored*>(storage))(); };
+        n.destroy = [](void* storage) { static_cast<Stored*>(storage)->~Stored(); };
+        n.expiry = expiry_for(delay);
+        insert(index);
+        ++pending_;
+        return make_id(n.generation, index);
+    }
+
+    // Unschedules a timer. Returns false if it has already fired, is
+    // running, or was cancelled. Thread-safe.
+    bool cancel(TimerId id);
+
+    // Runs every timer due at `now`. The tick calls it with the current
+    // time; it is public so the wheel can be driven without an io_context.
+    void advance_to(clock::time_point now);
+
+    size_t pending() const { return pending_.load(std::memory_order_relaxed); }
+    std::chrono::microseconds tick() const { return tick_; }
+
+private:
+    static constexpr uint32_t NIL = UINT32_MAX;
+    static constexpr size_t NODES_PER_CHUNK = 1024;
+
+    struct Node {
+        alignas(std::max_align_t) unsigned char callback[CALLBACK_BYTES];
+        void (*invoke)(void*);
+        void (*destroy)(void*);
+        uint64_t expiry;
+        uint32_t prev;
+        uint32_t next;
+        // Bucket the node is linked into, or NIL when it is not.
+        uint32_t bucket;
+        uint32_t generation;
+    };
+
+    static TimerId make_id(uint32_t generation, uint32_t index) {
+        return (static_cast<uint64_t>(generation) << 32) | index;
+    }
+
+    Node& node(uint32_t index) { return chunks_[index / NODES_PER_CHUNK][index % NODES_PER_CHUNK]; }
+
+    uint64_t expiry_for(std::chrono::nanoseconds delay) const;
+    void grow();
+    uint32_t acquire_node();
+    void release_node(uint32_t index);
+    void insert(uint32_t index);
+    void unlink(uint32_t index);
+    void cascade(size_t level, size_t slot);
+    void schedule_tick();
+
+    boost::asio::io_context& ioc_;
+    boost::asio::steady_timer timer_;
+    std::chrono::microseconds tick_;
+    clock::time_point epoch_;
+    std::atomic<bool> running_;
+
+    InstrumentedMutex mutex_;
+    // Nodes live in fixed chunks, so a node stays put while a callback
+    // runs outside the lock and more chunks are added.
+    std::vector<std::unique_ptr<Node[]>> chunks_;
+    uint32_t free_ = NIL;
+    std::array<uint32_t, LEVELS * SLOTS> buckets_;
+    // The next tick to run; deadlines are counted from it.
+    uint64_t now_ = 0;
+    std::atomic<size_t> pending_;
+    // Nodes due in the current advance_to(), run once the lock is dropped.
+    std::vector<std::pair<uint32_t, Node*>> expired_;
+    // Serialises advance_to(), which expired_ belongs to.
+    std::mutex advance_mutex_;
+};
+
+} // namespace deribit
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace deribit {
+
+// Sampled per-message tracing.
+//
+// One in every `sample_every` upstream messages or orders is given a
+// non-zero trace id, which is passed along the pipeline. Each stage records
+// a span (name, start, duration, thread) for that id into a fixed-size ring
+// buffer. Recording is lock-free: writers claim a slot with one fetch_add and
+// publish it through a per-slot sequence number, so old events are
+// overwritten once the buffer wraps. A trace id of 0 means "not sampled" and
+// costs a single branch.
+//
+// dump_chrome_trace() writes the buffer as Chrome trace-event JSON, which can
+// be opened in Perfetto or chrome://tracing. Spans sharing a trace id are
+// linked with flow events so a message can be followed across threads.
+class Tracer {
+public:
+    static Tracer& instance();
+
+    void configure(bool enabled, uint32_t sample_every, size_t capacity);
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // Returns a new trace id for sampled calls and 0 otherwise.
+    uint64_t sample();
+    // Low-rate paths such as order placement are traced whenever tracing is on.
+    uint64_t new_trace();
+
+    void record(uint64_t trace_id, const char* name, uint64_t start_ns, uint64_t end_ns);
+    bool dump_chrome_trace(const std::string& path);
+
+    static uint64_t now_ns();
+
+private:
+    Tracer() = default;
+
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<uint64_t> trace_id{0};
+        std::atomic<const char*> name{nullptr};
+        std::atomic<uint64_t> start_ns{0};
+        std::atomic<uint64_t> duration_ns{0};
+        std::atomic<uint32_t> thread_id{0};
+    };
+
+    std::atomic<bool> enabled_{false};
+    uint32_t sample_every_ = 1000;
+    std::atomic<uint64_t> sample_counter_{0};
+    std::atomic<uint64_t> next_trace_id_{1};
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_ = 0;
+    std::atomic<uint64_t> next_slot_{0};
+};
+
+// Records a span for the enclosing scope when trace_id is non-zero.
+class TraceSpan {
+public:
+    TraceSpan(uint64_t trace_id, const char* name)
+        : trace_id_(trace_id)
+        , name_(name)
+        , start_ns_(trace_id ? Tracer::now_ns() : 0) {}
+
+    ~TraceSpan() {
+        if (trace_id_) {
+            Tracer::instance().record(trace_id_, name_, start_ns_, Tracer::now_ns());
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    uint64_t trace_id_;
+    const char* name_;
+    uint64_t start_ns_;
+};
+
+} // namespace deribit
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "memory_pool.hpp"
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/post.hpp>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace deribit {
+
+// Session writes through io_uring.
+//
+// Without it, every message to every session is its own sendmsg() call, so
+// a broadcast to N subscribers costs N syscalls made one at a time by the
+// io threads. With a transport, session writes queue up here and a flush
+// posted to the io_context submits all of them with one io_uring_enter().
+// A broadcast reaches its sessions' strands within microseconds, so the
+// flush usually finds most of a fan-out queued.
+//
+// Sends are issued with MSG_DONTWAIT and complete during the submit. One
+// that would block, because the client's socket buffer is full, is retried
+// with the socket's own async_write_some, which waits on epoll as before.
+// Sockets are registered as fixed files, so a send still queued when its
+// session goes away cannot reach a reused descriptor.
+//
+// Boost.Asio 1.74 has no io_uring backend and liburing is not a
+// dependency; the ring is driven with the raw system calls. If the kernel
+// does not provide io_uring, or it is disabled, available() is false and
+// sessions write directly. SessionStream (session_stream.hpp) is the
+// client side.
+
+// Process-wide counts for the session write path, to compare the two
+// backends. `syscalls` counts the sendmsg() calls made for direct writes
+// (one per write, not counting epoll retries) and the io_uring_enter()
+// calls made by flushes.
+struct SessionWriteStats {
+    std::atomic<uint64_t> writes{0};
+    std::atomic<uint64_t> syscalls{0};
+    std::atomic<uint64_t> ring_sends{0};
+    std::atomic<uint64_t> ring_retries{0};
+};
+
+SessionWriteStats& session_write_stats();
+
+class UringTransport {
+public:
+    // A queued send. The transport owns it from submit() until it calls
+    // complete(), which must free it.
+    class Operation {
+    public:
+        static constexpr size_t MAX_BUFFERS = 16;
+
+        // Takes up to MAX_BUFFERS buffers; a write_some may send less than
+        // it was given.
+        template <typename ConstBufferSequence>
+        void set_buffers(const ConstBufferSequence& buffers) {
+            size_t count = 0;
+            for (auto it = boost::asio::buffer_sequence_begin(buffers);
+                 it != boost::asio::buffer_sequence_end(buffers) && count < MAX_BUFFERS; ++it) {
+                boost::asio::const_buffer buffer(*it);
+                iov_[count].iov_base = const_cast<void*>(buffer.data());
+                iov_[count].iov_len = buffer.size();
+                ++count;
+            }
+            message_ = {};
+            message_.msg_iov = iov_.data();
+            message_.msg_iovlen = count;
+        }
+
+        // `result` is the byte count or -errno.
+        virtual void complete(int result) = 0;
+
+    protected:
+        ~Operation() = default;
+
+        std::array<iovec, MAX_BUFFERS> iov_;
+        msghdr message_{};
+
+    private:
+        friend class UringTransport;
+        int slot_ = -1;
+        int result_ = 0;
+    };
+
+    // `entries` bounds the sends submitted per io_uring_enter(), `sessions`
+    // the number of registered sockets.
+    UringTransport(uint32_t entries, uint32_t sessions);
+    ~UringTransport();
+
+    UringTransport(const UringTransport&) = delete;
+    UringTransport& operator=(const UringTransport&) = delete;
+
+    bool available() const { return ring_ != nullptr; }
+
+    // Returns the socket's slot, or -1 if the transport is unavailable or
+    // every slot is taken; the caller then writes directly.
+    int register_socket(int fd);
+    void unregister_socket(int slot);
+
+    // Queues `op` for the socket in `slot` and, unless one is pending
+    // already, posts a flush to `executor`.
+    template <typename Executor>
+    void submit(Operation* op, int slot, const Executor& executor) {
+        op->slot_ = slot;
+        if (enqueue(op)) {
+            boost::asio::post(executor, [this] { flush(); });
+        }
+    }
+
+    // Sends everything queued and completes it.
+    void flush();
+
+    // Completes everything still queued with operation_aborted. For
+    // shutdown, once the io threads have stopped.
+    void cancel();
+
+private:
+    struct Ring;
+
+    // Returns true if the caller has to post a flush.
+    bool enqueue(Operation* op);
+    void send_batch();
+
+    std::unique_ptr<Ring> ring_;
+
+    SpinLock queue_lock_;
+    std::vector<Operation*> queued_;
+    bool flush_posted_ = false;
+
+    // Held while a flush drives the ring. batch_ is only used under it.
+    std::mutex ring_mutex_;
+    std::vector<Operation*> batch_;
+
+    std::mutex slots_mutex_;
+    std::vector<int> free_slots_;
+};
+
+} // namespace deribit
@@ -1,13 +1,27 @@
 #pragma once
 
+#include "async_io.hpp"
+#include "book_decoder.hpp"
 #include "config.hpp"
+#include "loop_monitor.hpp"
+#include "instrumented_mutex.hpp"
+#include "live_config.hpp"
+#include "json_writer.hpp"
+#include "memory_pool.hpp"
+#include "ondemand_json.hpp"
+#include "order_book.hpp"
+#include "session_stream.hpp"
+#include "timer_wheel.hpp"
+#include "uring_transport.hpp"
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
+#include <boost/beast/ssl.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ssl.hpp>
-#include <json/json.h>
+#include <chrono>
+#include <vector>
 #include <map>
 #include <set>
 #include <memory>
@@ -19,64 +33,294 @@ namespace deribit {
 
 class WebSocketSession;
 
+// Per-session settings, taken from config.server when the session is
+// accepted.
+struct SessionOptions {
+    UringTransport* transport = nullptr;
+    // Most queued messages sent with one write; 1 sends each on its own.
+    uint32_t write_batch_max = 64;
+    // How long a queued message may wait for others to share its write.
+    // 0 writes as soon as the previous write is done.
+    std::chrono::microseconds write_batch_delay{0};
+    // Queued bytes past which the client is disconnected; 0 is unlimited.
+    size_t max_queued_bytes = 0;
+    // Idle checks run on this wheel when both are set; otherwise Beast's
+    // own idle timeout applies.
+    TimerWheel* timers = nullptr;
+    std::chrono::milliseconds idle_timeout{0};
+};
+
 class WebsocketServer {
 public:
     explicit WebsocketServer(Config& config);
     ~WebsocketServer();
 
-    void run(uint16_t port);
+    // Before run(). Sessions accepted from then on, and upstream request
+    // deadlines, take their settings from the live snapshot.
+    void use_live_config(const LiveConfig* live) { live_ = live; }
+    // Applies a reloaded config: subscribes upstream to instruments added
+    // to supported_instruments and re-applies changed thread roles. Called
+    // by the config watcher between run() and stop().
+    void reconfigure(const Config& previous, const Config& next);
+
+    // Listens and starts the io threads. Unless `connect_upstream` is
+    // false, it first connects to Deribit, which otherwise is left to a
+    // later connect_upstream() call; client subscriptions made in between
+    // are queued and sent once it is connected.
+    void run(uint16_t port, bool connect_upstream = true);
+    // Blocks for the DNS, TCP, TLS and websocket handshakes. Returns false
+    // if the upstream could not be reached.
+    bool connect_upstream();
+    // For a graceful shutdown: stops taking clients and upstream updates,
+    // then waits until `deadline` at most for every session to write what
+    // it has queued. False if some did not. stop() still has to be called.
+    bool drain(std::chrono::steady_clock::time_point deadline);
     void stop();
 
+    // Subscribes upstream to `symbol`'s book, as a client subscription
+    // would. False if there is no upstream connection to send it on.
+    bool subscribe_to_orderbook(const std::string& symbol);
+    // Subscribes upstream to config.trading.supported_instruments ahead of
+    // any client, so the first subscriber to each gets a book as later ones
+    // do. Patterns are matched against the instrument catalog, and matched
+    // again each time set_instrument_catalog() replaces it. Like client
+    // subscriptions, they are queued until the upstream is connected.
+    // Returns the instruments subscribed.
+    std::vector<std::string> presubscribe();
+    // Waits until `deadline` at most for each of `instruments` to have a
+    // book built from live updates. Returns how many do.
+    size_t wait_for_books(const std::vector<std::string>& instruments,
+                          std::chrono::steady_clock::time_point deadline);
+
+    struct Status {
+        size_t sessions = 0;
+        // Summed over sessions.
+        size_t client_subscriptions = 0;
+        bool upstream_connected = false;
+        size_t upstream_channels = 0;
+        size_t pending_requests = 0;
+        size_t books = 0;
+    };
+    Status status();
+
+    // Ticks on the server's io_context; shared with anything else that
+    // needs coarse timers.
+    TimerWheel& timers() { return *timers_; }
+
+    // Saved with the checkpoint; after a restart, the catalog it restored.
+    void set_instrument_catalog(std::vector<std::string> names);
+    std::vector<std::string> instrument_catalog() const;
+
 private:
+    friend class WebsocketServerBenchmark;
+
+    // A public/subscribe carries at most this many channels, so a long
+    // instrument list neither builds one huge request nor re-sends every
+    // channel when one request times out.
+    static constexpr size_t MAX_SUBSCRIBE_CHANNELS = 100;
+
+    const Config& current_config() const { return live_ ? live_->get() : config_; }
+    // supported_instruments with its patterns expanded.
+    std::vector<std::string> expand_instruments(const std::vector<std::string>& patterns) const;
+    SessionOptions session_options() const;
     void do_accept();
-    void on_accept(boost::system::error_code ec, boost::asio::ip::tcp::socket socket);
+    void on_accept(boost::system::error_code ec, SessionSocket socket);
     void handle_client_message(std::shared_ptr<WebSocketSession> session, const std::string& message);
-    void subscribe_to_orderbook(const std::string& symbol);
-    void handle_orderbook_update(const std::string& symbol, const std::string& data);
+    void on_session_closed(const std::shared_ptr<WebSocketSession>& session);
+    void handle_orderbook_update(std::string_view symbol, const std::string& data, uint64_t trace_id);
     void init_deribit_connection();
-    void on_deribit_message(const std::string& message);
-    void broadcast_to_subscribers(const std::string& symbol, const std::string& data);
+    // Both run on deribit_ioc_ for as long as the upstream connection is
+    // open; the writer sends subscriptions queued by subscribe_to_orderbook.
+    template <typename Stream>
+    boost::asio::awaitable<void, UpstreamExecutor> upstream_read_loop(Stream& ws);
+    template <typename Stream>
+    boost::asio::awaitable<void, UpstreamExecutor> upstream_write_loop(Stream& ws);
+    void on_deribit_message(const std::string& message, uint64_t trace_id);
+    // A reply arrived for upstream request `id`, or its deadline passed.
+    void complete_upstream_request(uint64_t id, bool failed);
+    void on_upstream_request_timeout(uint64_t id);
+    // Has the writer unsubscribe and subscribe `instrument`'s channel again,
+    // for a fresh snapshot after its book was dropped. Upstream thread only.
+    void resubscribe(std::string_view instrument);
+    // Shuts the upstream connection down and joins its thread, so that no
+    // more updates are broadcast.
+    void close_upstream();
+    void broadcast_to_subscribers(std::string_view symbol, const std::string& data, uint64_t trace_id);
+    // Warm restart. The checkpoint is loaded by the constructor and written
+    // on an io thread every config.checkpoint.interval_ms, and once more
+    // by stop().
+    void restore_checkpoint();
+    void schedule_checkpoint();
+    void save_checkpoint();
+
+    // Runs `operation` on whichever upstream stream is open, TLS or plain.
+    template <typename Operation>
+    void with_upstream(Operation&& operation);
 
     Config& config_;
+    const LiveConfig* live_ = nullptr;
+    // Declared ahead of the io_context so that sessions still referenced by
+    // its queued handlers are destroyed before the pool.
+    FixedPool session_pool_;
+    // Set when config.server.io_uring is on and the kernel supports it.
+    // Sessions unregister from it when they are destroyed, so it is
+    // declared ahead of the io_context too.
+    std::unique_ptr<UringTransport> uring_;
     boost::asio::io_context ioc_;
     boost::asio::ip::tcp::acceptor acceptor_;
     std::vector<std::thread> server_threads_;
+    // Ticks on ioc_, so it is declared after it.
+    std::unique_ptr<TimerWheel> timers_;
+    std::unique_ptr<LoopMonitor> loop_monitor_;
     std::atomic<bool> running_;
     
-    std::mutex sessions_mutex_;
+    InstrumentedMutex sessions_mutex_;
     std::vector<std::shared_ptr<WebSocketSession>> sessions_;
-    std::map<std::shared_ptr<WebSocketSession>, std::set<std::string>> subscriptions_;
+    std::map<std::shared_ptr<WebSocketSession>, std::set<std::string, std::less<>>> subscriptions_;
+    // Scratch memory for one fan-out, reset when it is done. Guarded by
+    // sessions_mutex_.
+    Arena fanout_arena_;
+    // Broadcast payloads, recycled once every recipient has written them.
+    StringPool payloads_;
     
     std::unique_ptr<boost::asio::io_context> deribit_ioc_;
     std::unique_ptr<boost::beast::websocket::stream<
-        boost::beast::ssl_stream<boost::asio::ip::tcp::socket>>> deribit_ws_;
+        boost::beast::ssl_stream<UpstreamSocket>>> deribit_ws_;
+    // Used instead of deribit_ws_ when the upstream URL is ws://, e.g. a
+    // local mock feed.
+    std::unique_ptr<boost::beast::websocket::stream<UpstreamSocket>> deribit_plain_ws_;
+    // Remembers which channels are subscribed upstream and holds the ones
+    // the writer has yet to send; taken by the server threads and the
+    // upstream writer.
+    InstrumentedMutex upstream_write_mutex_;
+    std::set<std::string> upstream_channels_;
+    std::vector<std::string> pending_channels_;
+    // Subscribed channels to unsubscribe and queue again.
+    std::vector<std::string> resubscribe_channels_;
+    // Set from run() until the first connection attempt is over, so that
+    // subscriptions are queued rather than refused.
+    bool upstream_starting_ = false;
+    // Subscribe requests sent and not yet answered, by request id.
+    struct PendingRequest {
+        std::vector<std::string> channels;
+        TimerWheel::TimerId deadline;
+    };
+    std::map<uint64_t, PendingRequest> pending_requests_;
+    // Only used by the upstream writer.
+    uint64_t next_request_id_ = 1;
+    // Wakes the upstream writer. Only touched on deribit_ioc_.
+    std::unique_ptr<UpstreamTimer> upstream_write_signal_;
+    std::string upstream_request_buffer_;
+    // Runs deribit_ioc_.
     std::unique_ptr<std::thread> deribit_thread_;
     std::atomic<bool> deribit_connected_;
+    HandlerMemory upstream_write_memory_;
+    // Only used from the upstream read loop.
+    HandlerMemory upstream_read_memory_;
+    boost::beast::flat_buffer upstream_buffer_;
+    std::string upstream_payload_;
+    json::Parser upstream_parser_;
+    BookDeltaTable book_deltas_;
+    // Books applied by the upstream thread; new subscribers are sent a
+    // snapshot of the current one.
+    BookStore books_;
+    mutable InstrumentedMutex catalog_mutex_;
+    std::vector<std::string> instrument_catalog_;
+    // Set by presubscribe().
+    std::atomic<bool> presubscribing_{false};
+    TimerWheel::TimerId checkpoint_timer_ = 0;
     boost::asio::ssl::context ssl_ctx_;
+
+    int upstream_messages_metric_;
+    int orderbook_updates_metric_;
+    int messages_sent_metric_;
+    int sessions_accepted_metric_;
+    int propagation_metric_;
+    int sequence_gaps_metric_;
+    int book_rejects_metric_;
+    int upstream_timeouts_metric_;
+    int checkpoint_confirmed_metric_;
+    int checkpoint_discarded_metric_;
+    int checkpoint_write_metric_;
 };
 
 class WebSocketSession : public std::enable_shared_from_this<WebSocketSession> {
 public:
     using message_handler = std::function<void(std::shared_ptr<WebSocketSession>, const std::string&)>;
+    // Called once when the client goes away or the connection fails.
+    using close_handler = std::function<void(const std::shared_ptr<WebSocketSession>&)>;
 
     explicit WebSocketSession(
-        boost::asio::ip::tcp::socket socket,
-        message_handler on_message
+        SessionSocket socket,
+        message_handler on_message,
+        close_handler on_close = nullptr,
+        const SessionOptions& options = {}
     );
 
     void start();
-    void send(const std::string& message);
+    void send(const std::string& message, uint64_t trace_id = 0);
+    // Queues a payload that may be shared with other sessions.
+    void send(std::shared_ptr<const std::string> message, uint64_t trace_id = 0);
+    // Calls `done`, on the session's strand, once everything queued so far
+    // has been written or the session has closed.
+    void drain(std::function<void()> done);
     void close();
 
 private:
-    void do_read();
-    void on_read(boost::system::error_code ec, std::size_t bytes_transferred);
-    void on_write(boost::system::error_code ec, std::size_t bytes_transferred);
+    struct PendingWrite {
+        std::shared_ptr<const std::string> message;
+        uint64_t trace_id;
+        uint64_t queued_ns;
+    };
+
+    // Accepts the handshake, starts the write loop and then reads until
+    // the client goes away. Each coroutine holds `self` for its lifetime.
+    boost::asio::awaitable<void, SessionExecutor> run(std::shared_ptr<WebSocketSession> self);
+    boost::asio::awaitable<void, SessionExecutor> write_loop(std::shared_ptr<WebSocketSession> self);
+    void closed();
+    // Disconnects a client that has fallen max_queued_bytes_ behind.
+    void drop_slow_client();
+    // Idle tracking on the timer wheel; all on the session's strand.
+    void note_activity();
+    void arm_idle_check(std::chrono::nanoseconds delay);
+    void check_idle();
 
-    boost::beast::websocket::stream<boost::asio::ip::tcp::socket> ws_;
+    // Both loops run on the socket's executor, a strand, so they never run
+    // concurrently and the write queue needs no lock.
+    boost::beast::websocket::stream<SessionStream> ws_;
     boost::beast::flat_buffer buffer_;
+    std::string message_;
     message_handler on_message_;
-    std::mutex write_mutex_;
+    close_handler on_close_;
+    // Set once the handshake is done and cleared when the read loop ends;
+    // messages sent while it is false are dropped.
+    bool open_ = false;
+    // Pending writes are write_queue_[write_head_..]. The vector is only
+    // cleared, never shrunk, once it drains, so a session that keeps up
+    // queues without allocating.
+    std::vector<PendingWrite> write_queue_;
+    size_t write_head_ = 0;
+    // Payload bytes in write_queue_[write_head_..].
+    size_t queued_bytes_ = 0;
+    // The write loop waits on it, without expiry while the queue is empty
+    // and until the batch deadline while a batch fills. send() cancels it
+    // when the first message arrives or a batch is full.
+    SessionTimer write_signal_;
+    // Set by drain() until the queue next runs empty.
+    std::function<void()> drained_;
+    uint32_t write_batch_max_;
+    std::chrono::nanoseconds write_batch_delay_;
+    size_t max_queued_bytes_;
+    TimerWheel* timers_;
+    std::chrono::nanoseconds idle_timeout_;
+    TimerWheel::TimerId idle_timer_ = 0;
+    // Last frame of any kind from the client, and whether a ping has gone
+    // out since.
+    SessionTimer::time_point last_activity_;
+    bool ping_sent_ = false;
+    // One operation at a time each for the read and the write loop.
+    HandlerMemory read_memory_;
+    HandlerMemory write_memory_;
 };
 
 } // namespace deribit
\ No newline at end of file
@@ -0,0 +1,136 @@
+#include "allocation_tracker.hpp"
+#include "shm_metrics.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace deribit {
+
+namespace {
+
+// Plain thread_local POD so that operator new never triggers dynamic
+// initialisation (which could itself allocate).
+thread_local AllocationCounts thread_allocations;
+
+}
+
+AllocationCounts AllocationTracker::thread_counts() {
+    return thread_allocations;
+}
+
+AllocationRegion::AllocationRegion(const std::string& name)
+    : name_(name)
+    , calls_metric_(ShmMetrics::instance().counter("alloc." + name + ".calls"))
+    , allocations_metric_(ShmMetrics::instance().counter("alloc." + name + ".allocations"))
+    , bytes_metric_(ShmMetrics::instance().counter("alloc." + name + ".bytes"))
+{}
+
+void AllocationRegion::record(const AllocationCounts& delta) const {
+    auto& metrics = ShmMetrics::instance();
+    metrics.add(calls_metric_);
+    if (delta.allocations) {
+        metrics.add(allocations_metric_, delta.allocations);
+        metrics.add(bytes_metric_, delta.bytes);
+    }
+}
+
+AllocationGuard::AllocationGuard(const AllocationRegion& region, Mode mode)
+    : region_(region)
+    , mode_(mode)
+    , start_(thread_allocations)
+{}
+
+AllocationGuard::~AllocationGuard() {
+    AllocationCounts counts = delta();
+    if (mode_ == Mode::Assert && counts.allocations != 0) {
+        std::fprintf(stderr, "Allocation guard violated in %s: %llu allocations, %llu bytes\n",
+                     region_.name().c_str(),
+                     static_cast<unsigned long long>(counts.allocations),
+                     static_cast<unsigned long long>(counts.bytes));
+        std::abort();
+    }
+    region_.record(counts);
+}
+
+AllocationCounts AllocationGuard::delta() const {
+    const AllocationCounts& now = thread_allocations;
+    return {now.allocations - start_.allocations,
+            now.deallocations - start_.deallocations,
+            now.bytes - start_.bytes};
+}
+
+} // namespace deribit
+
+#ifdef DERIBIT_TRACK_ALLOCATIONS
+
+namespace {
+
+void* tracked_allocate(std::size_t size) {
+    auto& counts = deribit::thread_allocations;
+    ++counts.allocations;
+    counts.bytes += size;
+    return std::malloc(size ? size : 1);
+}
+
+void* tracked_allocate_aligned(std::size_t size, std::align_val_t alignment) {
+    auto& counts = deribit::thread_allocations;
+    ++counts.allocations;
+    counts.bytes += size;
+    std::size_t align = static_cast<std::size_t>(alignment);
+    std::size_t rounded = (size + align - 1) / align * align;
+    return std::aligned_alloc(align, rounded ? rounded : align);
+}
+
+void tracked_free(void* ptr) noexcept {
+    if (ptr) {
+        ++deribit::thread_allocations.deallocations;
+        std::free(ptr);
+    }
+}
+
+}
+
+void* operator new(std::size_t size) {
+    void* ptr = tracked_allocate(size);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return tracked_allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return tracked_allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    void* ptr = tracked_allocate_aligned(size, alignment);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept { tracked_free(ptr); }
+void operator delete[](void* ptr) noexcept { tracked_free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { tracked_free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { tracked_free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { tracked_free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { tracked_free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { tracked_free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { tracked_free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { tracked_free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { tracked_free(ptr); }
+
+#endif
@@ -1,5 +1,5 @@
 #include "authentication.hpp"
-#include <cpprest/json.h>
+#include "ondemand_json.hpp"
 #include <cpprest/asyncrt_utils.h>
 
 namespace deribit {
@@ -7,7 +7,7 @@ namespace deribit {
 Authentication::Authentication(Config& config)
     : config_(config)
     , is_authenticated_(false)
-    , client_(web::uri(utility::conversions::to_string_t(config.BASE_URL)))
+    , client_(web::uri(utility::conversions::to_string_t(config.endpoints.rest_url)))
 {}
 
 bool Authentication::authenticate() {
@@ -20,12 +20,11 @@ bool Authentication::authenticate() {
         auto response = client_.request(web::http::methods::GET, builder.to_string()).get();
         
         if (response.status_code() == web::http::status_codes::OK) {
-            auto json = response.extract_json().get();
-            auto& result = json.at(U("result"));
-            auto& access_token = result.at(U("access_token"));
-            config_.access_token = utility::conversions::to_utf8string(access_token.as_string());
-            is_authenticated_ = true;
-            return true;
+            json::Message reply(response.extract_utf8string(true).get());
+            if (reply.root()["result"]["access_token"].get(config_.access_token)) {
+                is_authenticated_ = true;
+                return true;
+            }
         }
     } catch (const std::exception& e) {
         is_authenticated_ = false;
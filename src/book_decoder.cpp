@@ -0,0 +1,403 @@
+#include "book_decoder.hpp"
+#include <algorithm>
+#include <charconv>
+
+namespace deribit {
+
+namespace {
+
+constexpr int MAX_DEPTH = 32;
+
+// Bounds-checked reader over the payload. Every method returns false
+// instead of reading past the end.
+class Cursor {
+public:
+    Cursor(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+    const char* position() const { return p_; }
+
+    void skip_whitespace() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) {
+            ++p_;
+        }
+    }
+
+    bool peek(char c) {
+        skip_whitespace();
+        return p_ < end_ && *p_ == c;
+    }
+
+    bool consume(char c) {
+        if (!peek(c)) {
+            return false;
+        }
+        ++p_;
+        return true;
+    }
+
+    bool at_end() {
+        skip_whitespace();
+        return p_ == end_;
+    }
+
+    // Raw string contents between the quotes; escapes are skipped, not
+    // decoded.
+    bool string(std::string_view& out) {
+        if (!consume('"')) {
+            return false;
+        }
+        const char* start = p_;
+        while (p_ < end_) {
+            char c = *p_;
+            if (c == '"') {
+                out = std::string_view(start, static_cast<size_t>(p_ - start));
+                ++p_;
+                return true;
+            }
+            if (static_cast<unsigned char>(c) < 0x20) {
+                return false;
+            }
+            if (c == '\\') {
+                if (end_ - p_ < 2) {
+                    return false;
+                }
+                ++p_;
+            }
+            ++p_;
+        }
+        return false;
+    }
+
+    bool number(std::string_view& out) {
+        skip_whitespace();
+        const char* start = p_;
+        while (p_ < end_ && ((*p_ >= '0' && *p_ <= '9') || *p_ == '-' || *p_ == '+' || *p_ == '.' ||
+                             *p_ == 'e' || *p_ == 'E')) {
+            ++p_;
+        }
+        out = std::string_view(start, static_cast<size_t>(p_ - start));
+        return !out.empty();
+    }
+
+    bool unsigned_integer(uint64_t& out) {
+        std::string_view text;
+        if (!number(text)) {
+            return false;
+        }
+        auto result = std::from_chars(text.data(), text.data() + text.size(), out);
+        return result.ec == std::errc() && result.ptr == text.data() + text.size();
+    }
+
+    bool decimal(json::Decimal& out) {
+        std::string_view text;
+        return number(text) && json::parse_decimal(text, out);
+    }
+
+    bool literal(std::string_view word) {
+        skip_whitespace();
+        if (static_cast<size_t>(end_ - p_) < word.size() || std::string_view(p_, word.size()) != word) {
+            return false;
+        }
+        p_ += word.size();
+        return true;
+    }
+
+    bool skip_value(int depth = 0) {
+        if (depth > MAX_DEPTH) {
+            return false;
+        }
+        skip_whitespace();
+        if (p_ == end_) {
+            return false;
+        }
+        switch (*p_) {
+        case '"': {
+            std::string_view ignored;
+            return string(ignored);
+        }
+        case '{':
+            return skip_container('}', true, depth);
+        case '[':
+            return skip_container(']', false, depth);
+        case 't':
+            return literal("true");
+        case 'f':
+            return literal("false");
+        case 'n':
+            return literal("null");
+        default: {
+            std::string_view ignored;
+            return number(ignored);
+        }
+        }
+    }
+
+    // Calls `on_key(key)` for every member of an object; the callback must
+    // consume the value.
+    template <typename OnKey>
+    bool object(OnKey&& on_key) {
+        if (!consume('{')) {
+            return false;
+        }
+        if (consume('}')) {
+            return true;
+        }
+        do {
+            std::string_view key;
+            if (!string(key) || !consume(':') || !on_key(key)) {
+                return false;
+            }
+        } while (consume(','));
+        return consume('}');
+    }
+
+private:
+    bool skip_container(char close, bool keyed, int depth) {
+        ++p_;
+        if (consume(close)) {
+            return true;
+        }
+        do {
+            if (keyed) {
+                std::string_view key;
+                if (!string(key) || !consume(':')) {
+                    return false;
+                }
+            }
+            if (!skip_value(depth + 1)) {
+                return false;
+            }
+        } while (consume(','));
+        return consume(close);
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+// [[action, price, amount], ...]; grouped channels send [price, amount]
+// pairs, which are taken as new levels.
+BookDecodeStatus decode_levels(Cursor& cursor, std::array<BookLevel, BookDelta::MAX_LEVELS>& levels,
+                               uint32_t& count) {
+    count = 0;
+    if (!cursor.consume('[')) {
+        return BookDecodeStatus::Malformed;
+    }
+    if (cursor.consume(']')) {
+        return BookDecodeStatus::Ok;
+    }
+    do {
+        if (count == BookDelta::MAX_LEVELS) {
+            return BookDecodeStatus::TooManyLevels;
+        }
+        BookLevel& level = levels[count];
+        if (!cursor.consume('[')) {
+            return BookDecodeStatus::Malformed;
+        }
+        if (cursor.peek('"')) {
+            std::string_view action;
+            if (!cursor.string(action) || !cursor.consume(',')) {
+                return BookDecodeStatus::Malformed;
+            }
+            if (action == "new") {
+                level.action = BookAction::New;
+            } else if (action == "change") {
+                level.action = BookAction::Change;
+            } else if (action == "delete") {
+                level.action = BookAction::Delete;
+            } else {
+                return BookDecodeStatus::Malformed;
+            }
+        } else {
+            level.action = BookAction::New;
+        }
+        if (!cursor.decimal(level.price) || !cursor.consume(',') || !cursor.decimal(level.amount) ||
+            !cursor.consume(']')) {
+            return BookDecodeStatus::Malformed;
+        }
+        ++count;
+    } while (cursor.consume(','));
+    return cursor.consume(']') ? BookDecodeStatus::Ok : BookDecodeStatus::Malformed;
+}
+
+BookDecodeStatus decode_data(Cursor& cursor, std::string_view instrument, BookDelta& delta) {
+    enum Seen : unsigned { TIMESTAMP = 1, CHANGE_ID = 2, BIDS = 4, ASKS = 8, TYPE = 16 };
+    unsigned seen = 0;
+    BookDecodeStatus status = BookDecodeStatus::Ok;
+    delta.prev_change_id = 0;
+
+    bool parsed = cursor.object([&](std::string_view key) {
+        if (key == "bids" || key == "asks") {
+            bool bids = key == "bids";
+            status = decode_levels(cursor, bids ? delta.bids : delta.asks, bids ? delta.bid_count : delta.ask_count);
+            seen |= bids ? BIDS : ASKS;
+            return status == BookDecodeStatus::Ok;
+        }
+        if (key == "change_id") {
+            seen |= CHANGE_ID;
+            return cursor.unsigned_integer(delta.change_id);
+        }
+        if (key == "prev_change_id") {
+            return cursor.unsigned_integer(delta.prev_change_id);
+        }
+        if (key == "timestamp") {
+            seen |= TIMESTAMP;
+            return cursor.unsigned_integer(delta.timestamp_ms);
+        }
+        if (key == "type") {
+            std::string_view type;
+            if (!cursor.string(type) || (type != "snapshot" && type != "change")) {
+                return false;
+            }
+            seen |= TYPE;
+            delta.snapshot = type == "snapshot";
+            return true;
+        }
+        if (key == "instrument_name") {
+            std::string_view name;
+            return cursor.string(name) && name == instrument;
+        }
+        return cursor.skip_value(2);
+    });
+
+    if (status != BookDecodeStatus::Ok) {
+        return status;
+    }
+    const unsigned required = TIMESTAMP | CHANGE_ID | BIDS | ASKS;
+    if (!parsed || (seen & required) != required) {
+        return BookDecodeStatus::Malformed;
+    }
+    if (!(seen & TYPE)) {
+        // Grouped channels carry no type; every message is a full book.
+        delta.snapshot = true;
+    }
+    if (!delta.snapshot && delta.prev_change_id == 0) {
+        return BookDecodeStatus::Malformed;
+    }
+    return BookDecodeStatus::Ok;
+}
+
+// Walks the envelope for the channel and the data object, and asks
+// `resolve(instrument)` for the delta to decode into. Deribit sends the
+// channel first, so data is normally decoded in the same pass and anything
+// that is not a book is given up on as soon as its channel is read. If data
+// comes first it is skipped and decoded afterwards.
+template <typename Resolve>
+BookDecodeStatus decode(std::string_view payload, Resolve&& resolve) {
+    const char* end = payload.data() + payload.size();
+    Cursor cursor(payload.data(), end);
+    std::string_view channel;
+    std::string_view instrument;
+    const char* deferred_data = nullptr;
+    bool has_params = false;
+    bool not_book = false;
+    BookDecodeStatus status = BookDecodeStatus::Malformed;
+
+    auto book_instrument = [&]() {
+        if (channel.compare(0, 5, "book.") != 0) {
+            not_book = true;
+            return false;
+        }
+        instrument = channel.substr(5);
+        instrument = instrument.substr(0, instrument.find('.'));
+        return !instrument.empty();
+    };
+
+    bool parsed = cursor.object([&](std::string_view key) {
+        if (key != "params") {
+            return cursor.skip_value(1);
+        }
+        has_params = true;
+        return cursor.object([&](std::string_view params_key) {
+            if (params_key == "channel") {
+                return cursor.string(channel) && book_instrument();
+            }
+            if (params_key != "data") {
+                return cursor.skip_value(2);
+            }
+            if (instrument.empty()) {
+                cursor.skip_whitespace();
+                deferred_data = cursor.position();
+                return cursor.skip_value(2);
+            }
+            status = decode_data(cursor, instrument, resolve(instrument));
+            return status == BookDecodeStatus::Ok;
+        });
+    });
+
+    if (not_book) {
+        return BookDecodeStatus::NotBook;
+    }
+    if (!parsed) {
+        return status == BookDecodeStatus::TooManyLevels ? status : BookDecodeStatus::Malformed;
+    }
+    if (!cursor.at_end()) {
+        return BookDecodeStatus::Malformed;
+    }
+    if (!has_params || channel.empty()) {
+        return BookDecodeStatus::NotBook;
+    }
+    if (deferred_data) {
+        Cursor data_cursor(deferred_data, end);
+        return decode_data(data_cursor, instrument, resolve(instrument));
+    }
+    return status;
+}
+
+}
+
+const char* book_decode_status_name(BookDecodeStatus status) {
+    switch (status) {
+    case BookDecodeStatus::Ok: return "ok";
+    case BookDecodeStatus::NotBook: return "not a book notification";
+    case BookDecodeStatus::Malformed: return "malformed";
+    case BookDecodeStatus::TooManyLevels: return "too many levels";
+    }
+    return "unknown";
+}
+
+BookDeltaTable::BookDeltaTable(const std::vector<std::string>& instruments) {
+    for (const auto& instrument : instruments) {
+        find_or_add(instrument);
+    }
+}
+
+BookDeltaTable::Entry* BookDeltaTable::find(std::string_view instrument) {
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), instrument,
+                               [](const std::unique_ptr<Entry>& entry, std::string_view name) {
+                                   return entry->instrument < name;
+                               });
+    return it != entries_.end() && (*it)->instrument == instrument ? it->get() : nullptr;
+}
+
+BookDeltaTable::Entry& BookDeltaTable::find_or_add(std::string_view instrument) {
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), instrument,
+                               [](const std::unique_ptr<Entry>& entry, std::string_view name) {
+                                   return entry->instrument < name;
+                               });
+    if (it != entries_.end() && (*it)->instrument == instrument) {
+        return **it;
+    }
+    return **entries_.insert(it, std::make_unique<Entry>(instrument));
+}
+
+BookDecodeStatus decode_book_notification(std::string_view payload, BookDeltaTable& table,
+                                          BookDeltaTable::Entry*& entry) {
+    BookDeltaTable::Entry* resolved = nullptr;
+    BookDecodeStatus status = decode(payload, [&](std::string_view instrument) -> BookDelta& {
+        resolved = &table.find_or_add(instrument);
+        return resolved->delta;
+    });
+    entry = status == BookDecodeStatus::Ok ? resolved : nullptr;
+    return status;
+}
+
+BookDecodeStatus decode_book_notification(std::string_view payload, BookDelta& delta,
+                                          std::string_view& instrument) {
+    return decode(payload, [&](std::string_view name) -> BookDelta& {
+        instrument = name;
+        return delta;
+    });
+}
+
+} // namespace deribit
@@ -0,0 +1,227 @@
+#include "checkpoint.hpp"
+#include "logger.hpp"
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace deribit {
+
+namespace {
+
+constexpr char MAGIC[8] = {'D', 'R', 'B', 'T', 'C', 'K', 'P', 'T'};
+constexpr uint32_t VERSION = 1;
+// Bounds on what a reader accepts, so a corrupt count cannot make it
+// allocate without limit.
+constexpr uint32_t MAX_ENTRIES = 1 << 20;
+constexpr uint32_t MAX_STRING = 1 << 16;
+
+uint64_t fnv1a(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+class Encoder {
+public:
+    explicit Encoder(std::string& out) : out_(out) {}
+
+    void u32(uint32_t v) { put(v, 4); }
+    void u64(uint64_t v) { put(v, 8); }
+    void string(const std::string& s) {
+        u32(static_cast<uint32_t>(s.size()));
+        out_ += s;
+    }
+    void levels(const std::vector<PriceLevel>& side) {
+        u32(static_cast<uint32_t>(side.size()));
+        for (const PriceLevel& level : side) {
+            u64(static_cast<uint64_t>(level.price.units));
+            u64(static_cast<uint64_t>(level.amount.units));
+        }
+    }
+
+private:
+    void put(uint64_t v, int bytes) {
+        for (int i = 0; i < bytes; ++i) {
+            out_ += static_cast<char>(v >> (8 * i));
+        }
+    }
+
+    std::string& out_;
+};
+
+class Decoder {
+public:
+    Decoder(const char* p, const char* end) : p_(p), end_(end) {}
+
+    bool u32(uint32_t& v) {
+        uint64_t wide;
+        if (!get(wide, 4)) {
+            return false;
+        }
+        v = static_cast<uint32_t>(wide);
+        return true;
+    }
+    bool u64(uint64_t& v) { return get(v, 8); }
+    bool count(uint32_t& n) { return u32(n) && n <= MAX_ENTRIES; }
+    bool string(std::string& s) {
+        uint32_t size;
+        if (!u32(size) || size > MAX_STRING || static_cast<size_t>(end_ - p_) < size) {
+            return false;
+        }
+        s.assign(p_, size);
+        p_ += size;
+        return true;
+    }
+    bool levels(std::vector<PriceLevel>& side) {
+        uint32_t n;
+        if (!count(n) || static_cast<size_t>(end_ - p_) / 16 < n) {
+            return false;
+        }
+        side.resize(n);
+        for (PriceLevel& level : side) {
+            uint64_t price, amount;
+            u64(price);
+            u64(amount);
+            level.price.units = static_cast<int64_t>(price);
+            level.amount.units = static_cast<int64_t>(amount);
+        }
+        return true;
+    }
+    bool at_end() const { return p_ == end_; }
+
+private:
+    bool get(uint64_t& v, int bytes) {
+        if (end_ - p_ < bytes) {
+            return false;
+        }
+        v = 0;
+        for (int i = 0; i < bytes; ++i) {
+            v |= static_cast<uint64_t>(static_cast<unsigned char>(p_[i])) << (8 * i);
+        }
+        p_ += bytes;
+        return true;
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+bool write_all(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+}
+
+bool write_checkpoint(const std::string& path, const CheckpointState& state) {
+    std::string data(MAGIC, sizeof(MAGIC));
+    Encoder encoder(data);
+    encoder.u32(VERSION);
+    encoder.u64(state.written_ms);
+    encoder.u32(static_cast<uint32_t>(state.channels.size()));
+    for (const auto& channel : state.channels) {
+        encoder.string(channel);
+    }
+    encoder.u32(static_cast<uint32_t>(state.catalog.size()));
+    for (const auto& name : state.catalog) {
+        encoder.string(name);
+    }
+    encoder.u32(static_cast<uint32_t>(state.books.size()));
+    for (const auto& [instrument, book] : state.books) {
+        encoder.string(instrument);
+        encoder.u64(book.change_id);
+        encoder.u64(book.timestamp_ms);
+        encoder.levels(book.bids());
+        encoder.levels(book.asks());
+    }
+    encoder.u64(fnv1a(data.data(), data.size()));
+
+    std::error_code ec;
+    auto parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, ec);
+    }
+    std::string temp = path + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("Unable to write checkpoint %s: %s", temp.c_str(), std::strerror(errno));
+        return false;
+    }
+    bool ok = write_all(fd, data) && ::fsync(fd) == 0;
+    int saved_errno = errno;
+    ::close(fd);
+    if (!ok || ::rename(temp.c_str(), path.c_str()) != 0) {
+        LOG_ERROR("Unable to write checkpoint %s: %s", path.c_str(), std::strerror(ok ? errno : saved_errno));
+        ::unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool read_checkpoint(const std::string& path, CheckpointState& state) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < sizeof(MAGIC) + 8 || std::memcmp(data.data(), MAGIC, sizeof(MAGIC)) != 0) {
+        LOG_WARNING("Ignoring checkpoint %s: not a checkpoint file", path.c_str());
+        return false;
+    }
+    size_t body = data.size() - 8;
+    uint64_t checksum;
+    Decoder trailer(data.data() + body, data.data() + data.size());
+    trailer.u64(checksum);
+    if (checksum != fnv1a(data.data(), body)) {
+        LOG_WARNING("Ignoring checkpoint %s: checksum mismatch", path.c_str());
+        return false;
+    }
+
+    Decoder decoder(data.data() + sizeof(MAGIC), data.data() + body);
+    uint32_t version;
+    if (!decoder.u32(version) || version != VERSION) {
+        LOG_WARNING("Ignoring checkpoint %s: unsupported version", path.c_str());
+        return false;
+    }
+    CheckpointState loaded;
+    uint32_t n;
+    bool ok = decoder.u64(loaded.written_ms) && decoder.count(n);
+    for (uint32_t i = 0; ok && i < n; ++i) {
+        ok = decoder.string(loaded.channels.emplace_back());
+    }
+    ok = ok && decoder.count(n);
+    for (uint32_t i = 0; ok && i < n; ++i) {
+        ok = decoder.string(loaded.catalog.emplace_back());
+    }
+    ok = ok && decoder.count(n);
+    for (uint32_t i = 0; ok && i < n; ++i) {
+        auto& [instrument, book] = loaded.books.emplace_back();
+        ok = decoder.string(instrument) && decoder.u64(book.change_id) && decoder.u64(book.timestamp_ms) &&
+             decoder.levels(book.bids()) && decoder.levels(book.asks());
+    }
+    if (!ok || !decoder.at_end()) {
+        LOG_WARNING("Ignoring checkpoint %s: malformed", path.c_str());
+        return false;
+    }
+    state = std::move(loaded);
+    return true;
+}
+
+} // namespace deribit
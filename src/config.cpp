@@ -0,0 +1,125 @@
+#include "config.hpp"
+#include "logger.hpp"
+#include "ondemand_json.hpp"
+#include "thread_topology.hpp"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace deribit {
+
+Config load_config(const std::string& config_path) {
+    std::ifstream config_file(config_path);
+    if (!config_file.is_open()) {
+        throw std::runtime_error("Unable to open config file");
+    }
+
+    std::stringstream contents;
+    contents << config_file.rdbuf();
+    json::Message document(contents.str());
+    json::Value root = document.root();
+    if (!document.ok() || root.type() != json::Type::Object) {
+        throw std::runtime_error("Failed to parse config file");
+    }
+
+    std::vector<std::string> supported_instruments;
+    for (const auto& instrument : root["trading"]["supported_instruments"].elements()) {
+        supported_instruments.push_back(instrument.get_or(""));
+    }
+
+    Config config(
+        root["api_credentials"]["client_id"].get_or(""),
+        root["api_credentials"]["client_secret"].get_or(""),
+        root["server"]["websocket_port"].get_or(0),
+        root["trading"]["default_currency"].get_or(""),
+        root["trading"]["default_instrument"].get_or(""),
+        supported_instruments);
+
+    json::Value trading = root["trading"];
+    config.trading.presubscribe = trading["presubscribe"].get_or(config.trading.presubscribe);
+    config.trading.presubscribe_wait_ms = trading["presubscribe_wait_ms"].get_or(config.trading.presubscribe_wait_ms);
+
+    json::Value server = root["server"];
+    config.server.io_uring = server["io_uring"].get_or(config.server.io_uring);
+    config.server.io_uring_entries = server["io_uring_entries"].get_or(config.server.io_uring_entries);
+    config.server.io_uring_sessions = server["io_uring_sessions"].get_or(config.server.io_uring_sessions);
+    config.server.write_batch_max = server["write_batch_max"].get_or(config.server.write_batch_max);
+    config.server.write_batch_delay_us = server["write_batch_delay_us"].get_or(config.server.write_batch_delay_us);
+    config.server.session_max_queued_bytes =
+        server["session_max_queued_bytes"].get_or(config.server.session_max_queued_bytes);
+
+    config.endpoints.rest_url = root["endpoints"]["rest_url"].get_or(config.endpoints.rest_url);
+    config.endpoints.websocket_url = root["endpoints"]["websocket_url"].get_or(config.endpoints.websocket_url);
+
+    json::Value metrics = root["metrics"];
+    config.metrics.shared_memory_enabled = metrics["shared_memory_enabled"].get_or(false);
+    config.metrics.shared_memory_name = metrics["shared_memory_name"].get_or(config.metrics.shared_memory_name);
+
+    json::Value tracing = root["tracing"];
+    config.tracing.enabled = tracing["enabled"].get_or(false);
+    config.tracing.sample_every = tracing["sample_every"].get_or(config.tracing.sample_every);
+    config.tracing.buffer_events = tracing["buffer_events"].get_or(config.tracing.buffer_events);
+    config.tracing.output_file = tracing["output_file"].get_or(config.tracing.output_file);
+
+    json::Value loop_lag = root["monitoring"]["loop_lag"];
+    config.monitoring.loop_lag_enabled = loop_lag["enabled"].get_or(config.monitoring.loop_lag_enabled);
+    config.monitoring.loop_probe_interval_us = loop_lag["probe_interval_us"].get_or(config.monitoring.loop_probe_interval_us);
+    config.monitoring.loop_lag_warning_us = loop_lag["warning_us"].get_or(config.monitoring.loop_lag_warning_us);
+    config.monitoring.loop_lag_critical_us = loop_lag["critical_us"].get_or(config.monitoring.loop_lag_critical_us);
+
+    json::Value perf_counters = root["monitoring"]["perf_counters"];
+    config.monitoring.perf_counters_enabled = perf_counters["enabled"].get_or(false);
+    config.monitoring.perf_sample_every = perf_counters["sample_every"].get_or(config.monitoring.perf_sample_every);
+    config.monitoring.lock_profiling_enabled = root["monitoring"]["lock_profiling"]["enabled"].get_or(false);
+
+    json::Value timers = root["timers"];
+    config.timers.tick_us = timers["tick_us"].get_or(config.timers.tick_us);
+    config.timers.session_idle_timeout_ms = timers["session_idle_timeout_ms"].get_or(config.timers.session_idle_timeout_ms);
+    config.timers.upstream_request_timeout_ms = timers["upstream_request_timeout_ms"].get_or(config.timers.upstream_request_timeout_ms);
+    config.timers.order_timeout_ms = timers["order_timeout_ms"].get_or(config.timers.order_timeout_ms);
+
+    json::Value checkpoint = root["checkpoint"];
+    config.checkpoint.enabled = checkpoint["enabled"].get_or(config.checkpoint.enabled);
+    config.checkpoint.path = checkpoint["path"].get_or(config.checkpoint.path);
+    config.checkpoint.interval_ms = checkpoint["interval_ms"].get_or(config.checkpoint.interval_ms);
+    config.checkpoint.max_age_s = checkpoint["max_age_s"].get_or(config.checkpoint.max_age_s);
+
+    json::Value daemon = root["daemon"];
+    config.daemon.control_socket = daemon["control_socket"].get_or(config.daemon.control_socket);
+    config.daemon.control_workers = daemon["control_workers"].get_or(config.daemon.control_workers);
+    config.daemon.shutdown_drain_ms = daemon["shutdown_drain_ms"].get_or(config.daemon.shutdown_drain_ms);
+
+    std::string log_level = root["logging"]["level"].get_or(config.logging.level);
+    LogLevel parsed_level;
+    if (Logger::parse_level(log_level, parsed_level)) {
+        config.logging.level = log_level;
+    } else {
+        LOG_WARNING("Ignoring logging.level %s: not a log level", log_level.c_str());
+    }
+
+    json::Value memory = root["memory"];
+    config.memory.huge_pages = memory["huge_pages"].get_or(config.memory.huge_pages);
+    config.memory.message_arena_bytes = memory["message_arena_bytes"].get_or(config.memory.message_arena_bytes);
+    config.memory.sessions_per_slab = memory["sessions_per_slab"].get_or(config.memory.sessions_per_slab);
+
+    for (const auto& entry : root["threading"].fields()) {
+        std::string role_name(entry.key);
+        if (!thread_role_known(role_name)) {
+            LOG_WARNING("Ignoring threading.%s: no such thread role", role_name.c_str());
+            continue;
+        }
+        ThreadRole role = config.threading.role(role_name);
+        role.name = entry.value["name"].get_or(role.name);
+        for (const auto& cpu : entry.value["cpus"].elements()) {
+            role.cpus.push_back(cpu.get_or(-1));
+        }
+        role.policy = entry.value["policy"].get_or(role.policy);
+        role.priority = entry.value["priority"].get_or(role.priority);
+        role.threads = entry.value["threads"].get_or(role.threads);
+        config.threading.roles[role_name] = role;
+    }
+
+    return config;
+}
+
+} // namespace deribit
@@ -0,0 +1,315 @@
+#include "control_server.hpp"
+#include "logger.hpp"
+#include "shm_metrics.hpp"
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/write.hpp>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace deribit {
+
+struct ControlServer::Connection {
+    explicit Connection(boost::asio::io_context& ioc) : socket(ioc) {}
+
+    boost::asio::local::stream_protocol::socket socket;
+    std::string input;
+    // Replies waiting to be written; the front one is being written while
+    // `writing` is set.
+    std::deque<std::string> outbox;
+    bool writing = false;
+    // Cleared once the client has shut down its side; the connection then
+    // stays open until every request it sent has been answered.
+    bool reading = true;
+    // Requests handed to the workers whose replies are not queued yet.
+    size_t pending = 0;
+};
+
+ControlServer::ControlServer(std::string path, uint32_t workers)
+    : path_(std::move(path))
+    , ioc_()
+    , acceptor_(ioc_)
+    , workers_(std::max<uint32_t>(workers, 1))
+    , accepting_(false)
+    , close_deadline_(ioc_)
+    , commands_metric_(ShmMetrics::instance().counter("control.commands"))
+    , command_latency_metric_(ShmMetrics::instance().histogram("control.command"))
+{}
+
+ControlServer::~ControlServer() {
+    if (thread_.joinable()) {
+        stop(std::chrono::steady_clock::now());
+    }
+}
+
+void ControlServer::add(const std::string& command, Handler handler) {
+    handlers_[command] = std::move(handler);
+}
+
+bool ControlServer::start() {
+    // A socket file outlives the process that bound it; anything else at
+    // the path is left alone and the bind fails.
+    struct stat info;
+    if (::lstat(path_.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        ::unlink(path_.c_str());
+    }
+
+    boost::system::error_code ec;
+    boost::asio::local::stream_protocol::endpoint endpoint(path_);
+    acceptor_.open(endpoint.protocol(), ec);
+    if (!ec) {
+        acceptor_.bind(endpoint, ec);
+    }
+    if (!ec) {
+        acceptor_.listen(boost::asio::socket_base::max_listen_connections, ec);
+    }
+    if (ec) {
+        LOG_ERROR("Unable to listen on control socket %s: %s", path_.c_str(), ec.message().c_str());
+        return false;
+    }
+    // Orders go through this socket: owner and group only.
+    ::chmod(path_.c_str(), 0660);
+
+    accepting_ = true;
+    accept();
+    thread_ = std::thread([this] {
+        LOG_INFO("Control socket thread started");
+        ioc_.run();
+        LOG_INFO("Control socket thread terminated");
+    });
+    LOG_INFO("Listening for control commands on %s", path_.c_str());
+    return true;
+}
+
+bool ControlServer::stop(std::chrono::steady_clock::time_point deadline) {
+    if (!thread_.joinable()) {
+        return true;
+    }
+    LOG_INFO("Stopping control socket");
+    accepting_ = false;
+    boost::asio::post(ioc_, [this] {
+        boost::system::error_code ec;
+        acceptor_.close(ec);
+    });
+
+    bool finished;
+    {
+        std::unique_lock<std::mutex> lock(in_flight_mutex_);
+        finished = in_flight_done_.wait_until(lock, deadline, [this] { return in_flight_ == 0; });
+        if (!finished) {
+            LOG_WARNING("Control socket stopping with %zu commands still running", in_flight_);
+        }
+    }
+
+    // Connections with nothing left to write close now and the rest once
+    // their replies are out, or at the deadline, whichever comes first.
+    // The io thread then runs out of work.
+    boost::asio::post(ioc_, [this, deadline] {
+        closing_ = true;
+        auto idle = connections_;
+        for (const auto& connection : idle) {
+            if (!connection->writing) {
+                close(connection);
+            }
+        }
+        if (connections_.empty()) {
+            return;
+        }
+        close_deadline_.expires_at(deadline);
+        close_deadline_.async_wait([this](boost::system::error_code ec) {
+            if (ec) {
+                return;
+            }
+            auto remaining = connections_;
+            for (const auto& connection : remaining) {
+                close(connection);
+            }
+        });
+    });
+    thread_.join();
+    workers_.join();
+    ::unlink(path_.c_str());
+    return finished;
+}
+
+void ControlServer::accept() {
+    auto connection = std::make_shared<Connection>(ioc_);
+    acceptor_.async_accept(connection->socket, [this, connection](boost::system::error_code ec) {
+        if (ec) {
+            if (ec != boost::asio::error::operation_aborted) {
+                LOG_ERROR("Control socket accept error: %s", ec.message().c_str());
+            }
+            return;
+        }
+        LOG_INFO("Control client connected");
+        connections_.insert(connection);
+        boost::asio::co_spawn(ioc_, serve(connection), boost::asio::detached);
+        if (accepting_) {
+            accept();
+        }
+    });
+}
+
+// Reads request lines and hands each to the workers; the read loop never
+// waits for a command to finish.
+boost::asio::awaitable<void> ControlServer::serve(std::shared_ptr<Connection> connection) {
+    boost::system::error_code ec;
+    for (;;) {
+        size_t length = co_await boost::asio::async_read_until(
+            connection->socket, boost::asio::dynamic_buffer(connection->input, MAX_REQUEST_BYTES), '\n',
+            boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        if (ec == boost::asio::error::eof) {
+            // A script that writes its requests and shuts down its side,
+            // as `socat` or `nc -N` do, still waits for the replies.
+            connection->reading = false;
+            close_when_answered(connection);
+            co_return;
+        }
+        if (ec) {
+            if (ec == boost::asio::error::not_found) {
+                LOG_WARNING("Closing control client: request longer than %zu bytes", MAX_REQUEST_BYTES);
+            }
+            break;
+        }
+        std::string line = connection->input.substr(0, length - 1);
+        connection->input.erase(0, length);
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+
+        if (!accepting_) {
+            reply(connection, "{\"id\":null,\"ok\":false,\"error\":\"shutting down\"}\n");
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(in_flight_mutex_);
+            ++in_flight_;
+        }
+        ++connection->pending;
+        boost::asio::post(workers_, [this, connection, line = std::move(line)] {
+            std::string message = execute(line);
+            boost::asio::post(ioc_, [this, connection, message = std::move(message)]() mutable {
+                --connection->pending;
+                reply(connection, std::move(message));
+            });
+            {
+                std::lock_guard<std::mutex> lock(in_flight_mutex_);
+                --in_flight_;
+            }
+            in_flight_done_.notify_all();
+        });
+    }
+    close(connection);
+}
+
+std::string ControlServer::execute(const std::string& line) {
+    auto start = std::chrono::steady_clock::now();
+    json::Message request(line);
+    json::Value root = request.root();
+
+    std::string out;
+    json::Writer writer(out);
+    writer.begin_object().key("id");
+    if (root["id"]) {
+        writer.raw(root["id"].raw());
+    } else {
+        writer.null();
+    }
+
+    std::string error;
+    std::string result;
+    bool ok = false;
+    std::string command;
+    if (!request.ok() || root.type() != json::Type::Object) {
+        error = "malformed request";
+    } else if (!root["command"].get(command)) {
+        error = "missing command";
+    } else {
+        auto it = handlers_.find(command);
+        if (it == handlers_.end()) {
+            error = "unknown command: " + command;
+        } else {
+            try {
+                json::Writer result_writer(result);
+                ok = it->second(root, result_writer, error);
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+        }
+    }
+
+    writer.member("ok", ok);
+    if (ok) {
+        writer.key("result").raw(result.empty() ? std::string_view("null") : std::string_view(result));
+    } else {
+        LOG_WARNING("Control command %s failed: %s", command.empty() ? "(none)" : command.c_str(), error.c_str());
+        writer.member("error", error);
+    }
+    writer.end_object();
+    out += '\n';
+
+    ShmMetrics::instance().add(commands_metric_);
+    ShmMetrics::instance().record(command_latency_metric_,
+                                  std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                      std::chrono::steady_clock::now() - start).count());
+    return out;
+}
+
+void ControlServer::reply(const std::shared_ptr<Connection>& connection, std::string message) {
+    if (!connections_.count(connection)) {
+        return;
+    }
+    connection->outbox.push_back(std::move(message));
+    if (!connection->writing) {
+        write_next(connection);
+    }
+}
+
+void ControlServer::write_next(const std::shared_ptr<Connection>& connection) {
+    if (connection->outbox.empty()) {
+        connection->writing = false;
+        if (closing_) {
+            close(connection);
+        } else {
+            close_when_answered(connection);
+        }
+        return;
+    }
+    connection->writing = true;
+    boost::asio::async_write(
+        connection->socket, boost::asio::buffer(connection->outbox.front()),
+        [this, connection](boost::system::error_code ec, size_t) {
+            connection->outbox.pop_front();
+            if (ec) {
+                connection->writing = false;
+                close(connection);
+                return;
+            }
+            write_next(connection);
+        });
+}
+
+void ControlServer::close_when_answered(const std::shared_ptr<Connection>& connection) {
+    if (!connection->reading && connection->pending == 0 && !connection->writing) {
+        close(connection);
+    }
+}
+
+void ControlServer::close(const std::shared_ptr<Connection>& connection) {
+    if (!connections_.erase(connection)) {
+        return;
+    }
+    LOG_INFO("Control client disconnected");
+    boost::system::error_code ec;
+    connection->socket.shutdown(boost::asio::local::stream_protocol::socket::shutdown_both, ec);
+    connection->socket.close(ec);
+    if (closing_ && connections_.empty()) {
+        close_deadline_.cancel();
+    }
+}
+
+} // namespace deribit
@@ -0,0 +1,148 @@
+#include "daemon.hpp"
+#include "logger.hpp"
+#include "shm_metrics.hpp"
+#include <csignal>
+
+namespace deribit {
+
+Daemon::Daemon(Config& config, WebsocketServer& server, OrderManager& orders)
+    : config_(config)
+    , server_(server)
+    , orders_(orders)
+    , control_(config.daemon.control_socket, config.daemon.control_workers)
+    , signals_ioc_()
+    , signals_(signals_ioc_, SIGINT, SIGTERM)
+    , started_(std::chrono::steady_clock::now())
+{
+    // A client that hangs up mid-reply must not take the process with it.
+    std::signal(SIGPIPE, SIG_IGN);
+    add_commands();
+}
+
+int Daemon::run() {
+    if (!control_.start()) {
+        return 1;
+    }
+    LOG_INFO("Running as a daemon; SIGINT or SIGTERM shuts down");
+
+    int caught = 0;
+    signals_.async_wait([&](boost::system::error_code ec, int signal_number) {
+        if (!ec) {
+            caught = signal_number;
+        }
+    });
+    signals_ioc_.run();
+    LOG_INFO("Caught signal %d, shutting down", caught);
+
+    // One deadline for the whole drain: commands first, as a running order
+    // may still be answered, then the clients' queued updates.
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(config_.daemon.shutdown_drain_ms);
+    bool commands_done = control_.stop(deadline);
+    bool sessions_done = server_.drain(deadline);
+    if (!commands_done || !sessions_done) {
+        LOG_WARNING("Shutdown drain did not finish within %u ms", config_.daemon.shutdown_drain_ms);
+    }
+    return 0;
+}
+
+void Daemon::add_commands() {
+    control_.add("place", [this](const json::Value& request, json::Writer& result, std::string& error) {
+        std::string side = request["side"].get_or("");
+        OrderParams params{request["instrument"].get_or(config_.trading.default_instrument), 0.0, 0.0,
+                           request["type"].get_or("limit")};
+        if (!request["amount"].get(params.amount)) {
+            error = "amount is required";
+            return false;
+        }
+        if (!request["price"].get(params.price) && params.type != "market") {
+            error = "price is required for " + params.type + " orders";
+            return false;
+        }
+
+        std::string order_id;
+        if (side == "buy") {
+            order_id = orders_.place_buy_order(params);
+        } else if (side == "sell") {
+            order_id = orders_.place_sell_order(params);
+        } else {
+            error = "side must be buy or sell";
+            return false;
+        }
+        if (order_id.empty()) {
+            error = "order was not accepted";
+            return false;
+        }
+        result.begin_object().member("order_id", order_id).end_object();
+        return true;
+    });
+
+    control_.add("cancel", [this](const json::Value& request, json::Writer& result, std::string& error) {
+        std::string order_id;
+        if (!request["order_id"].get(order_id) || order_id.empty()) {
+            error = "order_id is required";
+            return false;
+        }
+        if (!orders_.cancel_order(order_id)) {
+            error = "cancel failed for " + order_id;
+            return false;
+        }
+        result.begin_object().member("cancelled", order_id).end_object();
+        return true;
+    });
+
+    control_.add("status", [this](const json::Value&, json::Writer& result, std::string&) {
+        WebsocketServer::Status status = server_.status();
+        auto uptime = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - started_);
+        result.begin_object()
+            .member("uptime_s", static_cast<long long>(uptime.count()))
+            .member("sessions", status.sessions)
+            .member("client_subscriptions", status.client_subscriptions)
+            .member("upstream_connected", status.upstream_connected)
+            .member("upstream_channels", status.upstream_channels)
+            .member("pending_requests", status.pending_requests)
+            .member("books", status.books)
+            .end_object();
+        return true;
+    });
+
+    control_.add("stats", [this](const json::Value&, json::Writer& result, std::string& error) {
+        ShmMetricsReader reader;
+        if (!ShmMetrics::instance().is_open() || !reader.open(config_.metrics.shared_memory_name)) {
+            error = "shared-memory metrics are disabled (metrics.shared_memory_enabled)";
+            return false;
+        }
+        result.begin_object().key("counters").begin_object();
+        for (const auto& counter : reader.read_counters()) {
+            result.member(counter.name, counter.value);
+        }
+        result.end_object().key("histograms").begin_object();
+        for (const auto& histogram : reader.read_histograms()) {
+            result.key(histogram.name).begin_object()
+                .member("count", histogram.count)
+                .member("avg_ns", histogram.count ? histogram.sum_ns / histogram.count : 0)
+                .member("p50_ns", histogram.percentile_ns(50))
+                .member("p99_ns", histogram.percentile_ns(99))
+                .member("max_ns", histogram.max_ns)
+                .member("stale", histogram.stale)
+                .end_object();
+        }
+        result.end_object().end_object();
+        return true;
+    });
+
+    control_.add("subscribe", [this](const json::Value& request, json::Writer& result, std::string& error) {
+        std::string instrument;
+        if (!request["instrument"].get(instrument) || instrument.empty()) {
+            error = "instrument is required";
+            return false;
+        }
+        if (!server_.subscribe_to_orderbook(instrument)) {
+            error = "no upstream connection";
+            return false;
+        }
+        result.begin_object().member("subscribed", instrument).end_object();
+        return true;
+    });
+}
+
+} // namespace deribit
@@ -0,0 +1,167 @@
+#include "instrumented_mutex.hpp"
+#include "shm_metrics.hpp"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <vector>
+
+namespace deribit {
+
+struct LockStats {
+    std::string name;
+    std::atomic<uint64_t> acquisitions{0};
+    std::atomic<uint64_t> contended{0};
+    std::atomic<uint64_t> wait_ns{0};
+    std::atomic<uint64_t> max_wait_ns{0};
+    std::atomic<uint64_t> hold_ns{0};
+    std::atomic<uint64_t> max_hold_ns{0};
+    int acquisitions_metric = -1;
+    int contended_metric = -1;
+    int wait_metric = -1;
+    int hold_metric = -1;
+};
+
+namespace {
+
+// The registry itself uses a plain std::mutex: it is only taken when a lock
+// is constructed or the ranking is printed.
+std::mutex registry_mutex;
+std::deque<LockStats>& registry() {
+    static std::deque<LockStats> stats;
+    return stats;
+}
+
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void update_max(std::atomic<uint64_t>& target, uint64_t value) {
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (value > current &&
+           !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+}
+
+std::atomic<bool> LockProfiler::enabled_{false};
+
+void LockProfiler::set_enabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+LockStats* LockProfiler::stats_for(const std::string& name) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    auto& stats = registry();
+    auto it = std::find_if(stats.begin(), stats.end(),
+                           [&](const LockStats& entry) { return entry.name == name; });
+    if (it != stats.end()) {
+        return &*it;
+    }
+
+    LockStats& entry = stats.emplace_back();
+    entry.name = name;
+    auto& metrics = ShmMetrics::instance();
+    entry.acquisitions_metric = metrics.counter("lock." + name + ".acquisitions");
+    entry.contended_metric = metrics.counter("lock." + name + ".contended");
+    entry.wait_metric = metrics.histogram("lock." + name + ".wait");
+    entry.hold_metric = metrics.histogram("lock." + name + ".hold");
+    return &entry;
+}
+
+void LockProfiler::print_ranking(std::ostream& out) {
+    std::vector<const LockStats*> ranked;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (const auto& entry : registry()) {
+            if (entry.acquisitions.load(std::memory_order_relaxed) > 0) {
+                ranked.push_back(&entry);
+            }
+        }
+    }
+    if (ranked.empty()) {
+        return;
+    }
+
+    std::sort(ranked.begin(), ranked.end(), [](const LockStats* a, const LockStats* b) {
+        return a->wait_ns.load(std::memory_order_relaxed) > b->wait_ns.load(std::memory_order_relaxed);
+    });
+
+    out << "\n===== LOCK CONTENTION (by total wait) =====\n";
+    out << std::fixed << std::setprecision(2);
+    int rank = 1;
+    for (const LockStats* entry : ranked) {
+        uint64_t acquisitions = entry->acquisitions.load(std::memory_order_relaxed);
+        uint64_t contended = entry->contended.load(std::memory_order_relaxed);
+        uint64_t wait_ns = entry->wait_ns.load(std::memory_order_relaxed);
+        uint64_t hold_ns = entry->hold_ns.load(std::memory_order_relaxed);
+
+        out << rank++ << ". " << entry->name << std::endl;
+        out << "  Acquisitions: " << acquisitions << std::endl;
+        out << "  Contended: " << contended << " (" << 100.0 * contended / acquisitions << "%)" << std::endl;
+        out << "  Total wait: " << wait_ns / 1e6 << " ms" << std::endl;
+        out << "  Avg wait when contended: " << (contended ? wait_ns / 1000.0 / contended : 0.0) << " us" << std::endl;
+        out << "  Max wait: " << entry->max_wait_ns.load(std::memory_order_relaxed) / 1000.0 << " us" << std::endl;
+        out << "  Avg hold: " << hold_ns / 1000.0 / acquisitions << " us" << std::endl;
+        out << "  Max hold: " << entry->max_hold_ns.load(std::memory_order_relaxed) / 1000.0 << " us" << std::endl;
+    }
+    out << std::defaultfloat;
+    out << "===========================================\n";
+}
+
+InstrumentedMutex::InstrumentedMutex(const std::string& name)
+    : stats_(LockProfiler::stats_for(name))
+    , acquired_ns_(0)
+{}
+
+void InstrumentedMutex::lock() {
+    if (!LockProfiler::enabled()) {
+        mutex_.lock();
+        acquired_ns_ = 0;
+        return;
+    }
+
+    if (!mutex_.try_lock()) {
+        uint64_t wait_start = now_ns();
+        mutex_.lock();
+        uint64_t waited = now_ns() - wait_start;
+
+        stats_->contended.fetch_add(1, std::memory_order_relaxed);
+        stats_->wait_ns.fetch_add(waited, std::memory_order_relaxed);
+        update_max(stats_->max_wait_ns, waited);
+        ShmMetrics::instance().add(stats_->contended_metric);
+        ShmMetrics::instance().record(stats_->wait_metric, waited);
+    }
+
+    stats_->acquisitions.fetch_add(1, std::memory_order_relaxed);
+    ShmMetrics::instance().add(stats_->acquisitions_metric);
+    acquired_ns_ = now_ns();
+}
+
+bool InstrumentedMutex::try_lock() {
+    if (!mutex_.try_lock()) {
+        return false;
+    }
+    acquired_ns_ = 0;
+    if (LockProfiler::enabled()) {
+        stats_->acquisitions.fetch_add(1, std::memory_order_relaxed);
+        ShmMetrics::instance().add(stats_->acquisitions_metric);
+        acquired_ns_ = now_ns();
+    }
+    return true;
+}
+
+void InstrumentedMutex::unlock() {
+    if (acquired_ns_) {
+        uint64_t held = now_ns() - acquired_ns_;
+        acquired_ns_ = 0;
+        stats_->hold_ns.fetch_add(held, std::memory_order_relaxed);
+        update_max(stats_->max_hold_ns, held);
+        ShmMetrics::instance().record(stats_->hold_metric, held);
+    }
+    mutex_.unlock();
+}
+
+} // namespace deribit
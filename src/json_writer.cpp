@@ -0,0 +1,140 @@
+#include "json_writer.hpp"
+#include <charconv>
+#include <cmath>
+
+namespace deribit {
+namespace json {
+
+namespace {
+
+// Characters that must be escaped inside a JSON string.
+inline bool needs_escape(unsigned char c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+void append_string(std::string& out, std::string_view text) {
+    static const char HEX[] = "0123456789abcdef";
+    out += '"';
+    size_t run = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (!needs_escape(c)) {
+            continue;
+        }
+        out.append(text.data() + run, i - run);
+        run = i + 1;
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        default: {
+            char escape[6] = {'\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xf]};
+            out.append(escape, sizeof(escape));
+            break;
+        }
+        }
+    }
+    out.append(text.data() + run, text.size() - run);
+    out += '"';
+}
+
+}
+
+Writer& Writer::key(std::string_view name) {
+    separate();
+    append_string(out_, name);
+    out_ += ':';
+    after_key_ = true;
+    return *this;
+}
+
+Writer& Writer::value(std::string_view text) {
+    separate();
+    append_string(out_, text);
+    return *this;
+}
+
+Writer& Writer::value(bool flag) {
+    separate();
+    out_ += flag ? "true" : "false";
+    return *this;
+}
+
+Writer& Writer::value(double number) {
+    separate();
+    if (!std::isfinite(number)) {
+        // JSON has no NaN or infinity.
+        out_ += "null";
+        return *this;
+    }
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    out_.append(buffer, result.ptr - buffer);
+    return *this;
+}
+
+Writer& Writer::value(const Decimal& number) {
+    separate();
+    // The most negative value has no positive counterpart in int64_t.
+    uint64_t magnitude = number.units < 0 ? 0 - static_cast<uint64_t>(number.units)
+                                          : static_cast<uint64_t>(number.units);
+    uint64_t whole = magnitude / Decimal::SCALE;
+    uint64_t fraction = magnitude % Decimal::SCALE;
+
+    char buffer[32];
+    char* p = buffer;
+    if (number.units < 0) {
+        *p++ = '-';
+    }
+    p = std::to_chars(p, buffer + sizeof(buffer), whole).ptr;
+    if (fraction) {
+        *p++ = '.';
+        int digits = Decimal::DIGITS;
+        while (fraction % 10 == 0) {
+            fraction /= 10;
+            --digits;
+        }
+        for (int i = digits - 1; i >= 0; --i) {
+            p[i] = static_cast<char>('0' + fraction % 10);
+            fraction /= 10;
+        }
+        p += digits;
+    }
+    out_.append(buffer, p - buffer);
+    return *this;
+}
+
+Writer& Writer::null() {
+    separate();
+    out_ += "null";
+    return *this;
+}
+
+Writer& Writer::raw(std::string_view json) {
+    separate();
+    out_.append(json.data(), json.size());
+    return *this;
+}
+
+Writer& Writer::write_signed(long long number) {
+    separate();
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    out_.append(buffer, result.ptr - buffer);
+    return *this;
+}
+
+Writer& Writer::write_unsigned(unsigned long long number) {
+    separate();
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    out_.append(buffer, result.ptr - buffer);
+    return *this;
+}
+
+} // namespace json
+} // namespace deribit
@@ -0,0 +1,206 @@
+#include "live_config.hpp"
+#include "instrumented_mutex.hpp"
+#include "logger.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace deribit {
+
+namespace {
+
+// Lets a tool that writes the file in several steps finish before it is
+// read.
+constexpr auto SETTLE_TIME = std::chrono::milliseconds(50);
+
+// Reads whatever events are queued; true if any is for `file_name`.
+bool drain_events(int fd, const std::string& file_name) {
+    alignas(inotify_event) char buffer[4096];
+    bool matched = false;
+    ssize_t length;
+    while ((length = ::read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + length;) {
+            auto* event = reinterpret_cast<inotify_event*>(p);
+            if (event->len && file_name == event->name) {
+                matched = true;
+            }
+            p += sizeof(inotify_event) + event->len;
+        }
+    }
+    return matched;
+}
+
+bool same_thread_counts(const Config& a, const Config& b) {
+    for (const char* role : {"main", "upstream", "io"}) {
+        if (a.threading.role(role).threads != b.threading.role(role).threads) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+LiveConfig::LiveConfig(const Config& initial) {
+    snapshots_.push_back(std::make_unique<const Config>(initial));
+    current_.store(snapshots_.back().get(), std::memory_order_release);
+}
+
+const Config& LiveConfig::publish(const Config& next) {
+    std::lock_guard<std::mutex> lock(publish_mutex_);
+    const Config* previous = current_.load(std::memory_order_relaxed);
+    snapshots_.push_back(std::make_unique<const Config>(next));
+    current_.store(snapshots_.back().get(), std::memory_order_release);
+    return *previous;
+}
+
+ConfigWatcher::ConfigWatcher(std::string path, LiveConfig& live, Apply apply)
+    : path_(std::move(path))
+    , file_name_(std::filesystem::path(path_).filename().string())
+    , live_(live)
+    , apply_(std::move(apply))
+{}
+
+ConfigWatcher::~ConfigWatcher() {
+    stop();
+}
+
+bool ConfigWatcher::start() {
+    std::string directory = std::filesystem::path(path_).parent_path().string();
+    if (directory.empty()) {
+        directory = ".";
+    }
+    inotify_fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (inotify_fd_ < 0 || wake_fd_ < 0 ||
+        ::inotify_add_watch(inotify_fd_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        LOG_ERROR("Unable to watch %s for config changes: %s", directory.c_str(), std::strerror(errno));
+        stop();
+        return false;
+    }
+    thread_ = std::thread([this] { run(); });
+    LOG_INFO("Watching %s for config changes", path_.c_str());
+    return true;
+}
+
+void ConfigWatcher::stop() {
+    if (thread_.joinable()) {
+        uint64_t one = 1;
+        if (::write(wake_fd_, &one, sizeof(one)) < 0) {
+            LOG_WARNING("Unable to wake config watcher: %s", std::strerror(errno));
+        }
+        thread_.join();
+    }
+    for (int* fd : {&inotify_fd_, &wake_fd_}) {
+        if (*fd >= 0) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void ConfigWatcher::run() {
+    for (;;) {
+        pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Config watcher stopped: %s", std::strerror(errno));
+            return;
+        }
+        if (fds[1].revents) {
+            return;
+        }
+        if (drain_events(inotify_fd_, file_name_)) {
+            std::this_thread::sleep_for(SETTLE_TIME);
+            drain_events(inotify_fd_, file_name_);
+            reload();
+        }
+    }
+}
+
+bool ConfigWatcher::reload() {
+    Config next = live_.get();
+    try {
+        next = load_config(path_);
+    } catch (const std::exception& e) {
+        LOG_ERROR("Keeping the current config: reloading %s failed: %s", path_.c_str(), e.what());
+        return false;
+    }
+
+    const Config& previous = live_.publish(next);
+    const Config& current = live_.get();
+    LOG_INFO("Reloaded config from %s", path_.c_str());
+    for (const auto& name : restart_required(previous, current)) {
+        LOG_WARNING("Config %s changed; the change takes effect after a restart", name.c_str());
+    }
+
+    if (current.logging.level != previous.logging.level) {
+        LogLevel level;
+        if (Logger::parse_level(current.logging.level, level)) {
+            Logger::instance().set_level(level);
+            LOG_INFO("Log level is now %s", current.logging.level.c_str());
+        }
+    }
+    if (current.monitoring.lock_profiling_enabled != previous.monitoring.lock_profiling_enabled) {
+        LockProfiler::set_enabled(current.monitoring.lock_profiling_enabled);
+    }
+    if (apply_) {
+        apply_(previous, current);
+    }
+    return true;
+}
+
+std::vector<std::string> ConfigWatcher::restart_required(const Config& a, const Config& b) {
+    std::vector<std::string> changed;
+    auto check = [&](bool same, const char* name) {
+        if (!same) {
+            changed.push_back(name);
+        }
+    };
+    check(a.client_id == b.client_id && a.client_secret == b.client_secret, "api_credentials");
+    check(a.server.websocket_port == b.server.websocket_port, "server.websocket_port");
+    check(a.server.io_uring == b.server.io_uring && a.server.io_uring_entries == b.server.io_uring_entries &&
+              a.server.io_uring_sessions == b.server.io_uring_sessions,
+          "server.io_uring");
+    check(a.endpoints.rest_url == b.endpoints.rest_url && a.endpoints.websocket_url == b.endpoints.websocket_url,
+          "endpoints");
+    check(a.trading.default_currency == b.trading.default_currency &&
+              a.trading.default_instrument == b.trading.default_instrument,
+          "trading defaults");
+    check(a.metrics.shared_memory_enabled == b.metrics.shared_memory_enabled &&
+              a.metrics.shared_memory_name == b.metrics.shared_memory_name,
+          "metrics");
+    check(a.tracing.enabled == b.tracing.enabled && a.tracing.sample_every == b.tracing.sample_every &&
+              a.tracing.buffer_events == b.tracing.buffer_events && a.tracing.output_file == b.tracing.output_file,
+          "tracing");
+    check(a.monitoring.loop_lag_enabled == b.monitoring.loop_lag_enabled &&
+              a.monitoring.loop_probe_interval_us == b.monitoring.loop_probe_interval_us &&
+              a.monitoring.loop_lag_warning_us == b.monitoring.loop_lag_warning_us &&
+              a.monitoring.loop_lag_critical_us == b.monitoring.loop_lag_critical_us,
+          "monitoring.loop_lag");
+    check(a.monitoring.perf_counters_enabled == b.monitoring.perf_counters_enabled &&
+              a.monitoring.perf_sample_every == b.monitoring.perf_sample_every,
+          "monitoring.perf_counters");
+    check(a.timers.tick_us == b.timers.tick_us, "timers.tick_us");
+    check(a.checkpoint.enabled == b.checkpoint.enabled && a.checkpoint.path == b.checkpoint.path &&
+              a.checkpoint.interval_ms == b.checkpoint.interval_ms && a.checkpoint.max_age_s == b.checkpoint.max_age_s,
+          "checkpoint");
+    check(a.daemon.control_socket == b.daemon.control_socket &&
+              a.daemon.control_workers == b.daemon.control_workers &&
+              a.daemon.shutdown_drain_ms == b.daemon.shutdown_drain_ms,
+          "daemon");
+    check(a.memory.huge_pages == b.memory.huge_pages && a.memory.message_arena_bytes == b.memory.message_arena_bytes &&
+              a.memory.sessions_per_slab == b.memory.sessions_per_slab,
+          "memory");
+    check(same_thread_counts(a, b), "threading thread counts");
+    return changed;
+}
+
+} // namespace deribit
@@ -0,0 +1,109 @@
+#include "loop_monitor.hpp"
+#include "logger.hpp"
+#include "shm_metrics.hpp"
+#include <boost/asio/post.hpp>
+
+namespace deribit {
+
+namespace {
+
+constexpr std::chrono::seconds ALERT_INTERVAL{1};
+
+}
+
+LoopMonitor::LoopMonitor(boost::asio::io_context& ioc,
+                         const std::string& name,
+                         std::chrono::microseconds probe_interval,
+                         std::chrono::microseconds warning_threshold,
+                         std::chrono::microseconds critical_threshold)
+    : ioc_(ioc)
+    , timer_(ioc)
+    , name_(name)
+    , probe_interval_(probe_interval)
+    , warning_threshold_(warning_threshold)
+    , critical_threshold_(critical_threshold)
+    , running_(false)
+    , last_alert_ns_(0)
+    , lag_metric_(ShmMetrics::instance().histogram("loop." + name + ".lag"))
+    , iteration_metric_(ShmMetrics::instance().histogram("loop." + name + ".iteration"))
+    , handlers_metric_(ShmMetrics::instance().counter("loop." + name + ".handlers"))
+    , alerts_metric_(ShmMetrics::instance().counter("loop." + name + ".lag_alerts"))
+{}
+
+void LoopMonitor::start() {
+    LOG_INFO("Starting loop monitor for %s (probe every %lld us)", name_.c_str(),
+             static_cast<long long>(probe_interval_.count()));
+    running_ = true;
+    schedule_probe();
+}
+
+void LoopMonitor::stop() {
+    running_ = false;
+    boost::asio::post(ioc_, [this] { timer_.cancel(); });
+}
+
+void LoopMonitor::run() {
+    using clock = std::chrono::steady_clock;
+    auto& metrics = ShmMetrics::instance();
+
+    while (!ioc_.stopped()) {
+        auto start = clock::now();
+        std::size_t handlers = ioc_.poll();
+        if (handlers > 0) {
+            auto busy = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+            metrics.record(iteration_metric_, busy.count());
+            metrics.add(handlers_metric_, handlers);
+            continue;
+        }
+
+        // Nothing ready: block for the next handler. Its run time includes
+        // the idle wait, so it is counted but not timed.
+        handlers = ioc_.run_one();
+        if (handlers == 0) {
+            break;
+        }
+        metrics.add(handlers_metric_, handlers);
+    }
+}
+
+void LoopMonitor::schedule_probe() {
+    timer_.expires_after(probe_interval_);
+    timer_.async_wait([this](boost::system::error_code ec) {
+        if (ec || !running_) {
+            return;
+        }
+        auto posted = std::chrono::steady_clock::now();
+        boost::asio::post(ioc_, [this, posted] { on_probe(posted); });
+        schedule_probe();
+    });
+}
+
+void LoopMonitor::on_probe(std::chrono::steady_clock::time_point posted) {
+    auto now = std::chrono::steady_clock::now();
+    auto lag = std::chrono::duration_cast<std::chrono::nanoseconds>(now - posted);
+    ShmMetrics::instance().record(lag_metric_, lag.count());
+
+    if (lag < warning_threshold_) {
+        return;
+    }
+
+    ShmMetrics::instance().add(alerts_metric_);
+
+    int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+    int64_t last_alert = last_alert_ns_.load(std::memory_order_relaxed);
+    if (now_ns - last_alert < std::chrono::nanoseconds(ALERT_INTERVAL).count() ||
+        !last_alert_ns_.compare_exchange_strong(last_alert, now_ns, std::memory_order_relaxed)) {
+        return;
+    }
+
+    long long lag_us = std::chrono::duration_cast<std::chrono::microseconds>(lag).count();
+    if (lag >= critical_threshold_) {
+        LOG_ERROR("Event loop %s lag %lld us exceeds critical threshold %lld us", name_.c_str(), lag_us,
+                  static_cast<long long>(critical_threshold_.count()));
+    } else {
+        LOG_WARNING("Event loop %s lag %lld us exceeds warning threshold %lld us", name_.c_str(), lag_us,
+                    static_cast<long long>(warning_threshold_.count()));
+    }
+}
+
+} // namespace deribit
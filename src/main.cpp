@@ -4,41 +4,21 @@
 #include "market_data.hpp"
 #include "websocket_server.hpp"
 #include "performance_metrics.hpp"
+#include "shm_metrics.hpp"
+#include "trace.hpp"
+#include "perf_counters.hpp"
+#include "thread_topology.hpp"
+#include "ondemand_json.hpp"
+#include "startup.hpp"
+#include "daemon.hpp"
+#include "live_config.hpp"
 #include <iostream>
-#include <fstream>
-#include <json/json.h>
+#include <iomanip>
+#include <pthread.h>
 #include <cpprest/asyncrt_utils.h>
 #include <logger.hpp>
 
-deribit::Config load_config(const std::string &config_path)
-{
-    std::ifstream config_file(config_path);
-    if (!config_file.is_open())
-    {
-        throw std::runtime_error("Unable to open config file");
-    }
-
-    Json::Value root;
-    Json::Reader reader;
-    if (!reader.parse(config_file, root))
-    {
-        throw std::runtime_error("Failed to parse config file");
-    }
-
-    std::vector<std::string> supported_instruments;
-    for (const auto &instrument : root["trading"]["supported_instruments"])
-    {
-        supported_instruments.push_back(instrument.asString());
-    }
-
-    return deribit::Config(
-        root["api_credentials"]["client_id"].asString(),
-        root["api_credentials"]["client_secret"].asString(),
-        root["server"]["websocket_port"].asInt(),
-        root["trading"]["default_currency"].asString(),
-        root["trading"]["default_instrument"].asString(),
-        supported_instruments);
-}
+static constexpr const char *CONFIG_PATH = "config/config.json";
 
 void run_performance_test(deribit::OrderManager& order_manager, deribit::Config& config) 
 {
@@ -71,28 +51,161 @@ void run_performance_test(deribit::OrderManager& order_manager, deribit::Config&
 
 int main(int argc, char *argv[])
 {
+    bool daemon_mode = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "--daemon")
+        {
+            daemon_mode = true;
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--daemon]" << std::endl;
+            return 2;
+        }
+    }
+
     try
     {
         deribit::Logger::instance().set_log_file("logs/trading_system.log");
         deribit::Logger::instance().set_level(deribit::LogLevel::INFO);
         LOG_INFO("Starting Deribit Trading System");
         
-        auto config = load_config("config/config.json");
+        auto config = deribit::load_config(CONFIG_PATH);
+        deribit::LogLevel level;
+        if (deribit::Logger::parse_level(config.logging.level, level))
+        {
+            deribit::Logger::instance().set_level(level);
+        }
+        deribit::apply_thread_role(config.threading.role("main"));
+        pthread_t main_thread = pthread_self();
+
+        if (config.metrics.shared_memory_enabled)
+        {
+            if (deribit::ShmMetrics::instance().open(config.metrics.shared_memory_name))
+            {
+                LOG_INFO("Publishing metrics to shared memory segment %s", config.metrics.shared_memory_name.c_str());
+            }
+            else
+            {
+                LOG_WARNING("Shared memory metrics disabled: unable to open %s", config.metrics.shared_memory_name.c_str());
+            }
+        }
+
+        if (config.tracing.enabled)
+        {
+            deribit::Tracer::instance().configure(true, config.tracing.sample_every, config.tracing.buffer_events);
+            LOG_INFO("Tracing 1 in %u upstream messages", config.tracing.sample_every);
+        }
+
+        deribit::PerfStageProfiler::instance().configure(
+            config.monitoring.perf_counters_enabled, config.monitoring.perf_sample_every);
+        deribit::LockProfiler::set_enabled(config.monitoring.lock_profiling_enabled);
 
         deribit::Authentication auth(config);
-        if (!auth.authenticate())
+        deribit::WebsocketServer ws_server(config);
+        // Order deadlines run on the server's timer wheel.
+        deribit::OrderManager order_manager(config, &ws_server.timers());
+        deribit::MarketData market_data(config);
+        deribit::LiveConfig live_config(config);
+        ws_server.use_live_config(&live_config);
+        order_manager.use_live_config(&live_config);
+        deribit::ConfigWatcher config_watcher(CONFIG_PATH, live_config,
+            [&](const deribit::Config &previous, const deribit::Config &next) {
+                deribit::ThreadRole main_role = next.threading.role("main");
+                deribit::ThreadRole previous_role = previous.threading.role("main");
+                if (main_role.name != previous_role.name || main_role.cpus != previous_role.cpus ||
+                    main_role.policy != previous_role.policy || main_role.priority != previous_role.priority)
+                {
+                    deribit::apply_thread_role(main_thread, main_role);
+                }
+                ws_server.reconfigure(previous, next);
+            });
+        std::unique_ptr<deribit::Daemon> daemon;
+        if (daemon_mode)
+        {
+            daemon = std::make_unique<deribit::Daemon>(config, ws_server, order_manager);
+        }
+        // The catalog restored from the checkpoint, if any, serves until
+        // the fresh one has loaded.
+        market_data.set_instrument_catalog(ws_server.instrument_catalog());
+
+        // The network round trips of startup overlap; only the upstream
+        // connection waits, for the server's io threads and timer wheel.
+        deribit::StartupSequence startup;
+        bool authenticated = false;
+        startup.add("auth", [&] { return authenticated = auth.authenticate(); });
+        startup.add("server.listen", [&] {
+            ws_server.run(config.server.websocket_port, false);
+            // Queued now, so the instruments named outright go out as soon
+            // as the upstream connects; patterns follow the catalog.
+            if (config.trading.presubscribe)
+            {
+                ws_server.presubscribe();
+            }
+            return true;
+        });
+        startup.add("upstream.connect", [&] { return ws_server.connect_upstream(); }, {"server.listen"}, false);
+        startup.add("rest.warmup", [&] { return order_manager.warm_up(); }, {}, false);
+        startup.add("instruments.load", [&] {
+            if (!market_data.load_instrument_catalog(config.trading.default_currency)) {
+                return false;
+            }
+            ws_server.set_instrument_catalog(market_data.instrument_names());
+            return true;
+        }, {}, false);
+        if (config.trading.presubscribe)
+        {
+            startup.add("books.warm", [&] {
+                std::vector<std::string> instruments = ws_server.presubscribe();
+                auto deadline = std::chrono::steady_clock::now() +
+                                std::chrono::milliseconds(config.trading.presubscribe_wait_ms);
+                size_t warm = ws_server.wait_for_books(instruments, deadline);
+                if (warm < instruments.size())
+                {
+                    LOG_WARNING("%zu of %zu pre-subscribed books warm after %u ms", warm, instruments.size(),
+                                config.trading.presubscribe_wait_ms);
+                    return false;
+                }
+                return true;
+            }, {"upstream.connect", "instruments.load"}, false);
+        }
+        bool started = startup.run();
+
+        for (const auto &phase : startup.phases())
+        {
+            std::cout << "  " << std::left << std::setw(18) << phase.name << std::setw(8)
+                      << deribit::StartupSequence::status_name(phase.status) << std::right << std::fixed
+                      << std::setprecision(1) << std::chrono::duration<double, std::milli>(phase.duration).count()
+                      << " ms" << std::defaultfloat << std::endl;
+        }
+        std::cout << "Startup took " << std::fixed << std::setprecision(1)
+                  << std::chrono::duration<double, std::milli>(startup.elapsed()).count() << " ms"
+                  << std::defaultfloat << std::endl;
+
+        if (!authenticated)
         {
             std::cerr << "Authentication failed" << std::endl;
             return 1;
         }
+        if (!started)
+        {
+            std::cerr << "Startup failed" << std::endl;
+            return 1;
+        }
         std::cout << "Successfully authenticated" << std::endl;
-
-        deribit::OrderManager order_manager(config);
-        deribit::MarketData market_data(config);
-
-        deribit::WebsocketServer ws_server(config);
-        ws_server.run(config.server.websocket_port);
         std::cout << "WebSocket server started on port " << config.server.websocket_port << std::endl;
+        // Reloads only once everything it reconfigures is running.
+        config_watcher.start();
+
+        if (daemon)
+        {
+            int code = daemon->run();
+            config_watcher.stop();
+            ws_server.stop();
+            deribit::ShmMetrics::instance().close();
+            return code;
+        }
 
         std::string command;
         while (true)
@@ -107,9 +220,10 @@ int main(int argc, char *argv[])
             std::cout << "7. Get ticker" << std::endl;
             std::cout << "8. Get instruments" << std::endl;
             std::cout << "9. Run performance test" << std::endl;
-            std::cout << "10. Exit" << std::endl;
+            std::cout << "10. Dump trace timeline" << std::endl;
+            std::cout << "11. Exit" << std::endl;
 
-            std::cout << "\nEnter command (1-9): ";
+            std::cout << "\nEnter command (1-11): ";
             std::getline(std::cin, command);
 
             if (command == "1")
@@ -173,7 +287,7 @@ int main(int argc, char *argv[])
             {
                 auto positions = order_manager.get_positions(config.trading.default_currency, "future");
                 std::cout << "Retrieved positions:" << std::endl;
-                std::cout << utility::conversions::to_utf8string(positions.serialize()) << std::endl;
+                std::cout << positions.text() << std::endl;
             }
             else if (command == "6")
             {
@@ -182,7 +296,7 @@ int main(int argc, char *argv[])
                 std::getline(std::cin, instrument_name);
                 auto orderbook = market_data.get_orderbook(instrument_name, 10);
                 std::cout << "Retrieved orderbook for instrument: " << instrument_name << std::endl;
-                std::cout << utility::conversions::to_utf8string(orderbook.serialize()) << std::endl;
+                std::cout << orderbook.text() << std::endl;
             }
             else if (command == "7")
             {
@@ -191,23 +305,34 @@ int main(int argc, char *argv[])
                 std::getline(std::cin, instrument_name);
                 auto ticker = market_data.get_ticker(instrument_name);
                 std::cout << "Retrieved ticker for instrument: " << instrument_name << std::endl;
-                std::cout << utility::conversions::to_utf8string(ticker.serialize()) << std::endl;
+                std::cout << ticker.text() << std::endl;
             }
             else if (command == "8")
             {
                 auto instruments = market_data.get_instruments(config.trading.default_currency, "future");
                 std::cout << "Retrieved instruments for currency: " << config.trading.default_currency << std::endl;
-                std::cout << utility::conversions::to_utf8string(instruments.serialize()) << std::endl;
+                std::cout << instruments.text() << std::endl;
             }
             else if (command == "9") {
                 run_performance_test(order_manager, config);
             }
-            else if (command == "10") {
+            else if (command == "11") {
                 break;
             }
+            else if (command == "10") {
+                if (!deribit::Tracer::instance().enabled()) {
+                    std::cout << "Tracing is disabled in config.json" << std::endl;
+                } else if (deribit::Tracer::instance().dump_chrome_trace(config.tracing.output_file)) {
+                    std::cout << "Trace timeline written to " << config.tracing.output_file << std::endl;
+                } else {
+                    std::cout << "Failed to write trace timeline to " << config.tracing.output_file << std::endl;
+                }
+            }
         }
 
+        config_watcher.stop();
         ws_server.stop();
+        deribit::ShmMetrics::instance().close();
         return 0;
     }
     catch (const std::exception &e)
@@ -1,17 +1,17 @@
 #include "market_data.hpp"
 #include <iostream>
 #include <cpprest/uri_builder.h>
-#include <cpprest/json.h>
 #include <cpprest/asyncrt_utils.h>
 
 namespace deribit {
 
 MarketData::MarketData(Config& config)
     : config_(config)
-    , client_(web::uri(utility::conversions::to_string_t(config.BASE_URL)))
+    , client_(web::uri(utility::conversions::to_string_t(config.endpoints.rest_url)))
+    , catalog_mutex_("market_data.catalog")
 {}
 
-web::json::value MarketData::get_orderbook(const std::string& instrument_name, int depth) {
+json::Message MarketData::get_orderbook(const std::string& instrument_name, int depth) {
     web::uri_builder builder(U("/public/get_order_book"));
     builder.append_query(U("instrument_name"), instrument_name)
            .append_query(U("depth"), depth);
@@ -20,17 +20,17 @@ web::json::value MarketData::get_orderbook(const std::string& instrument_name, i
         auto response = client_.request(web::http::methods::GET, builder.to_string()).get();
         if (response.status_code() == web::http::status_codes::OK) {
             std::cout << "Retrieved orderbook for instrument: " << instrument_name << std::endl;
-            return response.extract_json().get();
+            return json::Message(response.extract_utf8string(true).get());
         } else {
             std::cout << "Failed to get orderbook for instrument: " << instrument_name << ". Status code: " << response.status_code() << std::endl;
         }
     } catch (const std::exception& e) {
         std::cerr << "Error getting orderbook for instrument " << instrument_name << ": " << e.what() << std::endl;
     }
-    return web::json::value::null();
+    return json::Message();
 }
 
-web::json::value MarketData::get_ticker(const std::string& instrument_name) {
+json::Message MarketData::get_ticker(const std::string& instrument_name) {
     web::uri_builder builder(U("/public/ticker"));
     builder.append_query(U("instrument_name"), instrument_name);
 
@@ -38,17 +38,17 @@ web::json::value MarketData::get_ticker(const std::string& instrument_name) {
         auto response = client_.request(web::http::methods::GET, builder.to_string()).get();
         if (response.status_code() == web::http::status_codes::OK) {
             std::cout << "Retrieved ticker for instrument: " << instrument_name << std::endl;
-            return response.extract_json().get();
+            return json::Message(response.extract_utf8string(true).get());
         } else {
             std::cout << "Failed to get ticker for instrument: " << instrument_name << ". Status code: " << response.status_code() << std::endl;
         }
     } catch (const std::exception& e) {
         std::cerr << "Error getting ticker for instrument " << instrument_name << ": " << e.what() << std::endl;
     }
-    return web::json::value::null();
+    return json::Message();
 }
 
-web::json::value MarketData::get_instruments(const std::string& currency, const std::string& kind) {
+json::Message MarketData::get_instruments(const std::string& currency, const std::string& kind) {
     web::uri_builder builder(U("/public/get_instruments"));
     builder.append_query(U("currency"), currency)
            .append_query(U("kind"), kind);
@@ -57,17 +57,57 @@ web::json::value MarketData::get_instruments(const std::string& currency, const
         auto response = client_.request(web::http::methods::GET, builder.to_string()).get();
         if (response.status_code() == web::http::status_codes::OK) {
             std::cout << "Retrieved instruments for currency: " << currency << ", kind: " << kind << std::endl;
-            return response.extract_json().get();
+            return json::Message(response.extract_utf8string(true).get());
         } else {
             std::cout << "Failed to get instruments for currency: " << currency << ", kind: " << kind << ". Status code: " << response.status_code() << std::endl;
         }
     } catch (const std::exception& e) {
         std::cerr << "Error getting instruments for currency " << currency << ", kind " << kind << ": " << e.what() << std::endl;
     }
-    return web::json::value::null();
+    return json::Message();
 }
 
-web::json::value MarketData::get_options_instruments(const std::string& currency) {
+bool MarketData::load_instrument_catalog(const std::string& currency) {
+    web::uri_builder builder(U("/public/get_instruments"));
+    builder.append_query(U("currency"), currency);
+
+    try {
+        auto response = client_.request(web::http::methods::GET, builder.to_string()).get();
+        if (response.status_code() != web::http::status_codes::OK) {
+            std::cout << "Failed to load instrument catalog for currency: " << currency << ". Status code: " << response.status_code() << std::endl;
+            return false;
+        }
+        json::Message reply(response.extract_utf8string(true).get());
+        std::vector<std::string> names;
+        for (const auto& instrument : reply.root()["result"].elements()) {
+            std::string name;
+            if (instrument["instrument_name"].get(name)) {
+                names.push_back(std::move(name));
+            }
+        }
+        if (names.empty()) {
+            return false;
+        }
+        std::lock_guard<InstrumentedMutex> lock(catalog_mutex_);
+        catalog_ = std::move(names);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error loading instrument catalog for " << currency << ": " << e.what() << std::endl;
+    }
+    return false;
+}
+
+std::vector<std::string> MarketData::instrument_names() const {
+    std::lock_guard<InstrumentedMutex> lock(catalog_mutex_);
+    return catalog_;
+}
+
+void MarketData::set_instrument_catalog(std::vector<std::string> names) {
+    std::lock_guard<InstrumentedMutex> lock(catalog_mutex_);
+    catalog_ = std::move(names);
+}
+
+json::Message MarketData::get_options_instruments(const std::string& currency) {
     web::uri_builder builder(U("/public/get_instruments"));
     builder.append_query(U("currency"), currency)
            .append_query(U("kind"), "option");
@@ -76,12 +116,12 @@ web::json::value MarketData::get_options_instruments(const std::string& currency
         auto response = client_.request(web::http::methods::GET, builder.to_string()).get();
         if (response.status_code() == web::http::status_codes::OK) {
             std::cout << "Retrieved options instruments for currency: " << currency << std::endl;
-            return response.extract_json().get();
+            return json::Message(response.extract_utf8string(true).get());
         }
     } catch (const std::exception& e) {
         std::cerr << "Error getting options instruments: " << e.what() << std::endl;
     }
-    return web::json::value::null();
+    return json::Message();
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,249 @@
+#include "memory_pool.hpp"
+#include <algorithm>
+#include <mutex>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace deribit {
+
+namespace {
+
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+// Room for a libstdc++ shared_ptr control block with a deleter and an
+// allocator.
+constexpr size_t CONTROL_BLOCK_SIZE = 128;
+// Larger strings, e.g. after a deep snapshot, are freed rather than kept.
+constexpr size_t MAX_RETAINED_CAPACITY = 1024 * 1024;
+
+size_t round_up(size_t bytes, size_t unit) {
+    return (bytes + unit - 1) / unit * unit;
+}
+
+}
+
+void* map_pages(size_t& bytes, bool huge_pages) {
+    const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    if (huge_pages) {
+        // Reserved hugetlbfs pages, if the host has any.
+        size_t huge_bytes = round_up(bytes, HUGE_PAGE_SIZE);
+        void* memory = ::mmap(nullptr, huge_bytes, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if (memory != MAP_FAILED) {
+            bytes = huge_bytes;
+            return memory;
+        }
+    }
+
+    size_t mapped = round_up(bytes, huge_pages ? HUGE_PAGE_SIZE : page);
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | (huge_pages ? 0 : MAP_POPULATE);
+    void* memory = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    if (huge_pages) {
+        // Transparent huge pages have to be asked for before the first
+        // touch, so the prefault happens by hand afterwards.
+        ::madvise(memory, mapped, MADV_HUGEPAGE);
+        for (size_t offset = 0; offset < mapped; offset += page) {
+            static_cast<volatile char*>(memory)[offset] = 0;
+        }
+    }
+    bytes = mapped;
+    return memory;
+}
+
+void unmap_pages(void* memory, size_t bytes) {
+    if (memory) {
+        ::munmap(memory, bytes);
+    }
+}
+
+Arena::Arena(size_t chunk_bytes, bool huge_pages)
+    : chunk_bytes_(chunk_bytes)
+    , huge_pages_(huge_pages)
+    , current_(0)
+    , cursor_(nullptr)
+    , limit_(nullptr)
+{}
+
+Arena::~Arena() {
+    for (const auto& chunk : chunks_) {
+        unmap_pages(chunk.memory, chunk.size);
+    }
+}
+
+void* Arena::allocate(size_t bytes, size_t alignment) {
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor_) + alignment - 1) & ~(uintptr_t(alignment) - 1);
+    if (!cursor_ || aligned + bytes > reinterpret_cast<uintptr_t>(limit_)) {
+        if (!next_chunk(bytes, alignment)) {
+            throw std::bad_alloc();
+        }
+        aligned = (reinterpret_cast<uintptr_t>(cursor_) + alignment - 1) & ~(uintptr_t(alignment) - 1);
+    }
+    cursor_ = reinterpret_cast<char*>(aligned + bytes);
+    return reinterpret_cast<void*>(aligned);
+}
+
+void Arena::reset() {
+    current_ = 0;
+    if (chunks_.empty()) {
+        cursor_ = limit_ = nullptr;
+    } else {
+        cursor_ = chunks_[0].memory;
+        limit_ = cursor_ + chunks_[0].size;
+    }
+}
+
+// Moves on to the next kept chunk that fits, or maps a new one.
+bool Arena::next_chunk(size_t bytes, size_t alignment) {
+    size_t needed = bytes + alignment;
+    size_t next = cursor_ ? current_ + 1 : 0;
+    for (; next < chunks_.size(); ++next) {
+        if (chunks_[next].size >= needed) {
+            break;
+        }
+    }
+    if (next == chunks_.size()) {
+        size_t size = std::max(chunk_bytes_, needed);
+        void* memory = map_pages(size, huge_pages_);
+        if (!memory) {
+            return false;
+        }
+        chunks_.push_back({static_cast<char*>(memory), size});
+    }
+    current_ = next;
+    cursor_ = chunks_[next].memory;
+    limit_ = cursor_ + chunks_[next].size;
+    return true;
+}
+
+FixedPool::FixedPool(size_t block_size, size_t blocks_per_slab, bool huge_pages)
+    : block_size_(round_up(std::max(block_size, sizeof(FreeBlock)), alignof(std::max_align_t)))
+    , blocks_per_slab_(std::max<size_t>(blocks_per_slab, 1))
+    , huge_pages_(huge_pages)
+    , free_(nullptr)
+{}
+
+FixedPool::~FixedPool() {
+    for (const auto& [memory, size] : slabs_) {
+        unmap_pages(memory, size);
+    }
+}
+
+void* FixedPool::allocate() {
+    std::lock_guard<SpinLock> lock(lock_);
+    if (!free_) {
+        add_slab();
+    }
+    FreeBlock* block = free_;
+    free_ = block->next;
+    return block;
+}
+
+void FixedPool::deallocate(void* block) {
+    std::lock_guard<SpinLock> lock(lock_);
+    auto* freed = static_cast<FreeBlock*>(block);
+    freed->next = free_;
+    free_ = freed;
+}
+
+// Called with the lock held; only happens until the pool has grown to the
+// peak number of live blocks.
+void FixedPool::add_slab() {
+    size_t size = block_size_ * blocks_per_slab_;
+    void* memory = map_pages(size, huge_pages_);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    slabs_.emplace_back(memory, size);
+    char* base = static_cast<char*>(memory);
+    for (size_t i = size / block_size_; i-- > 0;) {
+        auto* block = reinterpret_cast<FreeBlock*>(base + i * block_size_);
+        block->next = free_;
+        free_ = block;
+    }
+}
+
+struct StringPool::State {
+    State(size_t max_cached, bool huge_pages)
+        : max_cached(max_cached)
+        , control_blocks(CONTROL_BLOCK_SIZE, 1024, huge_pages)
+    {}
+
+    ~State() {
+        for (std::string* text : free) {
+            delete text;
+        }
+    }
+
+    void release(const std::string* text) {
+        auto* recycled = const_cast<std::string*>(text);
+        if (recycled->capacity() <= MAX_RETAINED_CAPACITY) {
+            std::lock_guard<SpinLock> lock(free_lock);
+            if (free.size() < max_cached) {
+                free.push_back(recycled);
+                return;
+            }
+        }
+        delete recycled;
+    }
+
+    const size_t max_cached;
+    SpinLock free_lock;
+    std::vector<std::string*> free;
+    FixedPool control_blocks;
+};
+
+namespace {
+
+// Allocates the control block from the pool's state and keeps that state
+// alive until the block has been returned, which is after the deleter ran.
+template <typename T>
+class ControlBlockAllocator {
+public:
+    using value_type = T;
+
+    explicit ControlBlockAllocator(std::shared_ptr<StringPool::State> state) : state_(std::move(state)) {}
+    template <typename U>
+    ControlBlockAllocator(const ControlBlockAllocator<U>& other) : state_(other.state_) {}
+
+    T* allocate(size_t n) { return PoolAllocator<T>(state_->control_blocks).allocate(n); }
+    void deallocate(T* p, size_t n) { PoolAllocator<T>(state_->control_blocks).deallocate(p, n); }
+
+    template <typename U>
+    bool operator==(const ControlBlockAllocator<U>& other) const { return state_ == other.state_; }
+    template <typename U>
+    bool operator!=(const ControlBlockAllocator<U>& other) const { return state_ != other.state_; }
+
+    std::shared_ptr<StringPool::State> state_;
+};
+
+}
+
+StringPool::StringPool(size_t max_cached, bool huge_pages)
+    : state_(std::make_shared<State>(max_cached, huge_pages))
+{
+    state_->free.reserve(max_cached);
+}
+
+std::shared_ptr<const std::string> StringPool::share(std::string_view data) {
+    std::string* text = nullptr;
+    {
+        std::lock_guard<SpinLock> lock(state_->free_lock);
+        if (!state_->free.empty()) {
+            text = state_->free.back();
+            state_->free.pop_back();
+        }
+    }
+    if (!text) {
+        text = new std::string();
+    }
+    text->assign(data.data(), data.size());
+
+    State* state = state_.get();
+    return std::shared_ptr<const std::string>(
+        text, [state](const std::string* released) { state->release(released); },
+        ControlBlockAllocator<char>(state_));
+}
+
+} // namespace deribit
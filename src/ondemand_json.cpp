@@ -0,0 +1,767 @@
+#include "ondemand_json.hpp"
+#include <charconv>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DERIBIT_JSON_X86 1
+#endif
+
+namespace deribit {
+namespace json {
+
+namespace {
+
+// Per 64-byte block, one bit per input byte.
+struct BlockMasks {
+    uint64_t backslash = 0;
+    uint64_t quote = 0;
+    uint64_t structural = 0;
+};
+
+// Carried from one block to the next.
+struct IndexState {
+    uint64_t prev_escaped = 0;
+    uint64_t prev_in_string = 0;
+};
+
+constexpr uint64_t EVEN_BITS = 0x5555555555555555ULL;
+
+// Bit i of the result is the xor of bits 0..i of x.
+inline uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// Turns one block's character masks into index entries. A quote is escaped
+// when it follows an odd-length run of backslashes, and runs can span
+// blocks; the branchless run-length trick is the one simdjson uses.
+__attribute__((always_inline)) inline uint32_t* flatten_block(const BlockMasks& masks, IndexState& state,
+                                                              uint32_t base, uint32_t* out) {
+    uint64_t backslash = masks.backslash & ~state.prev_escaped;
+    uint64_t follows_escape = backslash << 1 | state.prev_escaped;
+    uint64_t odd_starts = backslash & ~EVEN_BITS & ~follows_escape;
+    unsigned long long even_starts;
+    state.prev_escaped = __builtin_uaddll_overflow(odd_starts, backslash, &even_starts);
+    uint64_t escaped = (EVEN_BITS ^ (static_cast<uint64_t>(even_starts) << 1)) & follows_escape;
+
+    uint64_t quote = masks.quote & ~escaped;
+    uint64_t in_string = prefix_xor(quote) ^ state.prev_in_string;
+    state.prev_in_string = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+
+    uint64_t bits = (masks.structural & ~in_string) | quote;
+    while (bits) {
+        *out++ = base + static_cast<uint32_t>(__builtin_ctzll(bits));
+        bits &= bits - 1;
+    }
+    return out;
+}
+
+// The final partial block is classified from a space-padded copy.
+struct TailBlock {
+    alignas(64) char bytes[64];
+
+    TailBlock(const char* input, size_t size) {
+        std::memset(bytes, ' ', sizeof(bytes));
+        std::memcpy(bytes, input, size);
+    }
+};
+
+inline void classify_scalar(const char* block, BlockMasks& masks) {
+    for (int i = 0; i < 64; ++i) {
+        uint64_t bit = 1ULL << i;
+        switch (block[i]) {
+        case '\\': masks.backslash |= bit; break;
+        case '"': masks.quote |= bit; break;
+        case '{': case '}': case '[': case ']': case ':': case ',': masks.structural |= bit; break;
+        default: break;
+        }
+    }
+}
+
+uint32_t* index_scalar(const char* input, size_t size, IndexState& state, uint32_t* out) {
+    size_t offset = 0;
+    for (; offset + 64 <= size; offset += 64) {
+        BlockMasks masks;
+        classify_scalar(input + offset, masks);
+        out = flatten_block(masks, state, static_cast<uint32_t>(offset), out);
+    }
+    if (offset < size) {
+        TailBlock tail(input + offset, size - offset);
+        BlockMasks masks;
+        classify_scalar(tail.bytes, masks);
+        out = flatten_block(masks, state, static_cast<uint32_t>(offset), out);
+    }
+    return out;
+}
+
+#ifdef DERIBIT_JSON_X86
+
+// '[' and ']' differ from '{' and '}' only in bit 0x20, so four compares
+// find all six structural characters.
+__attribute__((target("sse2"), always_inline)) inline void classify_sse2(const char* block, BlockMasks& masks) {
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    for (int i = 0; i < 4; ++i) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+        __m128i folded = _mm_or_si128(chunk, case_bit);
+        __m128i structural = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, colon), _mm_cmpeq_epi8(chunk, comma)));
+        int shift = 16 * i;
+        masks.backslash |= static_cast<uint64_t>(static_cast<uint16_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslash)))) << shift;
+        masks.quote |= static_cast<uint64_t>(static_cast<uint16_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote)))) << shift;
+        masks.structural |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(structural))) << shift;
+    }
+}
+
+__attribute__((target("sse2"))) uint32_t* index_sse2(const char* input, size_t size, IndexState& state,
+                                                      uint32_t* out) {
+    size_t offset = 0;
+    for (; offset + 64 <= size; offset += 64) {
+        BlockMasks masks;
+        classify_sse2(input + offset, masks);
+        out = flatten_block(masks, state, static_cast<uint32_t>(offset), out);
+    }
+    if (offset < size) {
+        TailBlock tail(input + offset, size - offset);
+        BlockMasks masks;
+        classify_sse2(tail.bytes, masks);
+        out = flatten_block(masks, state, static_cast<uint32_t>(offset), out);
+    }
+    return out;
+}
+
+__attribute__((target("avx2"), always_inline)) inline void classify_avx2(const char* block, BlockMasks& masks) {
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    for (int i = 0; i < 2; ++i) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32 * i));
+        __m256i folded = _mm256_or_si256(chunk, case_bit);
+        __m256i structural = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(folded, open), _mm256_cmpeq_epi8(folded, close)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, colon), _mm256_cmpeq_epi8(chunk, comma)));
+        int shift = 32 * i;
+        masks.backslash |= static_cast<uint64_t>(static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, backslash)))) << shift;
+        masks.quote |= static_cast<uint64_t>(static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, quote)))) << shift;
+        masks.structural |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(structural))) << shift;
+    }
+}
+
+__attribute__((target("avx2"))) uint32_t* index_avx2(const char* input, size_t size, IndexState& state,
+                                                      uint32_t* out) {
+    size_t offset = 0;
+    for (; offset + 64 <= size; offset += 64) {
+        BlockMasks masks;
+        classify_avx2(input + offset, masks);
+        out = flatten_block(masks, state, static_cast<uint32_t>(offset), out);
+    }
+    if (offset < size) {
+        TailBlock tail(input + offset, size - offset);
+        BlockMasks masks;
+        classify_avx2(tail.bytes, masks);
+        out = flatten_block(masks, state, static_cast<uint32_t>(offset), out);
+    }
+    return out;
+}
+
+#endif
+
+inline bool is_whitespace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Four hex digits at `p`; false if any is missing or invalid.
+bool read_hex4(std::string_view text, size_t p, uint32_t& out) {
+    if (p + 4 > text.size()) {
+        return false;
+    }
+    out = 0;
+    for (size_t i = p; i < p + 4; ++i) {
+        int digit = hex_digit(text[i]);
+        if (digit < 0) {
+            return false;
+        }
+        out = out << 4 | static_cast<uint32_t>(digit);
+    }
+    return true;
+}
+
+void append_utf8(std::string& out, uint32_t code) {
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    } else if (code < 0x800) {
+        out += static_cast<char>(0xc0 | code >> 6);
+        out += static_cast<char>(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+        out += static_cast<char>(0xe0 | code >> 12);
+        out += static_cast<char>(0x80 | (code >> 6 & 0x3f));
+        out += static_cast<char>(0x80 | (code & 0x3f));
+    } else {
+        out += static_cast<char>(0xf0 | code >> 18);
+        out += static_cast<char>(0x80 | (code >> 12 & 0x3f));
+        out += static_cast<char>(0x80 | (code >> 6 & 0x3f));
+        out += static_cast<char>(0x80 | (code & 0x3f));
+    }
+}
+
+// Decodes the escapes in raw string contents. Lone surrogates become
+// U+FFFD; malformed escapes fail.
+bool unescape(std::string_view text, std::string& out) {
+    out.clear();
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (c != '\\') {
+            out += c;
+            continue;
+        }
+        if (++i == text.size()) {
+            return false;
+        }
+        switch (text[i]) {
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+            uint32_t code;
+            if (!read_hex4(text, i + 1, code)) {
+                return false;
+            }
+            i += 4;
+            uint32_t low;
+            if (code >= 0xd800 && code < 0xdc00 && i + 2 < text.size() && text[i + 1] == '\\' &&
+                text[i + 2] == 'u' && read_hex4(text, i + 3, low) && low >= 0xdc00 && low < 0xe000) {
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                i += 6;
+            } else if (code >= 0xd800 && code < 0xe000) {
+                code = 0xfffd;
+            }
+            append_utf8(out, code);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+constexpr uint64_t POWERS_OF_TEN[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL,
+};
+
+}
+
+const char* error_message(Error error) {
+    switch (error) {
+    case Error::None: return "no error";
+    case Error::Empty: return "empty input";
+    case Error::UnclosedString: return "unclosed string";
+    case Error::TooLarge: return "input larger than 4 GiB";
+    }
+    return "unknown error";
+}
+
+const char* backend_name(Backend backend) {
+    switch (backend) {
+    case Backend::Scalar: return "scalar";
+    case Backend::Sse2: return "sse2";
+    case Backend::Avx2: return "avx2";
+    }
+    return "unknown";
+}
+
+bool backend_supported(Backend backend) {
+    switch (backend) {
+    case Backend::Scalar:
+        return true;
+#ifdef DERIBIT_JSON_X86
+    case Backend::Sse2:
+        return __builtin_cpu_supports("sse2");
+    case Backend::Avx2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+Backend best_backend() {
+    if (backend_supported(Backend::Avx2)) {
+        return Backend::Avx2;
+    }
+    if (backend_supported(Backend::Sse2)) {
+        return Backend::Sse2;
+    }
+    return Backend::Scalar;
+}
+
+bool parse_decimal(std::string_view text, Decimal& out) {
+    size_t i = 0;
+    bool negative = i < text.size() && text[i] == '-';
+    if (negative) {
+        ++i;
+    }
+    if (i == text.size() || !is_digit(text[i])) {
+        return false;
+    }
+
+    // Up to 19 significant digits are kept; later ones only move the
+    // exponent (integer part) or are dropped (fraction). The first digit
+    // past them is still needed to round when the kept ones end exactly at
+    // the eighth fractional digit.
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    int dropped = -1;
+    for (; i < text.size() && is_digit(text[i]); ++i) {
+        if (significant < 19) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(text[i] - '0');
+            significant += mantissa != 0;
+        } else {
+            if (dropped < 0) {
+                dropped = text[i] - '0';
+            }
+            ++exponent;
+        }
+    }
+    if (i < text.size() && text[i] == '.') {
+        ++i;
+        if (i == text.size() || !is_digit(text[i])) {
+            return false;
+        }
+        for (; i < text.size() && is_digit(text[i]); ++i) {
+            if (significant < 19) {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(text[i] - '0');
+                significant += mantissa != 0;
+                --exponent;
+            } else if (dropped < 0) {
+                dropped = text[i] - '0';
+            }
+        }
+    }
+    if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+        ++i;
+        bool negative_exponent = i < text.size() && text[i] == '-';
+        if (i < text.size() && (text[i] == '-' || text[i] == '+')) {
+            ++i;
+        }
+        if (i == text.size() || !is_digit(text[i])) {
+            return false;
+        }
+        int value = 0;
+        for (; i < text.size() && is_digit(text[i]); ++i) {
+            value = std::min(value * 10 + (text[i] - '0'), 10000);
+        }
+        exponent += negative_exponent ? -value : value;
+    }
+    if (i != text.size()) {
+        return false;
+    }
+
+    int scale = exponent + Decimal::DIGITS;
+    const uint64_t limit = static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+    if (mantissa == 0) {
+        out.units = 0;
+        return true;
+    }
+    if (scale >= 0) {
+        if (scale > 19 || mantissa > limit / POWERS_OF_TEN[scale]) {
+            return false;
+        }
+        mantissa *= POWERS_OF_TEN[scale];
+        if (scale == 0 && dropped >= 5) {
+            ++mantissa;
+        }
+    } else if (-scale > 19) {
+        mantissa = 0;
+    } else {
+        uint64_t divisor = POWERS_OF_TEN[-scale];
+        uint64_t remainder = mantissa % divisor;
+        mantissa /= divisor;
+        if (remainder >= divisor - remainder) {
+            ++mantissa;
+        }
+    }
+    if (mantissa > limit) {
+        return false;
+    }
+    out.units = negative ? -static_cast<int64_t>(mantissa) : static_cast<int64_t>(mantissa);
+    return true;
+}
+
+uint32_t Document::skip_whitespace(uint32_t pos) const {
+    while (pos < size_ && is_whitespace(input_[pos])) {
+        ++pos;
+    }
+    return pos;
+}
+
+Value Document::root() const {
+    if (error_ != Error::None) {
+        return Value();
+    }
+    uint32_t pos = skip_whitespace(0);
+    if (pos >= size_) {
+        return Value();
+    }
+    return Value(this, 0, pos);
+}
+
+Type Value::type() const {
+    if (!doc_) {
+        return Type::Invalid;
+    }
+    switch (doc_->input_[pos_]) {
+    case '{': return Type::Object;
+    case '[': return Type::Array;
+    case '"': return Type::String;
+    case 't': case 'f': return Type::Bool;
+    case 'n': return Type::Null;
+    case '-': case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9': return Type::Number;
+    default: return Type::Invalid;
+    }
+}
+
+uint32_t Value::skip() const {
+    const uint32_t tokens = doc_->tokens_;
+    if (token_ >= tokens || doc_->index_[token_] != pos_) {
+        return token_;
+    }
+    char c = doc_->input_[pos_];
+    if (c == '"') {
+        return token_ + 2;
+    }
+    if (c != '{' && c != '[') {
+        return token_;
+    }
+    uint32_t depth = 0;
+    for (uint32_t token = token_; token < tokens; ++token) {
+        switch (doc_->at(token)) {
+        case '{': case '[':
+            ++depth;
+            break;
+        case '}': case ']':
+            if (--depth == 0) {
+                return token + 1;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return tokens;
+}
+
+Value Value::operator[](std::string_view key) const {
+    for (const Field& field : fields()) {
+        if (field.key == key) {
+            return field.value;
+        }
+    }
+    return Value();
+}
+
+Value Value::at(size_t index) const {
+    for (const Value& element : elements()) {
+        if (index-- == 0) {
+            return element;
+        }
+    }
+    return Value();
+}
+
+ObjectRange Value::fields() const {
+    ObjectRange range;
+    if (type() == Type::Object && doc_->index_[token_] == pos_) {
+        range.begin_.load(doc_, token_ + 1);
+    }
+    return range;
+}
+
+ArrayRange Value::elements() const {
+    ArrayRange range;
+    if (type() == Type::Array && doc_->index_[token_] == pos_) {
+        range.begin_.load(doc_, token_ + 1, doc_->skip_whitespace(pos_ + 1));
+    }
+    return range;
+}
+
+bool Value::get(std::string_view& out) const {
+    if (type() != Type::String || token_ + 1 >= doc_->tokens_ || doc_->index_[token_] != pos_) {
+        return false;
+    }
+    out = std::string_view(doc_->input_ + pos_ + 1, doc_->index_[token_ + 1] - pos_ - 1);
+    return true;
+}
+
+bool Value::get(std::string& out) const {
+    std::string_view text;
+    if (!get(text)) {
+        return false;
+    }
+    if (text.find('\\') == std::string_view::npos) {
+        out.assign(text.data(), text.size());
+        return true;
+    }
+    std::string decoded;
+    if (!unescape(text, decoded)) {
+        return false;
+    }
+    out = std::move(decoded);
+    return true;
+}
+
+bool Value::get(uint64_t& out) const {
+    std::string_view text = raw();
+    if (text.empty() || !is_digit(text[0])) {
+        return false;
+    }
+    auto result = std::from_chars(text.data(), text.data() + text.size(), out);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+bool Value::get(int64_t& out) const {
+    std::string_view text = raw();
+    if (type() != Type::Number) {
+        return false;
+    }
+    auto result = std::from_chars(text.data(), text.data() + text.size(), out);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+bool Value::get(uint32_t& out) const {
+    uint64_t wide;
+    if (!get(wide) || wide > std::numeric_limits<uint32_t>::max()) {
+        return false;
+    }
+    out = static_cast<uint32_t>(wide);
+    return true;
+}
+
+bool Value::get(int32_t& out) const {
+    int64_t wide;
+    if (!get(wide) || wide < std::numeric_limits<int32_t>::min() || wide > std::numeric_limits<int32_t>::max()) {
+        return false;
+    }
+    out = static_cast<int32_t>(wide);
+    return true;
+}
+
+bool Value::get(double& out) const {
+    std::string_view text = raw();
+    if (type() != Type::Number) {
+        return false;
+    }
+    auto result = std::from_chars(text.data(), text.data() + text.size(), out);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+bool Value::get(Decimal& out) const {
+    return type() == Type::Number && parse_decimal(raw(), out);
+}
+
+bool Value::get(bool& out) const {
+    std::string_view text = raw();
+    if (text == "true") {
+        out = true;
+        return true;
+    }
+    if (text == "false") {
+        out = false;
+        return true;
+    }
+    return false;
+}
+
+std::string_view Value::raw() const {
+    if (!doc_) {
+        return std::string_view();
+    }
+    uint32_t end;
+    Type kind = type();
+    if (kind == Type::String || kind == Type::Object || kind == Type::Array) {
+        uint32_t after = skip();
+        end = after > token_ && after <= doc_->tokens_ ? doc_->index_[after - 1] + 1 : doc_->size_;
+    } else {
+        end = token_ < doc_->tokens_ ? doc_->index_[token_] : doc_->size_;
+        while (end > pos_ && is_whitespace(doc_->input_[end - 1])) {
+            --end;
+        }
+    }
+    return std::string_view(doc_->input_ + pos_, end - pos_);
+}
+
+// `token` is where the next key's opening quote should be.
+void ObjectRange::iterator::load(const Document* doc, uint32_t token) {
+    field_ = Field();
+    if (token + 2 >= doc->tokens_ || doc->at(token) != '"' || doc->at(token + 1) != '"' ||
+        doc->at(token + 2) != ':') {
+        return;
+    }
+    uint32_t key_start = doc->index_[token] + 1;
+    uint32_t pos = doc->skip_whitespace(doc->index_[token + 2] + 1);
+    if (pos >= doc->size_) {
+        return;
+    }
+    field_.key = std::string_view(doc->input_ + key_start, doc->index_[token + 1] - key_start);
+    field_.value = Value(doc, token + 3, pos);
+}
+
+ObjectRange::iterator& ObjectRange::iterator::operator++() {
+    const Document* doc = field_.value.doc_;
+    uint32_t next = field_.value.skip();
+    if (next < doc->tokens_ && doc->at(next) == ',') {
+        load(doc, next + 1);
+    } else {
+        field_ = Field();
+    }
+    return *this;
+}
+
+void ArrayRange::iterator::load(const Document* doc, uint32_t token, uint32_t pos) {
+    if (pos >= doc->size_ || doc->input_[pos] == ']' || doc->input_[pos] == ',') {
+        value_ = Value();
+        return;
+    }
+    value_ = Value(doc, token, pos);
+}
+
+ArrayRange::iterator& ArrayRange::iterator::operator++() {
+    const Document* doc = value_.doc_;
+    uint32_t next = value_.skip();
+    if (next < doc->tokens_ && doc->at(next) == ',') {
+        load(doc, next + 1, doc->skip_whitespace(doc->index_[next] + 1));
+    } else {
+        value_ = Value();
+    }
+    return *this;
+}
+
+Parser::Parser(Backend backend)
+    : backend_(backend_supported(backend) ? backend : Backend::Scalar)
+    , capacity_(0)
+{}
+
+Document Parser::parse(std::string_view input) {
+    Document doc;
+    if (input.size() >= std::numeric_limits<uint32_t>::max()) {
+        doc.error_ = Error::TooLarge;
+        return doc;
+    }
+    // Every byte can be structural at most once.
+    if (input.size() > capacity_) {
+        capacity_ = std::max(input.size(), capacity_ * 2);
+        index_.reset(new uint32_t[capacity_]);
+    }
+
+    IndexState state;
+    uint32_t* end;
+    switch (backend_) {
+#ifdef DERIBIT_JSON_X86
+    case Backend::Avx2:
+        end = index_avx2(input.data(), input.size(), state, index_.get());
+        break;
+    case Backend::Sse2:
+        end = index_sse2(input.data(), input.size(), state, index_.get());
+        break;
+#endif
+    default:
+        end = index_scalar(input.data(), input.size(), state, index_.get());
+        break;
+    }
+
+    doc.input_ = input.data();
+    doc.size_ = static_cast<uint32_t>(input.size());
+    doc.index_ = index_.get();
+    doc.tokens_ = static_cast<uint32_t>(end - index_.get());
+    if (state.prev_in_string) {
+        doc.error_ = Error::UnclosedString;
+    } else if (doc.skip_whitespace(0) >= doc.size_) {
+        doc.error_ = Error::Empty;
+    } else {
+        doc.error_ = Error::None;
+    }
+    return doc;
+}
+
+struct Message::State {
+    explicit State(std::string body) : text(std::move(body)) {}
+
+    std::string text;
+    Parser parser;
+    Document document;
+};
+
+Message::Message() = default;
+
+Message::Message(std::string text) : state_(std::make_unique<State>(std::move(text))) {
+    state_->document = state_->parser.parse(state_->text);
+}
+
+Message::~Message() = default;
+Message::Message(Message&&) noexcept = default;
+Message& Message::operator=(Message&&) noexcept = default;
+
+Error Message::error() const {
+    return state_ ? state_->document.error() : Error::Empty;
+}
+
+Value Message::root() const {
+    return state_ ? state_->document.root() : Value();
+}
+
+const std::string& Message::text() const {
+    static const std::string empty;
+    return state_ ? state_->text : empty;
+}
+
+} // namespace json
+} // namespace deribit
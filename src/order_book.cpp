@@ -0,0 +1,179 @@
+#include "order_book.hpp"
+#include "json_writer.hpp"
+#include <algorithm>
+
+namespace deribit {
+
+namespace {
+
+// `better(a, b)` orders the side best first.
+template <typename Better>
+void apply_level(std::vector<PriceLevel>& side, const BookLevel& level, Better better) {
+    auto it = std::lower_bound(side.begin(), side.end(), level.price,
+                               [&](const PriceLevel& existing, const json::Decimal& price) {
+                                   return better(existing.price, price);
+                               });
+    bool found = it != side.end() && it->price == level.price;
+    if (level.action == BookAction::Delete || level.amount.units == 0) {
+        if (found) {
+            side.erase(it);
+        }
+    } else if (found) {
+        it->amount = level.amount;
+    } else {
+        side.insert(it, PriceLevel{level.price, level.amount});
+    }
+}
+
+void write_side(json::Writer& writer, const std::vector<PriceLevel>& side) {
+    writer.begin_array();
+    for (const PriceLevel& level : side) {
+        writer.begin_array().value("new").value(level.price).value(level.amount).end_array();
+    }
+    writer.end_array();
+}
+
+}
+
+void OrderBook::apply(const BookDelta& delta) {
+    if (delta.snapshot) {
+        clear();
+    }
+    auto higher = [](const json::Decimal& a, const json::Decimal& b) { return a > b; };
+    auto lower = [](const json::Decimal& a, const json::Decimal& b) { return a < b; };
+    for (uint32_t i = 0; i < delta.bid_count; ++i) {
+        apply_level(bids_, delta.bids[i], higher);
+    }
+    for (uint32_t i = 0; i < delta.ask_count; ++i) {
+        apply_level(asks_, delta.asks[i], lower);
+    }
+    change_id = delta.change_id;
+    timestamp_ms = delta.timestamp_ms;
+}
+
+void OrderBook::clear() {
+    // Keeps the capacity for the next snapshot.
+    bids_.clear();
+    asks_.clear();
+}
+
+BookStore::BookStore() : mutex_("books") {}
+
+OrderBook& BookStore::find_or_add(std::string_view instrument) {
+    std::lock_guard<InstrumentedMutex> lock(mutex_);
+    auto it = books_.find(instrument);
+    if (it == books_.end()) {
+        it = books_.emplace(std::string(instrument), OrderBook()).first;
+    }
+    return it->second;
+}
+
+BookStore::Update BookStore::apply(OrderBook& book, const BookDelta& delta) {
+    std::lock_guard<InstrumentedMutex> lock(mutex_);
+    Update update = Update::Applied;
+    if (book.restored) {
+        book.restored = false;
+        if (delta.snapshot) {
+            update = Update::CheckpointReplaced;
+        } else if (book.follows(delta)) {
+            update = Update::CheckpointConfirmed;
+        } else {
+            update = Update::CheckpointDiscarded;
+            book.clear();
+            book.valid = false;
+            return update;
+        }
+    }
+    if (delta.snapshot) {
+        book.valid = true;
+    } else if (!book.valid) {
+        return update;
+    } else if (update == Update::Applied && !book.follows(delta)) {
+        // Serving or saving it would pass the missed levels off as
+        // current.
+        book.clear();
+        book.valid = false;
+        return Update::Gap;
+    }
+    book.apply(delta);
+    return update;
+}
+
+bool BookStore::write_snapshot(std::string_view instrument, std::string_view channel, std::string& out) const {
+    std::lock_guard<InstrumentedMutex> lock(mutex_);
+    auto it = books_.find(instrument);
+    if (it == books_.end() || !it->second.valid) {
+        return false;
+    }
+    const OrderBook& book = it->second;
+    json::Writer writer(out);
+    writer.begin_object()
+        .member("jsonrpc", "2.0")
+        .member("method", "subscription")
+        .key("params").begin_object()
+        .member("channel", channel)
+        .key("data").begin_object()
+        .member("type", "snapshot")
+        .member("timestamp", book.timestamp_ms)
+        .member("instrument_name", instrument)
+        .member("change_id", book.change_id)
+        .key("bids");
+    write_side(writer, book.bids());
+    writer.key("asks");
+    write_side(writer, book.asks());
+    writer.end_object().end_object().end_object();
+    return true;
+}
+
+void BookStore::restore(const std::string& instrument, OrderBook book) {
+    book.valid = true;
+    book.restored = true;
+    std::lock_guard<InstrumentedMutex> lock(mutex_);
+    books_[instrument] = std::move(book);
+}
+
+size_t BookStore::discard_restored() {
+    std::lock_guard<InstrumentedMutex> lock(mutex_);
+    size_t discarded = 0;
+    for (auto& [instrument, book] : books_) {
+        if (book.restored) {
+            book.restored = false;
+            book.valid = false;
+            book.clear();
+            ++discarded;
+        }
+    }
+    return discarded;
+}
+
+size_t BookStore::count_live(const std::vector<std::string>& instruments) const {
+    std::lock_guard<InstrumentedMutex> lock(mutex_);
+    size_t live = 0;
+    for (const auto& instrument : instruments) {
+        auto it = books_.find(instrument);
+        if (it != books_.end() && it->second.valid && !it->second.restored) {
+            ++live;
+        }
+    }
+    return live;
+}
+
+size_t BookStore::size() const {
+    std::lock_guard<InstrumentedMutex> lock(mutex_);
+    size_t valid = 0;
+    for (const auto& [instrument, book] : books_) {
+        valid += book.valid;
+    }
+    return valid;
+}
+
+void BookStore::for_each(const std::function<void(const std::string&, const OrderBook&)>& visit) const {
+    std::lock_guard<InstrumentedMutex> lock(mutex_);
+    for (const auto& [instrument, book] : books_) {
+        if (book.valid) {
+            visit(instrument, book);
+        }
+    }
+}
+
+} // namespace deribit
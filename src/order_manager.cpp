@@ -1,15 +1,61 @@
 #include "order_manager.hpp"
-#include <cpprest/json.h>
 #include <cpprest/asyncrt_utils.h>
 #include <cpprest/uri_builder.h>
 #include <performance_metrics.hpp>
+#include <trace.hpp>
 
 namespace deribit
 {
 
-    OrderManager::OrderManager(Config &config)
-        : config_(config), client_(web::uri(utility::conversions::to_string_t(config.BASE_URL)))
+    namespace
     {
+
+        // order_id from a private/buy or private/sell reply, or "" if the
+        // reply has none.
+        std::string order_id_from_reply(const std::string &body)
+        {
+            thread_local json::Parser parser;
+            json::Document reply = parser.parse(body);
+            std::string order_id;
+            if (!reply.root()["result"]["order"]["order_id"].get(order_id))
+            {
+                std::cout << "Order reply without order_id: " << body << std::endl;
+            }
+            return order_id;
+        }
+
+    }
+
+    OrderManager::OrderManager(Config &config, TimerWheel *timers)
+        : config_(config), client_(web::uri(utility::conversions::to_string_t(config.endpoints.rest_url))), timers_(timers)
+    {
+    }
+
+    // Blocks for the response headers. Past the deadline the request is
+    // cancelled and get() throws pplx::task_canceled.
+    web::http::http_response OrderManager::send(const web::http::http_request &request)
+    {
+        uint32_t timeout_ms = (live_ ? live_->get() : config_).timers.order_timeout_ms;
+        if (!timers_ || timeout_ms == 0)
+        {
+            return client_.request(request).get();
+        }
+
+        pplx::cancellation_token_source cancellation;
+        TimerWheel::TimerId deadline = timers_->schedule(
+            std::chrono::milliseconds(timeout_ms),
+            [cancellation]() mutable { cancellation.cancel(); });
+        try
+        {
+            web::http::http_response response = client_.request(request, cancellation.get_token()).get();
+            timers_->cancel(deadline);
+            return response;
+        }
+        catch (...)
+        {
+            timers_->cancel(deadline);
+            throw;
+        }
     }
 
     web::http::http_request OrderManager::create_authenticated_request(
@@ -17,6 +63,7 @@ namespace deribit
         const std::string &path)
     {
         web::http::http_request request(method);
+        request.set_request_uri(utility::conversions::to_string_t(path));
         request.headers().add(
             U("Authorization"), 
             U("Bearer ") + utility::conversions::to_string_t(config_.access_token)
@@ -24,9 +71,8 @@ namespace deribit
         return request;
     }
 
-    std::string OrderManager::place_buy_order(const OrderParams &params)
+    std::string OrderManager::buy_order_path(const OrderParams &params)
     {
-        START_TIMING("buy_order_placement");
         web::uri_builder builder(U("/private/buy"));
         builder.append_query(U("amount"), params.amount)
             .append_query(U("instrument_name"), params.instrument_name)
@@ -37,21 +83,50 @@ namespace deribit
             builder.append_query(U("price"), params.price);
         }
 
-        auto request = create_authenticated_request(
-            web::http::methods::GET,
-            utility::conversions::to_utf8string(builder.to_string())
-        );
+        return utility::conversions::to_utf8string(builder.to_string());
+    }
+
+    std::string OrderManager::sell_order_path(const OrderParams &params)
+    {
+        web::uri_builder builder(U("/private/sell"));
+        builder.append_query(U("advanced"), "usd")
+            .append_query(U("amount"), params.amount)
+            .append_query(U("instrument_name"), params.instrument_name);
+
+        if (params.type == "limit")
+        {
+            builder.append_query(U("price"), params.price);
+        }
+
+        builder.append_query(U("type"), params.type);
+
+        return utility::conversions::to_utf8string(builder.to_string());
+    }
+
+    std::string OrderManager::place_buy_order(const OrderParams &params)
+    {
+        START_TIMING("buy_order_placement");
+        uint64_t trace_id = Tracer::instance().new_trace();
+        TraceSpan order_span(trace_id, "order.buy");
+        uint64_t build_start = trace_id ? Tracer::now_ns() : 0;
+        auto request = create_authenticated_request(web::http::methods::GET, buy_order_path(params));
+        if (trace_id)
+        {
+            Tracer::instance().record(trace_id, "order.build", build_start, Tracer::now_ns());
+        }
 
         try
         {
-            auto response = client_.request(request).get();
+            web::http::http_response response;
+            {
+                TraceSpan span(trace_id, "order.send");
+                response = send(request);
+            }
             END_TIMING("buy_order_placement");
             if (response.status_code() == web::http::status_codes::OK)
             {
-                auto json = response.extract_json().get();
-                auto& result = json.at(U("result"));
-                auto& order = result.at(U("order"));
-                return utility::conversions::to_utf8string(order.at(U("order_id")).as_string());
+                TraceSpan span(trace_id, "order.ack");
+                return order_id_from_reply(response.extract_utf8string(true).get());
             }
         }
         catch (const std::exception &e)
@@ -64,27 +139,24 @@ namespace deribit
 
     std::string OrderManager::place_sell_order(const OrderParams& params) {
         START_TIMING("sell_order_placement");
-        web::uri_builder builder(U("/private/sell"));
-        builder.append_query(U("advanced"), "usd")
-            .append_query(U("amount"), params.amount)
-            .append_query(U("instrument_name"), params.instrument_name);
-                    
-        if (params.type == "limit") {
-            builder.append_query(U("price"), params.price);
+        uint64_t trace_id = Tracer::instance().new_trace();
+        TraceSpan order_span(trace_id, "order.sell");
+        uint64_t build_start = trace_id ? Tracer::now_ns() : 0;
+        auto request = create_authenticated_request(web::http::methods::GET, sell_order_path(params));
+        if (trace_id) {
+            Tracer::instance().record(trace_id, "order.build", build_start, Tracer::now_ns());
         }
 
-        builder.append_query(U("type"), params.type);
-
-        auto request = create_authenticated_request(web::http::methods::GET, utility::conversions::to_utf8string(builder.to_string()));
-
         try {
-            auto response = client_.request(request).get();
+            web::http::http_response response;
+            {
+                TraceSpan span(trace_id, "order.send");
+                response = send(request);
+            }
             END_TIMING("sell_order_placement");
             if (response.status_code() == web::http::status_codes::OK) {
-                auto json = response.extract_json().get();
-                auto& result = json.at(U("result"));
-                auto& order = result.at(U("order"));
-                return utility::conversions::to_utf8string(order.at(U("order_id")).as_string());
+                TraceSpan span(trace_id, "order.ack");
+                return order_id_from_reply(response.extract_utf8string(true).get());
             }
         } catch (const std::exception& e) {
             END_TIMING("sell_order_placement");
@@ -102,7 +174,7 @@ namespace deribit
 
         try
         {
-            auto response = client_.request(request).get();
+            auto response = send(request);
             return response.status_code() == web::http::status_codes::OK;
         }
         catch (const std::exception &e)
@@ -123,7 +195,25 @@ namespace deribit
 
         try
         {
-            auto response = client_.request(request).get();
+            auto response = send(request);
+            return response.status_code() == web::http::status_codes::OK;
+        }
+        catch (const std::exception &e)
+        {
+            std::cout << e.what() << std::endl;
+        }
+        return false;
+    }
+
+    bool OrderManager::warm_up()
+    {
+        web::http::http_request request(web::http::methods::GET);
+        request.set_request_uri(U("/public/test"));
+
+        try
+        {
+            auto response = send(request);
+            response.extract_utf8string(true).get();
             return response.status_code() == web::http::status_codes::OK;
         }
         catch (const std::exception &e)
@@ -133,7 +223,7 @@ namespace deribit
         return false;
     }
 
-    web::json::value OrderManager::get_positions(const std::string &currency, const std::string &kind)
+    json::Message OrderManager::get_positions(const std::string &currency, const std::string &kind)
     {
         web::uri_builder builder(U("/private/get_positions"));
         builder.append_query(U("currency"), currency)
@@ -143,17 +233,17 @@ namespace deribit
 
         try
         {
-            auto response = client_.request(request).get();
+            auto response = send(request);
             if (response.status_code() == web::http::status_codes::OK)
             {
-                return response.extract_json().get();
+                return json::Message(response.extract_utf8string(true).get());
             }
         }
         catch (const std::exception &e)
         {
             std::cout << e.what() << std::endl;
         }
-        return web::json::value::null();
+        return json::Message();
     }
 
 }
\ No newline at end of file
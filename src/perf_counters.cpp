@@ -0,0 +1,237 @@
+#include "perf_counters.hpp"
+#include "logger.hpp"
+#include "shm_metrics.hpp"
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace deribit {
+
+namespace {
+
+const char* const COUNTER_NAMES[PERF_COUNTER_COUNT] = {
+    "cycles", "instructions", "cache_misses", "branch_misses",
+    "task_clock_ns", "context_switches", "page_faults"};
+
+thread_local bool message_sampled = false;
+thread_local uint32_t message_counter = 0;
+thread_local std::unique_ptr<PerfCounterGroup> thread_group;
+
+int open_counter(uint32_t type, uint64_t config, int group_fd, bool exclude_kernel) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = 1;
+    return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+// Opens `count` counters as one group; on any failure closes what was
+// opened and marks the group unavailable.
+template<size_t N>
+void open_group(int (&fds)[N], uint32_t type, const uint64_t (&configs)[N], bool exclude_kernel) {
+    for (size_t i = 0; i < N; ++i) {
+        fds[i] = open_counter(type, configs[i], i == 0 ? -1 : fds[0], exclude_kernel);
+        if (fds[i] < 0) {
+            for (size_t j = 0; j < i; ++j) {
+                ::close(fds[j]);
+            }
+            for (size_t j = 0; j < N; ++j) {
+                fds[j] = -1;
+            }
+            return;
+        }
+    }
+}
+
+template<size_t N>
+bool read_group(int leader, uint64_t* values) {
+    struct {
+        uint64_t nr;
+        uint64_t values[N];
+    } data;
+    if (::read(leader, &data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || data.nr != N) {
+        return false;
+    }
+    std::memcpy(values, data.values, sizeof(data.values));
+    return true;
+}
+
+uint64_t monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+PerfCounterGroup::PerfCounterGroup() {
+    static const uint64_t hardware_configs[4] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    static const uint64_t software_configs[3] = {
+        PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_CONTEXT_SWITCHES, PERF_COUNT_SW_PAGE_FAULTS};
+
+    open_group(hardware_fds_, PERF_TYPE_HARDWARE, hardware_configs, true);
+    int hardware_error = errno;
+    // The kernel counts context switches in kernel mode, so excluding it
+    // would read them as 0. Counting kernel events needs
+    // perf_event_paranoid <= 1; otherwise the rest are still worth having.
+    open_group(software_fds_, PERF_TYPE_SOFTWARE, software_configs, false);
+    if (!software_available()) {
+        open_group(software_fds_, PERF_TYPE_SOFTWARE, software_configs, true);
+        if (software_available()) {
+            LOG_WARNING("Kernel perf events not permitted, context switches will read 0");
+        }
+    }
+
+    if (!hardware_available()) {
+        LOG_WARNING("Hardware perf counters unavailable (%s), using software counters only",
+                    std::strerror(hardware_error));
+    }
+    if (!software_available()) {
+        LOG_WARNING("Software perf counters unavailable, reporting latency only");
+    }
+}
+
+PerfCounterGroup::~PerfCounterGroup() {
+    for (int fd : hardware_fds_) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    for (int fd : software_fds_) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+void PerfCounterGroup::read(PerfSample& sample) const {
+    if (hardware_available()) {
+        sample.hardware = read_group<4>(hardware_fds_[0], &sample.values[PERF_CYCLES]);
+    }
+    if (software_available()) {
+        read_group<3>(software_fds_[0], &sample.values[PERF_TASK_CLOCK_NS]);
+    }
+    sample.wall_ns = monotonic_ns();
+}
+
+PerfStageProfiler& PerfStageProfiler::instance() {
+    static PerfStageProfiler instance;
+    return instance;
+}
+
+void PerfStageProfiler::configure(bool enabled, uint32_t sample_every) {
+    enabled_ = enabled;
+    sample_every_ = sample_every ? sample_every : 1;
+}
+
+bool PerfStageProfiler::begin_message() {
+    message_sampled = enabled_ && (message_counter++ % sample_every_) == 0;
+    return message_sampled;
+}
+
+void PerfStageProfiler::end_message() {
+    message_sampled = false;
+}
+
+void PerfStageProfiler::record(const char* stage, const PerfSample& start, const PerfSample& end) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = stages_.find(stage);
+    if (it == stages_.end()) {
+        it = stages_.emplace(stage, StageTotals{}).first;
+        auto& metrics = ShmMetrics::instance();
+        std::string prefix = std::string("perf.") + stage + ".";
+        it->second.samples_metric = metrics.counter(prefix + "samples");
+        it->second.latency_metric = metrics.histogram(prefix + "latency");
+        for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+            it->second.value_metrics[i] = metrics.counter(prefix + COUNTER_NAMES[i]);
+        }
+    }
+
+    StageTotals& totals = it->second;
+    uint64_t wall_ns = end.wall_ns - start.wall_ns;
+    totals.samples++;
+    totals.wall_ns += wall_ns;
+    ShmMetrics::instance().add(totals.samples_metric);
+    ShmMetrics::instance().record(totals.latency_metric, wall_ns);
+
+    bool hardware = start.hardware && end.hardware;
+    if (hardware) {
+        totals.hardware_samples++;
+    }
+    for (int i = 0; i < PERF_COUNTER_COUNT; ++i) {
+        if (i < PERF_TASK_CLOCK_NS && !hardware) {
+            continue;
+        }
+        uint64_t delta = end.values[i] - start.values[i];
+        totals.values[i] += delta;
+        ShmMetrics::instance().add(totals.value_metrics[i], delta);
+    }
+}
+
+void PerfStageProfiler::print_report(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stages_.empty()) {
+        return;
+    }
+
+    out << "\n===== STAGE PERF COUNTERS =====\n";
+    out << std::fixed << std::setprecision(2);
+    for (const auto& [stage, totals] : stages_) {
+        out << "Stage: " << stage << std::endl;
+        out << "  Samples: " << totals.samples << std::endl;
+        out << "  Avg latency: " << totals.wall_ns / 1000.0 / totals.samples << " us" << std::endl;
+        out << "  Avg context switches: "
+            << static_cast<double>(totals.values[PERF_CONTEXT_SWITCHES]) / totals.samples << std::endl;
+        out << "  Avg page faults: "
+            << static_cast<double>(totals.values[PERF_PAGE_FAULTS]) / totals.samples << std::endl;
+
+        if (totals.hardware_samples == 0 || totals.values[PERF_CYCLES] == 0) {
+            out << "  IPC: n/a (hardware counters unavailable)" << std::endl;
+            continue;
+        }
+
+        double instructions = static_cast<double>(totals.values[PERF_INSTRUCTIONS]);
+        out << "  Avg cycles: " << static_cast<double>(totals.values[PERF_CYCLES]) / totals.hardware_samples << std::endl;
+        out << "  IPC: " << instructions / totals.values[PERF_CYCLES] << std::endl;
+        if (instructions > 0) {
+            out << "  Cache misses / 1k instr: " << totals.values[PERF_CACHE_MISSES] * 1000.0 / instructions << std::endl;
+            out << "  Branch misses / 1k instr: " << totals.values[PERF_BRANCH_MISSES] * 1000.0 / instructions << std::endl;
+        }
+    }
+    out << std::defaultfloat;
+    out << "==============================\n";
+}
+
+PerfStageScope::PerfStageScope(const char* stage)
+    : stage_(stage)
+    , group_(nullptr)
+{
+    if (!message_sampled) {
+        return;
+    }
+    if (!thread_group) {
+        thread_group = std::make_unique<PerfCounterGroup>();
+    }
+    group_ = thread_group.get();
+    group_->read(start_);
+}
+
+PerfStageScope::~PerfStageScope() {
+    if (!group_) {
+        return;
+    }
+    PerfSample end;
+    group_->read(end);
+    PerfStageProfiler::instance().record(stage_, start_, end);
+}
+
+} // namespace deribit
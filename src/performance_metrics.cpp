@@ -1,4 +1,6 @@
 #include "performance_metrics.hpp"
+#include "shm_metrics.hpp"
+#include "perf_counters.hpp"
 #include <iostream>
 #include <algorithm>
 #include <numeric>
@@ -6,12 +8,16 @@
 namespace deribit {
 
 void PerformanceMetrics::start_measurement(const std::string& operation_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    operations_[operation_id].start_time = std::chrono::high_resolution_clock::now();
+    std::lock_guard<InstrumentedMutex> lock(mutex_);
+    auto& operation = operations_[operation_id];
+    if (operation.shm_histogram < 0) {
+        operation.shm_histogram = ShmMetrics::instance().histogram(operation_id);
+    }
+    operation.start_time = std::chrono::high_resolution_clock::now();
 }
 
 void PerformanceMetrics::end_measurement(const std::string& operation_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<InstrumentedMutex> lock(mutex_);
     auto end_time = std::chrono::high_resolution_clock::now();
     
     if (operations_.find(operation_id) == operations_.end()) {
@@ -23,10 +29,13 @@ void PerformanceMetrics::end_measurement(const std::string& operation_id) {
     auto duration = end_time - operation.start_time;
     double milliseconds = std::chrono::duration<double, std::milli>(duration).count();
     operation.measurements_ms.push_back(milliseconds);
+    ShmMetrics::instance().record(
+        operation.shm_histogram,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
 }
 
 PerformanceMetrics::LatencyStats PerformanceMetrics::get_stats(const std::string& operation_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<InstrumentedMutex> lock(mutex_);
     LatencyStats stats;
     
     if (operations_.find(operation_id) == operations_.end()) {
@@ -47,14 +56,14 @@ PerformanceMetrics::LatencyStats PerformanceMetrics::get_stats(const std::string
 }
 
 void PerformanceMetrics::reset_stats(const std::string& operation_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<InstrumentedMutex> lock(mutex_);
     if (operations_.find(operation_id) != operations_.end()) {
         operations_[operation_id].measurements_ms.clear();
     }
 }
 
 void PerformanceMetrics::print_all_stats() {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<InstrumentedMutex> lock(mutex_);
     std::cout << "\n===== PERFORMANCE METRICS =====\n";
     
     for (const auto& [operation_id, timing] : operations_) {
@@ -75,6 +84,9 @@ void PerformanceMetrics::print_all_stats() {
     }
     
     std::cout << "==============================\n";
+    
+    PerfStageProfiler::instance().print_report(std::cout);
+    LockProfiler::print_ranking(std::cout);
 }
 
 }
\ No newline at end of file
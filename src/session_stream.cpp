@@ -0,0 +1,86 @@
+#include "session_stream.hpp"
+#include <boost/asio/write.hpp>
+#include <cstring>
+
+namespace deribit {
+
+namespace {
+
+// A view of flush_buffers_. Asio copies the buffer sequence into the write
+// operation, and copying the vector would allocate.
+struct BufferRange {
+    const boost::asio::const_buffer* first;
+    const boost::asio::const_buffer* last;
+
+    const boost::asio::const_buffer* begin() const { return first; }
+    const boost::asio::const_buffer* end() const { return last; }
+};
+
+}
+
+SessionStream::SessionStream(SessionSocket socket, UringTransport* transport)
+    : socket_(std::move(socket))
+    , transport_(transport)
+{
+    if (transport_ && socket_.is_open()) {
+        slot_ = transport_->register_socket(socket_.native_handle());
+    }
+}
+
+SessionStream::~SessionStream() {
+    if (slot_ >= 0) {
+        transport_->unregister_socket(slot_);
+    }
+}
+
+void SessionStream::add_segment(const void* data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    Collected& collected = collected_[collecting_];
+    if (size > COPY_LIMIT) {
+        collected.segments.push_back({data, 0, size});
+        return;
+    }
+    if (collected.segments.empty() || collected.segments.back().data) {
+        collected.segments.push_back({nullptr, collected.bytes.size(), 0});
+    }
+    collected.bytes.append(static_cast<const char*>(data), size);
+    collected.segments.back().size += size;
+}
+
+boost::asio::awaitable<void, SessionExecutor> SessionStream::flush(HandlerMemory& memory,
+                                                                   boost::system::error_code& ec) {
+    while (!collected_[collecting_].segments.empty()) {
+        Collected& writes = collected_[collecting_];
+        collecting_ ^= 1;
+
+        flush_buffers_.clear();
+        for (const auto& segment : writes.segments) {
+            flush_buffers_.emplace_back(segment.data ? segment.data : writes.bytes.data() + segment.offset,
+                                        segment.size);
+        }
+        Unbuffered unbuffered{*this};
+        co_await boost::asio::async_write(
+            unbuffered,
+            BufferRange{flush_buffers_.data(), flush_buffers_.data() + flush_buffers_.size()},
+            await_with<SessionExecutor>(memory, ec));
+        writes.bytes.clear();
+        writes.segments.clear();
+        if (ec) {
+            break;
+        }
+    }
+    for (auto& collected : collected_) {
+        collected.bytes.clear();
+        collected.segments.clear();
+    }
+    corked_ = false;
+}
+
+void teardown(boost::beast::role_type role, SessionStream& stream, boost::system::error_code& ec) {
+    using boost::beast::websocket::teardown;
+    teardown(role, stream.next_layer(), ec);
+}
+
+} // namespace deribit
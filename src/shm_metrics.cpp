@@ -0,0 +1,343 @@
+#include "shm_metrics.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace deribit {
+
+namespace shm {
+
+size_t bucket_for(uint64_t nanoseconds) {
+    if (nanoseconds < 2) {
+        return 0;
+    }
+    return std::min<size_t>(63 - __builtin_clzll(nanoseconds), HISTOGRAM_BUCKETS - 1);
+}
+
+uint64_t HistogramSnapshot::percentile_ns(double percentile) const {
+    if (count == 0) {
+        return 0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(count * percentile / 100.0);
+    if (target == 0) {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen >= target) {
+            uint64_t upper = i >= 63 ? max_ns : (uint64_t{2} << i) - 1;
+            return std::min(upper, max_ns);
+        }
+    }
+    return max_ns;
+}
+
+} // namespace shm
+
+namespace {
+
+// record() holds a histogram slot for nanoseconds, or for a scheduler
+// quantum if it is preempted. A slot still mid-write after this long was
+// left that way by a writer that died inside record().
+constexpr auto HISTOGRAM_READ_TIMEOUT = std::chrono::milliseconds(50);
+
+void copy_name(char* dest, const std::string& name) {
+    size_t length = std::min(name.size(), shm::NAME_LENGTH - 1);
+    std::memcpy(dest, name.data(), length);
+    dest[length] = '\0';
+}
+
+}
+
+ShmMetrics& ShmMetrics::instance() {
+    static ShmMetrics instance;
+    return instance;
+}
+
+ShmMetrics::~ShmMetrics() {
+    close();
+}
+
+bool ShmMetrics::open(const std::string& name) {
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    if (segment_.load(std::memory_order_relaxed)) {
+        return true;
+    }
+
+    int fd = ::shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        std::cerr << "Unable to create metrics segment " << name << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (::ftruncate(fd, sizeof(shm::Segment)) != 0) {
+        std::cerr << "Unable to size metrics segment " << name << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    void* mapped = ::mmap(nullptr, sizeof(shm::Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Unable to map metrics segment " << name << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // A previous writer may have left a segment of the same name behind;
+    // hide it from readers while it is being reinitialised.
+    auto* segment = static_cast<shm::Segment*>(mapped);
+    segment->header.magic.store(0, std::memory_order_release);
+    std::memset(static_cast<void*>(segment), 0, sizeof(shm::Segment));
+
+    timespec now{};
+    ::clock_gettime(CLOCK_REALTIME, &now);
+    segment->header.version = shm::LAYOUT_VERSION;
+    segment->header.segment_size = sizeof(shm::Segment);
+    segment->header.writer_pid = ::getpid();
+    segment->header.start_time_ns = static_cast<uint64_t>(now.tv_sec) * 1000000000ull + now.tv_nsec;
+
+    name_ = name;
+    segment_.store(segment, std::memory_order_release);
+
+    for (size_t id = 0; id < counter_names_.size(); ++id) {
+        publish_counter(static_cast<int>(id));
+    }
+    for (size_t id = 0; id < histogram_names_.size(); ++id) {
+        publish_histogram(static_cast<int>(id));
+    }
+
+    segment->header.magic.store(shm::SEGMENT_MAGIC, std::memory_order_release);
+    return true;
+}
+
+void ShmMetrics::close() {
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    shm::Segment* segment = segment_.exchange(nullptr, std::memory_order_acq_rel);
+    if (!segment) {
+        return;
+    }
+
+    ::munmap(segment, sizeof(shm::Segment));
+    ::shm_unlink(name_.c_str());
+    name_.clear();
+}
+
+int ShmMetrics::counter(const std::string& name) {
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    auto it = counter_ids_.find(name);
+    if (it != counter_ids_.end()) {
+        return it->second;
+    }
+    if (counter_names_.size() >= shm::MAX_COUNTERS) {
+        return -1;
+    }
+
+    int id = static_cast<int>(counter_names_.size());
+    counter_names_.push_back(name);
+    counter_ids_.emplace(name, id);
+    publish_counter(id);
+    return id;
+}
+
+int ShmMetrics::histogram(const std::string& name) {
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    auto it = histogram_ids_.find(name);
+    if (it != histogram_ids_.end()) {
+        return it->second;
+    }
+    if (histogram_names_.size() >= shm::MAX_HISTOGRAMS) {
+        return -1;
+    }
+
+    int id = static_cast<int>(histogram_names_.size());
+    histogram_names_.push_back(name);
+    histogram_ids_.emplace(name, id);
+    publish_histogram(id);
+    return id;
+}
+
+void ShmMetrics::publish_counter(int id) {
+    shm::Segment* segment = segment_.load(std::memory_order_relaxed);
+    if (!segment) {
+        return;
+    }
+    copy_name(segment->counters[id].name, counter_names_[id]);
+    segment->header.counter_count.store(id + 1, std::memory_order_release);
+}
+
+void ShmMetrics::publish_histogram(int id) {
+    shm::Segment* segment = segment_.load(std::memory_order_relaxed);
+    if (!segment) {
+        return;
+    }
+    auto& slot = segment->histograms[id];
+    copy_name(slot.name, histogram_names_[id]);
+    slot.min_ns.store(UINT64_MAX, std::memory_order_relaxed);
+    segment->header.histogram_count.store(id + 1, std::memory_order_release);
+}
+
+void ShmMetrics::add(int counter_id, uint64_t delta) {
+    shm::Segment* segment = segment_.load(std::memory_order_acquire);
+    if (!segment || counter_id < 0) {
+        return;
+    }
+    segment->counters[counter_id].value.fetch_add(delta, std::memory_order_relaxed);
+}
+
+void ShmMetrics::record(int histogram_id, uint64_t nanoseconds) {
+    shm::Segment* segment = segment_.load(std::memory_order_acquire);
+    if (!segment || histogram_id < 0) {
+        return;
+    }
+
+    auto& slot = segment->histograms[histogram_id];
+
+    // Writers exclude each other by moving the sequence from even to odd.
+    // Readers never write, so a writer only ever waits on another writer.
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    while (true) {
+        if ((sequence & 1) == 0 &&
+            slot.sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire,
+                                                std::memory_order_relaxed)) {
+            break;
+        }
+        sequence = slot.sequence.load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.count.store(slot.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    slot.sum_ns.store(slot.sum_ns.load(std::memory_order_relaxed) + nanoseconds, std::memory_order_relaxed);
+    if (nanoseconds < slot.min_ns.load(std::memory_order_relaxed)) {
+        slot.min_ns.store(nanoseconds, std::memory_order_relaxed);
+    }
+    if (nanoseconds > slot.max_ns.load(std::memory_order_relaxed)) {
+        slot.max_ns.store(nanoseconds, std::memory_order_relaxed);
+    }
+    auto& bucket = slot.buckets[shm::bucket_for(nanoseconds)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+ShmMetricsReader::~ShmMetricsReader() {
+    close();
+}
+
+bool ShmMetricsReader::open(const std::string& name) {
+    close();
+
+    int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info{};
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(shm::SegmentHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void* mapped = ::mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+
+    segment_ = static_cast<const shm::Segment*>(mapped);
+    mapped_size_ = info.st_size;
+
+    if (segment_->header.magic.load(std::memory_order_acquire) != shm::SEGMENT_MAGIC ||
+        segment_->header.version != shm::LAYOUT_VERSION ||
+        mapped_size_ < sizeof(shm::Segment)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ShmMetricsReader::close() {
+    if (segment_) {
+        ::munmap(const_cast<shm::Segment*>(segment_), mapped_size_);
+        segment_ = nullptr;
+        mapped_size_ = 0;
+    }
+}
+
+const shm::SegmentHeader* ShmMetricsReader::header() const {
+    return segment_ ? &segment_->header : nullptr;
+}
+
+std::vector<shm::CounterSnapshot> ShmMetricsReader::read_counters() const {
+    std::vector<shm::CounterSnapshot> counters;
+    if (!segment_) {
+        return counters;
+    }
+
+    uint32_t count = std::min<uint32_t>(segment_->header.counter_count.load(std::memory_order_acquire),
+                                        shm::MAX_COUNTERS);
+    counters.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const auto& slot = segment_->counters[i];
+        counters.push_back({std::string(slot.name, strnlen(slot.name, shm::NAME_LENGTH)),
+                            slot.value.load(std::memory_order_relaxed)});
+    }
+    return counters;
+}
+
+std::vector<shm::HistogramSnapshot> ShmMetricsReader::read_histograms() const {
+    std::vector<shm::HistogramSnapshot> histograms;
+    if (!segment_) {
+        return histograms;
+    }
+
+    uint32_t count = std::min<uint32_t>(segment_->header.histogram_count.load(std::memory_order_acquire),
+                                        shm::MAX_HISTOGRAMS);
+    histograms.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const auto& slot = segment_->histograms[i];
+        shm::HistogramSnapshot snapshot;
+        snapshot.name.assign(slot.name, strnlen(slot.name, shm::NAME_LENGTH));
+
+        std::chrono::steady_clock::time_point deadline;
+        while (true) {
+            // Copied even while odd, so a stale slot still shows its values.
+            uint32_t before = slot.sequence.load(std::memory_order_acquire);
+            snapshot.count = slot.count.load(std::memory_order_relaxed);
+            snapshot.sum_ns = slot.sum_ns.load(std::memory_order_relaxed);
+            snapshot.min_ns = slot.min_ns.load(std::memory_order_relaxed);
+            snapshot.max_ns = slot.max_ns.load(std::memory_order_relaxed);
+            for (size_t b = 0; b < shm::HISTOGRAM_BUCKETS; ++b) {
+                snapshot.buckets[b] = slot.buckets[b].load(std::memory_order_relaxed);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if ((before & 1) == 0 && slot.sequence.load(std::memory_order_relaxed) == before) {
+                break;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (deadline == std::chrono::steady_clock::time_point()) {
+                deadline = now + HISTOGRAM_READ_TIMEOUT;
+            } else if (now >= deadline) {
+                snapshot.stale = true;
+                break;
+            }
+        }
+
+        if (snapshot.count == 0) {
+            snapshot.min_ns = 0;
+        }
+        histograms.push_back(std::move(snapshot));
+    }
+    return histograms;
+}
+
+} // namespace deribit
@@ -0,0 +1,116 @@
+#include "startup.hpp"
+#include "logger.hpp"
+#include "shm_metrics.hpp"
+#include <algorithm>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+namespace deribit {
+
+void StartupSequence::add(const std::string& name,
+                          std::function<bool()> body,
+                          std::vector<std::string> after,
+                          bool required) {
+    for (const auto& dependency : after) {
+        bool known = std::any_of(phases_.begin(), phases_.end(),
+                                 [&](const Phase& phase) { return phase.name == dependency; });
+        if (!known) {
+            throw std::invalid_argument("startup phase " + name + " depends on unknown phase " + dependency);
+        }
+    }
+    Phase phase;
+    phase.name = name;
+    phase.body = std::move(body);
+    phase.after = std::move(after);
+    phase.required = required;
+    phases_.push_back(std::move(phase));
+}
+
+bool StartupSequence::run() {
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+
+    // Phases only depend on earlier ones, so every future a thread waits on
+    // exists before the thread starts.
+    std::vector<std::promise<bool>> done(phases_.size());
+    std::vector<std::shared_future<bool>> results;
+    for (auto& promise : done) {
+        results.push_back(promise.get_future().share());
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(phases_.size());
+    for (size_t i = 0; i < phases_.size(); ++i) {
+        std::vector<std::shared_future<bool>> dependencies;
+        for (const auto& dependency : phases_[i].after) {
+            auto it = std::find_if(phases_.begin(), phases_.end(),
+                                   [&](const Phase& phase) { return phase.name == dependency; });
+            dependencies.push_back(results[it - phases_.begin()]);
+        }
+
+        threads.emplace_back([this, i, start, dependencies, &done] {
+            Phase& phase = phases_[i];
+            bool ready = true;
+            for (const auto& dependency : dependencies) {
+                ready = dependency.get() && ready;
+            }
+            if (!ready) {
+                phase.status = Status::Skipped;
+                done[i].set_value(false);
+                return;
+            }
+
+            auto began = clock::now();
+            phase.started = began - start;
+            bool ok = false;
+            try {
+                ok = phase.body();
+            } catch (const std::exception& e) {
+                phase.error = e.what();
+            }
+            phase.duration = clock::now() - began;
+            phase.status = ok ? Status::Succeeded : Status::Failed;
+            done[i].set_value(ok);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    elapsed_ = clock::now() - start;
+
+    bool ok = true;
+    for (const auto& phase : phases_) {
+        auto to_ms = [](std::chrono::nanoseconds t) { return std::chrono::duration<double, std::milli>(t).count(); };
+        if (phase.status == Status::Skipped) {
+            LOG_WARNING("Startup phase %s skipped: a phase it depends on failed", phase.name.c_str());
+        } else if (phase.status == Status::Succeeded) {
+            LOG_INFO("Startup phase %s took %.1f ms (started at +%.1f ms)", phase.name.c_str(),
+                     to_ms(phase.duration), to_ms(phase.started));
+        } else {
+            LOG_ERROR("Startup phase %s failed after %.1f ms%s%s", phase.name.c_str(), to_ms(phase.duration),
+                      phase.error.empty() ? "" : ": ", phase.error.c_str());
+        }
+        if (phase.status != Status::Skipped) {
+            ShmMetrics::instance().record(ShmMetrics::instance().histogram("startup." + phase.name),
+                                          phase.duration.count());
+        }
+        if (phase.required && phase.status != Status::Succeeded) {
+            ok = false;
+        }
+    }
+    LOG_INFO("Startup finished in %.1f ms", std::chrono::duration<double, std::milli>(elapsed_).count());
+    return ok;
+}
+
+const char* StartupSequence::status_name(Status status) {
+    switch (status) {
+    case Status::Pending: return "pending";
+    case Status::Succeeded: return "ok";
+    case Status::Failed: return "failed";
+    case Status::Skipped: return "skipped";
+    }
+    return "unknown";
+}
+
+} // namespace deribit
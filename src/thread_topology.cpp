@@ -0,0 +1,141 @@
+#include "thread_topology.hpp"
+#include "logger.hpp"
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+
+namespace deribit {
+
+namespace {
+
+// Linux limit, without the terminating NUL.
+constexpr size_t MAX_THREAD_NAME = 15;
+
+// The CPUs the process was started on. Threads inherit affinity and
+// policy from their creator, so unpinned roles are reset to these rather
+// than left on whatever the creating thread was pinned to.
+cpu_set_t startup_cpus() {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        CPU_ZERO(&set);
+    }
+    return set;
+}
+
+const cpu_set_t STARTUP_CPUS = startup_cpus();
+
+bool parse_policy(const std::string& name, int& policy) {
+    if (name == "other") {
+        policy = SCHED_OTHER;
+    } else if (name == "batch") {
+        policy = SCHED_BATCH;
+    } else if (name == "idle") {
+        policy = SCHED_IDLE;
+    } else if (name == "fifo") {
+        policy = SCHED_FIFO;
+    } else if (name == "rr") {
+        policy = SCHED_RR;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool set_name(pthread_t thread, const std::string& name) {
+    std::string truncated = name.substr(0, MAX_THREAD_NAME);
+    int error = pthread_setname_np(thread, truncated.c_str());
+    if (error != 0) {
+        LOG_WARNING("Unable to name thread %s: %s", truncated.c_str(), std::strerror(error));
+        return false;
+    }
+    return true;
+}
+
+bool set_affinity(pthread_t thread, const std::string& name, const std::vector<int>& cpus) {
+    cpu_set_t set = STARTUP_CPUS;
+    if (!cpus.empty()) {
+        CPU_ZERO(&set);
+    } else if (CPU_COUNT(&set) == 0) {
+        return true;
+    }
+    for (int cpu : cpus) {
+        if (cpu < 0 || cpu >= CPU_SETSIZE) {
+            LOG_WARNING("Thread %s: CPU %d out of range, affinity unchanged", name.c_str(), cpu);
+            return false;
+        }
+        CPU_SET(cpu, &set);
+    }
+    int error = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (error != 0) {
+        LOG_WARNING("Thread %s: unable to set CPU affinity: %s", name.c_str(), std::strerror(error));
+        return false;
+    }
+    return true;
+}
+
+bool set_scheduling(pthread_t thread, const std::string& name, const std::string& policy_name, int priority) {
+    int policy;
+    if (!parse_policy(policy_name, policy)) {
+        LOG_WARNING("Thread %s: unknown scheduler policy '%s'", name.c_str(), policy_name.c_str());
+        return false;
+    }
+    sched_param param{};
+    if (policy == SCHED_FIFO || policy == SCHED_RR) {
+        int low = sched_get_priority_min(policy);
+        int high = sched_get_priority_max(policy);
+        if (priority < low || priority > high) {
+            LOG_WARNING("Thread %s: priority %d outside %d-%d for %s", name.c_str(), priority, low, high,
+                        policy_name.c_str());
+            return false;
+        }
+        param.sched_priority = priority;
+    }
+    int error = pthread_setschedparam(thread, policy, &param);
+    if (error != 0) {
+        LOG_WARNING("Thread %s: unable to set %s scheduling: %s", name.c_str(), policy_name.c_str(),
+                    std::strerror(error));
+        return false;
+    }
+    return true;
+}
+
+bool apply(pthread_t thread, const ThreadRole& role, const std::string& name, const std::vector<int>& cpus) {
+    bool ok = set_name(thread, name);
+    ok = set_affinity(thread, name, cpus) && ok;
+    ok = set_scheduling(thread, name, role.policy, role.priority) && ok;
+    if (cpus.empty()) {
+        LOG_DEBUG("Thread %s: unpinned, policy %s", name.c_str(), role.policy.c_str());
+    } else {
+        LOG_DEBUG("Thread %s: pinned to %zu CPUs, policy %s", name.c_str(), cpus.size(), role.policy.c_str());
+    }
+    return ok;
+}
+
+}
+
+bool apply_thread_role(const ThreadRole& role) {
+    return apply_thread_role(pthread_self(), role);
+}
+
+bool apply_thread_role(const ThreadRole& role, size_t index) {
+    return apply_thread_role(pthread_self(), role, index);
+}
+
+bool apply_thread_role(pthread_t thread, const ThreadRole& role) {
+    return apply(thread, role, role.name, role.cpus);
+}
+
+bool apply_thread_role(pthread_t thread, const ThreadRole& role, size_t index) {
+    std::string name = role.name + "-" + std::to_string(index);
+    if (role.cpus.empty()) {
+        return apply(thread, role, name, role.cpus);
+    }
+    return apply(thread, role, name, {role.cpus[index % role.cpus.size()]});
+}
+
+bool thread_role_known(const std::string& role_name) {
+    return role_name == "main" || role_name == "upstream" || role_name == "io";
+}
+
+} // namespace deribit
@@ -0,0 +1,218 @@
+#include "timer_wheel.hpp"
+#include "logger.hpp"
+#include <boost/asio/post.hpp>
+#include <algorithm>
+
+namespace deribit {
+
+namespace {
+
+constexpr uint64_t SLOT_MASK = TimerWheel::SLOTS - 1;
+// Furthest a deadline can be from the current tick.
+constexpr uint64_t MAX_DELTA = (uint64_t(1) << (TimerWheel::SLOT_BITS * TimerWheel::LEVELS)) - 1;
+
+}
+
+TimerWheel::TimerWheel(boost::asio::io_context& ioc, std::chrono::microseconds tick, size_t initial_capacity)
+    : ioc_(ioc)
+    , timer_(ioc)
+    , tick_(std::max(tick, std::chrono::microseconds(1)))
+    , epoch_(clock::now())
+    , running_(false)
+    , mutex_("timer_wheel")
+    , pending_(0)
+{
+    buckets_.fill(NIL);
+    std::lock_guard<InstrumentedMutex> lock(mutex_);
+    while (chunks_.size() * NODES_PER_CHUNK < initial_capacity) {
+        grow();
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    for (uint32_t& head : buckets_) {
+        while (head != NIL) {
+            Node& n = node(head);
+            head = n.next;
+            n.destroy(n.callback);
+        }
+    }
+}
+
+void TimerWheel::start() {
+    LOG_INFO("Starting timer wheel (%lld us tick)", static_cast<long long>(tick_.count()));
+    running_ = true;
+    schedule_tick();
+}
+
+void TimerWheel::stop() {
+    running_ = false;
+    boost::asio::post(ioc_, [this] { timer_.cancel(); });
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    uint32_t index = static_cast<uint32_t>(id);
+    Node* n;
+    {
+        std::lock_guard<InstrumentedMutex> lock(mutex_);
+        if (id == 0 || index >= chunks_.size() * NODES_PER_CHUNK) {
+            return false;
+        }
+        n = &node(index);
+        if (n->generation != static_cast<uint32_t>(id >> 32) || n->bucket == NIL) {
+            return false;
+        }
+        unlink(index);
+        --pending_;
+    }
+    // Outside the lock: the callback may own the last reference to
+    // something whose destructor cancels timers of its own.
+    n->destroy(n->callback);
+    std::lock_guard<InstrumentedMutex> lock(mutex_);
+    release_node(index);
+    return true;
+}
+
+void TimerWheel::advance_to(clock::time_point now) {
+    if (now < epoch_) {
+        return;
+    }
+    uint64_t target = static_cast<uint64_t>((now - epoch_) / tick_);
+
+    std::lock_guard<std::mutex> advancing(advance_mutex_);
+    {
+        std::lock_guard<InstrumentedMutex> lock(mutex_);
+        if (pending_ == 0 && target >= now_) {
+            // Every bucket is empty, so there is nothing to cascade.
+            now_ = target + 1;
+        }
+        for (; now_ <= target; ++now_) {
+            size_t slot = now_ & SLOT_MASK;
+            if (slot == 0) {
+                for (size_t level = 1; level < LEVELS; ++level) {
+                    size_t upper = (now_ >> (SLOT_BITS * level)) & SLOT_MASK;
+                    cascade(level, upper);
+                    if (upper != 0) {
+                        break;
+                    }
+                }
+            }
+            while (buckets_[slot] != NIL) {
+                uint32_t index = buckets_[slot];
+                unlink(index);
+                --pending_;
+                expired_.push_back({index, &node(index)});
+            }
+        }
+    }
+    if (expired_.empty()) {
+        return;
+    }
+
+    for (auto& [index, n] : expired_) {
+        n->invoke(n->callback);
+        n->destroy(n->callback);
+    }
+    std::lock_guard<InstrumentedMutex> lock(mutex_);
+    for (auto& [index, n] : expired_) {
+        release_node(index);
+    }
+    expired_.clear();
+}
+
+uint64_t TimerWheel::expiry_for(std::chrono::nanoseconds delay) const {
+    // Tick k runs no earlier than epoch_ + k * tick_, so rounding the
+    // deadline up to a tick never fires a timer early.
+    auto due = clock::now() - epoch_ + std::max(delay, std::chrono::nanoseconds(0));
+    auto tick = std::chrono::duration_cast<std::chrono::nanoseconds>(tick_).count();
+    uint64_t expiry = static_cast<uint64_t>((std::chrono::duration_cast<std::chrono::nanoseconds>(due).count() + tick - 1) / tick);
+    return std::clamp(expiry, now_, now_ + MAX_DELTA);
+}
+
+void TimerWheel::grow() {
+    uint32_t first = static_cast<uint32_t>(chunks_.size() * NODES_PER_CHUNK);
+    chunks_.push_back(std::make_unique<Node[]>(NODES_PER_CHUNK));
+    for (uint32_t i = 0; i < NODES_PER_CHUNK; ++i) {
+        Node& n = node(first + i);
+        n.bucket = NIL;
+        n.generation = 1;
+        n.next = i + 1 < NODES_PER_CHUNK ? first + i + 1 : free_;
+    }
+    free_ = first;
+}
+
+uint32_t TimerWheel::acquire_node() {
+    if (free_ == NIL) {
+        grow();
+    }
+    uint32_t index = free_;
+    free_ = node(index).next;
+    return index;
+}
+
+void TimerWheel::release_node(uint32_t index) {
+    node(index).next = free_;
+    free_ = index;
+}
+
+void TimerWheel::insert(uint32_t index) {
+    Node& n = node(index);
+    uint64_t delta = n.expiry - now_;
+    size_t level = 0;
+    while (level + 1 < LEVELS && delta >= (uint64_t(1) << (SLOT_BITS * (level + 1)))) {
+        ++level;
+    }
+    n.bucket = static_cast<uint32_t>(level * SLOTS + ((n.expiry >> (SLOT_BITS * level)) & SLOT_MASK));
+    uint32_t& head = buckets_[n.bucket];
+    n.prev = NIL;
+    n.next = head;
+    if (head != NIL) {
+        node(head).prev = index;
+    }
+    head = index;
+}
+
+// Also retires the node's id, so a late cancel() of a timer that is
+// already running fails.
+void TimerWheel::unlink(uint32_t index) {
+    Node& n = node(index);
+    if (n.prev != NIL) {
+        node(n.prev).next = n.next;
+    } else {
+        buckets_[n.bucket] = n.next;
+    }
+    if (n.next != NIL) {
+        node(n.next).prev = n.prev;
+    }
+    n.bucket = NIL;
+    if (++n.generation == 0) {
+        n.generation = 1;
+    }
+}
+
+// Moves a higher-level bucket's timers down now that the wheel has reached
+// its span; each lands in a lower level, or in the level 0 bucket about to
+// run.
+void TimerWheel::cascade(size_t level, size_t slot) {
+    uint32_t& head = buckets_[level * SLOTS + slot];
+    uint32_t index = head;
+    head = NIL;
+    while (index != NIL) {
+        uint32_t next = node(index).next;
+        insert(index);
+        index = next;
+    }
+}
+
+void TimerWheel::schedule_tick() {
+    timer_.expires_after(tick_);
+    timer_.async_wait([this](boost::system::error_code ec) {
+        if (ec || !running_) {
+            return;
+        }
+        advance_to(clock::now());
+        schedule_tick();
+    });
+}
+
+} // namespace deribit
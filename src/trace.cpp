@@ -0,0 +1,166 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace deribit {
+
+namespace {
+
+struct TraceEvent {
+    uint64_t trace_id;
+    const char* name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint32_t thread_id;
+};
+
+uint32_t current_thread_id() {
+    thread_local uint32_t thread_id = static_cast<uint32_t>(::syscall(SYS_gettid));
+    return thread_id;
+}
+
+size_t round_up_to_power_of_two(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+}
+
+Tracer& Tracer::instance() {
+    static Tracer instance;
+    return instance;
+}
+
+void Tracer::configure(bool enabled, uint32_t sample_every, size_t capacity) {
+    enabled_.store(false, std::memory_order_relaxed);
+    sample_every_ = std::max<uint32_t>(sample_every, 1);
+
+    size_t slot_count = round_up_to_power_of_two(std::max<size_t>(capacity, 2));
+    slots_.reset(new Slot[slot_count]);
+    mask_ = slot_count - 1;
+    next_slot_.store(0, std::memory_order_relaxed);
+
+    enabled_.store(enabled, std::memory_order_release);
+}
+
+uint64_t Tracer::sample() {
+    if (!enabled_.load(std::memory_order_relaxed)) {
+        return 0;
+    }
+    if (sample_counter_.fetch_add(1, std::memory_order_relaxed) % sample_every_ != 0) {
+        return 0;
+    }
+    return next_trace_id_.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t Tracer::new_trace() {
+    if (!enabled_.load(std::memory_order_relaxed)) {
+        return 0;
+    }
+    return next_trace_id_.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t Tracer::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Tracer::record(uint64_t trace_id, const char* name, uint64_t start_ns, uint64_t end_ns) {
+    if (!enabled_.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    uint64_t index = next_slot_.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots_[index & mask_];
+
+    slot.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.trace_id.store(trace_id, std::memory_order_relaxed);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start_ns.store(start_ns, std::memory_order_relaxed);
+    slot.duration_ns.store(end_ns > start_ns ? end_ns - start_ns : 0, std::memory_order_relaxed);
+    slot.thread_id.store(current_thread_id(), std::memory_order_relaxed);
+
+    slot.sequence.store(index * 2 + 2, std::memory_order_release);
+}
+
+bool Tracer::dump_chrome_trace(const std::string& path) {
+    if (!slots_) {
+        return false;
+    }
+
+    std::vector<TraceEvent> events;
+    events.reserve(mask_ + 1);
+    for (size_t i = 0; i <= mask_; ++i) {
+        const Slot& slot = slots_[i];
+        uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before == 0 || (before & 1)) {
+            continue;
+        }
+
+        TraceEvent event{
+            slot.trace_id.load(std::memory_order_relaxed),
+            slot.name.load(std::memory_order_relaxed),
+            slot.start_ns.load(std::memory_order_relaxed),
+            slot.duration_ns.load(std::memory_order_relaxed),
+            slot.thread_id.load(std::memory_order_relaxed)};
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == before && event.name) {
+            events.push_back(event);
+        }
+    }
+
+    std::sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+        return a.trace_id != b.trace_id ? a.trace_id < b.trace_id : a.start_ns < b.start_ns;
+    });
+
+    std::ofstream out(path, std::ios::trunc);
+    if (!out.is_open()) {
+        return false;
+    }
+
+    const int pid = ::getpid();
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+    bool first = true;
+    auto write_event = [&](const TraceEvent& event, const char* name, const char* phase) {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "{\"name\":\"" << name << "\",\"cat\":\"pipeline\",\"ph\":\"" << phase
+            << "\",\"ts\":" << event.start_ns / 1000.0
+            << ",\"pid\":" << pid << ",\"tid\":" << event.thread_id;
+    };
+
+    for (size_t i = 0; i < events.size(); ++i) {
+        const TraceEvent& event = events[i];
+        write_event(event, event.name, "X");
+        out << ",\"dur\":" << event.duration_ns / 1000.0
+            << ",\"args\":{\"trace_id\":" << event.trace_id << "}}";
+
+        // Flow arrows from each span of a trace to the next one; Chrome
+        // matches flow events by name, category and id.
+        bool has_previous = i > 0 && events[i - 1].trace_id == event.trace_id;
+        bool has_next = i + 1 < events.size() && events[i + 1].trace_id == event.trace_id;
+        if (has_previous || has_next) {
+            const char* phase = !has_previous ? "s" : (has_next ? "t" : "f");
+            write_event(event, "trace", phase);
+            out << ",\"id\":" << event.trace_id << ",\"bp\":\"e\"}";
+        }
+    }
+
+    out << "\n]}\n";
+    return out.good();
+}
+
+} // namespace deribit
@@ -0,0 +1,319 @@
+#include "uring_transport.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define DERIBIT_HAVE_IO_URING 1
+#endif
+
+namespace deribit {
+
+SessionWriteStats& session_write_stats() {
+    static SessionWriteStats stats;
+    return stats;
+}
+
+#ifdef DERIBIT_HAVE_IO_URING
+
+// The submission and completion rings as mapped from the kernel. Only the
+// flush that holds ring_mutex_ touches them.
+struct UringTransport::Ring {
+    int fd = -1;
+    uint32_t entries = 0;
+
+    void* sq_map = nullptr;
+    size_t sq_map_bytes = 0;
+    void* cq_map = nullptr;
+    size_t cq_map_bytes = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_bytes = 0;
+
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    ~Ring() {
+        if (sqes) {
+            munmap(sqes, sqes_bytes);
+        }
+        if (cq_map && cq_map != sq_map) {
+            munmap(cq_map, cq_map_bytes);
+        }
+        if (sq_map) {
+            munmap(sq_map, sq_map_bytes);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    // Sets errno and returns false on failure.
+    bool open(uint32_t requested_entries, uint32_t files) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, requested_entries, &params));
+        if (fd < 0) {
+            return false;
+        }
+        entries = params.sq_entries;
+
+        sq_map_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_map_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_map = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_map) {
+            sq_map_bytes = cq_map_bytes = std::max(sq_map_bytes, cq_map_bytes);
+        }
+        sq_map = mmap(nullptr, sq_map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                      IORING_OFF_SQ_RING);
+        if (sq_map == MAP_FAILED) {
+            sq_map = nullptr;
+            return false;
+        }
+        if (single_map) {
+            cq_map = sq_map;
+        } else {
+            cq_map = mmap(nullptr, cq_map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                          IORING_OFF_CQ_RING);
+            if (cq_map == MAP_FAILED) {
+                cq_map = nullptr;
+                return false;
+            }
+        }
+        sqes_bytes = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqe_map = mmap(nullptr, sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                             IORING_OFF_SQES);
+        if (sqe_map == MAP_FAILED) {
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe*>(sqe_map);
+
+        char* sq = static_cast<char*>(sq_map);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        char* cq = static_cast<char*>(cq_map);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // SQE i always sits at index i of the array.
+        for (unsigned i = 0; i < params.sq_entries; ++i) {
+            sq_array[i] = i;
+        }
+
+        // A sparse table; sockets are put into it one slot at a time.
+        std::vector<int> empty(files, -1);
+        return syscall(__NR_io_uring_register, fd, IORING_REGISTER_FILES, empty.data(), files) == 0;
+    }
+
+    bool update_file(int slot, int file) {
+        io_uring_files_update update;
+        std::memset(&update, 0, sizeof(update));
+        update.offset = static_cast<uint32_t>(slot);
+        update.fds = reinterpret_cast<uint64_t>(&file);
+        return syscall(__NR_io_uring_register, fd, IORING_REGISTER_FILES_UPDATE, &update, 1) == 1;
+    }
+
+    void prepare_send(Operation* op, int slot, msghdr* message) {
+        unsigned tail = *sq_tail;
+        io_uring_sqe* sqe = &sqes[tail & *sq_mask];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->flags = IOSQE_FIXED_FILE;
+        sqe->fd = slot;
+        sqe->addr = reinterpret_cast<uint64_t>(message);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+        sqe->user_data = reinterpret_cast<uint64_t>(op);
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    // Returns the number of SQEs consumed, or -errno.
+    int enter(unsigned to_submit, unsigned min_complete) {
+        session_write_stats().syscalls.fetch_add(1, std::memory_order_relaxed);
+        int consumed = static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                                                IORING_ENTER_GETEVENTS, nullptr, 0));
+        return consumed < 0 ? -errno : consumed;
+    }
+
+    // Stores each completion's result in its operation; returns how many
+    // there were.
+    unsigned reap() {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        for (; head != tail; ++head, ++count) {
+            const io_uring_cqe& cqe = cqes[head & *cq_mask];
+            reinterpret_cast<Operation*>(cqe.user_data)->result_ = cqe.res;
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        return count;
+    }
+};
+
+UringTransport::UringTransport(uint32_t entries, uint32_t sessions) {
+    auto ring = std::make_unique<Ring>();
+    if (!ring->open(entries, sessions)) {
+        LOG_WARNING("io_uring unavailable (%s); sessions write directly", std::strerror(errno));
+        return;
+    }
+    ring_ = std::move(ring);
+    queued_.reserve(ring_->entries);
+    batch_.reserve(ring_->entries);
+    free_slots_.reserve(sessions);
+    for (uint32_t slot = sessions; slot > 0; --slot) {
+        free_slots_.push_back(static_cast<int>(slot - 1));
+    }
+    LOG_INFO("io_uring transport ready: %u entries, %u session slots", ring_->entries, sessions);
+}
+
+int UringTransport::register_socket(int fd) {
+    if (!ring_) {
+        return -1;
+    }
+    int slot;
+    {
+        std::lock_guard<std::mutex> lock(slots_mutex_);
+        if (free_slots_.empty()) {
+            return -1;
+        }
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+    }
+    if (!ring_->update_file(slot, fd)) {
+        LOG_WARNING("Unable to register socket with io_uring: %s", std::strerror(errno));
+        std::lock_guard<std::mutex> lock(slots_mutex_);
+        free_slots_.push_back(slot);
+        return -1;
+    }
+    return slot;
+}
+
+void UringTransport::unregister_socket(int slot) {
+    if (!ring_->update_file(slot, -1)) {
+        // Leave the slot out of the free list rather than reuse a slot that
+        // may still refer to the old socket.
+        LOG_WARNING("Unable to unregister socket from io_uring: %s", std::strerror(errno));
+        return;
+    }
+    std::lock_guard<std::mutex> lock(slots_mutex_);
+    free_slots_.push_back(slot);
+}
+
+void UringTransport::send_batch() {
+    Ring& ring = *ring_;
+    size_t done = 0;
+    while (done < batch_.size()) {
+        unsigned count = static_cast<unsigned>(std::min<size_t>(batch_.size() - done, ring.entries));
+        for (unsigned i = 0; i < count; ++i) {
+            Operation* op = batch_[done + i];
+            ring.prepare_send(op, op->slot_, &op->message_);
+        }
+        // With MSG_DONTWAIT every send completes during the submit, so
+        // waiting for all of them does not block.
+        unsigned to_submit = count;
+        unsigned pending = count;
+        while (pending > 0) {
+            int consumed = ring.enter(to_submit, pending);
+            if (consumed >= 0) {
+                to_submit -= static_cast<unsigned>(consumed);
+            } else if (consumed != -EINTR && consumed != -EAGAIN && to_submit > 0) {
+                // Nothing more can be submitted. The kernel consumes the
+                // queue in order, so the last to_submit entries were never
+                // read; take them back and send those through epoll.
+                LOG_ERROR("io_uring_enter failed: %s", std::strerror(-consumed));
+                __atomic_store_n(ring.sq_tail, *ring.sq_tail - to_submit, __ATOMIC_RELEASE);
+                for (unsigned i = count - to_submit; i < count; ++i) {
+                    batch_[done + i]->result_ = -EAGAIN;
+                }
+                pending -= to_submit;
+                to_submit = 0;
+            }
+            pending -= ring.reap();
+        }
+        session_write_stats().ring_sends.fetch_add(count, std::memory_order_relaxed);
+        done += count;
+    }
+}
+
+void UringTransport::flush() {
+    // Completions run without the ring lock: they resume sessions, which
+    // queue their next writes for the flush that follows. The vector keeps
+    // its capacity, and batch_ gets the previous one back.
+    thread_local std::vector<Operation*> completed;
+    {
+        std::lock_guard<std::mutex> ring_lock(ring_mutex_);
+        {
+            std::lock_guard<SpinLock> lock(queue_lock_);
+            batch_.swap(queued_);
+            flush_posted_ = false;
+        }
+        if (batch_.empty()) {
+            return;
+        }
+        send_batch();
+        completed.swap(batch_);
+    }
+    for (Operation* op : completed) {
+        op->complete(op->result_);
+    }
+    completed.clear();
+}
+
+#else
+
+struct UringTransport::Ring {
+    uint32_t entries = 0;
+};
+
+UringTransport::UringTransport(uint32_t, uint32_t) {
+    LOG_WARNING("Built without io_uring support; sessions write directly");
+}
+
+int UringTransport::register_socket(int) {
+    return -1;
+}
+
+void UringTransport::unregister_socket(int) {}
+
+void UringTransport::send_batch() {}
+
+void UringTransport::flush() {}
+
+#endif
+
+UringTransport::~UringTransport() = default;
+
+bool UringTransport::enqueue(Operation* op) {
+    std::lock_guard<SpinLock> lock(queue_lock_);
+    queued_.push_back(op);
+    if (flush_posted_) {
+        return false;
+    }
+    flush_posted_ = true;
+    return true;
+}
+
+void UringTransport::cancel() {
+    std::vector<Operation*> cancelled;
+    {
+        std::lock_guard<SpinLock> lock(queue_lock_);
+        cancelled.swap(queued_);
+    }
+    for (Operation* op : cancelled) {
+        op->complete(-ECANCELED);
+    }
+}
+
+} // namespace deribit
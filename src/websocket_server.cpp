@@ -1,4 +1,8 @@
 #include "websocket_server.hpp"
+#include "checkpoint.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <fnmatch.h>
 #include <iostream>
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
@@ -6,126 +10,404 @@
 #include <boost/asio/ssl.hpp>
 #include <boost/asio/connect.hpp>
 #include <boost/asio/ip/tcp.hpp>
-#include <json/json.h>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
 #include "logger.hpp"
+#include "shm_metrics.hpp"
+#include "trace.hpp"
+#include "allocation_tracker.hpp"
+#include "perf_counters.hpp"
+#include "thread_topology.hpp"
 
 namespace deribit {
 
+namespace {
+
+std::string book_channel(std::string_view symbol) {
+    return "book." + std::string(symbol) + ".100ms";
+}
+
+uint64_t wall_clock_ms() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+// A JSON-RPC request whose only parameter is `channels`.
+void write_channels_request(std::string& out, uint64_t id, const char* method,
+                            const std::vector<std::string>& channels) {
+    out.clear();
+    json::Writer writer(out);
+    writer.begin_object()
+        .member("jsonrpc", "2.0")
+        .member("id", id)
+        .member("method", method)
+        .key("params").begin_object()
+        .key("channels").begin_array();
+    for (const auto& channel : channels) {
+        writer.value(channel);
+    }
+    writer.end_array().end_object().end_object();
+}
+
+bool is_instrument_pattern(const std::string& entry) {
+    return entry.find_first_of("*?[") != std::string::npos;
+}
+
+// The table only needs the names it can look up; patterns are added as
+// their instruments' first updates arrive.
+std::vector<std::string> literal_instruments(const std::vector<std::string>& entries) {
+    std::vector<std::string> instruments;
+    for (const auto& entry : entries) {
+        if (!is_instrument_pattern(entry)) {
+            instruments.push_back(entry);
+        }
+    }
+    return instruments;
+}
+
+bool same_role(const ThreadRole& a, const ThreadRole& b) {
+    return a.name == b.name && a.cpus == b.cpus && a.policy == b.policy && a.priority == b.priority;
+}
+
+}
+
 WebSocketSession::WebSocketSession(
-    boost::asio::ip::tcp::socket socket,
-    message_handler on_message
-) : ws_(std::move(socket))
+    SessionSocket socket,
+    message_handler on_message,
+    close_handler on_close,
+    const SessionOptions& options
+) : ws_(std::move(socket), options.transport)
   , on_message_(std::move(on_message))
+  , on_close_(std::move(on_close))
+  , write_signal_(ws_.get_executor(), SessionTimer::time_point::max())
+  , write_batch_max_(std::max<uint32_t>(options.write_batch_max, 1))
+  , write_batch_delay_(options.write_batch_delay)
+  , max_queued_bytes_(options.max_queued_bytes)
+  , timers_(options.idle_timeout.count() > 0 ? options.timers : nullptr)
+  , idle_timeout_(options.idle_timeout)
 {
     LOG_DEBUG("WebSocketSession created");
 }
 
 void WebSocketSession::start() {
     LOG_INFO("Starting WebSocketSession");
-    ws_.set_option(boost::beast::websocket::stream_base::timeout::suggested(
-        boost::beast::role_type::server));
-
-    ws_.async_accept(
-        [self = shared_from_this()](boost::system::error_code ec) {
-            if(ec) {
-                LOG_ERROR("Error accepting websocket: %s", ec.message().c_str());
-                return;
-            }
-            LOG_INFO("WebSocket connection accepted");
-            self->do_read();
-        });
+    auto self = shared_from_this();
+    boost::asio::co_spawn(ws_.get_executor(), run(self), boost::asio::detached);
 }
 
-void WebSocketSession::do_read() {
-    LOG_DEBUG("Setting up async read");
-    ws_.async_read(
-        buffer_,
-        [self = shared_from_this()](
-            boost::system::error_code ec,
-            std::size_t bytes_transferred) {
-                self->on_read(ec, bytes_transferred);
+boost::asio::awaitable<void, SessionExecutor> WebSocketSession::run(std::shared_ptr<WebSocketSession> self) {
+    auto timeouts = boost::beast::websocket::stream_base::timeout::suggested(boost::beast::role_type::server);
+    if (timers_) {
+        timeouts.idle_timeout = boost::beast::websocket::stream_base::none();
+        ws_.control_callback([this](boost::beast::websocket::frame_type, boost::beast::string_view) {
+            note_activity();
         });
-}
-
-void WebSocketSession::on_read(
-    boost::system::error_code ec,
-    std::size_t bytes_transferred) {
-    if(ec == boost::beast::websocket::error::closed) {
-        LOG_INFO("WebSocket connection closed");
-        return;
     }
+    ws_.set_option(timeouts);
 
+    boost::system::error_code ec;
+    co_await ws_.async_accept(await_with<SessionExecutor>(read_memory_, ec));
     if(ec) {
-        LOG_ERROR("Error reading from websocket: %s", ec.message().c_str());
-        return;
+        LOG_ERROR("Error accepting websocket: %s", ec.message().c_str());
+        closed();
+        co_return;
+    }
+    LOG_INFO("WebSocket connection accepted");
+    open_ = true;
+    boost::asio::co_spawn(ws_.get_executor(), write_loop(self), boost::asio::detached);
+    if (timers_) {
+        note_activity();
+        arm_idle_check(idle_timeout_ / 2);
     }
 
-    std::string message = boost::beast::buffers_to_string(buffer_.data());
-    LOG_DEBUG("Read %zu bytes: %s", bytes_transferred, message.c_str());
-    buffer_.consume(buffer_.size());
-    
-    on_message_(shared_from_this(), message);
+    for (;;) {
+        LOG_DEBUG("Waiting for client message");
+        std::size_t bytes_transferred = co_await ws_.async_read(
+            buffer_, await_with<SessionExecutor>(read_memory_, ec));
+        if(ec == boost::beast::websocket::error::closed) {
+            LOG_INFO("WebSocket connection closed");
+            break;
+        }
+        if(ec) {
+            LOG_ERROR("Error reading from websocket: %s", ec.message().c_str());
+            break;
+        }
+
+        if (timers_) {
+            note_activity();
+        }
+        auto data = buffer_.data();
+        message_.assign(static_cast<const char*>(data.data()), data.size());
+        LOG_DEBUG("Read %zu bytes: %s", bytes_transferred, message_.c_str());
+        buffer_.consume(buffer_.size());
+
+        on_message_(self, message_);
+    }
 
-    do_read();
+    open_ = false;
+    write_signal_.cancel();
+    closed();
 }
 
-void WebSocketSession::send(const std::string& message) {
-    LOG_DEBUG("Queueing message for send: %s", message.c_str());
+void WebSocketSession::send(const std::string& message, uint64_t trace_id) {
+    send(std::make_shared<const std::string>(message), trace_id);
+}
+
+void WebSocketSession::send(std::shared_ptr<const std::string> message, uint64_t trace_id) {
+    // Shared by every session: a broadcast posts one handler per recipient
+    // from the upstream thread, and they complete on the io threads.
+    static FixedPool send_handlers(256);
+
+    LOG_DEBUG("Queueing message for send: %s", message->c_str());
+    uint64_t queued_ns = trace_id || write_batch_delay_.count() ? Tracer::now_ns() : 0;
     boost::asio::post(
         ws_.get_executor(),
-        [self = shared_from_this(), message]() {
-            std::lock_guard<std::mutex> lock(self->write_mutex_);
-            
-            self->ws_.binary(true);
-            
-            self->ws_.async_write(
-                boost::asio::buffer(message),
-                [self](boost::system::error_code ec, std::size_t bytes_transferred) {
-                    self->on_write(ec, bytes_transferred);
-                });
-        });
+        bind_handler_pool(send_handlers,
+            [self = shared_from_this(), message = std::move(message), trace_id, queued_ns]() mutable {
+                if (!self->open_) {
+                    return;
+                }
+                if (self->max_queued_bytes_ && self->queued_bytes_ + message->size() > self->max_queued_bytes_) {
+                    self->drop_slow_client();
+                    return;
+                }
+                self->queued_bytes_ += message->size();
+                self->write_queue_.push_back({std::move(message), trace_id, queued_ns});
+                size_t pending = self->write_queue_.size() - self->write_head_;
+                if (pending == 1 || pending == self->write_batch_max_) {
+                    self->write_signal_.cancel();
+                }
+            }));
 }
 
-void WebSocketSession::on_write(
-    boost::system::error_code ec,
-    std::size_t bytes_transferred) {
-    if(ec) {
-        LOG_ERROR("Error writing to websocket: %s", ec.message().c_str());
+// Only one async_write may be outstanding on a websocket stream, so queued
+// messages are written one batch after another by this loop. The queue
+// entries keep the payloads alive until their batch has been sent.
+//
+// A batch is every message queued when the loop comes round, up to
+// write_batch_max_. Its frames are written to the corked stream, which
+// completes them at once, and flush() then sends the lot with one
+// scatter-gather write: a client subscribed to many instruments gets all
+// the updates of one burst for one syscall.
+boost::asio::awaitable<void, SessionExecutor> WebSocketSession::write_loop([[maybe_unused]] std::shared_ptr<WebSocketSession> self) {
+    ws_.binary(true);
+    boost::system::error_code ec;
+    while (open_) {
+        size_t pending = write_queue_.size() - write_head_;
+        if (pending == 0) {
+            write_queue_.clear();
+            write_head_ = 0;
+            if (drained_) {
+                std::exchange(drained_, nullptr)();
+            }
+            co_await write_signal_.async_wait(await_with<SessionExecutor>(write_memory_, ec));
+            continue;
+        }
+        if (pending < write_batch_max_ && write_batch_delay_.count() > 0) {
+            auto deadline = SessionTimer::time_point(std::chrono::nanoseconds(write_queue_[write_head_].queued_ns)) +
+                            write_batch_delay_;
+            if (SessionTimer::clock_type::now() < deadline) {
+                write_signal_.expires_at(deadline);
+                co_await write_signal_.async_wait(await_with<SessionExecutor>(write_memory_, ec));
+                write_signal_.expires_at(SessionTimer::time_point::max());
+                continue;
+            }
+        }
+
+        size_t count = std::min<size_t>(pending, write_batch_max_);
+        if (count > 1) {
+            ws_.next_layer().cork();
+        }
+        ec.clear();
+        size_t written = 0;
+        std::size_t bytes_transferred = 0;
+        while (written < count && !ec) {
+            bytes_transferred += co_await ws_.async_write(
+                boost::asio::buffer(*write_queue_[write_head_ + written].message),
+                await_with<SessionExecutor>(write_memory_, ec));
+            ++written;
+        }
+        if (count > 1) {
+            boost::system::error_code flush_ec;
+            co_await ws_.next_layer().flush(write_memory_, flush_ec);
+            if (!ec) {
+                ec = flush_ec;
+            }
+        }
+
+        // send() may have grown the queue while the batch was in flight.
+        uint64_t written_ns = 0;
+        for (size_t i = 0; i < written; ++i) {
+            PendingWrite& entry = write_queue_[write_head_++];
+            if (entry.trace_id) {
+                written_ns = written_ns ? written_ns : Tracer::now_ns();
+                Tracer::instance().record(entry.trace_id, "session.write", entry.queued_ns, written_ns);
+            }
+            // Hand the payload back to its pool now rather than when the
+            // slot is reused.
+            queued_bytes_ -= entry.message->size();
+            entry.message.reset();
+        }
+
+        if(ec) {
+            if (ec == boost::asio::error::operation_aborted || ec == boost::beast::websocket::error::closed) {
+                LOG_DEBUG("Dropping %zu queued messages for closed websocket", write_queue_.size() - write_head_);
+            } else {
+                LOG_ERROR("Error writing to websocket: %s", ec.message().c_str());
+            }
+            open_ = false;
+            break;
+        }
+        LOG_DEBUG("Successfully wrote %zu messages, %zu bytes", written, bytes_transferred);
+    }
+    write_queue_.clear();
+    write_head_ = 0;
+    queued_bytes_ = 0;
+    if (drained_) {
+        std::exchange(drained_, nullptr)();
+    }
+}
+
+void WebSocketSession::drain(std::function<void()> done) {
+    boost::asio::post(ws_.get_executor(), [self = shared_from_this(), done = std::move(done)]() mutable {
+        // Without an open write loop, nothing queued will be written.
+        if (!self->open_ || self->write_queue_.size() == self->write_head_) {
+            done();
+        } else {
+            self->drained_ = std::move(done);
+        }
+    });
+}
+
+void WebSocketSession::closed() {
+    // The pending check holds a weak reference, which would keep the
+    // session's pool block until it fired.
+    if (idle_timer_) {
+        timers_->cancel(idle_timer_);
+        idle_timer_ = 0;
+    }
+    if (on_close_) {
+        auto on_close = std::move(on_close_);
+        on_close_ = nullptr;
+        on_close(shared_from_this());
+    }
+}
+
+// Book changes build on one another, so a client that reads slower than
+// they arrive cannot be caught up by skipping or merging some: its queue
+// would only grow. It is disconnected instead, and resubscribes for a
+// fresh snapshot once it has caught up. Shutting the socket down fails
+// the write in flight, or the loop wakes from its batch wait; either way
+// it ends and drops the queue.
+void WebSocketSession::drop_slow_client() {
+    static const int dropped_metric = ShmMetrics::instance().counter("server.slow_clients_dropped");
+    LOG_WARNING("Closing WebSocketSession with %zu bytes queued: the client is not keeping up", queued_bytes_);
+    ShmMetrics::instance().add(dropped_metric);
+    open_ = false;
+    write_signal_.cancel();
+    boost::system::error_code ec;
+    ws_.next_layer().next_layer().shutdown(SessionSocket::shutdown_both, ec);
+}
+
+void WebSocketSession::note_activity() {
+    last_activity_ = SessionTimer::clock_type::now();
+    ping_sent_ = false;
+}
+
+void WebSocketSession::arm_idle_check(std::chrono::nanoseconds delay) {
+    idle_timer_ = timers_->schedule(delay, [weak = weak_from_this()] {
+        if (auto self = weak.lock()) {
+            boost::asio::post(self->ws_.get_executor(), [self] { self->check_idle(); });
+        }
+    });
+}
+
+// Runs when the session may have gone quiet: halfway through the timeout
+// it pings the client, whose pong counts as activity, and at the timeout
+// it shuts the socket down, which ends the read loop.
+void WebSocketSession::check_idle() {
+    idle_timer_ = 0;
+    if (!open_) {
         return;
     }
-    
-    LOG_DEBUG("Successfully wrote %zu bytes", bytes_transferred);
+    auto idle = SessionTimer::clock_type::now() - last_activity_;
+    if (idle >= idle_timeout_) {
+        LOG_INFO("Closing WebSocketSession idle for %lld ms",
+                 static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(idle).count()));
+        boost::system::error_code ec;
+        ws_.next_layer().next_layer().shutdown(SessionSocket::shutdown_both, ec);
+        return;
+    }
+    auto ping_after = idle_timeout_ / 2;
+    if (idle >= ping_after && !ping_sent_) {
+        ping_sent_ = true;
+        ws_.async_ping({}, [](boost::system::error_code) {});
+    }
+    arm_idle_check((idle >= ping_after ? idle_timeout_ : ping_after) - idle);
 }
 
 void WebSocketSession::close() {
     LOG_INFO("Closing WebSocketSession");
-    boost::asio::post(
+    boost::asio::co_spawn(
         ws_.get_executor(),
-        [self = shared_from_this()]() {
-            self->ws_.async_close(
+        [self = shared_from_this()]() -> boost::asio::awaitable<void, SessionExecutor> {
+            boost::system::error_code ec;
+            co_await self->ws_.async_close(
                 boost::beast::websocket::close_code::normal,
-                [](boost::system::error_code ec) {
-                    if(ec) {
-                        LOG_ERROR("Error closing websocket: %s", ec.message().c_str());
-                    } else {
-                        LOG_INFO("WebSocket closed successfully");
-                    }
-                });
-        });
+                boost::asio::redirect_error(boost::asio::use_awaitable_t<SessionExecutor>(), ec));
+            if(ec) {
+                LOG_ERROR("Error closing websocket: %s", ec.message().c_str());
+            } else {
+                LOG_INFO("WebSocket closed successfully");
+            }
+        },
+        boost::asio::detached);
 }
 
 WebsocketServer::WebsocketServer(Config& config)
     : config_(config)
+    // Room for the shared_ptr control block that allocate_shared puts in
+    // front of the session.
+    , session_pool_(sizeof(WebSocketSession) + 64, config.memory.sessions_per_slab, config.memory.huge_pages)
     , ioc_()
     , acceptor_(ioc_)
     , running_(false)
+    , sessions_mutex_("server.sessions")
+    , fanout_arena_(config.memory.message_arena_bytes, config.memory.huge_pages)
+    , payloads_(4096, config.memory.huge_pages)
+    , upstream_write_mutex_("upstream.write")
     , deribit_connected_(false)
+    , book_deltas_(literal_instruments(config.trading.supported_instruments))
+    , catalog_mutex_("server.catalog")
     , ssl_ctx_(boost::asio::ssl::context::tlsv12_client)
+    , upstream_messages_metric_(ShmMetrics::instance().counter("deribit.messages_received"))
+    , orderbook_updates_metric_(ShmMetrics::instance().counter("deribit.orderbook_updates"))
+    , messages_sent_metric_(ShmMetrics::instance().counter("server.messages_sent"))
+    , sessions_accepted_metric_(ShmMetrics::instance().counter("server.sessions_accepted"))
+    , propagation_metric_(ShmMetrics::instance().histogram("server.orderbook_propagation"))
+    , sequence_gaps_metric_(ShmMetrics::instance().counter("deribit.sequence_gaps"))
+    , book_rejects_metric_(ShmMetrics::instance().counter("deribit.book_rejected"))
+    , upstream_timeouts_metric_(ShmMetrics::instance().counter("deribit.request_timeouts"))
+    , checkpoint_confirmed_metric_(ShmMetrics::instance().counter("checkpoint.books_confirmed"))
+    , checkpoint_discarded_metric_(ShmMetrics::instance().counter("checkpoint.books_discarded"))
+    , checkpoint_write_metric_(ShmMetrics::instance().histogram("checkpoint.write"))
 {
     LOG_INFO("WebsocketServer initializing");
     ssl_ctx_.set_default_verify_paths();
     ssl_ctx_.set_verify_mode(boost::asio::ssl::verify_peer);
     LOG_DEBUG("SSL context initialized");
+
+    if (config.server.io_uring) {
+        uring_ = std::make_unique<UringTransport>(config.server.io_uring_entries, config.server.io_uring_sessions);
+        if (!uring_->available()) {
+            uring_.reset();
+        }
+    }
+    timers_ = std::make_unique<TimerWheel>(ioc_, std::chrono::microseconds(config.timers.tick_us));
+
+    if (config.checkpoint.enabled) {
+        restore_checkpoint();
+    }
 }
 
 WebsocketServer::~WebsocketServer() {
@@ -133,10 +415,14 @@ WebsocketServer::~WebsocketServer() {
     stop();
 }
 
-void WebsocketServer::run(uint16_t port) {
+void WebsocketServer::run(uint16_t port, bool connect_upstream) {
     try {
         LOG_INFO("Starting WebsocketServer on port %u", port);
         running_ = true;
+        {
+            std::lock_guard<InstrumentedMutex> lock(upstream_write_mutex_);
+            upstream_starting_ = true;
+        }
         
         boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::make_address("0.0.0.0"), port);
         acceptor_.open(endpoint.protocol());
@@ -146,18 +432,39 @@ void WebsocketServer::run(uint16_t port) {
         
         LOG_INFO("WebSocket server listening on port %u", port);
         
+        timers_->start();
+        if (config_.checkpoint.enabled) {
+            schedule_checkpoint();
+        }
         do_accept();
         
-        init_deribit_connection();
+        if (connect_upstream) {
+            init_deribit_connection();
+        }
+        
+        if (config_.monitoring.loop_lag_enabled) {
+            loop_monitor_ = std::make_unique<LoopMonitor>(
+                ioc_, "server",
+                std::chrono::microseconds(config_.monitoring.loop_probe_interval_us),
+                std::chrono::microseconds(config_.monitoring.loop_lag_warning_us),
+                std::chrono::microseconds(config_.monitoring.loop_lag_critical_us));
+            loop_monitor_->start();
+        }
         
-        unsigned int thread_count = std::thread::hardware_concurrency();
+        ThreadRole io_role = config_.threading.role("io");
+        unsigned int thread_count = io_role.threads ? io_role.threads : std::thread::hardware_concurrency();
         LOG_INFO("Starting %u IO service threads", thread_count);
         
         server_threads_.reserve(thread_count);
         for(auto i = 0u; i < thread_count; ++i) {
-            server_threads_.emplace_back([this] { 
+            server_threads_.emplace_back([this, io_role, i] { 
+                apply_thread_role(io_role, i);
                 LOG_DEBUG("IO service thread started");
-                ioc_.run(); 
+                if (loop_monitor_) {
+                    loop_monitor_->run();
+                } else {
+                    ioc_.run();
+                }
                 LOG_DEBUG("IO service thread terminated");
             });
         }
@@ -170,34 +477,57 @@ void WebsocketServer::run(uint16_t port) {
     }
 }
 
+SessionOptions WebsocketServer::session_options() const {
+    const Config& config = current_config();
+    SessionOptions options;
+    options.transport = uring_.get();
+    options.write_batch_max = config.server.write_batch_max;
+    options.write_batch_delay = std::chrono::microseconds(config.server.write_batch_delay_us);
+    options.max_queued_bytes = config.server.session_max_queued_bytes;
+    options.timers = timers_.get();
+    options.idle_timeout = std::chrono::milliseconds(config.timers.session_idle_timeout_ms);
+    return options;
+}
+
 void WebsocketServer::do_accept() {
     LOG_DEBUG("Setting up async accept");
     acceptor_.async_accept(
-        [this](boost::system::error_code ec, boost::asio::ip::tcp::socket socket) {
+        boost::asio::make_strand(ioc_),
+        [this](boost::system::error_code ec, SessionSocket socket) {
             on_accept(ec, std::move(socket));
         });
 }
 
-void WebsocketServer::on_accept(boost::system::error_code ec, boost::asio::ip::tcp::socket socket) {
+void WebsocketServer::on_accept(boost::system::error_code ec, SessionSocket socket) {
     if(ec) {
         LOG_ERROR("Accept error: %s", ec.message().c_str());
     } else {
         std::string client_endpoint = socket.remote_endpoint().address().to_string() + 
                                      ":" + std::to_string(socket.remote_endpoint().port());
         LOG_INFO("New connection from %s", client_endpoint.c_str());
+        // A batch usually fits one segment; with Nagle on, the next one
+        // would wait for the client's delayed ACK.
+        boost::system::error_code option_ec;
+        socket.set_option(boost::asio::ip::tcp::no_delay(true), option_ec);
         
-        auto session = std::make_shared<WebSocketSession>(
+        auto session = std::allocate_shared<WebSocketSession>(
+            PoolAllocator<WebSocketSession>(session_pool_),
             std::move(socket),
             [this](std::shared_ptr<WebSocketSession> session, const std::string& message) {
                 handle_client_message(session, message);
-            });
+            },
+            [this](const std::shared_ptr<WebSocketSession>& session) {
+                on_session_closed(session);
+            },
+            session_options());
             
         {
-            std::lock_guard<std::mutex> lock(sessions_mutex_);
+            std::lock_guard<InstrumentedMutex> lock(sessions_mutex_);
             sessions_.push_back(session);
-            subscriptions_[session] = std::set<std::string>();
+            subscriptions_[session];
             LOG_DEBUG("Added new session to sessions list, total sessions: %zu", sessions_.size());
         }
+        ShmMetrics::instance().add(sessions_accepted_metric_);
         
         session->start();
         
@@ -213,23 +543,34 @@ void WebsocketServer::handle_client_message(std::shared_ptr<WebSocketSession> se
     try {
         LOG_INFO("Received message from client: %s", message.c_str());
         
-        Json::Value json;
-        Json::Reader reader;
-        if (!reader.parse(message, json)) {
+        // Sessions are served from several io threads.
+        thread_local json::Parser parser;
+        json::Document document = parser.parse(message);
+        json::Value root = document.root();
+        if (document.error() != json::Error::None || root.type() != json::Type::Object) {
             LOG_WARNING("Failed to parse JSON message from client");
             return;
         }
         
-        std::string action = json["action"].asString();
-        std::string symbol = json["symbol"].asString();
+        std::string action = root["action"].get_or("");
+        std::string symbol = root["symbol"].get_or("");
         
         if (action == "subscribe") {
             LOG_INFO("Client subscribing to symbol: %s", symbol.c_str());
             
             {
-                std::lock_guard<std::mutex> lock(sessions_mutex_);
+                std::lock_guard<InstrumentedMutex> lock(sessions_mutex_);
                 subscriptions_[session].insert(symbol);
                 LOG_DEBUG("Added symbol %s to client's subscriptions", symbol.c_str());
+                // Taken under the lock, so every update the snapshot lacks
+                // is broadcast to the session after it; the last one it
+                // includes may be sent again.
+                thread_local std::string snapshot;
+                snapshot.clear();
+                if (books_.write_snapshot(symbol, book_channel(symbol), snapshot)) {
+                    LOG_DEBUG("Sending current %s book to new subscriber", symbol.c_str());
+                    session->send(snapshot);
+                }
             }
             
             subscribe_to_orderbook(symbol);
@@ -238,7 +579,7 @@ void WebsocketServer::handle_client_message(std::shared_ptr<WebSocketSession> se
             LOG_INFO("Client unsubscribing from symbol: %s", symbol.c_str());
             
             {
-                std::lock_guard<std::mutex> lock(sessions_mutex_);
+                std::lock_guard<InstrumentedMutex> lock(sessions_mutex_);
                 subscriptions_[session].erase(symbol);
                 LOG_DEBUG("Removed symbol %s from client's subscriptions", symbol.c_str());
             }
@@ -250,31 +591,173 @@ void WebsocketServer::handle_client_message(std::shared_ptr<WebSocketSession> se
     }
 }
 
-void WebsocketServer::subscribe_to_orderbook(const std::string& symbol) {
-    if (!deribit_connected_) {
-        LOG_WARNING("Cannot subscribe to %s: No connection to Deribit", symbol.c_str());
-        return;
+// Drops the server's references so that the session, and its pool block,
+// are released once its last handler has run.
+void WebsocketServer::on_session_closed(const std::shared_ptr<WebSocketSession>& session) {
+    std::lock_guard<InstrumentedMutex> lock(sessions_mutex_);
+    subscriptions_.erase(session);
+    auto it = std::find(sessions_.begin(), sessions_.end(), session);
+    if (it != sessions_.end()) {
+        sessions_.erase(it);
+    }
+    LOG_DEBUG("Removed closed session, total sessions: %zu", sessions_.size());
+}
+
+template <typename Operation>
+void WebsocketServer::with_upstream(Operation&& operation) {
+    if (deribit_ws_) {
+        operation(*deribit_ws_);
+    } else if (deribit_plain_ws_) {
+        operation(*deribit_plain_ws_);
+    }
+}
+
+bool WebsocketServer::subscribe_to_orderbook(const std::string& symbol) {
+    std::string channel = book_channel(symbol);
+    {
+        std::lock_guard<InstrumentedMutex> lock(upstream_write_mutex_);
+        if (!deribit_connected_ && !upstream_starting_) {
+            LOG_WARNING("Cannot subscribe to %s: No connection to Deribit", symbol.c_str());
+            return false;
+        }
+        if (!upstream_channels_.insert(channel).second) {
+            LOG_DEBUG("Already subscribed to orderbook for %s", symbol.c_str());
+            return true;
+        }
+        pending_channels_.push_back(std::move(channel));
     }
 
     LOG_INFO("Subscribing to orderbook for %s", symbol.c_str());
-    
-    Json::Value subscription;
-    subscription["jsonrpc"] = "2.0";
-    subscription["id"] = 42;
-    subscription["method"] = "public/subscribe";
-    subscription["params"]["channels"] = Json::arrayValue;
-    subscription["params"]["channels"].append("book." + symbol + ".100ms");
-
-    std::string message = Json::FastWriter().write(subscription);
-    LOG_DEBUG("Sending subscription request to Deribit: %s", message.c_str());
-    
-    try {
-        boost::beast::flat_buffer buffer;
-        deribit_ws_->write(boost::asio::buffer(message));
-        LOG_INFO("Successfully subscribed to orderbook for %s", symbol.c_str());
-    } catch (const std::exception& e) {
-        LOG_ERROR("Error subscribing to orderbook: %s", e.what());
+    // Until the connection is up, the writer picks the channel up when it
+    // starts.
+    if (deribit_connected_) {
+        // The timer may only be touched from the upstream thread.
+        boost::asio::post(*deribit_ioc_, [this] { upstream_write_signal_->cancel(); });
     }
+    return true;
+}
+
+// Sends everything queued by subscribe_to_orderbook since the last request
+// as one public/subscribe, or several of MAX_SUBSCRIBE_CHANNELS each, so a
+// burst of client subscriptions costs one upstream round trip. Each
+// request gets its own id and a deadline on the timer wheel; if no reply
+// arrives in time its channels are queued again.
+//
+// Channels to resubscribe are unsubscribed first, as Deribit sends no new
+// snapshot for a channel that is already subscribed, and then queued like
+// any other.
+template <typename Stream>
+boost::asio::awaitable<void, UpstreamExecutor> WebsocketServer::upstream_write_loop(Stream& ws) {
+    std::vector<std::string> channels;
+    boost::system::error_code ec;
+    while (deribit_connected_) {
+        {
+            std::lock_guard<InstrumentedMutex> lock(upstream_write_mutex_);
+            channels.swap(resubscribe_channels_);
+        }
+        if (!channels.empty()) {
+            // The reply is not tracked: a failed unsubscribe leaves the
+            // channel subscribed, and the subscribe after it still gets an
+            // answer.
+            write_channels_request(upstream_request_buffer_, next_request_id_++, "public/unsubscribe", channels);
+            co_await ws.async_write(boost::asio::buffer(upstream_request_buffer_),
+                                    await_with<UpstreamExecutor>(upstream_write_memory_, ec));
+            if (ec) {
+                LOG_ERROR("Error unsubscribing from orderbook: %s", ec.message().c_str());
+            }
+            std::lock_guard<InstrumentedMutex> lock(upstream_write_mutex_);
+            for (auto& channel : channels) {
+                pending_channels_.push_back(std::move(channel));
+            }
+            channels.clear();
+        }
+        {
+            std::lock_guard<InstrumentedMutex> lock(upstream_write_mutex_);
+            if (pending_channels_.size() <= MAX_SUBSCRIBE_CHANNELS) {
+                channels.swap(pending_channels_);
+            } else {
+                auto end = pending_channels_.begin() + MAX_SUBSCRIBE_CHANNELS;
+                channels.assign(std::make_move_iterator(pending_channels_.begin()), std::make_move_iterator(end));
+                pending_channels_.erase(pending_channels_.begin(), end);
+            }
+        }
+        if (channels.empty()) {
+            co_await upstream_write_signal_->async_wait(await_with<UpstreamExecutor>(upstream_write_memory_, ec));
+            continue;
+        }
+
+        uint64_t id = next_request_id_++;
+        std::string& message = upstream_request_buffer_;
+        write_channels_request(message, id, "public/subscribe", channels);
+        LOG_DEBUG("Sending subscription request to Deribit: %s", message.c_str());
+
+        co_await ws.async_write(boost::asio::buffer(message),
+                                await_with<UpstreamExecutor>(upstream_write_memory_, ec));
+        if (ec) {
+            LOG_ERROR("Error subscribing to orderbook: %s", ec.message().c_str());
+            std::lock_guard<InstrumentedMutex> lock(upstream_write_mutex_);
+            for (const auto& channel : channels) {
+                upstream_channels_.erase(channel);
+            }
+        } else {
+            for (const auto& channel : channels) {
+                LOG_INFO("Sent subscription to %s", channel.c_str());
+            }
+            std::lock_guard<InstrumentedMutex> lock(upstream_write_mutex_);
+            PendingRequest& request = pending_requests_[id];
+            request.channels = std::move(channels);
+            request.deadline = timers_->schedule(
+                std::chrono::milliseconds(current_config().timers.upstream_request_timeout_ms),
+                [this, id] { on_upstream_request_timeout(id); });
+        }
+        channels.clear();
+    }
+    LOG_DEBUG("Deribit writer stopped");
+}
+
+template <typename Stream>
+boost::asio::awaitable<void, UpstreamExecutor> WebsocketServer::upstream_read_loop(Stream& ws) {
+    LOG_INFO("Deribit message reader started");
+    // The buffer and payload keep their capacity from message to message.
+    boost::beast::flat_buffer& buffer = upstream_buffer_;
+    std::string& payload = upstream_payload_;
+    boost::system::error_code ec;
+    while (deribit_connected_) {
+        LOG_DEBUG("Waiting for message from Deribit");
+        buffer.consume(buffer.size());
+        co_await ws.async_read(buffer, await_with<UpstreamExecutor>(upstream_read_memory_, ec));
+        if (ec) {
+            break;
+        }
+
+        uint64_t trace_id = Tracer::instance().sample();
+        PerfStageProfiler::instance().begin_message();
+        {
+            TraceSpan span(trace_id, "upstream.receive");
+            PerfStageScope stage("upstream.receive");
+            auto data = buffer.data();
+            payload.assign(static_cast<const char*>(data.data()), data.size());
+        }
+        LOG_DEBUG("Received %zu bytes from Deribit", payload.size());
+        on_deribit_message(payload, trace_id);
+        PerfStageProfiler::instance().end_message();
+    }
+
+    if (!ec || ec == boost::beast::websocket::error::closed || !deribit_connected_) {
+        LOG_INFO("Deribit WebSocket connection closed");
+    } else {
+        LOG_ERROR("Deribit WebSocket error: %s", ec.message().c_str());
+    }
+    deribit_connected_ = false;
+    // Lets the writer see that the connection is gone, after which
+    // deribit_ioc_ runs out of work and its thread exits.
+    upstream_write_signal_->cancel();
+    LOG_INFO("Deribit message reader terminated");
+}
+
+bool WebsocketServer::connect_upstream() {
+    init_deribit_connection();
+    return deribit_connected_;
 }
 
 void WebsocketServer::init_deribit_connection() {
@@ -284,14 +767,23 @@ void WebsocketServer::init_deribit_connection() {
         
         boost::asio::ip::tcp::resolver resolver(*deribit_ioc_);
         
-        std::string host = config_.WS_URL;
+        std::string host = config_.endpoints.websocket_url;
         std::string port = "443";
+        std::string path = "/";
+        bool secure = true;
         
         if (host.substr(0, 6) == "wss://") {
             host = host.substr(6);
         } else if (host.substr(0, 5) == "ws://") {
             host = host.substr(5);
             port = "80";
+            secure = false;
+        }
+        
+        auto path_pos = host.find('/');
+        if (path_pos != std::string::npos) {
+            path = host.substr(path_pos);
+            host = host.substr(0, path_pos);
         }
         
         auto pos = host.find(':');
@@ -303,96 +795,185 @@ void WebsocketServer::init_deribit_connection() {
         LOG_INFO("Resolving Deribit host: %s:%s", host.c_str(), port.c_str());
         auto const results = resolver.resolve(host, port);
         
-        auto socket = boost::asio::ip::tcp::socket(*deribit_ioc_);
+        auto socket = UpstreamSocket(deribit_ioc_->get_executor());
         boost::asio::connect(socket, results.begin(), results.end());
         LOG_DEBUG("TCP connection established to Deribit");
         
-        auto ssl_stream = boost::beast::ssl_stream<boost::asio::ip::tcp::socket>(
-            std::move(socket), ssl_ctx_);
+        if (secure) {
+            auto ssl_stream = boost::beast::ssl_stream<UpstreamSocket>(
+                std::move(socket), ssl_ctx_);
+                
+            if(!SSL_set_tlsext_host_name(ssl_stream.native_handle(), host.c_str())) {
+                boost::system::error_code ec{static_cast<int>(::ERR_get_error()), 
+                                             boost::asio::error::get_ssl_category()};
+                LOG_ERROR("SSL SNI error: %s", ec.message().c_str());
+                throw boost::system::system_error{ec};
+            }
+            
+            LOG_DEBUG("Performing SSL handshake with Deribit");
+            ssl_stream.handshake(boost::asio::ssl::stream_base::client);
+            LOG_DEBUG("SSL handshake successful");
             
-        if(!SSL_set_tlsext_host_name(ssl_stream.native_handle(), host.c_str())) {
-            boost::system::error_code ec{static_cast<int>(::ERR_get_error()), 
-                                         boost::asio::error::get_ssl_category()};
-            LOG_ERROR("SSL SNI error: %s", ec.message().c_str());
-            throw boost::system::system_error{ec};
+            deribit_ws_ = std::make_unique<boost::beast::websocket::stream<
+                                boost::beast::ssl_stream<UpstreamSocket>>>(
+                                    std::move(ssl_stream));
+        } else {
+            LOG_WARNING("Upstream %s is not encrypted", config_.endpoints.websocket_url.c_str());
+            deribit_plain_ws_ = std::make_unique<boost::beast::websocket::stream<
+                                    UpstreamSocket>>(std::move(socket));
         }
-        
-        LOG_DEBUG("Performing SSL handshake with Deribit");
-        ssl_stream.handshake(boost::asio::ssl::stream_base::client);
-        LOG_DEBUG("SSL handshake successful");
-        
-        deribit_ws_ = std::make_unique<boost::beast::websocket::stream<
-                            boost::beast::ssl_stream<boost::asio::ip::tcp::socket>>>(
-                                std::move(ssl_stream));
                                 
-        deribit_ws_->set_option(boost::beast::websocket::stream_base::decorator(
-            [](boost::beast::websocket::request_type& req) {
-                req.set(boost::beast::http::field::user_agent,
-                    std::string(BOOST_BEAST_VERSION_STRING) +
-                        " deribit-trading-client");
-            }));
-            
-        LOG_DEBUG("Performing WebSocket handshake with Deribit");
-        deribit_ws_->handshake(host, "/ws/api/v2");
+        with_upstream([&](auto& ws) {
+            ws.set_option(boost::beast::websocket::stream_base::decorator(
+                [](boost::beast::websocket::request_type& req) {
+                    req.set(boost::beast::http::field::user_agent,
+                        std::string(BOOST_BEAST_VERSION_STRING) +
+                            " deribit-trading-client");
+                }));
+                
+            LOG_DEBUG("Performing WebSocket handshake with Deribit");
+            ws.handshake(host, path);
+        });
         LOG_INFO("Successfully connected to Deribit WebSocket");
         
         deribit_connected_ = true;
         
+        upstream_write_signal_ = std::make_unique<UpstreamTimer>(
+            deribit_ioc_->get_executor(), UpstreamTimer::time_point::max());
+        with_upstream([&](auto& ws) {
+            boost::asio::co_spawn(*deribit_ioc_, upstream_read_loop(ws), boost::asio::detached);
+            boost::asio::co_spawn(*deribit_ioc_, upstream_write_loop(ws), boost::asio::detached);
+        });
+        
         deribit_thread_ = std::make_unique<std::thread>([this]() {
-            LOG_INFO("Deribit message reader thread started");
-            try {
-                while (deribit_connected_) {
-                    boost::beast::flat_buffer buffer;
-                    LOG_DEBUG("Waiting for message from Deribit");
-                    deribit_ws_->read(buffer);
-                    
-                    std::string payload = boost::beast::buffers_to_string(buffer.data());
-                    LOG_DEBUG("Received %zu bytes from Deribit", payload.size());
-                    on_deribit_message(payload);
-                }
-            } catch (const boost::beast::system_error& e) {
-                if (e.code() == boost::beast::websocket::error::closed) {
-                    LOG_INFO("Deribit WebSocket connection closed");
-                } else {
-                    LOG_ERROR("Deribit WebSocket error: %s", e.what());
-                }
-                deribit_connected_ = false;
-            } catch (const std::exception& e) {
-                LOG_ERROR("Deribit WebSocket error: %s", e.what());
-                deribit_connected_ = false;
-            }
-            LOG_INFO("Deribit message reader thread terminated");
+            apply_thread_role(config_.threading.role("upstream"));
+            LOG_INFO("Deribit IO thread started");
+            deribit_ioc_->run();
+            LOG_INFO("Deribit IO thread terminated");
         });
         
     } catch (const std::exception& e) {
         LOG_ERROR("Error initializing Deribit connection: %s", e.what());
     }
+
+    std::lock_guard<InstrumentedMutex> lock(upstream_write_mutex_);
+    upstream_starting_ = false;
+    if (!deribit_connected_) {
+        // Queued while connecting; nothing will send them now.
+        upstream_channels_.clear();
+        pending_channels_.clear();
+        resubscribe_channels_.clear();
+        // Nor will anything confirm the restored books.
+        size_t discarded = books_.discard_restored();
+        if (discarded) {
+            LOG_WARNING("Dropping %zu books restored from the checkpoint: upstream unavailable", discarded);
+            ShmMetrics::instance().add(checkpoint_discarded_metric_, discarded);
+        }
+    }
 }
 
-void WebsocketServer::on_deribit_message(const std::string& payload) {
+void WebsocketServer::on_deribit_message(const std::string& payload, uint64_t trace_id) {
+    ALLOCATION_GUARD("on_deribit_message");
     try {
         LOG_DEBUG("Processing message from Deribit: %s", payload.c_str());
-        
-        Json::Value root;
-        Json::Reader reader;
-        if (!reader.parse(payload, root)) {
-            LOG_WARNING("Failed to parse JSON message from Deribit");
+        ShmMetrics::instance().add(upstream_messages_metric_);
+
+        // Book notifications take the dedicated decoder; everything else,
+        // and any book it rejects, goes through the generic parser.
+        BookDeltaTable::Entry* book = nullptr;
+        BookDecodeStatus book_status;
+        {
+            TraceSpan span(trace_id, "upstream.parse");
+            PerfStageScope stage("upstream.parse");
+            book_status = decode_book_notification(payload, book_deltas_, book);
+        }
+        if (book_status == BookDecodeStatus::Ok) {
+            const BookDelta& delta = book->delta;
+            if (!delta.snapshot && book->last_change_id && delta.prev_change_id != book->last_change_id) {
+                ShmMetrics::instance().add(sequence_gaps_metric_);
+                LOG_WARNING("Sequence gap on %s: prev_change_id %llu after change_id %llu",
+                            book->instrument.c_str(),
+                            static_cast<unsigned long long>(delta.prev_change_id),
+                            static_cast<unsigned long long>(book->last_change_id));
+            }
+            book->last_change_id = delta.change_id;
+            if (!book->book) {
+                book->book = &books_.find_or_add(book->instrument);
+            }
+            BookStore::Update update;
+            {
+                TraceSpan span(trace_id, "orderbook.apply");
+                PerfStageScope stage("orderbook.apply");
+                update = books_.apply(*book->book, delta);
+            }
+            switch (update) {
+            case BookStore::Update::Applied:
+                break;
+            case BookStore::Update::CheckpointConfirmed:
+                ShmMetrics::instance().add(checkpoint_confirmed_metric_);
+                LOG_INFO("Restored %s book confirmed by change %llu", book->instrument.c_str(),
+                         static_cast<unsigned long long>(delta.change_id));
+                break;
+            case BookStore::Update::CheckpointReplaced:
+                ShmMetrics::instance().add(checkpoint_confirmed_metric_);
+                LOG_INFO("Restored %s book replaced by snapshot %llu", book->instrument.c_str(),
+                         static_cast<unsigned long long>(delta.change_id));
+                break;
+            case BookStore::Update::CheckpointDiscarded:
+                ShmMetrics::instance().add(checkpoint_discarded_metric_);
+                LOG_WARNING("Restored %s book discarded: change %llu does not follow on, requesting a snapshot",
+                            book->instrument.c_str(), static_cast<unsigned long long>(delta.change_id));
+                resubscribe(book->instrument);
+                break;
+            case BookStore::Update::Gap:
+                LOG_WARNING("%s book dropped after a sequence gap, requesting a snapshot", book->instrument.c_str());
+                resubscribe(book->instrument);
+                break;
+            }
+            LOG_INFO("Received orderbook update for %s", book->instrument.c_str());
+            handle_orderbook_update(book->instrument, payload, trace_id);
             return;
         }
-        
-        if (root.isMember("params") && root["params"].isMember("channel")) {
-            std::string channel = root["params"]["channel"].asString();
+        if (book_status != BookDecodeStatus::NotBook) {
+            ShmMetrics::instance().add(book_rejects_metric_);
+            LOG_WARNING("Book notification rejected by decoder: %s", book_decode_status_name(book_status));
+        }
+
+        json::Document document;
+        {
+            TraceSpan span(trace_id, "upstream.parse");
+            PerfStageScope stage("upstream.parse");
+            document = upstream_parser_.parse(payload);
+            if (document.error() != json::Error::None) {
+                LOG_WARNING("Failed to parse JSON message from Deribit: %s", json::error_message(document.error()));
+                return;
+            }
+        }
+        json::Value root = document.root();
+
+        std::string_view channel;
+        if (root["params"]["channel"].get(channel)) {
             size_t firstDot = channel.find('.');
             size_t secondDot = channel.find('.', firstDot + 1);
-            if (firstDot != std::string::npos && secondDot != std::string::npos) {
-                std::string symbol = channel.substr(firstDot + 1, secondDot - firstDot - 1);
-                LOG_INFO("Received orderbook update for %s", symbol.c_str());
-                handle_orderbook_update(symbol, payload);
+            if (firstDot != std::string_view::npos && secondDot != std::string_view::npos) {
+                std::string_view symbol = channel.substr(firstDot + 1, secondDot - firstDot - 1);
+                LOG_INFO("Received orderbook update for %.*s", static_cast<int>(symbol.size()), symbol.data());
+                handle_orderbook_update(symbol, payload, trace_id);
             } else {
-                LOG_WARNING("Received message with unexpected channel format: %s", channel.c_str());
+                LOG_WARNING("Received message with unexpected channel format: %.*s",
+                            static_cast<int>(channel.size()), channel.data());
             }
-        } else if (root.isMember("id") && root.isMember("result")) {
-            LOG_INFO("Received response to request with id: %s", root["id"].asString().c_str());
+        } else if (root["id"] && (root["result"] || root["error"])) {
+            uint64_t id = 0;
+            root["id"].get(id);
+            if (root["error"]) {
+                std::string_view error = root["error"].raw();
+                LOG_WARNING("Request %llu failed: %.*s", static_cast<unsigned long long>(id),
+                            static_cast<int>(error.size()), error.data());
+            } else {
+                LOG_INFO("Received response to request with id: %llu", static_cast<unsigned long long>(id));
+            }
+            complete_upstream_request(id, static_cast<bool>(root["error"]));
         } else {
             LOG_WARNING("Received message with unexpected format");
         }
@@ -401,33 +982,365 @@ void WebsocketServer::on_deribit_message(const std::string& payload) {
     }
 }
 
-void WebsocketServer::handle_orderbook_update(const std::string& symbol, const std::string& data) {
-    LOG_DEBUG("Handling orderbook update for %s", symbol.c_str());
+void WebsocketServer::complete_upstream_request(uint64_t id, bool failed) {
+    std::lock_guard<InstrumentedMutex> lock(upstream_write_mutex_);
+    auto it = pending_requests_.find(id);
+    if (it == pending_requests_.end()) {
+        return;
+    }
+    timers_->cancel(it->second.deadline);
+    if (failed) {
+        // Forgotten, so the next client that asks for them retries.
+        for (const auto& channel : it->second.channels) {
+            upstream_channels_.erase(channel);
+        }
+    } else {
+        for (const auto& channel : it->second.channels) {
+            LOG_INFO("Successfully subscribed to %s", channel.c_str());
+        }
+    }
+    pending_requests_.erase(it);
+}
+
+void WebsocketServer::resubscribe(std::string_view instrument) {
+    std::string channel = book_channel(instrument);
+    {
+        std::lock_guard<InstrumentedMutex> lock(upstream_write_mutex_);
+        if (!upstream_channels_.count(channel)) {
+            return;
+        }
+        resubscribe_channels_.push_back(std::move(channel));
+    }
+    upstream_write_signal_->cancel();
+}
+
+// Runs on the timer wheel, off the upstream thread.
+void WebsocketServer::on_upstream_request_timeout(uint64_t id) {
+    {
+        std::lock_guard<InstrumentedMutex> lock(upstream_write_mutex_);
+        auto it = pending_requests_.find(id);
+        if (it == pending_requests_.end()) {
+            return;
+        }
+        LOG_WARNING("No reply to upstream request %llu within %u ms, re-sending %zu channels",
+                    static_cast<unsigned long long>(id), current_config().timers.upstream_request_timeout_ms,
+                    it->second.channels.size());
+        for (auto& channel : it->second.channels) {
+            pending_channels_.push_back(std::move(channel));
+        }
+        pending_requests_.erase(it);
+    }
+    ShmMetrics::instance().add(upstream_timeouts_metric_);
+    if (deribit_connected_) {
+        boost::asio::post(*deribit_ioc_, [this] { upstream_write_signal_->cancel(); });
+    }
+}
+
+void WebsocketServer::handle_orderbook_update(std::string_view symbol, const std::string& data, uint64_t trace_id) {
+    TraceSpan span(trace_id, "orderbook.update");
+    PerfStageScope stage("orderbook.update");
+    LOG_DEBUG("Handling orderbook update for %.*s", static_cast<int>(symbol.size()), symbol.data());
+    ShmMetrics::instance().add(orderbook_updates_metric_);
     auto start_time = std::chrono::high_resolution_clock::now();
     
-    broadcast_to_subscribers(symbol, data);
+    broadcast_to_subscribers(symbol, data, trace_id);
     
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
-    LOG_INFO("Message propagation time for %s: %lld microseconds", symbol.c_str(), duration.count());
+    ShmMetrics::instance().record(
+        propagation_metric_,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count());
+    LOG_INFO("Message propagation time for %.*s: %lld microseconds",
+             static_cast<int>(symbol.size()), symbol.data(), duration.count());
 }
 
-void WebsocketServer::broadcast_to_subscribers(const std::string& symbol, const std::string& data) {
-    std::lock_guard<std::mutex> lock(sessions_mutex_);
-    
-    std::vector<std::shared_ptr<WebSocketSession>> recipients;
-    
-    for (auto it = subscriptions_.begin(); it != subscriptions_.end(); ++it) {
-        if (it->second.find(symbol) != it->second.end()) {
-            recipients.push_back(it->first);
+void WebsocketServer::broadcast_to_subscribers(std::string_view symbol, const std::string& data, uint64_t trace_id) {
+    TraceSpan span(trace_id, "fanout.broadcast");
+    PerfStageScope stage("fanout.broadcast");
+    ALLOCATION_GUARD("broadcast_to_subscribers");
+    std::lock_guard<InstrumentedMutex> lock(sessions_mutex_);
+    size_t sent = 0;
+    {
+        std::vector<WebSocketSession*, ArenaAllocator<WebSocketSession*>> recipients{
+            ArenaAllocator<WebSocketSession*>(fanout_arena_)};
+        
+        for (auto it = subscriptions_.begin(); it != subscriptions_.end(); ++it) {
+            if (it->second.find(symbol) != it->second.end()) {
+                recipients.push_back(it->first.get());
+            }
+        }
+        
+        LOG_DEBUG("Broadcasting %.*s update to %zu subscribers",
+                  static_cast<int>(symbol.size()), symbol.data(), recipients.size());
+        
+        // One copy of the payload is shared by every recipient's write queue.
+        // Sessions stay alive while they are in subscriptions_, which cannot
+        // change while the lock is held.
+        auto payload = payloads_.share(data);
+        for (WebSocketSession* session : recipients) {
+            session->send(payload, trace_id);
         }
+        sent = recipients.size();
     }
-    
-    LOG_DEBUG("Broadcasting %s update to %zu subscribers", symbol.c_str(), recipients.size());
-    
-    for (auto& session : recipients) {
-        session->send(data);
+    fanout_arena_.reset();
+    ShmMetrics::instance().add(messages_sent_metric_, sent);
+}
+
+void WebsocketServer::set_instrument_catalog(std::vector<std::string> names) {
+    {
+        std::lock_guard<InstrumentedMutex> lock(catalog_mutex_);
+        instrument_catalog_ = std::move(names);
     }
+    if (presubscribing_ && current_config().trading.presubscribe) {
+        presubscribe();
+    }
+}
+
+std::vector<std::string> WebsocketServer::instrument_catalog() const {
+    std::lock_guard<InstrumentedMutex> lock(catalog_mutex_);
+    return instrument_catalog_;
+}
+
+// Queues the checkpoint's channels for the writer, which sends them as
+// soon as the upstream connection is up, and puts its books back so that
+// clients subscribing before the first live update get one. Each restored
+// book is checked against the first update for it (see BookStore::apply).
+void WebsocketServer::restore_checkpoint() {
+    CheckpointState state;
+    if (!read_checkpoint(config_.checkpoint.path, state)) {
+        LOG_INFO("Starting without a checkpoint");
+        return;
+    }
+    uint64_t now_ms = wall_clock_ms();
+    uint64_t age_ms = now_ms > state.written_ms ? now_ms - state.written_ms : 0;
+
+    std::lock_guard<InstrumentedMutex> lock(upstream_write_mutex_);
+    for (auto& channel : state.channels) {
+        if (upstream_channels_.insert(channel).second) {
+            pending_channels_.push_back(std::move(channel));
+        }
+    }
+    size_t restored_books = 0;
+    if (age_ms <= uint64_t(config_.checkpoint.max_age_s) * 1000) {
+        for (auto& [instrument, book] : state.books) {
+            // A book nothing will update would go stale.
+            if (upstream_channels_.count(book_channel(instrument))) {
+                books_.restore(instrument, std::move(book));
+                ++restored_books;
+            }
+        }
+    } else {
+        LOG_WARNING("Not restoring books from a checkpoint %llu s old",
+                    static_cast<unsigned long long>(age_ms / 1000));
+    }
+    set_instrument_catalog(std::move(state.catalog));
+    LOG_INFO("Restored checkpoint %s (%llu ms old): %zu channels, %zu books, %zu catalog instruments",
+             config_.checkpoint.path.c_str(), static_cast<unsigned long long>(age_ms), upstream_channels_.size(),
+             restored_books, instrument_catalog().size());
+}
+
+// The wheel's callback only posts, so writing the file does not hold up
+// the timers behind it.
+void WebsocketServer::schedule_checkpoint() {
+    checkpoint_timer_ = timers_->schedule(
+        std::chrono::milliseconds(config_.checkpoint.interval_ms),
+        [this] {
+            boost::asio::post(ioc_, [this] {
+                save_checkpoint();
+                if (running_) {
+                    schedule_checkpoint();
+                }
+            });
+        });
+}
+
+void WebsocketServer::save_checkpoint() {
+    auto start = std::chrono::steady_clock::now();
+    CheckpointState state;
+    state.written_ms = wall_clock_ms();
+    {
+        std::lock_guard<InstrumentedMutex> lock(upstream_write_mutex_);
+        state.channels.assign(upstream_channels_.begin(), upstream_channels_.end());
+    }
+    state.catalog = instrument_catalog();
+    books_.for_each([&](const std::string& instrument, const OrderBook& book) {
+        state.books.emplace_back(instrument, book);
+    });
+    if (write_checkpoint(config_.checkpoint.path, state)) {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        ShmMetrics::instance().record(checkpoint_write_metric_,
+                                      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        LOG_DEBUG("Checkpointed %zu books and %zu channels", state.books.size(), state.channels.size());
+    }
+}
+
+void WebsocketServer::close_upstream() {
+    if (deribit_connected_.exchange(false) && deribit_ioc_) {
+        // Shutting the socket down fails the pending read, and the read
+        // loop then stops the writer, so deribit_ioc_ runs out of work.
+        LOG_DEBUG("Closing Deribit WebSocket connection");
+        boost::asio::post(*deribit_ioc_, [this] {
+            boost::system::error_code ec;
+            with_upstream([&](auto& ws) {
+                boost::beast::get_lowest_layer(ws).shutdown(UpstreamSocket::shutdown_both, ec);
+            });
+            if (ec) {
+                LOG_WARNING("Error closing Deribit WebSocket: %s", ec.message().c_str());
+            }
+            upstream_write_signal_->cancel();
+        });
+    }
+
+    // The thread may already have exited on its own after the upstream
+    // closed the connection; it still has to be joined.
+    if (deribit_thread_ && deribit_thread_->joinable()) {
+        LOG_DEBUG("Joining Deribit thread");
+        deribit_thread_->join();
+    }
+    deribit_thread_.reset();
+}
+
+bool WebsocketServer::drain(std::chrono::steady_clock::time_point deadline) {
+    LOG_INFO("Draining WebSocket server");
+    running_ = false;
+    boost::asio::post(ioc_, [this] {
+        boost::system::error_code ec;
+        acceptor_.close(ec);
+    });
+    // Once the upstream thread has stopped, no session's queue grows.
+    close_upstream();
+
+    std::vector<std::shared_ptr<WebSocketSession>> sessions;
+    {
+        std::lock_guard<InstrumentedMutex> lock(sessions_mutex_);
+        sessions = sessions_;
+    }
+    struct Remaining {
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t sessions;
+    };
+    auto remaining = std::make_shared<Remaining>();
+    remaining->sessions = sessions.size();
+    for (const auto& session : sessions) {
+        session->drain([remaining] {
+            {
+                std::lock_guard<std::mutex> lock(remaining->mutex);
+                --remaining->sessions;
+            }
+            remaining->done.notify_all();
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(remaining->mutex);
+    bool drained = remaining->done.wait_until(lock, deadline, [&] { return remaining->sessions == 0; });
+    if (drained) {
+        LOG_INFO("Drained %zu sessions", sessions.size());
+    } else {
+        LOG_WARNING("%zu of %zu sessions still had messages queued at the drain deadline",
+                    remaining->sessions, sessions.size());
+    }
+    return drained;
+}
+
+std::vector<std::string> WebsocketServer::expand_instruments(const std::vector<std::string>& patterns) const {
+    std::vector<std::string> catalog;
+    std::vector<std::string> instruments;
+    for (const auto& pattern : patterns) {
+        if (!is_instrument_pattern(pattern)) {
+            instruments.push_back(pattern);
+            continue;
+        }
+        if (catalog.empty()) {
+            catalog = instrument_catalog();
+        }
+        size_t matched = 0;
+        for (const auto& name : catalog) {
+            if (::fnmatch(pattern.c_str(), name.c_str(), 0) == 0) {
+                instruments.push_back(name);
+                ++matched;
+            }
+        }
+        // Until the catalog has loaded, every pattern matches nothing.
+        if (!matched && !catalog.empty()) {
+            LOG_WARNING("supported_instruments pattern %s matches no instrument in the catalog", pattern.c_str());
+        }
+    }
+    std::sort(instruments.begin(), instruments.end());
+    instruments.erase(std::unique(instruments.begin(), instruments.end()), instruments.end());
+    return instruments;
+}
+
+std::vector<std::string> WebsocketServer::presubscribe() {
+    presubscribing_ = true;
+    std::vector<std::string> instruments = expand_instruments(current_config().trading.supported_instruments);
+    for (const auto& instrument : instruments) {
+        if (!subscribe_to_orderbook(instrument)) {
+            return {};
+        }
+    }
+    LOG_INFO("Pre-subscribed to %zu configured instruments", instruments.size());
+    return instruments;
+}
+
+// Polls: books are applied on the upstream thread's hot path, which
+// should not pay for a notification nobody but startup waits for.
+size_t WebsocketServer::wait_for_books(const std::vector<std::string>& instruments,
+                                       std::chrono::steady_clock::time_point deadline) {
+    size_t live = books_.count_live(instruments);
+    while (live < instruments.size() && deribit_connected_ && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        live = books_.count_live(instruments);
+    }
+    return live;
+}
+
+// Runs on the config watcher's thread. Settings read through
+// current_config() need nothing here.
+void WebsocketServer::reconfigure(const Config& previous, const Config& next) {
+    const auto& before = previous.trading.supported_instruments;
+    if (next.trading.presubscribe && next.trading.supported_instruments != before) {
+        presubscribe();
+    }
+    for (const auto& symbol : before) {
+        const auto& after = next.trading.supported_instruments;
+        if (std::find(after.begin(), after.end(), symbol) == after.end()) {
+            LOG_INFO("%s left supported_instruments; its upstream subscription stays until a restart",
+                     symbol.c_str());
+        }
+    }
+
+    ThreadRole io_role = next.threading.role("io");
+    if (!same_role(io_role, previous.threading.role("io"))) {
+        for (size_t i = 0; i < server_threads_.size(); ++i) {
+            apply_thread_role(server_threads_[i].native_handle(), io_role, i);
+        }
+    }
+    ThreadRole upstream_role = next.threading.role("upstream");
+    if (!same_role(upstream_role, previous.threading.role("upstream")) && deribit_connected_) {
+        // The upstream thread applies it to itself: it may be joined by
+        // close_upstream() at any moment, but not while running a handler.
+        boost::asio::post(*deribit_ioc_, [upstream_role] { apply_thread_role(upstream_role); });
+    }
+}
+
+WebsocketServer::Status WebsocketServer::status() {
+    Status status;
+    {
+        std::lock_guard<InstrumentedMutex> lock(sessions_mutex_);
+        status.sessions = sessions_.size();
+        for (const auto& [session, symbols] : subscriptions_) {
+            status.client_subscriptions += symbols.size();
+        }
+    }
+    {
+        std::lock_guard<InstrumentedMutex> lock(upstream_write_mutex_);
+        status.upstream_channels = upstream_channels_.size();
+        status.pending_requests = pending_requests_.size();
+    }
+    status.upstream_connected = deribit_connected_;
+    status.books = books_.size();
+    return status;
 }
 
 void WebsocketServer::stop() {
@@ -437,7 +1350,7 @@ void WebsocketServer::stop() {
         running_ = false;
         
         {
-            std::lock_guard<std::mutex> lock(sessions_mutex_);
+            std::lock_guard<InstrumentedMutex> lock(sessions_mutex_);
             LOG_DEBUG("Closing %zu active WebSocket sessions", sessions_.size());
             for (auto& session : sessions_) {
                 session->close();
@@ -452,6 +1365,11 @@ void WebsocketServer::stop() {
             LOG_WARNING("Error closing acceptor: %s", ec.message().c_str());
         }
         
+        if (loop_monitor_) {
+            loop_monitor_->stop();
+        }
+        timers_->stop();
+        
         LOG_DEBUG("Stopping IO context");
         ioc_.stop();
         
@@ -462,37 +1380,33 @@ void WebsocketServer::stop() {
             }
         }
         server_threads_.clear();
+        loop_monitor_.reset();
+        // Re-armed from the io threads, so only safe to touch now.
+        if (checkpoint_timer_) {
+            timers_->cancel(checkpoint_timer_);
+            checkpoint_timer_ = 0;
+        }
+        if (uring_) {
+            // Writes queued for a flush that will not run now.
+            uring_->cancel();
+        }
         
         LOG_INFO("Stopping Deribit WebSocket client...");
-        
-        if (deribit_connected_) {
-            deribit_connected_ = false;
-            
-            if (deribit_ws_) {
-                LOG_DEBUG("Gracefully closing Deribit WebSocket connection");
-                boost::beast::websocket::close_reason reason;
-                reason.code = boost::beast::websocket::close_code::normal;
-                reason.reason = "Client shutting down";
-                
-                boost::system::error_code ec;
-                deribit_ws_->close(reason, ec);
-                if (ec) {
-                    LOG_WARNING("Error closing Deribit WebSocket: %s", ec.message().c_str());
-                }
-                deribit_ws_.reset();
-            }
-            
-            if (deribit_ioc_) {
-                LOG_DEBUG("Stopping Deribit IO context");
-                deribit_ioc_->stop();
-            }
-            
-            if (deribit_thread_ && deribit_thread_->joinable()) {
-                LOG_DEBUG("Joining Deribit thread");
-                deribit_thread_->join();
-            }
-            deribit_thread_.reset();
+        close_upstream();
+        if (config_.checkpoint.enabled && !upstream_channels_.empty()) {
+            // Nothing else touches the books or channels now.
+            save_checkpoint();
+        }
+        upstream_write_signal_.reset();
+        deribit_ws_.reset();
+        deribit_plain_ws_.reset();
+        upstream_channels_.clear();
+        pending_channels_.clear();
+        resubscribe_channels_.clear();
+        for (auto& [id, request] : pending_requests_) {
+            timers_->cancel(request.deadline);
         }
+        pending_requests_.clear();
         
         LOG_INFO("WebSocket server and Deribit client stopped successfully");
     } catch (const std::exception& e) {
@@ -0,0 +1,106 @@
+#include "book_decoder.hpp"
+#include "deribit_payloads.hpp"
+#include "ondemand_json.hpp"
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+
+namespace {
+
+// Generic-parser view of a book notification, to check the decoder against.
+bool reference_decode(deribit::json::Parser& parser, const std::string& payload, uint64_t& change_id,
+                      size_t& bids, size_t& asks) {
+    auto document = parser.parse(payload);
+    auto data = document.root()["params"]["data"];
+    if (document.error() != deribit::json::Error::None || !data["change_id"].get(change_id)) {
+        return false;
+    }
+    bids = asks = 0;
+    for (const auto& level : data["bids"].elements()) {
+        (void)level;
+        ++bids;
+    }
+    for (const auto& level : data["asks"].elements()) {
+        (void)level;
+        ++asks;
+    }
+    return true;
+}
+
+// The decoder must agree with the generic parser on the recorded payloads,
+// and randomly corrupted copies (byte flips, structural characters spliced
+// in, truncation) must either be rejected or decode to what the generic
+// parser sees. Run under ASan/UBSan this doubles as a fuzz pass for
+// out-of-bounds reads.
+bool verify_book_decoder(uint32_t iterations) {
+    deribit::json::Parser parser;
+    auto delta = std::make_unique<deribit::BookDelta>();
+    std::string_view instrument;
+    uint64_t change_id = 0;
+    size_t bids = 0;
+    size_t asks = 0;
+
+    for (const char* payload : {deribit::payloads::BOOK_CHANGE, deribit::payloads::BOOK_SNAPSHOT}) {
+        std::string message = payload;
+        auto status = deribit::decode_book_notification(message, *delta, instrument);
+        if (status != deribit::BookDecodeStatus::Ok || !reference_decode(parser, message, change_id, bids, asks) ||
+            delta->change_id != change_id || delta->bid_count != bids || delta->ask_count != asks) {
+            std::cerr << "Book decoder disagrees with the generic parser on a recorded payload" << std::endl;
+            return false;
+        }
+    }
+    for (const char* payload : {deribit::payloads::TICKER, deribit::payloads::SUBSCRIBE_RESPONSE}) {
+        if (deribit::decode_book_notification(payload, *delta, instrument) != deribit::BookDecodeStatus::NotBook) {
+            std::cerr << "Book decoder accepted a non-book payload" << std::endl;
+            return false;
+        }
+    }
+
+    std::mt19937 rng(12345);
+    const char splice[] = "{}[]:,\"0-.e ";
+    std::map<deribit::BookDecodeStatus, uint64_t> outcomes;
+    for (uint32_t i = 0; i < iterations; ++i) {
+        std::string message = i % 2 ? deribit::payloads::BOOK_CHANGE : deribit::payloads::BOOK_SNAPSHOT;
+        uint32_t mutations = 1 + rng() % 4;
+        for (uint32_t m = 0; m < mutations && !message.empty(); ++m) {
+            size_t pos = rng() % message.size();
+            switch (rng() % 4) {
+            case 0: message[pos] = static_cast<char>(rng()); break;
+            case 1: message[pos] = splice[rng() % (sizeof(splice) - 1)]; break;
+            case 2: message.insert(pos, 1, splice[rng() % (sizeof(splice) - 1)]); break;
+            default: message.resize(pos); break;
+            }
+        }
+        // Exact-size heap copy so ASan catches any read past the end.
+        std::unique_ptr<char[]> exact(new char[message.size()]);
+        std::copy(message.begin(), message.end(), exact.get());
+        std::string_view view(exact.get(), message.size());
+
+        auto status = deribit::decode_book_notification(view, *delta, instrument);
+        ++outcomes[status];
+        if (status != deribit::BookDecodeStatus::Ok) {
+            continue;
+        }
+        if (delta->bid_count > deribit::BookDelta::MAX_LEVELS || delta->ask_count > deribit::BookDelta::MAX_LEVELS ||
+            !reference_decode(parser, message, change_id, bids, asks) || delta->change_id != change_id ||
+            delta->bid_count != bids || delta->ask_count != asks) {
+            std::cerr << "Book decoder accepted a corrupted payload inconsistently: " << message << std::endl;
+            return false;
+        }
+    }
+
+    std::cerr << "Book decoder robustness: " << iterations << " corrupted payloads";
+    for (const auto& [status, count] : outcomes) {
+        std::cerr << ", " << deribit::book_decode_status_name(status) << " " << count;
+    }
+    std::cerr << std::endl;
+    return true;
+}
+
+}
+
+int main() {
+    return verify_book_decoder(200000) ? 0 : 1;
+}
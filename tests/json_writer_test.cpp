@@ -0,0 +1,61 @@
+#include "json_writer.hpp"
+#include "ondemand_json.hpp"
+#include <json/json.h>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+
+namespace {
+
+// Random strings, integers, doubles and decimals written by json::Writer
+// must read back unchanged through jsoncpp.
+bool verify_writer(uint32_t iterations) {
+    using deribit::json::Decimal;
+    std::mt19937_64 rng(7);
+    std::string buffer;
+    Json::Reader reader;
+    for (uint32_t i = 0; i < iterations; ++i) {
+        std::string text(rng() % 24, '\0');
+        for (char& c : text) {
+            c = static_cast<char>(rng() % 0x80);
+        }
+        int64_t integer = static_cast<int64_t>(rng());
+        uint64_t id = rng();
+        double number = std::ldexp(static_cast<double>(rng() % 1000000007), static_cast<int>(rng() % 80) - 40);
+        Decimal decimal{static_cast<int64_t>(rng() % 2000000000000000) - 1000000000000000};
+
+        buffer.clear();
+        deribit::json::Writer(buffer)
+            .begin_object()
+            .member("text", text)
+            .member("integer", integer)
+            .member("id", id)
+            .key("numbers").begin_array().value(number).value(decimal).null().end_array()
+            .key("empty").begin_object().end_object()
+            .end_object();
+
+        Json::Value parsed;
+        Decimal decimal_back;
+        bool ok = reader.parse(buffer, parsed) && parsed["text"].asString() == text &&
+                  parsed["integer"].asInt64() == integer && parsed["id"].asUInt64() == id &&
+                  parsed["numbers"][0].asDouble() == number && parsed["numbers"][2].isNull() &&
+                  parsed["empty"].isObject() && parsed["empty"].empty();
+        if (ok) {
+            std::string decimal_text = Json::FastWriter().write(parsed["numbers"][1]);
+            ok = deribit::json::parse_decimal(decimal_text.substr(0, decimal_text.size() - 1), decimal_back) &&
+                 decimal_back == decimal;
+        }
+        if (!ok) {
+            std::fprintf(stderr, "json writer round trip failed: %s\n", buffer.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main() {
+    return verify_writer(100000) ? 0 : 1;
+}
@@ -0,0 +1,342 @@
+#include "ondemand_json.hpp"
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using deribit::json::Backend;
+using deribit::json::Decimal;
+using deribit::json::Type;
+using deribit::json::Value;
+
+std::vector<Backend> supported_backends() {
+    std::vector<Backend> backends;
+    for (Backend backend : {Backend::Scalar, Backend::Sse2, Backend::Avx2}) {
+        if (deribit::json::backend_supported(backend)) {
+            backends.push_back(backend);
+        }
+    }
+    return backends;
+}
+
+// Flattens a value into a form that differs whenever navigation would:
+// keys raw, strings unescaped and length-prefixed, other scalars raw.
+void describe(const Value& value, std::string& out) {
+    switch (value.type()) {
+    case Type::Object:
+        out += '{';
+        for (const auto& field : value.fields()) {
+            out += std::to_string(field.key.size()) + ':';
+            out += field.key;
+            out += '=';
+            describe(field.value, out);
+        }
+        out += '}';
+        break;
+    case Type::Array:
+        out += '[';
+        for (const auto& element : value.elements()) {
+            describe(element, out);
+            out += ';';
+        }
+        out += ']';
+        break;
+    case Type::String: {
+        std::string text;
+        if (!value.get(text)) {
+            out += "!string";
+            break;
+        }
+        out += 's' + std::to_string(text.size()) + ':' + text;
+        break;
+    }
+    case Type::Number:
+    case Type::Bool:
+    case Type::Null:
+        out += value.raw();
+        break;
+    case Type::Invalid:
+        out += "!invalid";
+        break;
+    }
+}
+
+// Escaped pieces of string contents and what they decode to. Structural
+// characters and runs of backslashes are where the index can go wrong.
+struct Piece {
+    const char* text;
+    const char* decoded;
+};
+
+const Piece PIECES[] = {
+    {"a", "a"},
+    {"{", "{"},
+    {"}", "}"},
+    {"[", "["},
+    {"]", "]"},
+    {":", ":"},
+    {",", ","},
+    {" ", " "},
+    {"\\\"", "\""},
+    {"\\\\", "\\"},
+    {"\\\\\\\"", "\\\""},
+    {"\\/", "/"},
+    {"\\n", "\n"},
+    {"\\t", "\t"},
+    {"\\u0041", "A"},
+    {"\\u00e9", "\xc3\xa9"},
+    {"\\u20ac", "\xe2\x82\xac"},
+    {"\\ud83d\\ude00", "\xf0\x9f\x98\x80"},
+    {"\\ud83d", "\xef\xbf\xbd"},
+};
+
+void whitespace(std::mt19937_64& rng, std::string& text) {
+    static const char SPACES[] = {' ', '\n', '\t', '\r'};
+    for (uint64_t n = rng() % 4 == 0 ? rng() % 3 : 0; n > 0; --n) {
+        text += SPACES[rng() % 4];
+    }
+}
+
+void generate_string(std::mt19937_64& rng, std::string& text, std::string& decoded) {
+    text += '"';
+    decoded.clear();
+    for (uint64_t n = rng() % 12; n > 0; --n) {
+        const Piece& piece = PIECES[rng() % (sizeof(PIECES) / sizeof(PIECES[0]))];
+        text += piece.text;
+        decoded += piece.decoded;
+    }
+    text += '"';
+}
+
+// Appends a random document to `text` and its description to `expected`.
+void generate(std::mt19937_64& rng, int depth, std::string& text, std::string& expected) {
+    whitespace(rng, text);
+    uint64_t kind = depth > 3 ? 2 + rng() % 4 : rng() % 6;
+    switch (kind) {
+    case 0: {
+        text += '{';
+        expected += '{';
+        for (uint64_t n = rng() % 5; n > 0; --n) {
+            whitespace(rng, text);
+            size_t key_start = text.size() + 1;
+            std::string decoded;
+            generate_string(rng, text, decoded);
+            std::string key = text.substr(key_start, text.size() - key_start - 1);
+            expected += std::to_string(key.size()) + ':' + key + '=';
+            whitespace(rng, text);
+            text += ':';
+            generate(rng, depth + 1, text, expected);
+            text += n > 1 ? "," : "";
+        }
+        text += '}';
+        expected += '}';
+        break;
+    }
+    case 1:
+        text += '[';
+        expected += '[';
+        for (uint64_t n = rng() % 5; n > 0; --n) {
+            generate(rng, depth + 1, text, expected);
+            expected += ';';
+            text += n > 1 ? "," : "";
+        }
+        text += ']';
+        expected += ']';
+        break;
+    case 2:
+    case 3: {
+        std::string decoded;
+        generate_string(rng, text, decoded);
+        expected += 's' + std::to_string(decoded.size()) + ':' + decoded;
+        break;
+    }
+    case 4: {
+        std::string number = (rng() % 2 ? "-" : "") + std::to_string(rng() % 100000);
+        if (rng() % 2) {
+            number += '.' + std::to_string(rng() % 100000000);
+        }
+        text += number;
+        expected += number;
+        break;
+    }
+    default: {
+        const char* literal = rng() % 3 == 0 ? "null" : rng() % 2 ? "true" : "false";
+        text += literal;
+        expected += literal;
+        break;
+    }
+    }
+    whitespace(rng, text);
+}
+
+// Random documents must navigate the same, and as generated, on every
+// backend.
+bool verify_backends(uint32_t documents) {
+    std::mt19937_64 rng(17);
+    std::vector<Backend> backends = supported_backends();
+    std::vector<std::unique_ptr<deribit::json::Parser>> parsers;
+    for (Backend backend : backends) {
+        parsers.push_back(std::make_unique<deribit::json::Parser>(backend));
+    }
+    std::string text;
+    std::string expected;
+    std::string described;
+    for (uint32_t i = 0; i < documents; ++i) {
+        text.clear();
+        expected.clear();
+        generate(rng, 0, text, expected);
+        for (size_t b = 0; b < parsers.size(); ++b) {
+            deribit::json::Document doc = parsers[b]->parse(text);
+            described.clear();
+            describe(doc.root(), described);
+            if (doc.error() != deribit::json::Error::None || described != expected) {
+                std::cerr << "Backend " << deribit::json::backend_name(backends[b]) << " misread: " << text
+                          << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Escapes and quotes placed at every offset around the first two 64-byte
+// block boundaries, so backslash runs and string state carry across them.
+bool verify_block_boundaries() {
+    std::vector<Backend> backends = supported_backends();
+    for (const Piece& piece : PIECES) {
+        for (size_t pad = 0; pad < 140; ++pad) {
+            std::string text = "{\"pad\":\"" + std::string(pad, 'x') + "\",\"v\":\"" + piece.text + piece.text +
+                               "\",\"after\":[1,\"}\"]}";
+            std::string decoded = std::string(piece.decoded) + piece.decoded;
+            for (Backend backend : backends) {
+                deribit::json::Parser parser(backend);
+                deribit::json::Document doc = parser.parse(text);
+                Value root = doc.root();
+                std::string value;
+                std::string_view closing;
+                if (doc.error() != deribit::json::Error::None || !root["v"].get(value) || value != decoded ||
+                    root["after"].at(0).get_or(0) != 1 || !root["after"].at(1).get(closing) || closing != "}") {
+                    std::cerr << "Backend " << deribit::json::backend_name(backend) << " misread: " << text
+                              << std::endl;
+                    return false;
+                }
+            }
+            // Cut inside the value: the string is never closed.
+            std::string cut = text.substr(0, 16 + pad);
+            for (Backend backend : backends) {
+                deribit::json::Parser parser(backend);
+                if (parser.parse(cut).error() != deribit::json::Error::UnclosedString) {
+                    std::cerr << "Backend " << deribit::json::backend_name(backend)
+                              << " missed an unclosed string: " << cut << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool verify_decimals() {
+    struct Case {
+        const char* text;
+        bool ok;
+        int64_t units;
+    };
+    static const Case CASES[] = {
+        {"0", true, 0},
+        {"-0", true, 0},
+        {"1", true, 100000000},
+        {"-1.5", true, -150000000},
+        {"0.00000001", true, 1},
+        {"0.000000005", true, 1},
+        {"0.0000000049999999999", true, 0},
+        {"-0.000000005", true, -1},
+        {"-0.0000000049", true, 0},
+        {"1.123456785", true, 112345679},
+        {"1.123456784999", true, 112345678},
+        {"0.999999995", true, 100000000},
+        {"12345678901.234567895", true, 1234567890123456790},
+        {"12345678901.234567894", true, 1234567890123456789},
+        {"1234567890123456789.5e-8", true, 1234567890123456790},
+        {"12345678901234567895e-9", true, 1234567890123456790},
+        {"1e-9", true, 0},
+        {"5e-9", true, 1},
+        {"2.5E+2", true, 25000000000},
+        {"1e-100000", true, 0},
+        {"92233720368.54775807", true, INT64_MAX},
+        {"-92233720368.54775807", true, -INT64_MAX},
+        {"92233720368.547758065", true, INT64_MAX},
+        {"92233720368.54775808", false, 0},
+        {"92233720368.547758075", false, 0},
+        {"92233720369", false, 0},
+        {"1e11", false, 0},
+        {"1e100000", false, 0},
+        {"", false, 0},
+        {"-", false, 0},
+        {".5", false, 0},
+        {"1.", false, 0},
+        {"1e", false, 0},
+        {"1e+", false, 0},
+        {"+1", false, 0},
+        {"1.5x", false, 0},
+    };
+    for (const Case& c : CASES) {
+        Decimal decimal{42};
+        bool ok = deribit::json::parse_decimal(c.text, decimal);
+        if (ok != c.ok || (ok && decimal.units != c.units)) {
+            std::cerr << "parse_decimal(\"" << c.text << "\") gave " << (ok ? "" : "failure, ") << decimal.units
+                      << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool verify_unescape() {
+    struct Case {
+        const char* text;
+        bool ok;
+        std::string_view decoded;
+    };
+    static const Case CASES[] = {
+        {"\"plain\"", true, "plain"},
+        {"\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"", true, "\"\\/\b\f\n\r\t"},
+        {"\"\\u0041\\u00E9\\u20aC\"", true, "A\xc3\xa9\xe2\x82\xac"},
+        {"\"\\u0000\"", true, std::string_view("\0", 1)},
+        {"\"\\ud83d\\ude00\"", true, "\xf0\x9f\x98\x80"},
+        {"\"\\uDBFF\\uDFFF\"", true, "\xf4\x8f\xbf\xbf"},
+        {"\"\\ud83d\"", true, "\xef\xbf\xbd"},
+        {"\"\\ude00\"", true, "\xef\xbf\xbd"},
+        {"\"\\ud83dx\"", true, "\xef\xbf\xbdx"},
+        {"\"\\ud83d\\u0041\"", true, "\xef\xbf\xbd" "A"},
+        {"\"\\ud83d\\ud83d\\ude00\"", true, "\xef\xbf\xbd\xf0\x9f\x98\x80"},
+        {"\"\\u00\"", false, ""},
+        {"\"\\u00g0\"", false, ""},
+        {"\"\\x41\"", false, ""},
+    };
+    deribit::json::Parser parser;
+    for (const Case& c : CASES) {
+        std::string out = "untouched";
+        bool ok = parser.parse(c.text).root().get(out);
+        if (ok != c.ok || (ok ? out != c.decoded : out != "untouched")) {
+            std::cerr << "Unescaping " << c.text << " gave " << (ok ? "" : "failure, ") << out << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main() {
+    bool ok = verify_backends(200000);
+    ok = verify_block_boundaries() && ok;
+    ok = verify_decimals() && ok;
+    ok = verify_unescape() && ok;
+    return ok ? 0 : 1;
+}
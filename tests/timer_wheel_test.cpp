@@ -0,0 +1,61 @@
+#include "timer_wheel.hpp"
+#include <boost/asio/io_context.hpp>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Random deadlines spread over every level of the wheel, a third of them
+// cancelled, driven through simulated time. Each remaining timer must fire
+// exactly once, no earlier than its deadline and by the first advance a
+// tick after it.
+bool verify_timer_wheel(uint32_t timers) {
+    using clock = deribit::TimerWheel::clock;
+    boost::asio::io_context ioc;
+    deribit::TimerWheel wheel(ioc, std::chrono::microseconds(1000));
+    std::mt19937_64 rng(31);
+    std::vector<int64_t> due(timers);
+    std::vector<int64_t> fired(timers, -1);
+    std::vector<deribit::TimerWheel::TimerId> ids(timers);
+    int64_t now_ns = 0;
+
+    auto epoch = clock::now();
+    for (uint32_t i = 0; i < timers; ++i) {
+        due[i] = static_cast<int64_t>(rng() % (uint64_t(1) << (rng() % 36)));
+        ids[i] = wheel.schedule(std::chrono::nanoseconds(due[i]), [&fired, &now_ns, i] {
+            fired[i] = fired[i] < 0 ? now_ns : -2;
+        });
+    }
+    // Deadlines count from each schedule() call, a little after epoch.
+    int64_t slack = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - epoch).count();
+    for (uint32_t i = 0; i < timers; i += 3) {
+        if (!wheel.cancel(ids[i]) || wheel.cancel(ids[i])) {
+            std::cerr << "Timer wheel cancel() of a pending timer did not succeed exactly once" << std::endl;
+            return false;
+        }
+    }
+
+    const int64_t step_ns = 50000000;
+    const int64_t tick_ns = 1000000;
+    while (wheel.pending() > 0) {
+        now_ns += static_cast<int64_t>(rng() % step_ns);
+        wheel.advance_to(epoch + std::chrono::nanoseconds(now_ns));
+    }
+    for (uint32_t i = 0; i < timers; ++i) {
+        bool ok = i % 3 == 0 ? fired[i] == -1
+                             : fired[i] >= due[i] && fired[i] <= due[i] + slack + tick_ns + step_ns;
+        if (!ok) {
+            std::cerr << "Timer wheel fired timer " << i << " (deadline " << due[i] << " ns) at " << fired[i]
+                      << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main() {
+    return verify_timer_wheel(200000) ? 0 : 1;
+}
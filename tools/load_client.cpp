@@ -0,0 +1,313 @@
+#include "load_client.hpp"
+#include "json_writer.hpp"
+#include "logger.hpp"
+#include <boost/asio/post.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace deribit {
+namespace load {
+
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+
+namespace {
+
+uint64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Extracts the number following `"key":` or 0 if the key is absent.
+uint64_t find_number(const std::string& message, const char* key) {
+    size_t pos = message.find(key);
+    if (pos == std::string::npos) {
+        return 0;
+    }
+    return std::strtoull(message.c_str() + pos + std::strlen(key), nullptr, 10);
+}
+
+// Extracts the string following `"key":"` or an empty string.
+std::string find_string(const std::string& message, const char* key) {
+    size_t pos = message.find(key);
+    if (pos == std::string::npos) {
+        return std::string();
+    }
+    pos += std::strlen(key);
+    size_t end = message.find('"', pos);
+    if (end == std::string::npos) {
+        return std::string();
+    }
+    return message.substr(pos, end - pos);
+}
+
+}
+
+ClientSession::ClientSession(asio::io_context& ioc, const ClientOptions& options, WorkerStats& stats,
+                             std::vector<std::string> symbols, bool slow, uint32_t id)
+    : ws_(ioc)
+    , slow_timer_(ioc)
+    , options_(options)
+    , stats_(stats)
+    , symbols_(std::move(symbols))
+    , slow_(slow)
+    , id_(id)
+    , next_subscription_(0)
+    , open_(false)
+{}
+
+void ClientSession::start(const tcp::resolver::results_type& endpoints) {
+    beast::get_lowest_layer(ws_).expires_after(std::chrono::seconds(10));
+    beast::get_lowest_layer(ws_).async_connect(
+        endpoints,
+        [self = shared_from_this()](beast::error_code ec, const tcp::endpoint&) {
+            self->on_connect(ec);
+        });
+}
+
+void ClientSession::stop() {
+    asio::post(ws_.get_executor(), [self = shared_from_this()]() {
+        self->slow_timer_.cancel();
+        if (!self->open_) {
+            beast::error_code ec;
+            beast::get_lowest_layer(self->ws_).socket().close(ec);
+            return;
+        }
+        self->open_ = false;
+        self->stats_.connected.fetch_sub(1, std::memory_order_relaxed);
+        self->ws_.async_close(websocket::close_code::normal, [self](beast::error_code) {});
+    });
+}
+
+void ClientSession::on_connect(beast::error_code ec) {
+    if (ec) {
+        fail("connect", ec);
+        return;
+    }
+    beast::get_lowest_layer(ws_).expires_never();
+    ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::client));
+    ws_.set_option(websocket::stream_base::decorator([](websocket::request_type& req) {
+        req.set(beast::http::field::user_agent,
+                std::string(BOOST_BEAST_VERSION_STRING) + " deribit-load-generator");
+    }));
+    ws_.async_handshake(options_.host, "/", [self = shared_from_this()](beast::error_code ec) {
+        self->on_handshake(ec);
+    });
+}
+
+void ClientSession::on_handshake(beast::error_code ec) {
+    if (ec) {
+        fail("handshake", ec);
+        return;
+    }
+    open_ = true;
+    stats_.connected.fetch_add(1, std::memory_order_relaxed);
+    LOG_DEBUG("Session %u connected", id_);
+    send_next_subscription();
+    do_read();
+}
+
+// Subscriptions are written one at a time; a websocket stream allows only
+// one outstanding write.
+void ClientSession::send_next_subscription() {
+    if (next_subscription_ >= symbols_.size()) {
+        return;
+    }
+    outgoing_.clear();
+    json::Writer(outgoing_)
+        .begin_object()
+        .member("action", "subscribe")
+        .member("symbol", symbols_[next_subscription_++])
+        .end_object();
+
+    ws_.async_write(asio::buffer(outgoing_), [self = shared_from_this()](beast::error_code ec, std::size_t) {
+        if (ec) {
+            self->fail("subscribe", ec);
+            return;
+        }
+        self->send_next_subscription();
+    });
+}
+
+void ClientSession::do_read() {
+    ws_.async_read(buffer_, [self = shared_from_this()](beast::error_code ec, std::size_t bytes) {
+        self->on_read(ec, bytes);
+    });
+}
+
+void ClientSession::on_read(beast::error_code ec, std::size_t bytes) {
+    if (ec) {
+        if (open_) {
+            open_ = false;
+            stats_.disconnects.fetch_add(1, std::memory_order_relaxed);
+            stats_.connected.fetch_sub(1, std::memory_order_relaxed);
+            LOG_DEBUG("Session %u disconnected: %s", id_, ec.message().c_str());
+        }
+        return;
+    }
+
+    uint64_t received_us = now_us();
+    std::string message = beast::buffers_to_string(buffer_.data());
+    buffer_.consume(buffer_.size());
+    stats_.messages.fetch_add(1, std::memory_order_relaxed);
+    stats_.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    process(message, received_us);
+
+    if (slow_) {
+        slow_timer_.expires_after(std::chrono::milliseconds(options_.slow_delay_ms));
+        slow_timer_.async_wait([self = shared_from_this()](beast::error_code ec) {
+            if (!ec) {
+                self->do_read();
+            }
+        });
+    } else {
+        do_read();
+    }
+}
+
+// Only book notifications are decoded, and only the fields needed for
+// latency and sequencing, so the client stays cheap per message.
+void ClientSession::process(const std::string& message, uint64_t received_us) {
+    if (message.find("\"change_id\":") == std::string::npos) {
+        return;
+    }
+    stats_.book_messages.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t sent_us = find_number(message, "\"mock_timestamp_us\":");
+    if (!sent_us) {
+        sent_us = find_number(message, "\"timestamp\":") * 1000;
+    }
+    if (sent_us) {
+        if (received_us < sent_us) {
+            stats_.clock_skewed.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            (slow_ ? stats_.slow_latency : stats_.fast_latency).record(received_us - sent_us);
+        }
+    }
+
+    std::string symbol = find_string(message, "\"instrument_name\":\"");
+    uint64_t change_id = find_number(message, "\"change_id\":");
+    uint64_t prev_change_id = find_number(message, "\"prev_change_id\":");
+    bool snapshot = message.find("\"type\":\"snapshot\"") != std::string::npos;
+
+    auto it = last_change_id_.find(symbol);
+    if (it == last_change_id_.end() || snapshot) {
+        last_change_id_[symbol] = change_id;
+        return;
+    }
+    if (change_id <= it->second) {
+        stats_.sequence_regressions.fetch_add(1, std::memory_order_relaxed);
+        LOG_DEBUG("Session %u: %s change_id %llu after %llu", id_, symbol.c_str(),
+                  static_cast<unsigned long long>(change_id),
+                  static_cast<unsigned long long>(it->second));
+        return;
+    }
+    if (prev_change_id != it->second) {
+        stats_.sequence_gaps.fetch_add(1, std::memory_order_relaxed);
+        LOG_DEBUG("Session %u: %s gap, prev_change_id %llu but last seen %llu", id_, symbol.c_str(),
+                  static_cast<unsigned long long>(prev_change_id),
+                  static_cast<unsigned long long>(it->second));
+    }
+    it->second = change_id;
+}
+
+void ClientSession::fail(const char* stage, beast::error_code ec) {
+    if (ec == asio::error::operation_aborted) {
+        return;
+    }
+    if (open_) {
+        open_ = false;
+        stats_.disconnects.fetch_add(1, std::memory_order_relaxed);
+        stats_.connected.fetch_sub(1, std::memory_order_relaxed);
+    } else {
+        stats_.connect_failures.fetch_add(1, std::memory_order_relaxed);
+    }
+    LOG_DEBUG("Session %u %s failed: %s", id_, stage, ec.message().c_str());
+}
+
+ClientPool::ClientPool(const ClientOptions& options, uint32_t threads)
+    : options_(options)
+    , started_(0)
+    , stopped_(false)
+{
+    try {
+        asio::io_context resolver_ioc;
+        tcp::resolver resolver(resolver_ioc);
+        endpoints_ = resolver.resolve(options_.host, options_.port);
+    } catch (const std::exception& e) {
+        throw std::runtime_error("Unable to resolve " + options_.host + ":" + options_.port + ": " + e.what());
+    }
+
+    for (uint32_t i = 0; i < std::max(threads, 1u); ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (auto& worker : workers_) {
+        work_guards_.push_back(asio::make_work_guard(worker->ioc));
+        worker->thread = std::thread([&ioc = worker->ioc] { ioc.run(); });
+    }
+}
+
+ClientPool::~ClientPool() {
+    stop();
+}
+
+void ClientPool::add_session(std::vector<std::string> symbols, bool slow) {
+    uint32_t id = static_cast<uint32_t>(sessions_.size());
+    Worker& worker = *workers_[id % workers_.size()];
+    sessions_.push_back(std::make_shared<ClientSession>(
+        worker.ioc, options_, worker.stats, std::move(symbols), slow, id));
+}
+
+bool ClientPool::start_next() {
+    if (started_ >= sessions_.size()) {
+        return false;
+    }
+    size_t index = started_++;
+    auto session = sessions_[index];
+    asio::post(workers_[index % workers_.size()]->ioc, [this, session] { session->start(endpoints_); });
+    return true;
+}
+
+Totals ClientPool::totals() const {
+    Totals totals;
+    for (const auto& worker : workers_) {
+        const WorkerStats& stats = worker->stats;
+        totals.connected += stats.connected.load(std::memory_order_relaxed);
+        totals.connect_failures += stats.connect_failures.load(std::memory_order_relaxed);
+        totals.disconnects += stats.disconnects.load(std::memory_order_relaxed);
+        totals.messages += stats.messages.load(std::memory_order_relaxed);
+        totals.bytes += stats.bytes.load(std::memory_order_relaxed);
+        totals.book_messages += stats.book_messages.load(std::memory_order_relaxed);
+        totals.sequence_gaps += stats.sequence_gaps.load(std::memory_order_relaxed);
+        totals.sequence_regressions += stats.sequence_regressions.load(std::memory_order_relaxed);
+        totals.clock_skewed += stats.clock_skewed.load(std::memory_order_relaxed);
+        totals.fast_latency.merge(stats.fast_latency);
+        totals.slow_latency.merge(stats.slow_latency);
+    }
+    return totals;
+}
+
+void ClientPool::stop() {
+    if (stopped_) {
+        return;
+    }
+    stopped_ = true;
+
+    for (size_t i = 0; i < started_; ++i) {
+        sessions_[i]->stop();
+    }
+    work_guards_.clear();
+    // Give the close handshakes a moment, then abandon whatever is left.
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    for (auto& worker : workers_) {
+        worker->ioc.stop();
+        worker->thread.join();
+    }
+}
+
+} // namespace load
+} // namespace deribit
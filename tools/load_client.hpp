@@ -0,0 +1,242 @@
+#pragma once
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace deribit {
+namespace load {
+
+// Simulated fan-out clients, shared by the load generator and the
+// end-to-end benchmark.
+//
+// A ClientPool owns a few io_context threads and the sessions assigned to
+// them. Each session subscribes to its symbols and reads until stopped;
+// slow sessions pause between reads so their socket buffers fill up and the
+// server has to queue for them.
+//
+// Every message is stamped on receipt. Book notifications carry the exchange
+// timestamp and change ids, which feed the latency histograms and a check
+// that each session sees an unbroken change_id -> prev_change_id chain per
+// symbol. Messages from the mock feed also carry mock_timestamp_us, which is
+// preferred over the millisecond exchange timestamp when present.
+
+// Log-linear histogram of microsecond values: 16 linear sub-buckets per
+// power of two, so any recorded value is reported within ~6%. Buckets are
+// atomics so the reporting thread can read while workers record.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKETS = 16;
+    static constexpr int MAX_EXPONENT = 40;
+    static constexpr int BUCKETS = (MAX_EXPONENT - 2) * SUB_BUCKETS;
+
+    void record(uint64_t value_us) {
+        buckets_[index_for(value_us)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value_us, std::memory_order_relaxed);
+        uint64_t current = max_.load(std::memory_order_relaxed);
+        while (value_us > current &&
+               !max_.compare_exchange_weak(current, value_us, std::memory_order_relaxed)) {
+        }
+    }
+
+    struct Snapshot {
+        std::array<uint64_t, BUCKETS> buckets{};
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t max = 0;
+
+        void merge(const LatencyHistogram& histogram) {
+            for (int i = 0; i < BUCKETS; ++i) {
+                buckets[i] += histogram.buckets_[i].load(std::memory_order_relaxed);
+            }
+            count += histogram.count_.load(std::memory_order_relaxed);
+            sum += histogram.sum_.load(std::memory_order_relaxed);
+            max = std::max(max, histogram.max_.load(std::memory_order_relaxed));
+        }
+
+        // Values recorded since `earlier` was taken. The maximum cannot be
+        // windowed, so it is taken from the highest non-empty bucket.
+        Snapshot since(const Snapshot& earlier) const {
+            Snapshot window;
+            for (int i = 0; i < BUCKETS; ++i) {
+                window.buckets[i] = buckets[i] - earlier.buckets[i];
+                if (window.buckets[i]) {
+                    window.max = std::min(lower_bound(i + 1), max);
+                }
+            }
+            window.count = count - earlier.count;
+            window.sum = sum - earlier.sum;
+            return window;
+        }
+
+        uint64_t average() const {
+            return count ? sum / count : 0;
+        }
+
+        uint64_t percentile(double p) const {
+            if (count == 0) {
+                return 0;
+            }
+            uint64_t target = static_cast<uint64_t>(p / 100.0 * count);
+            uint64_t seen = 0;
+            for (int i = 0; i < BUCKETS; ++i) {
+                seen += buckets[i];
+                if (seen > target) {
+                    return std::min(lower_bound(i), max);
+                }
+            }
+            return max;
+        }
+    };
+
+private:
+    static int index_for(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return static_cast<int>(value);
+        }
+        int exponent = 63 - __builtin_clzll(value);
+        if (exponent >= MAX_EXPONENT) {
+            return BUCKETS - 1;
+        }
+        int shift = exponent - 4;
+        return (exponent - 3) * SUB_BUCKETS + static_cast<int>((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    static uint64_t lower_bound(int index) {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+        int exponent = index / SUB_BUCKETS + 3;
+        return static_cast<uint64_t>(SUB_BUCKETS + index % SUB_BUCKETS) << (exponent - 4);
+    }
+
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+// Counters for the sessions owned by one worker thread.
+struct WorkerStats {
+    std::atomic<uint64_t> connected{0};
+    std::atomic<uint64_t> connect_failures{0};
+    std::atomic<uint64_t> disconnects{0};
+    std::atomic<uint64_t> messages{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> book_messages{0};
+    std::atomic<uint64_t> sequence_gaps{0};
+    std::atomic<uint64_t> sequence_regressions{0};
+    std::atomic<uint64_t> clock_skewed{0};
+    LatencyHistogram fast_latency;
+    LatencyHistogram slow_latency;
+};
+
+// Sum of all workers' stats at one point in time.
+struct Totals {
+    uint64_t connected = 0;
+    uint64_t connect_failures = 0;
+    uint64_t disconnects = 0;
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    uint64_t book_messages = 0;
+    uint64_t sequence_gaps = 0;
+    uint64_t sequence_regressions = 0;
+    uint64_t clock_skewed = 0;
+    LatencyHistogram::Snapshot fast_latency;
+    LatencyHistogram::Snapshot slow_latency;
+};
+
+struct ClientOptions {
+    std::string host = "localhost";
+    std::string port = "8080";
+    uint32_t slow_delay_ms = 50;
+};
+
+class ClientSession : public std::enable_shared_from_this<ClientSession> {
+public:
+    ClientSession(boost::asio::io_context& ioc, const ClientOptions& options, WorkerStats& stats,
+                  std::vector<std::string> symbols, bool slow, uint32_t id);
+
+    void start(const boost::asio::ip::tcp::resolver::results_type& endpoints);
+    void stop();
+
+private:
+    void on_connect(boost::beast::error_code ec);
+    void on_handshake(boost::beast::error_code ec);
+    void send_next_subscription();
+    void do_read();
+    void on_read(boost::beast::error_code ec, std::size_t bytes);
+    void process(const std::string& message, uint64_t received_us);
+    void fail(const char* stage, boost::beast::error_code ec);
+
+    boost::beast::websocket::stream<boost::beast::tcp_stream> ws_;
+    boost::beast::flat_buffer buffer_;
+    boost::asio::steady_timer slow_timer_;
+    const ClientOptions& options_;
+    WorkerStats& stats_;
+    std::vector<std::string> symbols_;
+    bool slow_;
+    uint32_t id_;
+    size_t next_subscription_;
+    std::string outgoing_;
+    bool open_;
+    std::unordered_map<std::string, uint64_t> last_change_id_;
+};
+
+class ClientPool {
+public:
+    // Resolves the server address up front; throws std::runtime_error if it
+    // cannot be resolved.
+    ClientPool(const ClientOptions& options, uint32_t threads);
+    ~ClientPool();
+
+    ClientPool(const ClientPool&) = delete;
+    ClientPool& operator=(const ClientPool&) = delete;
+
+    // Sessions are assigned to threads round-robin. Must be called before
+    // the sessions are started.
+    void add_session(std::vector<std::string> symbols, bool slow);
+
+    size_t size() const { return sessions_.size(); }
+    size_t started() const { return started_; }
+
+    // Begins connecting the next session that has not been started yet.
+    // Returns false once every session has been started.
+    bool start_next();
+
+    Totals totals() const;
+
+    // Closes every session and joins the worker threads.
+    void stop();
+
+private:
+    struct Worker {
+        boost::asio::io_context ioc;
+        WorkerStats stats;
+        std::thread thread;
+    };
+
+    ClientOptions options_;
+    boost::asio::ip::tcp::resolver::results_type endpoints_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> work_guards_;
+    std::vector<std::shared_ptr<ClientSession>> sessions_;
+    size_t started_;
+    bool stopped_;
+};
+
+} // namespace load
+} // namespace deribit
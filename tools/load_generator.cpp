@@ -0,0 +1,308 @@
+#include "load_client.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Load generator for the fan-out server.
+//
+// Opens many client sessions (see load_client.hpp) paced by a connect rate,
+// subscribes each one to a weighted random mix of symbols and reports
+// throughput, end-to-end latency and sequence breaks while it runs.
+
+namespace {
+
+using deribit::load::LatencyHistogram;
+using deribit::load::Totals;
+
+struct SymbolWeight {
+    std::string symbol;
+    uint32_t weight;
+};
+
+struct Options {
+    std::string host = "localhost";
+    std::string port = "8080";
+    uint32_t sessions = 100;
+    uint32_t threads = 2;
+    double connect_rate = 200;
+    std::vector<SymbolWeight> symbols{{"BTC-PERPETUAL", 1}};
+    uint32_t symbols_per_session = 1;
+    double slow_fraction = 0;
+    uint32_t slow_delay_ms = 50;
+    uint32_t duration_s = 30;
+    uint32_t report_interval_s = 1;
+    uint32_t seed = 1;
+    std::string output;
+    bool verbose = false;
+};
+
+void print_latency(const char* label, const LatencyHistogram::Snapshot& latency) {
+    std::cout << "  " << std::left << std::setw(22) << label << std::right
+              << std::setw(10) << latency.count;
+    if (latency.count) {
+        std::cout << std::setw(10) << latency.average()
+                  << std::setw(10) << latency.percentile(50)
+                  << std::setw(10) << latency.percentile(99)
+                  << std::setw(10) << latency.percentile(99.9)
+                  << std::setw(10) << latency.max;
+    }
+    std::cout << std::endl;
+}
+
+void print_summary(const Options& options, const Totals& totals, double elapsed_s) {
+    std::cout << "\n===== LOAD GENERATOR SUMMARY =====\n";
+    std::cout << "Target: " << options.host << ":" << options.port << std::endl;
+    std::cout << "Sessions: " << options.sessions << " requested, " << totals.connected << " connected at end, "
+              << totals.connect_failures << " failed to connect, " << totals.disconnects << " disconnected"
+              << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Duration: " << elapsed_s << " s" << std::endl;
+    std::cout << "Messages: " << totals.messages << " (" << totals.messages / elapsed_s << "/s, "
+              << totals.bytes / elapsed_s / (1024 * 1024) << " MiB/s)" << std::endl;
+    std::cout << std::defaultfloat;
+    std::cout << "Book messages: " << totals.book_messages << std::endl;
+    std::cout << "Sequence gaps: " << totals.sequence_gaps
+              << ", regressions: " << totals.sequence_regressions << std::endl;
+    if (totals.clock_skewed) {
+        std::cout << "Messages stamped in the future (clock skew): " << totals.clock_skewed << std::endl;
+    }
+    std::cout << "End-to-end latency (us, exchange timestamp to receipt):\n";
+    std::cout << "  " << std::left << std::setw(22) << "readers" << std::right
+              << std::setw(10) << "count" << std::setw(10) << "avg" << std::setw(10) << "p50"
+              << std::setw(10) << "p99" << std::setw(10) << "p99.9" << std::setw(10) << "max" << std::endl;
+    print_latency("normal", totals.fast_latency);
+    if (options.slow_fraction > 0) {
+        print_latency("slow", totals.slow_latency);
+    }
+    std::cout << "==================================\n";
+}
+
+void write_latency_json(std::ostream& out, const LatencyHistogram::Snapshot& latency) {
+    out << "{\"count\": " << latency.count
+        << ", \"avg_us\": " << latency.average()
+        << ", \"p50_us\": " << latency.percentile(50)
+        << ", \"p99_us\": " << latency.percentile(99)
+        << ", \"p999_us\": " << latency.percentile(99.9)
+        << ", \"max_us\": " << latency.max << "}";
+}
+
+bool write_json(const Options& options, const Totals& totals, double elapsed_s) {
+    std::ofstream out(options.output, std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Unable to write " << options.output << std::endl;
+        return false;
+    }
+    out << "{\n  \"sessions\": " << options.sessions
+        << ",\n  \"threads\": " << options.threads
+        << ",\n  \"slow_fraction\": " << options.slow_fraction
+        << ",\n  \"duration_s\": " << elapsed_s
+        << ",\n  \"connected\": " << totals.connected
+        << ",\n  \"connect_failures\": " << totals.connect_failures
+        << ",\n  \"disconnects\": " << totals.disconnects
+        << ",\n  \"messages\": " << totals.messages
+        << ",\n  \"bytes\": " << totals.bytes
+        << ",\n  \"book_messages\": " << totals.book_messages
+        << ",\n  \"sequence_gaps\": " << totals.sequence_gaps
+        << ",\n  \"sequence_regressions\": " << totals.sequence_regressions
+        << ",\n  \"latency\": ";
+    write_latency_json(out, totals.fast_latency);
+    out << ",\n  \"slow_latency\": ";
+    write_latency_json(out, totals.slow_latency);
+    out << "\n}\n";
+    return out.good();
+}
+
+// Picks `count` distinct symbols, each draw weighted by the remaining weights.
+std::vector<std::string> pick_symbols(const Options& options, std::mt19937& rng) {
+    std::vector<SymbolWeight> pool = options.symbols;
+    std::vector<std::string> picked;
+    while (picked.size() < options.symbols_per_session && !pool.empty()) {
+        uint64_t total = 0;
+        for (const auto& entry : pool) {
+            total += entry.weight;
+        }
+        uint64_t draw = std::uniform_int_distribution<uint64_t>(0, total - 1)(rng);
+        auto it = pool.begin();
+        for (; draw >= it->weight; ++it) {
+            draw -= it->weight;
+        }
+        picked.push_back(it->symbol);
+        pool.erase(it);
+    }
+    return picked;
+}
+
+std::vector<SymbolWeight> parse_symbols(const std::string& text) {
+    std::vector<SymbolWeight> symbols;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find(',', start);
+        std::string item = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        size_t colon = item.find(':');
+        if (!item.empty()) {
+            uint32_t weight = colon == std::string::npos ? 1 : std::max(1, std::atoi(item.c_str() + colon + 1));
+            symbols.push_back({item.substr(0, colon), weight});
+        }
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    return symbols;
+}
+
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --host <host>              server host (default: localhost)\n"
+              << "  --port <port>              server port (default: 8080)\n"
+              << "  --sessions <n>             client sessions to open (default: 100)\n"
+              << "  --threads <n>              io threads driving the sessions (default: 2)\n"
+              << "  --connect-rate <n>         new sessions per second (default: 200)\n"
+              << "  --symbols <sym[:w],...>    symbol mix with optional weights (default: BTC-PERPETUAL)\n"
+              << "  --per-session <n>          distinct symbols each session subscribes to (default: 1)\n"
+              << "  --slow-fraction <0..1>     share of sessions that read slowly (default: 0)\n"
+              << "  --slow-delay <ms>          pause between reads for slow sessions (default: 50)\n"
+              << "  --duration <s>             run time after the first connection attempt (default: 30)\n"
+              << "  --report-interval <s>      progress line interval, 0 to disable (default: 1)\n"
+              << "  --seed <n>                 seed for symbol and slow-reader assignment (default: 1)\n"
+              << "  --out <file.json>          write the summary as JSON\n"
+              << "  --verbose                  log per-session events to load_generator.log\n";
+}
+
+Options parse_options(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--host" && has_value) {
+            options.host = argv[++i];
+        } else if (arg == "--port" && has_value) {
+            options.port = argv[++i];
+        } else if (arg == "--sessions" && has_value) {
+            options.sessions = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--threads" && has_value) {
+            options.threads = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        } else if (arg == "--connect-rate" && has_value) {
+            options.connect_rate = std::stod(argv[++i]);
+        } else if (arg == "--symbols" && has_value) {
+            options.symbols = parse_symbols(argv[++i]);
+        } else if (arg == "--per-session" && has_value) {
+            options.symbols_per_session = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--slow-fraction" && has_value) {
+            options.slow_fraction = std::stod(argv[++i]);
+        } else if (arg == "--slow-delay" && has_value) {
+            options.slow_delay_ms = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--duration" && has_value) {
+            options.duration_s = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--report-interval" && has_value) {
+            options.report_interval_s = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--seed" && has_value) {
+            options.seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--out" && has_value) {
+            options.output = argv[++i];
+        } else if (arg == "--verbose") {
+            options.verbose = true;
+        } else {
+            print_usage(argv[0]);
+            std::exit(arg == "--help" ? 0 : 1);
+        }
+    }
+    if (options.symbols.empty()) {
+        std::cerr << "--symbols must name at least one symbol" << std::endl;
+        std::exit(1);
+    }
+    return options;
+}
+
+std::atomic<bool> interrupted{false};
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options = parse_options(argc, argv);
+
+    deribit::Logger::instance().set_level(options.verbose ? deribit::LogLevel::DEBUG : deribit::LogLevel::WARNING);
+    deribit::Logger::instance().set_log_file("load_generator.log");
+    std::signal(SIGINT, [](int) { interrupted = true; });
+
+    deribit::load::ClientOptions client_options;
+    client_options.host = options.host;
+    client_options.port = options.port;
+    client_options.slow_delay_ms = options.slow_delay_ms;
+
+    std::unique_ptr<deribit::load::ClientPool> pool;
+    try {
+        pool = std::make_unique<deribit::load::ClientPool>(client_options, options.threads);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    // Sessions are assigned up front so the run is reproducible for a seed.
+    std::mt19937 rng(options.seed);
+    std::bernoulli_distribution slow_reader(std::clamp(options.slow_fraction, 0.0, 1.0));
+    for (uint32_t id = 0; id < options.sessions; ++id) {
+        std::vector<std::string> symbols = pick_symbols(options, rng);
+        pool->add_session(std::move(symbols), slow_reader(rng));
+    }
+
+    std::cout << "Opening " << options.sessions << " sessions to " << options.host << ":" << options.port
+              << " across " << options.threads << " threads at " << options.connect_rate << "/s" << std::endl;
+
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    const auto end = start + std::chrono::seconds(options.duration_s);
+    const auto connect_interval = std::chrono::duration<double>(1.0 / std::max(options.connect_rate, 1e-3));
+    auto next_report = start + std::chrono::seconds(options.report_interval_s);
+    Totals previous;
+    auto previous_time = start;
+
+    while (!interrupted && clock::now() < end) {
+        auto now = clock::now();
+        // Start every session whose slot in the connect schedule has passed.
+        while (pool->started() < pool->size() &&
+               start + std::chrono::duration_cast<clock::duration>(connect_interval * pool->started()) <= now) {
+            pool->start_next();
+        }
+
+        if (options.report_interval_s && now >= next_report) {
+            Totals totals = pool->totals();
+            double interval_s = std::chrono::duration<double>(now - previous_time).count();
+            std::cout << std::fixed << std::setprecision(1)
+                      << "[" << std::setw(6) << std::chrono::duration<double>(now - start).count() << "s] "
+                      << "connected " << totals.connected << "/" << options.sessions
+                      << "  msgs/s " << (totals.messages - previous.messages) / interval_s
+                      << "  MiB/s " << (totals.bytes - previous.bytes) / interval_s / (1024 * 1024)
+                      << "  gaps " << totals.sequence_gaps
+                      << "  p50 " << totals.fast_latency.percentile(50) << "us"
+                      << "  p99 " << totals.fast_latency.percentile(99) << "us"
+                      << std::defaultfloat << std::endl;
+            previous = totals;
+            previous_time = now;
+            next_report += std::chrono::seconds(options.report_interval_s);
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(
+            pool->started() < pool->size() ? 1 : 50));
+    }
+
+    double elapsed_s = std::chrono::duration<double>(clock::now() - start).count();
+    Totals totals = pool->totals();
+    pool->stop();
+
+    print_summary(options, totals, elapsed_s);
+    if (!options.output.empty() && !write_json(options, totals, elapsed_s)) {
+        return 1;
+    }
+    return totals.sequence_gaps || totals.sequence_regressions ? 2 : 0;
+}
@@ -0,0 +1,95 @@
+#include "shm_metrics.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace {
+
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [segment_name] [--interval <ms>] [--once]" << std::endl;
+    std::cout << "  segment_name  shared-memory segment to read (default: "
+              << deribit::shm::DEFAULT_SEGMENT_NAME << ")" << std::endl;
+}
+
+double to_us(uint64_t nanoseconds) {
+    return nanoseconds / 1000.0;
+}
+
+void print_snapshot(const deribit::ShmMetricsReader& reader) {
+    const auto* header = reader.header();
+    std::cout << "\n===== SHARED-MEMORY METRICS (pid " << header->writer_pid << ") =====\n";
+
+    std::cout << "Counters:" << std::endl;
+    for (const auto& counter : reader.read_counters()) {
+        std::cout << "  " << std::left << std::setw(40) << counter.name << counter.value << std::endl;
+    }
+
+    std::cout << "Histograms (us):" << std::endl;
+    std::cout << "  " << std::left << std::setw(40) << "name"
+              << std::right << std::setw(10) << "count"
+              << std::setw(12) << "avg"
+              << std::setw(12) << "p50"
+              << std::setw(12) << "p99"
+              << std::setw(12) << "p99.9"
+              << std::setw(12) << "max" << std::endl;
+
+    std::cout << std::fixed << std::setprecision(1);
+    for (const auto& histogram : reader.read_histograms()) {
+        double avg = histogram.count ? to_us(histogram.sum_ns) / histogram.count : 0.0;
+        std::string name = histogram.stale ? histogram.name + " (stale)" : histogram.name;
+        std::cout << "  " << std::left << std::setw(40) << name
+                  << std::right << std::setw(10) << histogram.count
+                  << std::setw(12) << avg
+                  << std::setw(12) << to_us(histogram.percentile_ns(50))
+                  << std::setw(12) << to_us(histogram.percentile_ns(99))
+                  << std::setw(12) << to_us(histogram.percentile_ns(99.9))
+                  << std::setw(12) << to_us(histogram.max_ns) << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::string segment_name = deribit::shm::DEFAULT_SEGMENT_NAME;
+    int interval_ms = 1000;
+    bool once = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            interval_ms = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--once") == 0) {
+            once = true;
+        } else if (std::strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else {
+            segment_name = argv[i];
+        }
+    }
+
+    deribit::ShmMetricsReader reader;
+    while (true) {
+        // Re-map on every refresh so a restarted writer's new segment is picked up.
+        if (reader.open(segment_name)) {
+            print_snapshot(reader);
+        } else if (once) {
+            std::cerr << "Unable to open metrics segment " << segment_name
+                      << " (is the trading system running with shared-memory metrics enabled?)" << std::endl;
+            return 1;
+        } else {
+            std::cout << "Waiting for metrics segment " << segment_name << "..." << std::endl;
+        }
+
+        if (once) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+    }
+
+    return 0;
+}
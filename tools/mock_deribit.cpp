@@ -0,0 +1,620 @@
+#include "mock_deribit.hpp"
+#include "logger.hpp"
+#include "ondemand_json.hpp"
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace deribit {
+namespace mock {
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace websocket = beast::websocket;
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+
+namespace {
+
+constexpr size_t SNAPSHOT_LEVELS = 10;
+constexpr size_t MAX_BATCH = 1024;
+
+uint64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string book_channel(const std::string& instrument) {
+    return "book." + instrument + ".100ms";
+}
+
+void stamp(json::Writer& response, uint64_t received_us, uint64_t sent_us) {
+    response.member("usIn", received_us)
+        .member("usOut", sent_us)
+        .member("usDiff", sent_us - received_us)
+        .member("testnet", true);
+}
+
+void write_not_found(json::Writer& response) {
+    response.key("error").begin_object()
+        .member("code", -32601)
+        .member("message", "Method not found")
+        .end_object();
+}
+
+// The parameter's serialized value, or null when it is absent.
+std::string_view param(const std::map<std::string, std::string>& params, const std::string& name,
+                       std::string_view fallback = "null") {
+    auto it = params.find(name);
+    return it == params.end() ? fallback : std::string_view(it->second);
+}
+
+std::string url_decode(const std::string& text) {
+    std::string decoded;
+    decoded.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '%' && i + 2 < text.size()) {
+            decoded += static_cast<char>(std::strtol(text.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        } else if (text[i] == '+') {
+            decoded += ' ';
+        } else {
+            decoded += text[i];
+        }
+    }
+    return decoded;
+}
+
+// REST calls carry their parameters in the query string, all as strings.
+std::map<std::string, std::string> parse_query(const std::string& query) {
+    std::map<std::string, std::string> params;
+    size_t start = 0;
+    while (start < query.size()) {
+        size_t end = query.find('&', start);
+        if (end == std::string::npos) {
+            end = query.size();
+        }
+        std::string pair = query.substr(start, end - start);
+        size_t equals = pair.find('=');
+        if (equals != std::string::npos) {
+            std::string& value = params[url_decode(pair.substr(0, equals))];
+            json::Writer(value).value(url_decode(pair.substr(equals + 1)));
+        }
+        start = end + 1;
+    }
+    return params;
+}
+
+}
+
+struct MockDeribit::Connection {
+    explicit Connection(tcp::socket socket) : ws(std::move(socket)) {}
+
+    websocket::stream<tcp::socket> ws;
+    std::atomic<bool> open{true};
+    std::thread reader;
+
+    struct Reply {
+        std::chrono::steady_clock::time_point due;
+        std::string text;
+    };
+
+    // Guards the two members below, which the reader thread fills and the
+    // publisher drains.
+    std::mutex mutex;
+    std::vector<Reply> replies;
+    std::vector<std::string> instruments;
+};
+
+struct MockDeribit::BookState {
+    std::shared_ptr<Connection> connection;
+    std::string instrument;
+    uint64_t change_id = 0;
+    double mid = 0;
+};
+
+MockDeribit::MockDeribit(uint16_t port)
+    : port_(port)
+    , acceptor_(ioc_)
+    , running_(false)
+    , subscriptions_version_(0)
+    , publish_rate_(0)
+    , rate_epoch_(0)
+    , burst_(1)
+    , messages_published_(0)
+    , order_latency_us_(0)
+    , orders_received_(0)
+    , next_order_id_(1)
+    , wake_pending_(false)
+{}
+
+MockDeribit::~MockDeribit() {
+    stop();
+}
+
+void MockDeribit::start() {
+    tcp::endpoint endpoint(asio::ip::make_address("127.0.0.1"), port_);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.set_option(asio::socket_base::reuse_address(true));
+    acceptor_.bind(endpoint);
+    acceptor_.listen(asio::socket_base::max_listen_connections);
+    port_ = acceptor_.local_endpoint().port();
+
+    running_ = true;
+    do_accept();
+    accept_thread_ = std::thread([this] { ioc_.run(); });
+    publish_thread_ = std::thread([this] { publish_loop(); });
+    LOG_INFO("Mock Deribit listening on %s", websocket_url().c_str());
+}
+
+void MockDeribit::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    ioc_.stop();
+    accept_thread_.join();
+    wake_publisher();
+    publish_thread_.join();
+
+    std::vector<std::shared_ptr<Connection>> connections;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        connections.swap(connections_);
+    }
+    for (auto& connection : connections) {
+        beast::error_code ec;
+        connection->ws.next_layer().shutdown(tcp::socket::shutdown_both, ec);
+        if (connection->reader.joinable()) {
+            connection->reader.join();
+        }
+    }
+    boost::system::error_code ec;
+    acceptor_.close(ec);
+}
+
+std::string MockDeribit::websocket_url() const {
+    return "ws://127.0.0.1:" + std::to_string(port_) + "/ws/api/v2";
+}
+
+std::string MockDeribit::rest_url() const {
+    return "http://127.0.0.1:" + std::to_string(port_) + "/api/v2";
+}
+
+void MockDeribit::set_publish_rate(double messages_per_second) {
+    publish_rate_.store(std::max(messages_per_second, 0.0), std::memory_order_relaxed);
+    rate_epoch_.fetch_add(1, std::memory_order_release);
+    wake_publisher();
+}
+
+void MockDeribit::set_burst(uint32_t messages) {
+    burst_.store(std::max(messages, 1u), std::memory_order_relaxed);
+    rate_epoch_.fetch_add(1, std::memory_order_release);
+    wake_publisher();
+}
+
+void MockDeribit::set_order_latency(std::chrono::microseconds latency) {
+    order_latency_us_.store(std::max<int64_t>(latency.count(), 0), std::memory_order_relaxed);
+}
+
+void MockDeribit::wake_publisher() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        wake_pending_ = true;
+    }
+    wake_.notify_one();
+}
+
+std::map<std::string, uint64_t> MockDeribit::published_by_instrument() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return published_by_instrument_;
+}
+
+size_t MockDeribit::subscriptions() const {
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    size_t total = 0;
+    for (const auto& connection : connections_) {
+        std::lock_guard<std::mutex> connection_lock(connection->mutex);
+        total += connection->instruments.size();
+    }
+    return total;
+}
+
+void MockDeribit::do_accept() {
+    acceptor_.async_accept([this](boost::system::error_code ec, tcp::socket socket) {
+        if (ec) {
+            if (running_) {
+                LOG_WARNING("Mock Deribit accept error: %s", ec.message().c_str());
+            }
+            return;
+        }
+        auto connection = std::make_shared<Connection>(std::move(socket));
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex_);
+            connections_.push_back(connection);
+        }
+        connection->reader = std::thread([this, connection] { serve(connection); });
+        do_accept();
+    });
+}
+
+void MockDeribit::serve(std::shared_ptr<Connection> connection) {
+    try {
+        beast::flat_buffer buffer;
+        http::request<http::string_body> request;
+        http::read(connection->ws.next_layer(), buffer, request);
+
+        if (!websocket::is_upgrade(request)) {
+            serve_rest(*connection, buffer, std::move(request));
+        } else {
+            connection->ws.accept(request);
+            while (running_) {
+                beast::flat_buffer message;
+                connection->ws.read(message);
+                handle_request(*connection, beast::buffers_to_string(message.data()));
+            }
+        }
+    } catch (const std::exception& e) {
+        LOG_DEBUG("Mock Deribit connection closed: %s", e.what());
+    }
+    connection->open = false;
+    subscriptions_version_.fetch_add(1, std::memory_order_release);
+}
+
+// Answers REST calls on a keep-alive connection until the client closes it.
+// Order replies are delayed on this thread, so concurrent orders need
+// concurrent connections, as they would against the real REST API.
+void MockDeribit::serve_rest(Connection& connection, beast::flat_buffer& buffer,
+                             http::request<http::string_body> request) {
+    static const std::string prefix = "/api/v2/";
+    tcp::socket& socket = connection.ws.next_layer();
+
+    while (running_) {
+        auto received = std::chrono::steady_clock::now();
+        uint64_t received_us = now_us();
+
+        std::string target(request.target());
+        std::string query;
+        size_t mark = target.find('?');
+        if (mark != std::string::npos) {
+            query = target.substr(mark + 1);
+            target.resize(mark);
+        }
+
+        std::string body;
+        json::Writer response(body);
+        response.begin_object().member("jsonrpc", "2.0");
+        Dispatch outcome = Dispatch::NotFound;
+        if (target.compare(0, prefix.size(), prefix) == 0) {
+            outcome = dispatch(target.substr(prefix.size()), parse_query(query), response);
+        } else {
+            write_not_found(response);
+        }
+
+        uint64_t sent_us = received_us;
+        if (outcome == Dispatch::Delayed) {
+            auto latency = std::chrono::microseconds(order_latency_us_.load(std::memory_order_relaxed));
+            std::this_thread::sleep_until(received + latency);
+            sent_us = now_us();
+        }
+        stamp(response, received_us, sent_us);
+        response.end_object();
+
+        http::response<http::string_body> reply{
+            outcome == Dispatch::NotFound ? http::status::bad_request : http::status::ok, request.version()};
+        reply.set(http::field::content_type, "application/json");
+        reply.keep_alive(request.keep_alive());
+        reply.body() = std::move(body);
+        reply.prepare_payload();
+        http::write(socket, reply);
+
+        if (!request.keep_alive()) {
+            break;
+        }
+        request = {};
+        http::read(socket, buffer, request);
+    }
+}
+
+MockDeribit::Dispatch MockDeribit::dispatch(const std::string& method, const Params& params,
+                                            json::Writer& response) {
+    if (method == "public/auth") {
+        response.key("result").begin_object()
+            .member("access_token", "mock-access-token")
+            .member("refresh_token", "mock-refresh-token")
+            .member("expires_in", 900)
+            .member("scope", "connection mainaccount")
+            .member("token_type", "bearer")
+            .end_object();
+        return Dispatch::Immediate;
+    }
+    if (method == "private/buy" || method == "private/sell") {
+        orders_received_.fetch_add(1, std::memory_order_relaxed);
+        response.key("result").begin_object()
+            .key("order").begin_object()
+            .member("order_id", "MOCK-" + std::to_string(next_order_id_.fetch_add(1, std::memory_order_relaxed)))
+            .member("order_state", "open")
+            .member("direction", method.substr(method.find('/') + 1))
+            .key("instrument_name").raw(param(params, "instrument_name"))
+            .key("amount").raw(param(params, "amount"))
+            .key("price").raw(param(params, "price"))
+            .key("order_type").raw(param(params, "type", "\"limit\""))
+            .end_object()
+            .key("trades").begin_array().end_array()
+            .end_object();
+        return Dispatch::Delayed;
+    }
+    if (method == "private/cancel") {
+        orders_received_.fetch_add(1, std::memory_order_relaxed);
+        response.key("result").begin_object()
+            .key("order_id").raw(param(params, "order_id"))
+            .member("order_state", "cancelled")
+            .end_object();
+        return Dispatch::Delayed;
+    }
+    if (method == "private/edit") {
+        orders_received_.fetch_add(1, std::memory_order_relaxed);
+        response.key("result").begin_object()
+            .key("order").begin_object()
+            .key("order_id").raw(param(params, "order_id"))
+            .member("order_state", "open")
+            .key("amount").raw(param(params, "amount"))
+            .key("price").raw(param(params, "price"))
+            .end_object()
+            .key("trades").begin_array().end_array()
+            .end_object();
+        return Dispatch::Delayed;
+    }
+    if (method == "private/get_positions") {
+        response.key("result").begin_array().end_array();
+        return Dispatch::Immediate;
+    }
+    write_not_found(response);
+    return Dispatch::NotFound;
+}
+
+void MockDeribit::handle_request(Connection& connection, const std::string& text) {
+    auto received = std::chrono::steady_clock::now();
+    uint64_t received_us = now_us();
+    // Each connection is served on its own thread.
+    thread_local json::Parser parser;
+    json::Document document = parser.parse(text);
+    json::Value request = document.root();
+    if (document.error() != json::Error::None || request.type() != json::Type::Object) {
+        LOG_WARNING("Mock Deribit received malformed request: %s", text.c_str());
+        return;
+    }
+
+    std::string body;
+    json::Writer response(body);
+    response.begin_object().member("jsonrpc", "2.0");
+    json::Value id = request["id"];
+    response.key("id").raw(id ? id.raw() : "null");
+    std::string method = request["method"].get_or("");
+    std::chrono::microseconds latency(0);
+
+    if (method == "public/subscribe") {
+        response.key("result").begin_array();
+        std::lock_guard<std::mutex> lock(connection.mutex);
+        for (const auto& channel : request["params"]["channels"].elements()) {
+            std::string name = channel.get_or("");
+            size_t first = name.find('.');
+            size_t second = name.find('.', first + 1);
+            if (name.compare(0, 5, "book.") != 0 || second == std::string::npos) {
+                continue;
+            }
+            std::string instrument = name.substr(first + 1, second - first - 1);
+            if (std::find(connection.instruments.begin(), connection.instruments.end(), instrument) ==
+                connection.instruments.end()) {
+                connection.instruments.push_back(instrument);
+            }
+            response.value(name);
+        }
+        response.end_array();
+        subscriptions_version_.fetch_add(1, std::memory_order_release);
+    } else {
+        Params params;
+        for (const auto& field : request["params"].fields()) {
+            params[std::string(field.key)] = std::string(field.value.raw());
+        }
+        if (dispatch(method, params, response) == Dispatch::Delayed) {
+            latency = std::chrono::microseconds(order_latency_us_.load(std::memory_order_relaxed));
+        }
+    }
+
+    // The publisher sends the reply once it is due; usOut is when it will be.
+    stamp(response, received_us, std::max(now_us(), received_us + latency.count()));
+    response.end_object();
+    {
+        std::lock_guard<std::mutex> lock(connection.mutex);
+        connection.replies.push_back({received + latency, std::move(body)});
+    }
+    wake_publisher();
+}
+
+void MockDeribit::publish_loop() {
+    using clock = std::chrono::steady_clock;
+
+    std::vector<BookState> targets;
+    uint64_t targets_version = ~0ull;
+    size_t next_target = 0;
+    uint64_t epoch = ~0ull;
+    clock::time_point epoch_start;
+    uint64_t epoch_published = 0;
+    std::map<std::string, uint64_t> published;
+    std::string payload;
+    payload.reserve(2048);
+
+    auto write = [&](Connection& connection, const std::string& message) {
+        beast::error_code ec;
+        connection.ws.text(true);
+        connection.ws.write(asio::buffer(message), ec);
+        if (ec) {
+            connection.open = false;
+            subscriptions_version_.fetch_add(1, std::memory_order_release);
+        }
+    };
+
+    auto wait_until = [&](clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        wake_.wait_until(lock, deadline, [this] { return wake_pending_ || !running_; });
+        wake_pending_ = false;
+    };
+
+    while (running_) {
+        // Replies go out before any further notifications for the connection.
+        std::vector<std::shared_ptr<Connection>> connections;
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex_);
+            connections = connections_;
+        }
+        clock::time_point now = clock::now();
+        clock::time_point next_reply = clock::time_point::max();
+        std::vector<std::string> replies;
+        for (auto& connection : connections) {
+            replies.clear();
+            {
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                auto pending = connection->replies.begin();
+                for (; pending != connection->replies.end() && pending->due <= now; ++pending) {
+                    replies.push_back(std::move(pending->text));
+                }
+                connection->replies.erase(connection->replies.begin(), pending);
+                if (!connection->replies.empty()) {
+                    next_reply = std::min(next_reply, connection->replies.front().due);
+                }
+            }
+            for (const auto& reply : replies) {
+                if (connection->open) {
+                    write(*connection, reply);
+                }
+            }
+        }
+
+        uint64_t version = subscriptions_version_.load(std::memory_order_acquire);
+        if (version != targets_version) {
+            // Keep the sequence state of subscriptions that still exist.
+            std::vector<BookState> rebuilt;
+            for (auto& connection : connections) {
+                if (!connection->open) {
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                for (const auto& instrument : connection->instruments) {
+                    auto existing = std::find_if(targets.begin(), targets.end(), [&](const BookState& state) {
+                        return state.connection == connection && state.instrument == instrument;
+                    });
+                    if (existing != targets.end()) {
+                        rebuilt.push_back(*existing);
+                    } else {
+                        BookState state;
+                        state.connection = connection;
+                        state.instrument = instrument;
+                        state.mid = 1000.0 * (1 + rebuilt.size());
+                        rebuilt.push_back(state);
+                    }
+                }
+            }
+            targets.swap(rebuilt);
+            targets_version = version;
+        }
+
+        uint64_t current_epoch = rate_epoch_.load(std::memory_order_acquire);
+        if (current_epoch != epoch) {
+            epoch = current_epoch;
+            epoch_start = clock::now();
+            epoch_published = 0;
+        }
+
+        double rate = publish_rate_.load(std::memory_order_relaxed);
+        if (targets.empty() || rate <= 0) {
+            wait_until(std::min(next_reply, clock::now() + std::chrono::milliseconds(1)));
+            continue;
+        }
+
+        uint64_t burst = burst_.load(std::memory_order_relaxed);
+        double elapsed_s = std::chrono::duration<double>(clock::now() - epoch_start).count();
+        uint64_t due = static_cast<uint64_t>(elapsed_s * rate / burst) * burst;
+        if (due <= epoch_published) {
+            auto next_publish = epoch_start + std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<double>((epoch_published / burst + 1) * burst / rate));
+            wait_until(std::min(next_reply, next_publish));
+            continue;
+        }
+
+        size_t batch = static_cast<size_t>(std::min<uint64_t>(due - epoch_published, MAX_BATCH));
+        for (size_t i = 0; i < batch; ++i) {
+            BookState& state = targets[next_target++ % targets.size()];
+            if (!state.connection->open) {
+                continue;
+            }
+
+            uint64_t timestamp_us = now_us();
+            const char* channel = state.instrument.c_str();
+            char levels[1024];
+            if (state.change_id == 0) {
+                // Snapshot: SNAPSHOT_LEVELS levels a side around the mid.
+                int offset = std::snprintf(levels, sizeof(levels), "\"bids\":[");
+                for (size_t level = 0; level < SNAPSHOT_LEVELS; ++level) {
+                    offset += std::snprintf(levels + offset, sizeof(levels) - offset, "%s[\"new\",%.1f,%.1f]",
+                                            level ? "," : "", state.mid - 0.5 * (level + 1), 1000.0 * (level + 1));
+                }
+                offset += std::snprintf(levels + offset, sizeof(levels) - offset, "],\"asks\":[");
+                for (size_t level = 0; level < SNAPSHOT_LEVELS; ++level) {
+                    offset += std::snprintf(levels + offset, sizeof(levels) - offset, "%s[\"new\",%.1f,%.1f]",
+                                            level ? "," : "", state.mid + 0.5 * (level + 1), 1000.0 * (level + 1));
+                }
+                std::snprintf(levels + offset, sizeof(levels) - offset, "]");
+            } else {
+                state.mid += 0.5 * static_cast<int>(state.change_id % 3) - 0.5;
+                std::snprintf(levels, sizeof(levels),
+                              "\"bids\":[[\"change\",%.1f,%.1f]],\"asks\":[[\"change\",%.1f,%.1f]]",
+                              state.mid - 0.5, 100.0 * (state.change_id % 50 + 1),
+                              state.mid + 0.5, 100.0 * (state.change_id % 40 + 1));
+            }
+
+            char header[512];
+            uint64_t change_id = state.change_id + 1;
+            if (state.change_id == 0) {
+                std::snprintf(header, sizeof(header),
+                              "\"type\":\"snapshot\",\"timestamp\":%llu,\"mock_timestamp_us\":%llu,"
+                              "\"instrument_name\":\"%s\",\"change_id\":%llu,",
+                              static_cast<unsigned long long>(timestamp_us / 1000),
+                              static_cast<unsigned long long>(timestamp_us), channel,
+                              static_cast<unsigned long long>(change_id));
+            } else {
+                std::snprintf(header, sizeof(header),
+                              "\"type\":\"change\",\"timestamp\":%llu,\"mock_timestamp_us\":%llu,"
+                              "\"prev_change_id\":%llu,\"instrument_name\":\"%s\",\"change_id\":%llu,",
+                              static_cast<unsigned long long>(timestamp_us / 1000),
+                              static_cast<unsigned long long>(timestamp_us),
+                              static_cast<unsigned long long>(state.change_id), channel,
+                              static_cast<unsigned long long>(change_id));
+            }
+
+            payload.assign(R"({"jsonrpc":"2.0","method":"subscription","params":{"channel":")");
+            payload.append(book_channel(state.instrument));
+            payload.append(R"(","data":{)");
+            payload.append(header);
+            payload.append(levels);
+            payload.append("}}}");
+
+            write(*state.connection, payload);
+            state.change_id = change_id;
+            ++published[state.instrument];
+        }
+        epoch_published += batch;
+        messages_published_.fetch_add(batch, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        published_by_instrument_ = published;
+    }
+
+}
+
+} // namespace mock
+} // namespace deribit
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "json_writer.hpp"
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace deribit {
+namespace mock {
+
+// Local stand-in for the Deribit API, so the benchmarks run on one box
+// without network access or credentials.
+//
+// Clients connect with plain ws:// to any path. public/subscribe is answered
+// the way Deribit answers it, and every subscribed book channel is then fed
+// with synthetic notifications: a snapshot first, then changes whose
+// change_id/prev_change_id form an unbroken chain per connection and
+// instrument. Notifications are paced to an aggregate rate that can be
+// changed while running, and carry the send time in microseconds as
+// mock_timestamp_us next to the usual millisecond timestamp.
+//
+// Orders are accepted over both transports: as JSON-RPC requests on the
+// websocket, and as REST calls under /api/v2 on plain HTTP connections, the
+// way OrderManager sends them. public/auth hands out a token without
+// checking credentials. Order replies are held back by a configurable
+// latency, standing in for the matching engine.
+//
+// Each connection gets a reader thread. A single publisher thread performs
+// every websocket write, so a connection is never written from two threads;
+// REST connections are answered by their reader thread.
+class MockDeribit {
+public:
+    // Port 0 picks a free port; see port() after start().
+    explicit MockDeribit(uint16_t port = 0);
+    ~MockDeribit();
+
+    MockDeribit(const MockDeribit&) = delete;
+    MockDeribit& operator=(const MockDeribit&) = delete;
+
+    // Throws boost::system::system_error if the port cannot be bound.
+    void start();
+    void stop();
+
+    uint16_t port() const { return port_; }
+    std::string websocket_url() const;
+    std::string rest_url() const;
+
+    // Aggregate book notifications per second across all subscriptions.
+    void set_publish_rate(double messages_per_second);
+    // Publishes notifications in bursts of this many, back to back, like a
+    // market move touching several books at once. The average rate stays
+    // as set. Default 1.
+    void set_burst(uint32_t messages);
+
+    // Time each order request is held before it is answered.
+    void set_order_latency(std::chrono::microseconds latency);
+
+    uint64_t messages_published() const { return messages_published_.load(std::memory_order_relaxed); }
+    std::map<std::string, uint64_t> published_by_instrument() const;
+    size_t subscriptions() const;
+    uint64_t orders_received() const { return orders_received_.load(std::memory_order_relaxed); }
+
+private:
+    struct Connection;
+    struct BookState;
+
+    void do_accept();
+    void serve(std::shared_ptr<Connection> connection);
+    void serve_rest(Connection& connection, boost::beast::flat_buffer& buffer,
+                    boost::beast::http::request<boost::beast::http::string_body> request);
+    void handle_request(Connection& connection, const std::string& request);
+    // Request parameters as serialized JSON values, by name.
+    using Params = std::map<std::string, std::string>;
+    enum class Dispatch {
+        Immediate,
+        // Order methods, whose replies are held for the order latency.
+        Delayed,
+        NotFound,
+    };
+    // Writes the result or error member for the methods both transports
+    // support.
+    Dispatch dispatch(const std::string& method, const Params& params, json::Writer& response);
+    void wake_publisher();
+    void publish_loop();
+
+    uint16_t port_;
+    boost::asio::io_context ioc_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    std::thread accept_thread_;
+    std::thread publish_thread_;
+    std::atomic<bool> running_;
+
+    mutable std::mutex connections_mutex_;
+    std::vector<std::shared_ptr<Connection>> connections_;
+    // Bumped whenever a connection or subscription is added or removed so
+    // the publisher knows to rebuild its target list.
+    std::atomic<uint64_t> subscriptions_version_;
+
+    std::atomic<double> publish_rate_;
+    std::atomic<uint64_t> rate_epoch_;
+    std::atomic<uint32_t> burst_;
+    std::atomic<uint64_t> messages_published_;
+    std::atomic<int64_t> order_latency_us_;
+    std::atomic<uint64_t> orders_received_;
+    std::atomic<uint64_t> next_order_id_;
+
+    // Lets the publisher sleep until its next send is due while still
+    // reacting at once to new replies.
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    bool wake_pending_;
+    mutable std::mutex stats_mutex_;
+    std::map<std::string, uint64_t> published_by_instrument_;
+};
+
+} // namespace mock
+} // namespace deribit